@@ -0,0 +1,102 @@
+/**
+ * @file audio_packetizer.h
+ * @brief Zero-copy microphone packetizer feeding the USB CDC IN endpoint
+ * @version 1.0
+ * @date 2025-10
+ *
+ * I2S DMA half blocks are unpacked straight into preallocated transmit slots
+ * which are handed to USBD_CDC_SetTxBuffer() as-is (no staging copy, no text
+ * formatting). Each slot is a whole number of 64-byte FS packets.
+ *
+ * Each slot holds exactly one telemetry frame (see telemetry.h) on
+ * TLM_CHAN_AUDIO: the header timestamp is the I2S frame index of the first
+ * sample, the payload is AUDIO_PKT_SAMPLES x signed 24-bit little endian and
+ * the CRC is appended when the slot is complete.
+ *
+ * Flow control may lower the rate (AudioPkt_SetDecimation): each sample is
+ * then the mean of `decim` consecutive I2S frames and the timestamp stays
+ * the I2S frame index, so consecutive packets advance by
+ * AUDIO_PKT_SAMPLES x decim. A new factor takes effect at the next slot.
+ */
+
+#ifndef __AUDIO_PACKETIZER_H__
+#define __AUDIO_PACKETIZER_H__
+
+#include "stm32f4xx_hal.h"
+#include "telemetry.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== PACKET FORMAT ==== */
+#define AUDIO_PKT_HEADER_SIZE   TLM_HEADER_SIZE
+#define AUDIO_PKT_BYTES_PER_SMP 3U
+#define AUDIO_PKT_SLOT_SIZE     512U    // 8 x CDC_DATA_FS_MAX_PACKET_SIZE
+#define AUDIO_PKT_SLOT_COUNT    4U
+#define AUDIO_PKT_SAMPLES       ((AUDIO_PKT_SLOT_SIZE - TLM_OVERHEAD) / AUDIO_PKT_BYTES_PER_SMP)
+#define AUDIO_PKT_MAX_DECIM     8U
+
+#if ((AUDIO_PKT_SLOT_SIZE % 64U) != 0U) || \
+    ((TLM_OVERHEAD + AUDIO_PKT_SAMPLES * AUDIO_PKT_BYTES_PER_SMP) != AUDIO_PKT_SLOT_SIZE)
+#error "audio packet slot must be fully used and a multiple of the FS max packet size"
+#endif
+
+/* ==== STRUCTURE ==== */
+typedef enum {
+    AUDIO_PKT_SLOT_FREE = 0,
+    AUDIO_PKT_SLOT_FILLING,
+    AUDIO_PKT_SLOT_READY,
+    AUDIO_PKT_SLOT_BUSY,      // owned by the USB IN endpoint
+} AUDIO_PKT_SlotStateTypeDef;
+
+typedef struct {
+    uint32_t packets_sent;
+    uint32_t packets_dropped;   // seq numbers spent on samples_dropped
+    uint32_t samples_in;
+    uint32_t samples_dropped;   // no free slot when a DMA block arrived
+    uint32_t samples_skipped;   // not packed because the stream was off, paused or shed
+    uint32_t blocks;
+    uint32_t cycles_last;       // DWT cycles spent converting the last block
+    uint32_t cycles_max;
+    uint64_t cycles_total;
+} AUDIO_PKT_StatsTypeDef;
+
+typedef struct {
+    uint8_t  slot[AUDIO_PKT_SLOT_COUNT][AUDIO_PKT_SLOT_SIZE] __attribute__((aligned(4)));
+    volatile AUDIO_PKT_SlotStateTypeDef state[AUDIO_PKT_SLOT_COUNT];
+    uint8_t  wr;                // slot being filled by the I2S callback
+    uint8_t  rd;                // next slot to hand to the endpoint
+    uint16_t fill;              // samples already in slot[wr]
+    uint16_t seq;
+    uint32_t lost;              // I2S frames dropped since the last slot was started
+    uint8_t  decim;             // I2S frames per sample in the slot being filled
+    volatile uint8_t decim_req; // factor for the next slot, 0 = shed the stream
+    uint8_t  acc_n;             // frames summed into acc
+    int32_t  acc;
+    volatile uint8_t enabled;   // audio mode selected by the host command
+    volatile uint8_t paused;    // no host listening: skip all unpacking
+    AUDIO_PKT_StatsTypeDef stats;
+} AUDIO_PKT_HandleTypeDef;
+
+/* ==== FUNCTION PROTOTYPES ==== */
+HAL_StatusTypeDef AudioPkt_Init(AUDIO_PKT_HandleTypeDef *pkt);
+void AudioPkt_PushBlock(AUDIO_PKT_HandleTypeDef *pkt, const uint32_t *block,
+                        uint16_t frames, uint32_t first_frame);
+void AudioPkt_SetEnabled(AUDIO_PKT_HandleTypeDef *pkt, uint8_t enable);
+void AudioPkt_SetPaused(AUDIO_PKT_HandleTypeDef *pkt, uint8_t paused);
+HAL_StatusTypeDef AudioPkt_SetDecimation(AUDIO_PKT_HandleTypeDef *pkt, uint8_t decim);
+uint8_t AudioPkt_Backlog(const AUDIO_PKT_HandleTypeDef *pkt);
+uint8_t AudioPkt_Pending(const AUDIO_PKT_HandleTypeDef *pkt);
+uint8_t *AudioPkt_Claim(AUDIO_PKT_HandleTypeDef *pkt);
+void AudioPkt_Unclaim(AUDIO_PKT_HandleTypeDef *pkt);
+void AudioPkt_OnTxComplete(AUDIO_PKT_HandleTypeDef *pkt, const uint8_t *buf);
+float AudioPkt_BytesPerSample(void);
+float AudioPkt_CyclesPerSample(const AUDIO_PKT_HandleTypeDef *pkt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_PACKETIZER_H__ */
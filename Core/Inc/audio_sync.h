@@ -0,0 +1,73 @@
+/**
+ * @file audio_sync.h
+ * @brief I2S audio clock drift estimation against the USB SOF (1 kHz) reference
+ * @version 1.0
+ * @date 2025-10
+ *
+ * The I2S clock is derived from PLLI2S (HSE/4*50/2 = 50 MHz, I2SDIV rounding
+ * gives ~15.943 kHz for a requested 16 kHz) and is not locked to the host.
+ * Every USB SOF the DMA write position is sampled and fed into a 2nd order
+ * (PI) digital PLL that tracks the audio frame rate in frames per SOF.
+ */
+
+#ifndef __AUDIO_SYNC_H__
+#define __AUDIO_SYNC_H__
+
+#include "stm32f4xx_hal.h"
+#include "microphone_sensor.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== CONFIGURATION ==== */
+#define AUDIO_SYNC_SOF_HZ           1000U   // USB FS SOF rate
+#define AUDIO_SYNC_ACQUIRE_SOFS     256U    // coarse window before closing the loop
+#define AUDIO_SYNC_LOOP_KP          4.44e-3f // 2*zeta*wn*T, zeta=0.707, fn=0.5 Hz
+#define AUDIO_SYNC_LOOP_KI          9.87e-6f // (wn*T)^2
+#define AUDIO_SYNC_LOCK_ERR_FRAMES  0.25f   // |phase error| below this counts as locked
+#define AUDIO_SYNC_MAX_SOF_GAP      8U      // larger SOF gaps (suspend) restart acquisition
+
+/* ==== STATE ==== */
+typedef enum {
+    AUDIO_SYNC_IDLE = 0,
+    AUDIO_SYNC_ACQUIRE,
+    AUDIO_SYNC_TRACK,
+} AUDIO_SYNC_StateTypeDef;
+
+typedef struct {
+    MIC_HandleTypeDef *mic;
+    AUDIO_SYNC_StateTypeDef state;
+
+    float nominal;          // configured AudioFreq / SOF rate, frames per SOF
+    float freq_dev;         // loop estimate minus nominal, frames per SOF
+    float phase_err;        // measured minus predicted position, frames
+
+    uint32_t last_words;    // DMA position (words) at the previous SOF
+    uint16_t last_frame_num;// 11-bit USB frame number at the previous SOF
+    uint32_t acq_sofs;      // SOFs accumulated during acquisition
+    uint32_t acq_words;     // DMA words accumulated during acquisition
+
+    uint32_t sof_count;     // SOFs processed
+    uint32_t sof_missed;    // SOFs inferred from frame number jumps
+    uint8_t  locked;
+
+    /* linear interpolation resampler state */
+    float    rs_phase;      // fractional read position in [0,1)
+    int32_t  rs_prev;       // last input sample of the previous block
+} AUDIO_SYNC_HandleTypeDef;
+
+/* ==== FUNCTION PROTOTYPES ==== */
+HAL_StatusTypeDef AudioSync_Init(AUDIO_SYNC_HandleTypeDef *sync, MIC_HandleTypeDef *mic);
+void AudioSync_OnSOF(AUDIO_SYNC_HandleTypeDef *sync, uint16_t frame_num);
+float AudioSync_GetPPM(const AUDIO_SYNC_HandleTypeDef *sync);
+float AudioSync_GetRateHz(const AUDIO_SYNC_HandleTypeDef *sync);
+uint16_t AudioSync_Resample(AUDIO_SYNC_HandleTypeDef *sync, const int32_t *in, uint16_t n_in,
+                            int32_t *out, uint16_t max_out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_SYNC_H__ */
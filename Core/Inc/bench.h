@@ -0,0 +1,58 @@
+/**
+ * @file bench.h
+ * @brief USB CDC link benchmark: pattern stream and echo
+ * @version 1.0
+ * @date 2025-10
+ *
+ * Selected with TLM_CMD_BENCH (see telemetry.h); Host/cdc_bench measures
+ * throughput, loss, ordering and round-trip latency against it.
+ *
+ * Stream frames are built once and only the counter, header and CRC are
+ * rewritten per frame, so the numbers reflect the link and not the
+ * formatting cost. Frames go through CDC_Transmit_FS like any producer.
+ */
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include "stm32f4xx_hal.h"
+#include "telemetry.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== CONFIGURATION ==== */
+#define BENCH_MIN_PAYLOAD   4U
+#define BENCH_MAX_PAYLOAD   (512U - TLM_OVERHEAD)   // one frame per 512-byte batch
+#define BENCH_TX_RESERVE    512U    // queue space left for command responses
+
+/* ==== STRUCTURE ==== */
+typedef struct {
+    uint32_t frames;            // stream frames queued
+    uint32_t bytes;             // stream bytes queued, framing included
+    uint32_t echoes;
+    uint32_t echo_dropped;      // echo did not fit in the transmit queue
+} BENCH_StatsTypeDef;
+
+typedef struct {
+    uint8_t  mode;              // TLM_BENCH_xxx
+    uint16_t size;              // stream payload bytes
+    uint32_t counter;
+    TLM_EncoderTypeDef *tlm;
+    uint8_t  frame[TLM_OVERHEAD + BENCH_MAX_PAYLOAD] __attribute__((aligned(4)));
+    BENCH_StatsTypeDef stats;
+} BENCH_HandleTypeDef;
+
+/* ==== FUNCTION PROTOTYPES ==== */
+HAL_StatusTypeDef Bench_Init(BENCH_HandleTypeDef *bench, TLM_EncoderTypeDef *tlm);
+HAL_StatusTypeDef Bench_SetMode(BENCH_HandleTypeDef *bench, uint8_t mode, uint16_t size);
+void Bench_Service(BENCH_HandleTypeDef *bench);
+void Bench_OnFrame(BENCH_HandleTypeDef *bench, const TLM_FrameTypeDef *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BENCH_H__ */
@@ -0,0 +1,74 @@
+/**
+ * @file command.h
+ * @brief Host-to-device command channel over the CDC OUT endpoint
+ * @version 1.0
+ * @date 2025-10
+ *
+ * Requests are telemetry frames on TLM_CHAN_CMD and every one is answered
+ * with a TLM_CHAN_CMD_RSP frame carrying the same request id, the opcode
+ * and a status (see telemetry.h for opcodes and payloads). Frames with a
+ * bad CRC are not answered, the host retries on timeout. TLM_CHAN_BENCH
+ * frames are handed to the link benchmark (echo mode).
+ *
+ * Bytes are taken from the CDC receive queue and parsed incrementally in
+ * Cmd_Poll() (main loop), never in the USB interrupt. Input is only consumed
+ * while the transmit queue can hold the responses it may produce, so a busy
+ * link backs up into the receive queue and finally NAKs the host instead of
+ * losing responses: CMD_RX_RESERVE bytes, plus CMD_ECHO_RESERVE in echo
+ * mode for an echo frame that started in an earlier chunk.
+ */
+
+#ifndef __COMMAND_H__
+#define __COMMAND_H__
+
+#include "stm32f4xx_hal.h"
+#include "telemetry.h"
+#include "scheduler.h"
+#include "audio_packetizer.h"
+#include "bench.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== CONFIGURATION ==== */
+#define CMD_RX_CHUNK        64U     // bytes fed to the parser per step
+#define CMD_MAX_RSP_DATA    64U
+#define CMD_MAX_RSP_FRAME   (TLM_OVERHEAD + TLM_CMD_RSP_SIZE + CMD_MAX_RSP_DATA)
+/* One chunk completes at most this many requests (one may have started earlier) */
+#define CMD_MAX_REQ_PER_CHUNK (CMD_RX_CHUNK / (TLM_OVERHEAD + TLM_CMD_REQ_SIZE) + 1U)
+/* Transmit queue space needed before a chunk is parsed */
+#define CMD_RX_RESERVE      (CMD_MAX_REQ_PER_CHUNK * CMD_MAX_RSP_FRAME)
+/* Echoes are as long as the frames they answer: frames within one chunk add
+ * no more than the chunk, one that started earlier up to a full echo */
+#define CMD_ECHO_RESERVE    (TLM_OVERHEAD + BENCH_MAX_PAYLOAD)
+
+/* ==== STRUCTURE ==== */
+typedef struct {
+    uint32_t requests;
+    uint32_t errors;            // answered with a non-zero status
+    uint32_t malformed;         // too short to carry a request id, not answered
+    uint32_t rsp_dropped;       // response did not fit in the transmit queue
+} CMD_StatsTypeDef;
+
+typedef struct {
+    SCHED_HandleTypeDef *sched;
+    AUDIO_PKT_HandleTypeDef *audio;
+    BENCH_HandleTypeDef *bench;
+    TLM_EncoderTypeDef *tlm;
+    TLM_DecoderTypeDef dec;
+    CMD_StatsTypeDef stats;
+} CMD_HandleTypeDef;
+
+/* ==== FUNCTION PROTOTYPES ==== */
+HAL_StatusTypeDef Cmd_Init(CMD_HandleTypeDef *cmd, SCHED_HandleTypeDef *sched,
+                           AUDIO_PKT_HandleTypeDef *audio, BENCH_HandleTypeDef *bench,
+                           TLM_EncoderTypeDef *tlm);
+void Cmd_Poll(CMD_HandleTypeDef *cmd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __COMMAND_H__ */
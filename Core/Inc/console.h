@@ -0,0 +1,65 @@
+/**
+ * @file console.h
+ * @brief stdio backend: printf/puts/getchar on the non-blocking output rings
+ * @version 1.0
+ * @date 2025-10
+ *
+ * syscalls.c routes _write (stdout, stderr) and _read (stdin) here. Output
+ * is copied into the log console ring (USB CDC, sent from SOF) and/or the
+ * USART1 DMA ring, whichever routes are enabled, and the call returns: the
+ * transport drains in the background, so printf costs its formatting plus
+ * a memcpy. stdout is line buffered in a static buffer (no heap), one
+ * _write per line.
+ *
+ * Both rings are single producer: printf belongs to the main loop. A
+ * _write from interrupt context is dropped and counted instead of racing
+ * the main loop on the ring head; use DLOG() there.
+ *
+ * Overflow policy: a line that does not fit a route's ring is dropped whole
+ * and counted by that ring; _write still reports it written so newlib
+ * never retries (which would spin until the transport catches up).
+ *
+ * stdin reads what was typed into the USB console and never waits: with
+ * nothing pending _read returns 0, which newlib takes as end of file, so
+ * clearerr(stdin) before polling again.
+ */
+
+#ifndef __CONSOLE_H__
+#define __CONSOLE_H__
+
+#include "stm32f4xx_hal.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== CONFIGURATION ==== */
+#define CONSOLE_ROUTE_USB       0x01U   // log console, second CDC function
+#define CONSOLE_ROUTE_UART      0x02U   // USART1, shared with Send_Raw_Bytes
+#define CONSOLE_DEFAULT_ROUTES  CONSOLE_ROUTE_USB
+#define CONSOLE_LINE_SIZE       128U    // stdout buffer, longer lines go out in pieces
+
+/* ==== STRUCTURE ==== */
+typedef struct {
+    uint32_t writes;            // _write calls on stdout/stderr
+    uint32_t bytes;
+    uint32_t refused;           // writes no enabled route accepted
+    uint32_t isr_writes;        // dropped: called from interrupt context
+    uint32_t read_bytes;
+} CONSOLE_StatsTypeDef;
+
+/* ==== EXPORTED VARIABLES ==== */
+extern CONSOLE_StatsTypeDef console_stats;
+
+/* ==== FUNCTION PROTOTYPES ==== */
+void Console_Init(uint8_t routes);
+void Console_SetRoutes(uint8_t routes);
+int Console_Write(const char *buf, int len);
+int Console_Read(char *buf, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CONSOLE_H__ */
@@ -0,0 +1,75 @@
+/**
+ * @file dlog.h
+ * @brief Deferred binary logging: format IDs and raw arguments, formatted on the host
+ * @version 1.0
+ * @date 2025-10
+ *
+ * DLOG("fmt", args...) stores the format string in the dlog_fmt section and
+ * records only its ID (offset in that section), the HAL tick and the
+ * arguments as 32-bit words into a ring: no vsnprintf, no stack buffer,
+ * a few dozen cycles with interrupts masked, usable from interrupt context.
+ * The main loop drains the ring into TLM_CHAN_LOG frames (DLog_Fill) and the
+ * host formats them from the ID table it reads out of the firmware ELF
+ * (tlm_dump -e firmware.elf). The linker script keeps dlog_fmt in the ELF
+ * but does not load it, so format strings cost no flash.
+ *
+ * Arguments are integers of at most 32 bits; pass a float through
+ * DLOG_F(x) and print it with %f/%e/%g. %s prints the pointer only, the
+ * string itself is not copied.
+ *
+ * Overflow policy: an entry that does not fit is dropped whole and counted;
+ * the next TLM_CHAN_LOG frame reports how many were lost before it.
+ */
+
+#ifndef __DLOG_H__
+#define __DLOG_H__
+
+#include "stm32f4xx_hal.h"
+#include "telemetry.h"
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== CONFIGURATION ==== */
+#define DLOG_RING_SIZE      2048U       // power of two
+#define DLOG_MAX_ARGS       TLM_LOG_MAX_ARGS
+
+/* ==== STRUCTURE ==== */
+typedef struct {
+    uint32_t entries;           // recorded
+    uint32_t dropped;           // ring full
+    uint32_t high_watermark;    // highest ring fill level in bytes
+} DLOG_StatsTypeDef;
+
+/* ==== EXPORTED VARIABLES ==== */
+extern DLOG_StatsTypeDef dlog_stats;
+
+/* Start of the format string section: provided by the linker */
+extern const char __start_dlog_fmt[];
+
+/* ==== FUNCTION PROTOTYPES ==== */
+void DLog_Init(void);
+void DLog_Write(uint16_t id, const uint32_t *args, uint8_t n);
+uint8_t DLog_Pending(void);
+void DLog_Fill(TLM_WriterTypeDef *w, uint16_t max_len);
+
+/* A float argument, passed by its bits */
+static inline uint32_t DLOG_F(float x) { uint32_t v; memcpy(&v, &x, 4); return v; }
+
+#define DLOG_ID(fmt)        ((uint16_t)((uintptr_t)(fmt) - (uintptr_t)__start_dlog_fmt))
+
+#define DLOG(fmt, ...) do { \
+    static const char dlog_fmt_[] __attribute__((section("dlog_fmt"), used)) = fmt; \
+    const uint32_t dlog_args_[] = { 0, ##__VA_ARGS__ }; \
+    _Static_assert(sizeof(dlog_args_) / 4U - 1U <= DLOG_MAX_ARGS, "DLOG: too many arguments"); \
+    DLog_Write(DLOG_ID(dlog_fmt_), &dlog_args_[1], (uint8_t)(sizeof(dlog_args_) / 4U - 1U)); \
+} while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DLOG_H__ */
@@ -0,0 +1,84 @@
+/**
+ * @file flow_control.h
+ * @brief Backpressure policy: degrade output in steps while the host lags
+ * @version 1.0
+ * @date 2025-10
+ *
+ * Evaluated periodically from a scheduler job. The transmit queue depth, the
+ * audio slot backlog and the device drop counters decide the level
+ * (TLM_FLOW_xxx in telemetry.h):
+ *   FULL       -> everything at its configured rate
+ *   AUDIO_LOW  -> raw audio averaged down by FLOW_AUDIO_DECIM
+ *   FEATURES   -> raw audio shed, feature jobs unchanged
+ *   SUMMARY    -> feature jobs released 1 in FLOW_SUMMARY_DIV
+ * A queue above the high mark or any new drop steps down one level, at most
+ * once per FLOW_SETTLE_MS so the previous step can take effect. A queue that
+ * stays below the low mark for the hold time steps back up one level; the
+ * hold doubles (up to FLOW_RECOVER_MAX_MS) when a step up is undone soon
+ * after, so a marginal link does not oscillate. A step up that holds lets
+ * the next one follow after FLOW_RECOVER_MS again.
+ *
+ * Every change is announced on TLM_CHAN_FLOW; an announcement that finds no
+ * room is retried on the next evaluation and always reports the latest level.
+ * Audio timestamps advance by AUDIO_PKT_SAMPLES * decimation per packet, so
+ * the host never depends on where the announcement lands in the stream.
+ */
+
+#ifndef __FLOW_CONTROL_H__
+#define __FLOW_CONTROL_H__
+
+#include "stm32f4xx_hal.h"
+#include "telemetry.h"
+#include "scheduler.h"
+#include "audio_packetizer.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== CONFIGURATION ==== */
+#define FLOW_HIGH_EIGHTHS       7U      // queue above 7/8 full: step down
+#define FLOW_LOW_EIGHTHS        3U      // queue below 3/8 full (above one batch): calm
+#define FLOW_SETTLE_MS          100U    // minimum time between two steps down
+#define FLOW_RECOVER_MS         2000U   // calm time before a step up
+#define FLOW_RECOVER_MAX_MS     32000U
+#define FLOW_AUDIO_DECIM        2U      // AUDIO_LOW: 16 kHz -> 8 kHz
+#define FLOW_SUMMARY_DIV        10U     // SUMMARY: feature jobs at 1/10 rate
+
+/* ==== STRUCTURE ==== */
+typedef struct {
+    uint32_t steps_down;
+    uint32_t steps_up;
+    uint32_t report_retries;    // announcement deferred for lack of queue space
+} FLOW_StatsTypeDef;
+
+typedef struct {
+    SCHED_HandleTypeDef *sched;
+    AUDIO_PKT_HandleTypeDef *audio;
+    TLM_EncoderTypeDef *tlm;
+    uint32_t feature_jobs;      // bit per scheduler job id thinned at SUMMARY
+    uint8_t  level;             // TLM_FLOW_xxx
+    uint8_t  reported;          // level last announced to the host
+    uint8_t  reason;            // TLM_FLOW_REASON_xxx of the latest change
+    uint8_t  report_pending;
+    uint32_t drops_seen;
+    uint32_t down_ms;           // tick of the last step down
+    uint32_t up_ms;             // tick of the last step up
+    uint32_t calm_ms;           // tick since which the queue has stayed low
+    uint32_t hold_ms;           // current calm time required for a step up
+    FLOW_StatsTypeDef stats;
+} FLOW_HandleTypeDef;
+
+/* ==== FUNCTION PROTOTYPES ==== */
+HAL_StatusTypeDef Flow_Init(FLOW_HandleTypeDef *flow, SCHED_HandleTypeDef *sched,
+                            AUDIO_PKT_HandleTypeDef *audio, TLM_EncoderTypeDef *tlm,
+                            uint32_t feature_jobs);
+void Flow_Reset(FLOW_HandleTypeDef *flow);
+void Flow_Update(FLOW_HandleTypeDef *flow);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FLOW_CONTROL_H__ */
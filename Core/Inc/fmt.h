@@ -0,0 +1,60 @@
+/**
+ * @file fmt.h
+ * @brief Small number-to-text conversions for the text output paths
+ * @version 1.0
+ * @date 2025-10
+ *
+ * Integer, decimal fixed-point and float conversions that print exactly
+ * what printf prints for the equivalent format, without vsnprintf's format
+ * parsing and without newlib's float support (the firmware no longer links
+ * -u _printf_float: %f in printf/USB_Print prints nothing). Floats are
+ * converted from their bits with 32/64-bit integer arithmetic only, rounded
+ * half to even on the exact value as printf does.
+ *
+ * Each call writes at p, NUL terminates and returns the end, so a line is
+ * built by chaining:
+ *
+ *   char line[64], *p = line;
+ *   p = Fmt_Str(p, "T=");
+ *   p = Fmt_Float(p, t, 2);
+ *   p = Fmt_Str(p, " C\r\n");
+ *   CDC_Log_Write((const uint8_t *)line, (uint16_t)(p - line));
+ *
+ * The caller sizes the buffer: FMT_xxx_MAX bytes per conversion, NUL included.
+ *
+ * No HAL dependency: this file is also built into the host checks.
+ */
+
+#ifndef __FMT_H__
+#define __FMT_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== CONFIGURATION ==== */
+#define FMT_FIXED_MAX_DECIMALS  9U
+#define FMT_FLOAT_MAX_DECIMALS  6U
+
+/* Worst case output per conversion, NUL included */
+#define FMT_U32_MAX     11U     // 4294967295
+#define FMT_I32_MAX     12U     // -2147483648
+#define FMT_HEX_MAX     9U      // FFFFFFFF
+#define FMT_FIXED_MAX   13U     // -0.000000001, -2147483.648
+#define FMT_FLOAT_MAX   22U     // -8796092497920.000000
+
+/* ==== FUNCTION PROTOTYPES ==== */
+char *Fmt_Str(char *p, const char *s);
+char *Fmt_U32(char *p, uint32_t v);
+char *Fmt_I32(char *p, int32_t v);
+char *Fmt_Hex(char *p, uint32_t v, uint8_t digits);
+char *Fmt_Fixed(char *p, int32_t v, uint8_t decimals);
+char *Fmt_Float(char *p, float x, uint8_t decimals);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FMT_H__ */
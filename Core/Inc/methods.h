@@ -4,7 +4,10 @@
 #include <stdint.h>
 #include <stm32f4xx_hal.h>
 #include "usart.h"
+#include "uart_tx.h"
 #include "usbd_cdc_if.h"
+#include "usbd_cdc_log_if.h"
+#include "fmt.h"
 #include "i2c.h"
 
 #ifdef __cplusplus
@@ -13,12 +16,17 @@ extern "C" {
 
 void RGB_LED_Init(void);
 void RGB_LED_Blink(void);
+/* 格式串不支持 %f (未链接 _printf_float): 浮点数先用 Fmt_Float 转换 (fmt.h) */
 void USART_Print(const char *format, ...);
 void I2C_Scan(void);
 void Send_Raw_Bytes(uint16_t data);
 void Send_Buffer_Bytes(uint16_t *buffer, uint16_t count);
 void USB_Print(const char *format, ...);
 
+/* ==== DWT 周期计数器 (性能测量) ==== */
+#define CYCLE_COUNT()   (DWT->CYCCNT)
+void DWT_CycleCounter_Init(void);
+
 HAL_StatusTypeDef I2C_Protected_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress,
                                          uint16_t MemAddress, uint16_t MemAddSize,
                                          uint8_t *pData, uint16_t Size, uint32_t Timeout);
@@ -17,8 +17,14 @@
 extern "C" {
 #endif
 
-#define MIC_BUFFER_SIZE 4   // DMA 缓冲长度
+#define MIC_BUFFER_SIZE 64  // DMA 缓冲长度 (24bit 采样数, 32 个立体声帧)
 #define MIC_SAMPLE_COUNT (MIC_BUFFER_SIZE / 2)
+#define MIC_DMA_WORDS_PER_FRAME 4   // 24bit 立体声: 每声道 2 个半字, DMA 按字搬运
+#define MIC_DMA_XFER_WORDS (MIC_BUFFER_SIZE * 2)  // HAL 对 24/32bit 格式按 Size*2 搬运
+#define MIC_FRAMES_PER_HALF (MIC_DMA_XFER_WORDS / 2 / MIC_DMA_WORDS_PER_FRAME)  // 16 帧 = 1 ms @16 kHz
+
+/* 左声道 24bit 采样: 高 16 位在第一个字, 低 8 位在第二个字的高字节 */
+#define MIC_UNPACK24(w0, w1)  ((((w0) & 0xFFFFU) << 8) | (((w1) & 0xFFFFU) >> 8))
 
 typedef struct
 {
@@ -26,11 +32,16 @@ typedef struct
     int32_t audio_result;
     uint8_t   half_ready;               // 半缓冲就绪标志
     uint8_t   full_ready;               // 全缓冲就绪标志
+    volatile uint32_t block_count;      // 已完成的半缓冲数 (半传输 + 全传输回调)
 } MIC_HandleTypeDef;
 
 /* 初始化与启动 */
 HAL_StatusTypeDef MIC_Init(MIC_HandleTypeDef *mic, I2S_HandleTypeDef *hi2s);
 HAL_StatusTypeDef MIC_Start(MIC_HandleTypeDef *mic);
+
+/* DMA 回调处理 */
+int32_t MIC_DecodeFrame(const uint32_t *frame);
+const uint32_t *MIC_ProcessBlock(MIC_HandleTypeDef *mic, uint8_t second_half);
  
 
 #ifdef __cplusplus
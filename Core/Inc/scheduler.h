@@ -0,0 +1,99 @@
+/**
+ * @file scheduler.h
+ * @brief TIM2 driven periodic job scheduler with per-job jitter statistics
+ * @version 1.0
+ * @date 2025-10
+ *
+ * TIM2 runs free at 1 MHz (32-bit, wraps every ~71 min) and serves as the
+ * microsecond timebase; its CC1 compare interrupt fires every SCHED_TICK_US
+ * and releases the jobs that are due. Jobs run in the main loop
+ * (Sched_RunPending), so they may use I2C and the CDC transmit queue, and the
+ * CPU sleeps in Sched_Idle() between ticks.
+ *
+ * Release times are exact multiples of the period on the TIM2 timebase; the
+ * start latency of every run against its release time is recorded, so
+ * lat_max - lat_min is the peak-to-peak jitter of that job.
+ *
+ * A job can also be thinned to every n-th release (Sched_SetDivider) without
+ * touching its configured rate; flow control uses this to slow feature
+ * streams while the host falls behind.
+ */
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include "stm32f4xx_hal.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== CONFIGURATION ==== */
+#define SCHED_TIM               TIM2
+#define SCHED_TIM_IRQn          TIM2_IRQn
+#define SCHED_IRQ_PRIORITY      2U      // below USB OTG and I2S DMA (0)
+#define SCHED_TIMEBASE_HZ       1000000U
+#define SCHED_TICK_US           1000U
+#define SCHED_MAX_JOBS          8U
+
+/* ==== STRUCTURE ==== */
+typedef void (*SCHED_JobFn)(void *ctx);
+
+typedef struct {
+    uint32_t runs;
+    uint32_t overruns;          // releases that found the previous run still pending
+    uint32_t lat_last;          // start latency after release (us)
+    uint32_t lat_min;
+    uint32_t lat_max;
+    uint64_t lat_sum;
+    uint32_t exec_max;          // longest run time (us)
+} SCHED_JobStatsTypeDef;
+
+typedef struct {
+    const char *name;
+    SCHED_JobFn fn;
+    void *ctx;
+    uint32_t period_us;
+    uint32_t due_us;            // next release time on the TIM2 timebase
+    volatile uint32_t release_us;
+    volatile uint8_t pending;
+    volatile uint8_t enabled;   // disabled jobs keep their cadence but are not released
+    uint16_t divider;           // released on every divider-th due time
+    uint16_t div_count;
+    SCHED_JobStatsTypeDef stats;
+} SCHED_JobTypeDef;
+
+typedef struct {
+    TIM_TypeDef *tim;
+    SCHED_JobTypeDef job[SCHED_MAX_JOBS];
+    uint8_t n_jobs;
+    uint8_t suspended;
+    volatile uint32_t ticks;
+} SCHED_HandleTypeDef;
+
+/* ==== FUNCTION PROTOTYPES ==== */
+HAL_StatusTypeDef Sched_Init(SCHED_HandleTypeDef *sched);
+HAL_StatusTypeDef Sched_AddJob(SCHED_HandleTypeDef *sched, const char *name, SCHED_JobFn fn,
+                               void *ctx, uint32_t rate_hz);
+HAL_StatusTypeDef Sched_Start(SCHED_HandleTypeDef *sched);
+void Sched_Suspend(SCHED_HandleTypeDef *sched);
+void Sched_Resume(SCHED_HandleTypeDef *sched);
+HAL_StatusTypeDef Sched_SetRate(SCHED_HandleTypeDef *sched, uint8_t id, uint32_t rate_hz);
+HAL_StatusTypeDef Sched_EnableJob(SCHED_HandleTypeDef *sched, uint8_t id, uint8_t enable);
+HAL_StatusTypeDef Sched_SetDivider(SCHED_HandleTypeDef *sched, uint8_t id, uint16_t divider);
+void Sched_OnTick(SCHED_HandleTypeDef *sched);
+void Sched_RunPending(SCHED_HandleTypeDef *sched);
+void Sched_Idle(SCHED_HandleTypeDef *sched);
+void Sched_ResetStats(SCHED_HandleTypeDef *sched);
+
+static inline uint32_t Sched_Micros(const SCHED_HandleTypeDef *sched)
+{
+    return sched->tim->CNT;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SCHEDULER_H__ */
@@ -0,0 +1,93 @@
+/**
+ * @file stream_mux.h
+ * @brief Telemetry stream multiplexer: per-channel rate and priority, shared transfers
+ * @version 1.0
+ * @date 2025-10
+ *
+ * Each producer registers its channel once with a rate, a priority and a
+ * fill function that appends the record fields. The rate is a scheduler job
+ * of its own (so TLM_CMD_SET_RATE, TLM_CMD_ENABLE and the flow control
+ * divider keep working by job id), but the job only marks the stream due.
+ * Mux_Service() then builds the frames of every due stream, highest
+ * priority first, back to back in one staging buffer and hands them to the
+ * transmit queue in a single write, so streams released in the same tick
+ * share the USB transfer instead of each queueing on its own.
+ *
+ * Priorities matter when the transmit queue runs full: a stream of priority
+ * p (0 = highest) is only built while the queue keeps p * MUX_PRIO_HEADROOM
+ * bytes free after it, so bulk streams give way before the clock, loss and
+ * control records do. A stream that gets no room spends its seq number
+ * (TLM_Drop) as before.
+ *
+ * Streams with a TLM_DeltaTypeDef are delta coded (TLM_EndDelta).
+ */
+
+#ifndef __STREAM_MUX_H__
+#define __STREAM_MUX_H__
+
+#include "stm32f4xx_hal.h"
+#include "telemetry.h"
+#include "scheduler.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== CONFIGURATION ==== */
+#define MUX_MAX_STREAMS         SCHED_MAX_JOBS
+#define MUX_PRIO_LEVELS         4U
+#define MUX_PRIO_HEADROOM       256U    // queue bytes each level leaves to the levels above
+#define MUX_BATCH_SIZE          512U    // staging buffer, at least the largest frame
+
+/* Append the record fields to w, at most max_len bytes */
+typedef void (*MUX_FillFn)(TLM_WriterTypeDef *w, void *ctx);
+
+/* ==== STRUCTURE ==== */
+typedef struct {
+    uint32_t frames;            // queued
+    uint32_t dropped;           // no room at its priority, or the queue write failed
+} MUX_StreamStatsTypeDef;
+
+typedef struct {
+    uint8_t chan;
+    uint8_t prio;
+    uint8_t job;                // scheduler job id
+    volatile uint8_t due;
+    uint16_t max_len;           // record bytes
+    MUX_FillFn fill;
+    void *ctx;
+    TLM_DeltaTypeDef *delta;    // NULL: plain frames
+    MUX_StreamStatsTypeDef stats;
+} MUX_StreamTypeDef;
+
+typedef struct {
+    uint32_t batches;           // queue writes
+    uint32_t frames;
+    uint32_t max_frames;        // most frames in one batch
+} MUX_StatsTypeDef;
+
+typedef struct {
+    TLM_EncoderTypeDef *tlm;
+    SCHED_HandleTypeDef *sched;
+    MUX_StreamTypeDef stream[MUX_MAX_STREAMS];
+    uint8_t n_streams;
+    uint8_t order[MUX_MAX_STREAMS];     // stream indices by priority, registration order within one
+    uint8_t batch[MUX_BATCH_SIZE];
+    MUX_StatsTypeDef stats;
+} MUX_HandleTypeDef;
+
+/* ==== FUNCTION PROTOTYPES ==== */
+HAL_StatusTypeDef Mux_Init(MUX_HandleTypeDef *mux, TLM_EncoderTypeDef *tlm, SCHED_HandleTypeDef *sched);
+HAL_StatusTypeDef Mux_AddStream(MUX_HandleTypeDef *mux, const char *name, uint8_t chan, uint32_t rate_hz,
+                                uint8_t prio, uint16_t max_len, MUX_FillFn fill, void *ctx,
+                                TLM_DeltaTypeDef *delta);
+uint32_t Mux_JobMask(const MUX_HandleTypeDef *mux, uint32_t chans);
+void Mux_Service(MUX_HandleTypeDef *mux);
+void Mux_Reset(MUX_HandleTypeDef *mux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STREAM_MUX_H__ */
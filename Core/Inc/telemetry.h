@@ -0,0 +1,287 @@
+/**
+ * @file telemetry.h
+ * @brief Versioned binary telemetry framing (device encoder + reference decoder)
+ * @version 1.0
+ * @date 2025-10
+ *
+ * Frame layout (little endian):
+ *   off  size  field
+ *   0    2     sync      0xA5 0x5A
+ *   2    1     version   TLM_VERSION
+ *   3    1     channel   TLM_CHAN_xxx
+ *   4    2     seq       per-channel frame counter, a gap means lost frames
+ *   6    4     timestamp channel timebase (ms tick, audio: I2S frame index)
+ *   10   2     length    payload bytes
+ *   12   n     payload
+ *   12+n 2     crc       CRC-16/CCITT-FALSE over bytes [2, 12+n)
+ *
+ * Every channel numbers its frames separately. A frame that is due but cannot
+ * be queued on the device still spends its number (TLM_Drop), so the decoder
+ * sees device-side drops and link/host losses alike as gaps; the periodic
+ * TLM_CHAN_LOSS record tells the two apart.
+ *
+ * The slow sensor channels may be delta coded (TLM_EndDelta): the channel
+ * byte then carries TLM_CHAN_DELTA and the payload only the changes since
+ * the previous frame of the channel, see DELTA CODING below.
+ *
+ * No HAL dependency: this file is also built into the host tools.
+ */
+
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== FRAME FORMAT ==== */
+#define TLM_SYNC0           0xA5
+#define TLM_SYNC1           0x5A
+#define TLM_VERSION         1U
+#define TLM_HEADER_SIZE     12U
+#define TLM_CRC_SIZE        2U
+#define TLM_OVERHEAD        (TLM_HEADER_SIZE + TLM_CRC_SIZE)
+#define TLM_MAX_PAYLOAD     1024U
+#define TLM_MAX_FRAME       (TLM_MAX_PAYLOAD + TLM_OVERHEAD)
+#define TLM_CHAN_COUNT      16U     // channel ids are below this
+#define TLM_SEQ_MAX_MISORDER 64U    // a larger step back is taken as a device restart
+
+/* ==== CHANNEL IDS ==== */
+#define TLM_CHAN_AUDIO      0x01    // packed signed 24-bit PCM, ts = first I2S frame
+#define TLM_CHAN_PROX       0x02    // VCNL4040: u16 als, u16 ps
+#define TLM_CHAN_AUDIO_LVL  0x03    // i32 latest microphone sample
+#define TLM_CHAN_GAS        0x04    // ENS160: u8 aqi, u16 tvoc, u16 eco2
+#define TLM_CHAN_HUMTEMP    0x05    // HDC302x: n x (i16 centi-degC, u16 centi-%RH)
+#define TLM_CHAN_SCHED      0x06    // per job: u8 id, u32 runs, overruns, lat min/max/avg us, exec max us
+#define TLM_CHAN_CMD        0x07    // host -> device: u16 request id, u8 op, arguments
+#define TLM_CHAN_CMD_RSP    0x08    // device -> host: u16 request id, u8 op, u8 status, data
+#define TLM_CHAN_LINK       0x09    // on port open: u8 line state, u32 ms without a host, u32 audio samples skipped
+#define TLM_CHAN_BENCH      0x0A    // link benchmark, see TLM_CMD_BENCH
+#define TLM_CHAN_LOSS       0x0B    // per channel: u8 chan, u16 next seq, u32 frames dropped on the device
+#define TLM_CHAN_FLOW       0x0C    // flow control level change, see TLM_FLOW_xxx
+#define TLM_CHAN_AUDIO_CLK  0x0D    // 1 Hz: u32 configured I2S rate Hz, u32 measured rate mHz in USB SOF time (0 = not locked)
+#define TLM_CHAN_LOG        0x0E    // deferred log entries, see TLM_LOG_xxx
+#define TLM_CHAN_DELTA      0x80    // flag on PROX, GAS, HUMTEMP: payload delta coded, seq shared with the plain frames
+
+#define TLM_SCHED_JOB_SIZE  25U
+#define TLM_LOSS_ENTRY_SIZE 7U
+#define TLM_FLOW_SIZE       11U
+#define TLM_AUDIO_CLK_SIZE  8U
+
+/* ==== DEFERRED LOG (TLM_CHAN_LOG) ==== */
+/* u16 entries dropped on the device since the previous frame, then entries:
+ *   u16 format id (offset of the string in the firmware ELF's dlog_fmt
+ *   section), u8 argument count n, u32 tick ms, n x u32 arguments */
+#define TLM_LOG_HEADER_SIZE 2U
+#define TLM_LOG_ENTRY_SIZE  7U
+#define TLM_LOG_MAX_ARGS    8U
+
+/* ==== FLOW CONTROL (TLM_CHAN_FLOW) ==== */
+/* Sent on every level change and when a host opens the port:
+ *   u8 level, u8 previous level, u8 reason, u8 audio decimation (0 = raw
+ *   audio off), u8 feature job divider, u16 transmit queue bytes,
+ *   u32 frames dropped on the device so far (all channels)
+ * Levels degrade in this order and recover one step at a time. */
+#define TLM_FLOW_FULL       0x00    // every stream at its configured rate
+#define TLM_FLOW_AUDIO_LOW  0x01    // raw audio at a reduced sample rate
+#define TLM_FLOW_FEATURES   0x02    // raw audio off, feature streams only
+#define TLM_FLOW_SUMMARY    0x03    // feature streams thinned, summaries only
+#define TLM_FLOW_LEVELS     4U
+
+#define TLM_FLOW_REASON_START   0x00    // host connected, starting at FULL
+#define TLM_FLOW_REASON_QUEUE   0x01    // transmit queue above the high mark
+#define TLM_FLOW_REASON_DROPS   0x02    // frames had to be dropped
+#define TLM_FLOW_REASON_DRAINED 0x03    // queue stayed low for the hold time
+
+/* ==== COMMANDS (TLM_CHAN_CMD) ==== */
+/* Job ids are the scheduler registration order, as in TLM_CHAN_SCHED */
+#define TLM_CMD_PING        0x01    // -> u8 TLM_VERSION, u32 uptime ms
+#define TLM_CMD_GET_STATS   0x02    // -> TLM_STAT_COUNT x u32, indexed by TLM_STAT_xxx
+#define TLM_CMD_GET_JOBS    0x03    // -> per job: u8 id, u8 enabled, u32 period us
+#define TLM_CMD_SET_RATE    0x04    // u8 job, u16 rate Hz (period a whole number of ms)
+#define TLM_CMD_ENABLE      0x05    // u8 job, u8 0/1
+#define TLM_CMD_AUDIO_MODE  0x06    // u8 TLM_AUDIO_xxx
+#define TLM_CMD_BENCH       0x07    // u8 TLM_BENCH_xxx, u16 stream payload bytes
+#define TLM_CMD_TIME_SYNC   0x08    // -> u32 uptime ms, u32 scheduler timebase us (TIM2), see below
+
+#define TLM_TIME_SYNC_SIZE  8U
+
+#define TLM_AUDIO_OFF       0x00
+#define TLM_AUDIO_STREAM    0x01    // raw PCM on TLM_CHAN_AUDIO (default)
+
+/* STREAM: the device keeps the link full of TLM_CHAN_BENCH frames whose
+ * payload is a u32 counter followed by TLM_BENCH_PATTERN(i) for i >= 4.
+ * ECHO: every TLM_CHAN_BENCH frame the host sends is returned with the same
+ * payload and flushed at once. Other output continues unless disabled. */
+#define TLM_BENCH_OFF       0x00
+#define TLM_BENCH_STREAM    0x01
+#define TLM_BENCH_ECHO      0x02
+#define TLM_BENCH_PATTERN(i) ((uint8_t)((i) * 7U))
+
+/* TIME_SYNC: the HAL tick (the ts of every channel but audio) counts whole
+ * ms, so the host cannot place a record better than that from ts alone.
+ * The response pairs the tick with the free-running 1 MHz scheduler
+ * timebase read right after it; both run off the same crystal, so over a
+ * few samples the smallest (us - ms * 1000) gives the tick edges in us. The
+ * host sends the request, notes the send and receive time and fits offset
+ * and skew of the us counter against its own clock. */
+
+#define TLM_CMD_OK          0x00
+#define TLM_CMD_ERR_OP      0x01    // unknown opcode
+#define TLM_CMD_ERR_LEN     0x02    // wrong argument length
+#define TLM_CMD_ERR_ARG     0x03    // argument out of range
+
+#define TLM_CMD_REQ_SIZE    3U      // request payload before the arguments
+#define TLM_CMD_RSP_SIZE    4U      // response payload before the data
+
+/* GET_STATS fields */
+enum {
+    TLM_STAT_TX_BYTES = 0,
+    TLM_STAT_TX_DROPS,
+    TLM_STAT_TX_DROPPED_BYTES,
+    TLM_STAT_TX_HIGH_WATERMARK,
+    TLM_STAT_RX_BYTES,
+    TLM_STAT_RX_OVERFLOWS,
+    TLM_STAT_AUDIO_PACKETS,
+    TLM_STAT_AUDIO_DROPPED,
+    TLM_STAT_CMD_REQUESTS,
+    TLM_STAT_CMD_ERRORS,
+    TLM_STAT_CMD_CRC_ERRORS,
+    TLM_STAT_CMD_RSP_DROPPED,
+    TLM_STAT_COUNT
+};
+
+/* ==== ENCODER ==== */
+typedef struct {
+    uint8_t *base;      // start of the frame being built
+    uint8_t *p;         // payload write pointer
+} TLM_WriterTypeDef;
+
+typedef struct {
+    uint16_t seq[TLM_CHAN_COUNT];       // next sequence number per channel
+    uint32_t dropped[TLM_CHAN_COUNT];   // frames that were due but never queued
+} TLM_EncoderTypeDef;
+
+uint16_t TLM_CRC16(uint16_t crc, const uint8_t *data, size_t len);
+void TLM_WriteHeader(uint8_t *buf, uint8_t chan, uint16_t seq, uint32_t ts, uint16_t len);
+uint16_t TLM_Seal(uint8_t *frame);
+
+void TLM_Begin(TLM_EncoderTypeDef *enc, TLM_WriterTypeDef *w, uint8_t *buf, uint8_t chan, uint32_t ts);
+uint16_t TLM_End(TLM_WriterTypeDef *w);
+
+/* Field writers: a single (unaligned) store each on Cortex-M4 */
+static inline void TLM_PutU8(TLM_WriterTypeDef *w, uint8_t v)   { *w->p++ = v; }
+static inline void TLM_PutU16(TLM_WriterTypeDef *w, uint16_t v) { memcpy(w->p, &v, 2); w->p += 2; }
+static inline void TLM_PutU32(TLM_WriterTypeDef *w, uint32_t v) { memcpy(w->p, &v, 4); w->p += 4; }
+static inline void TLM_PutI16(TLM_WriterTypeDef *w, int16_t v)  { memcpy(w->p, &v, 2); w->p += 2; }
+static inline void TLM_PutI32(TLM_WriterTypeDef *w, int32_t v)  { memcpy(w->p, &v, 4); w->p += 4; }
+
+/* A frame that was due but could not be queued: spend its number so the
+ * receiver sees the gap, and count it */
+static inline void TLM_Drop(TLM_EncoderTypeDef *enc, uint8_t chan)
+{
+    chan &= TLM_CHAN_COUNT - 1U;
+    enc->seq[chan]++;
+    enc->dropped[chan]++;
+}
+
+/* ==== DELTA CODING ==== */
+/* ALS/PS, gas and humidity/temperature records change little from one to
+ * the next. A delta frame (chan | TLM_CHAN_DELTA) carries, per field in
+ * record order, the difference to the same field of the channel's previous
+ * record, wrapped to the field width, zig-zag mapped and written as a
+ * LEB128 varint; trailing zero differences are left out, so an unchanged
+ * record has an empty payload. A plain frame (keyframe) is sent instead
+ *   - for the first record and after TLM_DELTA_KEY_INTERVAL - 1 deltas,
+ *   - when the previous frame of the channel was not queued (seq spent by
+ *     TLM_Drop, or counted in enc->dropped after a failed send),
+ *   - when the record length changed or the delta would not be shorter.
+ * A delta frame refers to the frame of seq - 1: the decoder expands it only
+ * if it has that record and otherwise waits for the next keyframe, so a
+ * lost frame costs at most TLM_DELTA_KEY_INTERVAL records. */
+#define TLM_DELTA_KEY_INTERVAL  64U
+#define TLM_DELTA_MAX_RECORD    32U     // longer records are always sent plain
+
+typedef struct {
+    uint8_t  ref[TLM_DELTA_MAX_RECORD]; // previous record of the channel, plain
+    uint16_t ref_len;
+    uint16_t ref_seq;
+    uint32_t ref_dropped;               // encoder: enc->dropped[chan] when ref was sent
+    uint8_t  valid;
+    uint8_t  since_key;                 // encoder: deltas since the last keyframe
+} TLM_DeltaTypeDef;
+
+/* Next record goes out as a keyframe (new host, restart) */
+void TLM_DeltaReset(TLM_DeltaTypeDef *d);
+/* TLM_End() for a channel with a delta layout: sends a delta frame when it
+ * can, d keeps the reference of that channel */
+uint16_t TLM_EndDelta(TLM_EncoderTypeDef *enc, TLM_WriterTypeDef *w, TLM_DeltaTypeDef *d);
+
+/* ==== REFERENCE DECODER ==== */
+typedef struct {
+    uint8_t  version;
+    uint8_t  chan;
+    uint16_t seq;
+    uint32_t ts;
+    uint16_t len;
+    const uint8_t *payload;
+} TLM_FrameTypeDef;
+
+typedef void (*TLM_FrameCallback)(const TLM_FrameTypeDef *frame, void *ctx);
+
+/* Sequence accounting per channel */
+typedef struct {
+    uint32_t frames;
+    uint32_t lost;          // frames missing according to seq gaps
+    uint32_t gaps;          // forward jumps in seq
+    uint32_t reordered;     // late or duplicate frame, seq up to TLM_SEQ_MAX_MISORDER behind
+    uint32_t resyncs;       // larger step back: the sender restarted its counter
+    uint16_t next_seq;
+    uint8_t  synced;        // next_seq is valid
+} TLM_SeqStatsTypeDef;
+
+typedef struct {
+    uint8_t  buf[TLM_MAX_FRAME];
+    uint16_t pos;
+    uint32_t frames_ok;
+    uint32_t crc_errors;
+    uint32_t bad_headers;   // wrong version or oversize length
+    uint32_t skipped_bytes; // discarded while hunting for sync
+    TLM_SeqStatsTypeDef chan[TLM_CHAN_COUNT];
+} TLM_DecoderTypeDef;
+
+void TLM_DecoderInit(TLM_DecoderTypeDef *dec);
+void TLM_DecoderFeed(TLM_DecoderTypeDef *dec, const uint8_t *data, size_t len,
+                     TLM_FrameCallback cb, void *ctx);
+
+/* Delta frame expansion, one per stream, fed every frame in order */
+typedef struct {
+    TLM_DeltaTypeDef chan[TLM_CHAN_COUNT];
+    uint32_t key_frames;    // plain frames of the delta channels
+    uint32_t delta_frames;  // expanded
+    uint32_t unresolved;    // reference record lost: dropped until the next keyframe
+    uint32_t invalid;       // malformed delta payload
+} TLM_DeltaDecoderTypeDef;
+
+void TLM_DeltaDecoderInit(TLM_DeltaDecoderTypeDef *dd);
+/* 1: f is a plain frame now (a delta frame is rewritten to the base channel
+ * and the expanded record, valid until the channel's next frame);
+ * 0: drop f, it cannot be reconstructed */
+int TLM_DeltaExpand(TLM_DeltaDecoderTypeDef *dd, TLM_FrameTypeDef *f);
+
+static inline uint16_t TLM_GetU16(const uint8_t *p) { uint16_t v; memcpy(&v, p, 2); return v; }
+static inline uint32_t TLM_GetU32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline int32_t  TLM_GetS24(const uint8_t *p)
+{
+    return ((int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24)) >> 8;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TELEMETRY_H__ */
@@ -0,0 +1,54 @@
+/**
+ * @file uart_tx.h
+ * @brief Non-blocking USART1 transmit: byte ring drained by DMA2 Stream7
+ * @version 1.0
+ * @date 2025-10
+ *
+ * Writes are copied into a ring and return at once; the ring is sent by
+ * DMA (DMA2 Stream7 channel 4, USART1_TX) one contiguous span at a time,
+ * the next span chained from the transfer complete interrupt, so the CPU
+ * never waits on the 460800 baud line (~46 kB/s).
+ *
+ * Overflow policy: a write that does not fit is rejected whole and counted
+ * (drops, dropped_bytes), as on the USB rings, so records are never cut in
+ * two. Producers that would rather shed than lose check UartTx_Free() first.
+ */
+
+#ifndef __UART_TX_H__
+#define __UART_TX_H__
+
+#include "stm32f4xx_hal.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== CONFIGURATION ==== */
+#define UART_TX_RING_SIZE   4096U       // power of two, ~89 ms of line time
+
+/* ==== STRUCTURE ==== */
+typedef struct {
+    uint32_t bytes_queued;
+    uint32_t bytes_sent;
+    uint32_t transfers;         // completed DMA spans
+    uint32_t drops;             // writes rejected because the ring was full
+    uint32_t dropped_bytes;
+    uint32_t high_watermark;    // highest ring fill level in bytes
+    uint32_t errors;            // DMA starts the HAL refused
+} UART_TxStatsTypeDef;
+
+/* ==== EXPORTED VARIABLES ==== */
+extern UART_TxStatsTypeDef uart_tx_stats;
+
+/* ==== FUNCTION PROTOTYPES ==== */
+void UartTx_Init(UART_HandleTypeDef *huart);
+uint16_t UartTx_Write(const uint8_t *buf, uint16_t len);
+uint16_t UartTx_Free(void);
+void UartTx_OnComplete(UART_HandleTypeDef *huart);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UART_TX_H__ */
@@ -0,0 +1,222 @@
+/**
+ * @file audio_packetizer.c
+ * @brief Zero-copy microphone packetizer implementation
+ *
+ * Slot ownership: FREE -> FILLING (I2S callback) -> READY -> BUSY (USB IN)
+ * -> FREE (CDC_TransmitCplt_FS). Slots are filled and sent strictly in
+ * order, so wr/rd are enough to track them. The endpoint itself is owned by
+ * the CDC transmit queue in usbd_cdc_if.c, which claims ready slots ahead of
+ * queued byte data.
+ */
+
+#include "audio_packetizer.h"
+#include "microphone_sensor.h"
+#include "methods.h"
+#include <string.h>
+
+/* ==== INTERNAL HELPERS ==== */
+static void AudioPkt_StartSlot(AUDIO_PKT_HandleTypeDef *pkt, uint32_t first_frame)
+{
+    /* Packets that found no free slot still spend their sequence numbers,
+     * so the receiver sees the loss as a seq gap and not only in ts */
+    pkt->decim = pkt->decim_req;
+    if (pkt->lost > 0U) {
+        uint32_t span = AUDIO_PKT_SAMPLES * pkt->decim;
+        uint16_t missed = (uint16_t)((pkt->lost + span - 1U) / span);
+        pkt->seq += missed;
+        pkt->stats.packets_dropped += missed;
+        pkt->lost = 0;
+    }
+    TLM_WriteHeader(pkt->slot[pkt->wr], TLM_CHAN_AUDIO, pkt->seq, first_frame,
+                    AUDIO_PKT_SAMPLES * AUDIO_PKT_BYTES_PER_SMP);
+    pkt->seq++;
+    pkt->fill = 0;
+    pkt->state[pkt->wr] = AUDIO_PKT_SLOT_FILLING;
+}
+
+/* ==== PUBLIC API ==== */
+
+/**
+ * @brief Initialize slots and the DWT cycle counter used for cost reporting
+ */
+HAL_StatusTypeDef AudioPkt_Init(AUDIO_PKT_HandleTypeDef *pkt)
+{
+    if (!pkt) return HAL_ERROR;
+    memset(pkt, 0, sizeof(*pkt));
+    pkt->enabled = 1;
+    pkt->decim = 1;
+    pkt->decim_req = 1;
+    DWT_CycleCounter_Init();
+    return HAL_OK;
+}
+
+/**
+ * @brief Unpack one DMA half block directly into the current slot
+ * @note  Called from the I2S half/full transfer callbacks
+ */
+void AudioPkt_PushBlock(AUDIO_PKT_HandleTypeDef *pkt, const uint32_t *block,
+                        uint16_t frames, uint32_t first_frame)
+{
+    if (!pkt->enabled || pkt->paused) {
+        /* A partly filled slot would resume with a gap inside the frame */
+        if (pkt->state[pkt->wr] == AUDIO_PKT_SLOT_FILLING) {
+            pkt->state[pkt->wr] = AUDIO_PKT_SLOT_FREE;
+            pkt->seq--;     // never sent: not a gap
+        }
+        pkt->acc_n = 0;
+        pkt->acc = 0;
+        pkt->stats.samples_skipped += frames;
+        return;
+    }
+
+    uint32_t t0 = CYCLE_COUNT();
+
+    for (uint16_t f = 0; f < frames; f++, block += MIC_DMA_WORDS_PER_FRAME) {
+        if (pkt->state[pkt->wr] != AUDIO_PKT_SLOT_FILLING) {
+            if (pkt->decim_req == 0U) {
+                /* Shed by flow control between slots: announced, not a gap */
+                pkt->stats.samples_skipped += frames - f;
+                break;
+            }
+            if (pkt->state[pkt->wr] != AUDIO_PKT_SLOT_FREE) {
+                /* Host is not draining: drop the rest of this block */
+                pkt->stats.samples_dropped += frames - f;
+                pkt->lost += frames - f;
+                break;
+            }
+            AudioPkt_StartSlot(pkt, first_frame + f);
+        }
+
+        uint32_t val = MIC_UNPACK24(block[0], block[1]);
+        pkt->stats.samples_in++;
+        if (pkt->decim > 1U) {
+            /* Boxcar mean over decim frames: cheap anti-alias for the lower rate */
+            pkt->acc += (int32_t)(val << 8) >> 8;
+            if (++pkt->acc_n < pkt->decim) continue;
+            val = (uint32_t)(pkt->acc / (int32_t)pkt->decim);
+            pkt->acc = 0;
+            pkt->acc_n = 0;
+        }
+        uint8_t *dst = &pkt->slot[pkt->wr][AUDIO_PKT_HEADER_SIZE + pkt->fill * AUDIO_PKT_BYTES_PER_SMP];
+        dst[0] = (uint8_t)(val & 0xFF);
+        dst[1] = (uint8_t)((val >> 8) & 0xFF);
+        dst[2] = (uint8_t)(val >> 16);
+
+        if (++pkt->fill >= AUDIO_PKT_SAMPLES) {
+            TLM_Seal(pkt->slot[pkt->wr]);
+            pkt->state[pkt->wr] = AUDIO_PKT_SLOT_READY;
+            pkt->wr = (uint8_t)((pkt->wr + 1U) % AUDIO_PKT_SLOT_COUNT);
+        }
+    }
+
+    uint32_t cycles = CYCLE_COUNT() - t0;
+    pkt->stats.blocks++;
+    pkt->stats.cycles_last = cycles;
+    pkt->stats.cycles_total += cycles;
+    if (cycles > pkt->stats.cycles_max)
+        pkt->stats.cycles_max = cycles;
+}
+
+/**
+ * @brief Turn the audio stream on or off
+ * @note  Slots already complete are still sent; the one being filled is
+ *        discarded by the next PushBlock
+ */
+void AudioPkt_SetEnabled(AUDIO_PKT_HandleTypeDef *pkt, uint8_t enable)
+{
+    pkt->enabled = enable ? 1U : 0U;
+}
+
+/**
+ * @brief Pause the stream while no host is listening, independent of the
+ *        audio mode; unpacking is skipped entirely so the I2S callback
+ *        only keeps the frame counter running
+ */
+void AudioPkt_SetPaused(AUDIO_PKT_HandleTypeDef *pkt, uint8_t paused)
+{
+    pkt->paused = paused ? 1U : 0U;
+}
+
+/**
+ * @brief Lower the sample rate to 1/decim by averaging, or shed the raw
+ *        stream entirely with decim = 0 (flow control)
+ * @note  The slot being filled completes at its own factor
+ */
+HAL_StatusTypeDef AudioPkt_SetDecimation(AUDIO_PKT_HandleTypeDef *pkt, uint8_t decim)
+{
+    if (decim > AUDIO_PKT_MAX_DECIM) return HAL_ERROR;
+    pkt->decim_req = decim;
+    return HAL_OK;
+}
+
+/**
+ * @brief Complete slots not yet released by the endpoint
+ */
+uint8_t AudioPkt_Backlog(const AUDIO_PKT_HandleTypeDef *pkt)
+{
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < AUDIO_PKT_SLOT_COUNT; i++)
+        if (pkt->state[i] == AUDIO_PKT_SLOT_READY || pkt->state[i] == AUDIO_PKT_SLOT_BUSY)
+            n++;
+    return n;
+}
+
+/**
+ * @brief Whether a complete slot is waiting for the endpoint
+ */
+uint8_t AudioPkt_Pending(const AUDIO_PKT_HandleTypeDef *pkt)
+{
+    return pkt->state[pkt->rd] == AUDIO_PKT_SLOT_READY;
+}
+
+/**
+ * @brief Take the oldest ready slot for transmission
+ * @retval slot of AUDIO_PKT_SLOT_SIZE bytes now owned by the endpoint, or NULL
+ * @note  Caller must hold off the USB interrupt
+ */
+uint8_t *AudioPkt_Claim(AUDIO_PKT_HandleTypeDef *pkt)
+{
+    if (pkt->state[pkt->rd] != AUDIO_PKT_SLOT_READY) return NULL;
+    pkt->state[pkt->rd] = AUDIO_PKT_SLOT_BUSY;
+    return pkt->slot[pkt->rd];
+}
+
+/**
+ * @brief Return a claimed slot whose transfer was never started or was lost
+ *        (bus reset, failed TransmitPacket); it is sent again later
+ */
+void AudioPkt_Unclaim(AUDIO_PKT_HandleTypeDef *pkt)
+{
+    if (pkt->state[pkt->rd] == AUDIO_PKT_SLOT_BUSY)
+        pkt->state[pkt->rd] = AUDIO_PKT_SLOT_READY;
+}
+
+/**
+ * @brief Release the slot once the endpoint finished with it
+ * @note  Called from CDC_TransmitCplt_FS (USB interrupt)
+ */
+void AudioPkt_OnTxComplete(AUDIO_PKT_HandleTypeDef *pkt, const uint8_t *buf)
+{
+    if (pkt->state[pkt->rd] == AUDIO_PKT_SLOT_BUSY && buf == pkt->slot[pkt->rd]) {
+        pkt->state[pkt->rd] = AUDIO_PKT_SLOT_FREE;
+        pkt->rd = (uint8_t)((pkt->rd + 1U) % AUDIO_PKT_SLOT_COUNT);
+        pkt->stats.packets_sent++;
+    }
+}
+
+/**
+ * @brief Wire bytes per audio sample, header overhead included
+ */
+float AudioPkt_BytesPerSample(void)
+{
+    return (float)AUDIO_PKT_SLOT_SIZE / (float)AUDIO_PKT_SAMPLES;
+}
+
+/**
+ * @brief Average conversion cost in CPU cycles per sample
+ */
+float AudioPkt_CyclesPerSample(const AUDIO_PKT_HandleTypeDef *pkt)
+{
+    if (pkt->stats.samples_in == 0) return 0.0f;
+    return (float)pkt->stats.cycles_total / (float)pkt->stats.samples_in;
+}
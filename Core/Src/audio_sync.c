@@ -0,0 +1,176 @@
+/**
+ * @file audio_sync.c
+ * @brief I2S clock drift estimation against USB SOF, optional rate correction
+ *
+ * Loop model (per SOF, T = 1 ms):
+ *   err   += measured_advance - (nominal + freq_dev) * sofs
+ *   freq_dev += Ki * err
+ *   err   -= Kp * err
+ * freq_dev is kept separate from the nominal rate so the ppm-sized
+ * corrections do not vanish in float rounding.
+ */
+
+#include "audio_sync.h"
+#include <string.h>
+
+/* ==== INTERNAL HELPERS ==== */
+
+/**
+ * @brief Absolute DMA write position in words (wraps at 2^32)
+ *
+ * block_count is advanced in the half/full transfer callbacks, NDTR gives
+ * the position inside the circular buffer. At most one half transfer event
+ * can be pending (same NVIC priority as OTG_FS), so the true position lies
+ * in [block_count * half, block_count * half + xfer).
+ */
+static uint32_t AudioSync_DmaWords(MIC_HandleTypeDef *mic)
+{
+    const uint32_t xfer = MIC_DMA_XFER_WORDS;
+    const uint32_t half = xfer / 2U;
+
+    uint32_t ndtr = __HAL_DMA_GET_COUNTER(mic->hi2s->hdmarx);
+    uint32_t est  = mic->block_count * half;
+    uint32_t pos  = (ndtr >= xfer) ? 0U : (xfer - ndtr);
+    uint32_t cand = (est - (est % xfer)) + pos;
+
+    if ((int32_t)(cand - est) < 0)
+        cand += xfer;
+    return cand;
+}
+
+static void AudioSync_Restart(AUDIO_SYNC_HandleTypeDef *sync)
+{
+    sync->state = AUDIO_SYNC_ACQUIRE;
+    sync->acq_sofs = 0;
+    sync->acq_words = 0;
+    sync->phase_err = 0.0f;
+    sync->locked = 0;
+    sync->last_words = AudioSync_DmaWords(sync->mic);
+}
+
+/* ==== PUBLIC API ==== */
+
+/**
+ * @brief Initialize the estimator; the loop starts on the first SOF
+ */
+HAL_StatusTypeDef AudioSync_Init(AUDIO_SYNC_HandleTypeDef *sync, MIC_HandleTypeDef *mic)
+{
+    if (!sync || !mic || !mic->hi2s) return HAL_ERROR;
+
+    memset(sync, 0, sizeof(*sync));
+    sync->mic = mic;
+    sync->nominal = (float)mic->hi2s->Init.AudioFreq / (float)AUDIO_SYNC_SOF_HZ;
+    sync->state = AUDIO_SYNC_IDLE;
+    return HAL_OK;
+}
+
+/**
+ * @brief Feed one SOF event (called from the USBD_CDC_DUAL SOF callback)
+ * @param frame_num 11-bit frame number from OTG_FS DSTS.FNSOF
+ */
+void AudioSync_OnSOF(AUDIO_SYNC_HandleTypeDef *sync, uint16_t frame_num)
+{
+    if (sync->mic == NULL) return;
+
+    if (sync->state == AUDIO_SYNC_IDLE) {
+        sync->last_frame_num = frame_num;
+        AudioSync_Restart(sync);
+        return;
+    }
+
+    uint32_t sofs = (uint32_t)(frame_num - sync->last_frame_num) & 0x7FFU;
+    sync->last_frame_num = frame_num;
+    if (sofs == 0U) return;
+    if (sofs > AUDIO_SYNC_MAX_SOF_GAP) {
+        AudioSync_Restart(sync);
+        return;
+    }
+    sync->sof_count += sofs;
+    sync->sof_missed += sofs - 1U;
+
+    uint32_t words = AudioSync_DmaWords(sync->mic);
+    uint32_t delta = words - sync->last_words;
+    sync->last_words = words;
+
+    if (sync->state == AUDIO_SYNC_ACQUIRE) {
+        /* Open-loop average first, so the loop starts near the real rate */
+        sync->acq_sofs += sofs;
+        sync->acq_words += delta;
+        if (sync->acq_sofs >= AUDIO_SYNC_ACQUIRE_SOFS) {
+            float rate = (float)sync->acq_words / (float)MIC_DMA_WORDS_PER_FRAME
+                         / (float)sync->acq_sofs;
+            sync->freq_dev = rate - sync->nominal;
+            sync->phase_err = 0.0f;
+            sync->state = AUDIO_SYNC_TRACK;
+        }
+        return;
+    }
+
+    float advance = (float)delta / (float)MIC_DMA_WORDS_PER_FRAME;
+    /* Subtract the nominal part exactly before adding the small residuals */
+    sync->phase_err += (advance - sync->nominal * (float)sofs) - sync->freq_dev * (float)sofs;
+    sync->freq_dev  += AUDIO_SYNC_LOOP_KI * sync->phase_err;
+    sync->phase_err -= AUDIO_SYNC_LOOP_KP * sync->phase_err;
+
+    float abs_err = (sync->phase_err < 0.0f) ? -sync->phase_err : sync->phase_err;
+    sync->locked = (abs_err < AUDIO_SYNC_LOCK_ERR_FRAMES) ? 1U : 0U;
+}
+
+/**
+ * @brief Measured audio clock offset relative to the configured AudioFreq
+ * @note  Includes the static I2SDIV rounding error (about -3500 ppm at 16 kHz)
+ */
+float AudioSync_GetPPM(const AUDIO_SYNC_HandleTypeDef *sync)
+{
+    if (sync->state != AUDIO_SYNC_TRACK || sync->nominal <= 0.0f) return 0.0f;
+    return sync->freq_dev / sync->nominal * 1.0e6f;
+}
+
+/**
+ * @brief Measured audio sample rate in host (SOF) time
+ */
+float AudioSync_GetRateHz(const AUDIO_SYNC_HandleTypeDef *sync)
+{
+    return (sync->nominal + sync->freq_dev) * (float)AUDIO_SYNC_SOF_HZ;
+}
+
+/**
+ * @brief Resample a block to the nominal rate in host time (linear interpolation)
+ *
+ * Reads in[] at a step of measured/nominal input samples per output sample,
+ * carrying the fractional phase and the last sample across calls so block
+ * boundaries are seamless. Pass-through until the loop is tracking.
+ *
+ * @retval number of samples written to out[]
+ */
+uint16_t AudioSync_Resample(AUDIO_SYNC_HandleTypeDef *sync, const int32_t *in, uint16_t n_in,
+                            int32_t *out, uint16_t max_out)
+{
+    uint16_t n_out = 0;
+
+    if (n_in == 0) return 0;
+
+    if (sync->state != AUDIO_SYNC_TRACK) {
+        n_out = (n_in < max_out) ? n_in : max_out;
+        memcpy(out, in, n_out * sizeof(int32_t));
+        sync->rs_prev = in[n_in - 1];
+        sync->rs_phase = 0.0f;
+        return n_out;
+    }
+
+    float step = 1.0f + sync->freq_dev / sync->nominal;
+    float t = sync->rs_phase;
+
+    while (t < (float)n_in && n_out < max_out) {
+        uint16_t i = (uint16_t)t;
+        float frac = t - (float)i;
+        int32_t a = (i == 0) ? sync->rs_prev : in[i - 1];
+        int32_t b = in[i];
+        out[n_out++] = a + (int32_t)((float)(b - a) * frac);
+        t += step;
+    }
+
+    sync->rs_phase = (t >= (float)n_in) ? (t - (float)n_in) : 0.0f;
+    sync->rs_prev = in[n_in - 1];
+    return n_out;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file bench.c
+ * @brief USB CDC link benchmark implementation
+ */
+
+#include "bench.h"
+#include "usbd_cdc_if.h"
+#include <string.h>
+
+/* ==== PUBLIC API ==== */
+
+HAL_StatusTypeDef Bench_Init(BENCH_HandleTypeDef *bench, TLM_EncoderTypeDef *tlm)
+{
+    if (!bench || !tlm) return HAL_ERROR;
+    memset(bench, 0, sizeof(*bench));
+    bench->tlm = tlm;
+    return HAL_OK;
+}
+
+/**
+ * @brief Switch mode; STREAM restarts the counter and prepares the pattern
+ */
+HAL_StatusTypeDef Bench_SetMode(BENCH_HandleTypeDef *bench, uint8_t mode, uint16_t size)
+{
+    if (mode > TLM_BENCH_ECHO) return HAL_ERROR;
+    if (mode == TLM_BENCH_STREAM) {
+        if (size < BENCH_MIN_PAYLOAD || size > BENCH_MAX_PAYLOAD) return HAL_ERROR;
+        for (uint16_t i = BENCH_MIN_PAYLOAD; i < size; i++)
+            bench->frame[TLM_HEADER_SIZE + i] = TLM_BENCH_PATTERN(i);
+        bench->size = size;
+        bench->counter = 0;
+    }
+    bench->mode = mode;
+    return HAL_OK;
+}
+
+/**
+ * @brief Top up the transmit queue with stream frames
+ * @note  Main loop context
+ */
+void Bench_Service(BENCH_HandleTypeDef *bench)
+{
+    if (bench->mode != TLM_BENCH_STREAM) return;
+
+    uint16_t total = (uint16_t)(TLM_OVERHEAD + bench->size);
+    while (CDC_TxQueue_Free() >= total + BENCH_TX_RESERVE) {
+        TLM_WriteHeader(bench->frame, TLM_CHAN_BENCH, bench->tlm->seq[TLM_CHAN_BENCH], HAL_GetTick(), bench->size);
+        memcpy(&bench->frame[TLM_HEADER_SIZE], &bench->counter, 4);
+        TLM_Seal(bench->frame);
+        if (CDC_Transmit_FS(bench->frame, total) != USBD_OK) break;
+        bench->tlm->seq[TLM_CHAN_BENCH]++;
+        bench->counter++;
+        bench->stats.frames++;
+        bench->stats.bytes += total;
+    }
+}
+
+/**
+ * @brief Return a host TLM_CHAN_BENCH frame unchanged (ECHO mode)
+ */
+void Bench_OnFrame(BENCH_HandleTypeDef *bench, const TLM_FrameTypeDef *frame)
+{
+    if (bench->mode != TLM_BENCH_ECHO || frame->len > BENCH_MAX_PAYLOAD) return;
+
+    uint8_t buf[TLM_OVERHEAD + BENCH_MAX_PAYLOAD];
+    TLM_WriteHeader(buf, TLM_CHAN_BENCH, bench->tlm->seq[TLM_CHAN_BENCH]++, HAL_GetTick(), frame->len);
+    memcpy(&buf[TLM_HEADER_SIZE], frame->payload, frame->len);
+    uint16_t total = TLM_Seal(buf);
+    if (CDC_TxQueue_Write(buf, total) != total) {
+        bench->stats.echo_dropped++;
+        bench->tlm->dropped[TLM_CHAN_BENCH]++;
+        return;
+    }
+    bench->stats.echoes++;
+    CDC_TxQueue_Flush();
+}
@@ -0,0 +1,199 @@
+/**
+ * @file command.c
+ * @brief Host-to-device command channel implementation
+ */
+
+#include "command.h"
+#include "usbd_cdc_if.h"
+#include <string.h>
+
+#if (6U * SCHED_MAX_JOBS > CMD_MAX_RSP_DATA) || (4U * TLM_STAT_COUNT > CMD_MAX_RSP_DATA)
+#error "CMD_MAX_RSP_DATA too small for GET_JOBS / GET_STATS"
+#endif
+
+/* ==== COMMAND HANDLERS ==== */
+/* Each returns a TLM_CMD_xxx status; response data is appended to w only on success */
+
+static uint8_t Cmd_Ping(CMD_HandleTypeDef *cmd, const uint8_t *arg, uint16_t n, TLM_WriterTypeDef *w)
+{
+    UNUSED(cmd);
+    UNUSED(arg);
+    if (n != 0U) return TLM_CMD_ERR_LEN;
+    TLM_PutU8(w, TLM_VERSION);
+    TLM_PutU32(w, HAL_GetTick());
+    return TLM_CMD_OK;
+}
+
+static uint8_t Cmd_GetStats(CMD_HandleTypeDef *cmd, const uint8_t *arg, uint16_t n, TLM_WriterTypeDef *w)
+{
+    UNUSED(arg);
+    if (n != 0U) return TLM_CMD_ERR_LEN;
+
+    uint32_t v[TLM_STAT_COUNT];
+    v[TLM_STAT_TX_BYTES]           = cdc_tx_stats.bytes_sent;
+    v[TLM_STAT_TX_DROPS]           = cdc_tx_stats.drops;
+    v[TLM_STAT_TX_DROPPED_BYTES]   = cdc_tx_stats.dropped_bytes;
+    v[TLM_STAT_TX_HIGH_WATERMARK]  = cdc_tx_stats.high_watermark;
+    v[TLM_STAT_RX_BYTES]           = cdc_rx_stats.bytes_received;
+    v[TLM_STAT_RX_OVERFLOWS]       = cdc_rx_stats.overflows;
+    v[TLM_STAT_AUDIO_PACKETS]      = cmd->audio->stats.packets_sent;
+    v[TLM_STAT_AUDIO_DROPPED]      = cmd->audio->stats.samples_dropped;
+    v[TLM_STAT_CMD_REQUESTS]       = cmd->stats.requests;
+    v[TLM_STAT_CMD_ERRORS]         = cmd->stats.errors;
+    v[TLM_STAT_CMD_CRC_ERRORS]     = cmd->dec.crc_errors;
+    v[TLM_STAT_CMD_RSP_DROPPED]    = cmd->stats.rsp_dropped;
+    for (uint8_t i = 0; i < TLM_STAT_COUNT; i++)
+        TLM_PutU32(w, v[i]);
+    return TLM_CMD_OK;
+}
+
+static uint8_t Cmd_GetJobs(CMD_HandleTypeDef *cmd, const uint8_t *arg, uint16_t n, TLM_WriterTypeDef *w)
+{
+    UNUSED(arg);
+    if (n != 0U) return TLM_CMD_ERR_LEN;
+    for (uint8_t i = 0; i < cmd->sched->n_jobs; i++) {
+        TLM_PutU8(w, i);
+        TLM_PutU8(w, cmd->sched->job[i].enabled);
+        TLM_PutU32(w, cmd->sched->job[i].period_us);
+    }
+    return TLM_CMD_OK;
+}
+
+static uint8_t Cmd_SetRate(CMD_HandleTypeDef *cmd, const uint8_t *arg, uint16_t n, TLM_WriterTypeDef *w)
+{
+    UNUSED(w);
+    if (n != 3U) return TLM_CMD_ERR_LEN;
+    if (Sched_SetRate(cmd->sched, arg[0], TLM_GetU16(&arg[1])) != HAL_OK) return TLM_CMD_ERR_ARG;
+    return TLM_CMD_OK;
+}
+
+static uint8_t Cmd_Enable(CMD_HandleTypeDef *cmd, const uint8_t *arg, uint16_t n, TLM_WriterTypeDef *w)
+{
+    UNUSED(w);
+    if (n != 2U) return TLM_CMD_ERR_LEN;
+    if (arg[1] > 1U) return TLM_CMD_ERR_ARG;
+    if (Sched_EnableJob(cmd->sched, arg[0], arg[1]) != HAL_OK) return TLM_CMD_ERR_ARG;
+    return TLM_CMD_OK;
+}
+
+static uint8_t Cmd_AudioMode(CMD_HandleTypeDef *cmd, const uint8_t *arg, uint16_t n, TLM_WriterTypeDef *w)
+{
+    UNUSED(w);
+    if (n != 1U) return TLM_CMD_ERR_LEN;
+    if (arg[0] != TLM_AUDIO_OFF && arg[0] != TLM_AUDIO_STREAM) return TLM_CMD_ERR_ARG;
+    AudioPkt_SetEnabled(cmd->audio, arg[0] == TLM_AUDIO_STREAM);
+    return TLM_CMD_OK;
+}
+
+static uint8_t Cmd_Bench(CMD_HandleTypeDef *cmd, const uint8_t *arg, uint16_t n, TLM_WriterTypeDef *w)
+{
+    UNUSED(w);
+    if (n != 3U) return TLM_CMD_ERR_LEN;
+    if (Bench_SetMode(cmd->bench, arg[0], TLM_GetU16(&arg[1])) != HAL_OK) return TLM_CMD_ERR_ARG;
+    return TLM_CMD_OK;
+}
+
+static uint8_t Cmd_TimeSync(CMD_HandleTypeDef *cmd, const uint8_t *arg, uint16_t n, TLM_WriterTypeDef *w)
+{
+    UNUSED(arg);
+    if (n != 0U) return TLM_CMD_ERR_LEN;
+    /* Tick first: an interrupt in between only makes us - ms * 1000 larger,
+     * and the host takes the smallest it sees */
+    uint32_t ms = HAL_GetTick();
+    uint32_t us = Sched_Micros(cmd->sched);
+    TLM_PutU32(w, ms);
+    TLM_PutU32(w, us);
+    return TLM_CMD_OK;
+}
+
+typedef uint8_t (*CMD_HandlerFn)(CMD_HandleTypeDef *cmd, const uint8_t *arg, uint16_t n, TLM_WriterTypeDef *w);
+
+static const CMD_HandlerFn cmd_table[] = {
+    [TLM_CMD_PING]       = Cmd_Ping,
+    [TLM_CMD_GET_STATS]  = Cmd_GetStats,
+    [TLM_CMD_GET_JOBS]   = Cmd_GetJobs,
+    [TLM_CMD_SET_RATE]   = Cmd_SetRate,
+    [TLM_CMD_ENABLE]     = Cmd_Enable,
+    [TLM_CMD_AUDIO_MODE] = Cmd_AudioMode,
+    [TLM_CMD_BENCH]      = Cmd_Bench,
+    [TLM_CMD_TIME_SYNC]  = Cmd_TimeSync,
+};
+
+/* ==== DISPATCH ==== */
+static void Cmd_OnFrame(const TLM_FrameTypeDef *f, void *ctx)
+{
+    CMD_HandleTypeDef *cmd = (CMD_HandleTypeDef *)ctx;
+
+    if (f->chan == TLM_CHAN_BENCH) {
+        Bench_OnFrame(cmd->bench, f);
+        return;
+    }
+    if (f->chan != TLM_CHAN_CMD) return;
+    if (f->len < TLM_CMD_REQ_SIZE) {
+        cmd->stats.malformed++;
+        return;
+    }
+
+    uint16_t id = TLM_GetU16(f->payload);
+    uint8_t op = f->payload[2];
+    uint8_t buf[CMD_MAX_RSP_FRAME];
+    TLM_WriterTypeDef w;
+
+    TLM_Begin(cmd->tlm, &w, buf, TLM_CHAN_CMD_RSP, HAL_GetTick());
+    TLM_PutU16(&w, id);
+    TLM_PutU8(&w, op);
+    uint8_t *status = w.p++;
+
+    CMD_HandlerFn fn = (op < sizeof(cmd_table) / sizeof(cmd_table[0])) ? cmd_table[op] : NULL;
+    *status = fn ? fn(cmd, &f->payload[TLM_CMD_REQ_SIZE], (uint16_t)(f->len - TLM_CMD_REQ_SIZE), &w)
+                 : TLM_CMD_ERR_OP;
+    if (*status != TLM_CMD_OK) {
+        w.p = status + 1;
+        cmd->stats.errors++;
+    }
+    cmd->stats.requests++;
+
+    uint16_t len = TLM_End(&w);
+    if (CDC_TxQueue_Write(buf, len) != len) {
+        cmd->stats.rsp_dropped++;
+        cmd->tlm->dropped[TLM_CHAN_CMD_RSP]++;
+    }
+}
+
+/* ==== PUBLIC API ==== */
+
+/**
+ * @brief Bind the command channel to the objects it controls
+ */
+HAL_StatusTypeDef Cmd_Init(CMD_HandleTypeDef *cmd, SCHED_HandleTypeDef *sched,
+                           AUDIO_PKT_HandleTypeDef *audio, BENCH_HandleTypeDef *bench,
+                           TLM_EncoderTypeDef *tlm)
+{
+    if (!cmd || !sched || !audio || !bench || !tlm) return HAL_ERROR;
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->sched = sched;
+    cmd->audio = audio;
+    cmd->bench = bench;
+    cmd->tlm = tlm;
+    TLM_DecoderInit(&cmd->dec);
+    return HAL_OK;
+}
+
+/**
+ * @brief Parse received bytes and execute complete requests
+ * @note  Main loop context
+ */
+void Cmd_Poll(CMD_HandleTypeDef *cmd)
+{
+    uint8_t chunk[CMD_RX_CHUNK];
+    uint32_t requests = cmd->stats.requests;
+
+    while (CDC_TxQueue_Free() >= CMD_RX_RESERVE + (cmd->bench->mode == TLM_BENCH_ECHO ? CMD_ECHO_RESERVE : 0U)) {
+        uint16_t n = CDC_RxQueue_Read(chunk, sizeof(chunk));
+        if (n == 0U) break;
+        TLM_DecoderFeed(&cmd->dec, chunk, n, Cmd_OnFrame, cmd);
+    }
+    /* The host is waiting: do not hold responses back for coalescing */
+    if (cmd->stats.requests != requests)
+        CDC_TxQueue_Flush();
+}
@@ -0,0 +1,74 @@
+/**
+ * @file console.c
+ * @brief stdio backend over the log console and USART1 transmit rings
+ */
+
+#include "console.h"
+#include "uart_tx.h"
+#include "usbd_cdc_log_if.h"
+#include <stdio.h>
+#include <string.h>
+
+CONSOLE_StatsTypeDef console_stats;
+
+static char console_line[CONSOLE_LINE_SIZE];
+static volatile uint8_t console_routes;
+
+/* ==== PUBLIC API ==== */
+
+/**
+ * @brief Select the output routes and give stdout its static line buffer
+ * @note  Before the first printf: setvbuf must precede any other use of stdout
+ */
+void Console_Init(uint8_t routes)
+{
+    memset(&console_stats, 0, sizeof(console_stats));
+    console_routes = routes;
+    setvbuf(stdout, console_line, _IOLBF, sizeof(console_line));
+    setvbuf(stderr, NULL, _IONBF, 0);
+}
+
+void Console_SetRoutes(uint8_t routes)
+{
+    console_routes = routes;
+}
+
+/**
+ * @brief Queue stdout/stderr output on every enabled route, without waiting
+ * @note  Main loop context; an interrupt-context call is dropped and counted
+ * @retval len, always: refused output is counted, never retried
+ */
+int Console_Write(const char *buf, int len)
+{
+    if (len <= 0) return 0;
+    if (__get_IPSR() != 0U) {
+        console_stats.isr_writes++;
+        return len;
+    }
+
+    uint8_t routes = console_routes;
+    uint16_t n = len > 0xFFFF ? 0U : (uint16_t)len;     // larger than any ring
+    uint8_t taken = 0;
+    console_stats.writes++;
+    console_stats.bytes += (uint32_t)len;
+    if ((routes & CONSOLE_ROUTE_USB) != 0U && n != 0U)
+        taken |= CDC_Log_Write((const uint8_t *)buf, n) == n;
+    if ((routes & CONSOLE_ROUTE_UART) != 0U && n != 0U)
+        taken |= UartTx_Write((const uint8_t *)buf, n) == n;
+    if (!taken)
+        console_stats.refused++;
+    return len;
+}
+
+/**
+ * @brief Take what was typed into the USB console
+ * @note  Main loop context only
+ * @retval bytes copied, 0 if nothing is pending
+ */
+int Console_Read(char *buf, int len)
+{
+    if (len <= 0 || __get_IPSR() != 0U) return 0;
+    uint16_t n = CDC_Log_Read((uint8_t *)buf, len > 0xFFFF ? 0xFFFFU : (uint16_t)len);
+    console_stats.read_bytes += n;
+    return n;
+}
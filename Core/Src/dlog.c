@@ -0,0 +1,124 @@
+/**
+ * @file dlog.c
+ * @brief Deferred log ring
+ *
+ * Any context writes whole entries at head with interrupts masked; the main
+ * loop is the only reader and takes whole entries from tail. head/tail are
+ * free running byte counters, an entry may wrap around the ring end.
+ */
+
+#include "dlog.h"
+
+#define DLOG_RING_MASK      (DLOG_RING_SIZE - 1U)
+
+#if (DLOG_RING_SIZE & DLOG_RING_MASK) != 0U
+#error "DLOG_RING_SIZE must be a power of two"
+#endif
+
+DLOG_StatsTypeDef dlog_stats;
+
+static uint8_t dlog_ring[DLOG_RING_SIZE];
+static volatile uint32_t dlog_head;
+static volatile uint32_t dlog_tail;
+static volatile uint32_t dlog_lost;     // dropped since the last frame
+
+/* ==== INTERNAL HELPERS ==== */
+
+static void DLog_Put(uint32_t pos, const void *src, uint32_t len)
+{
+    uint32_t off = pos & DLOG_RING_MASK;
+    uint32_t first = DLOG_RING_SIZE - off;
+    if (first > len) first = len;
+    memcpy(&dlog_ring[off], src, first);
+    memcpy(dlog_ring, (const uint8_t *)src + first, len - first);
+}
+
+static void DLog_Get(uint32_t pos, void *dst, uint32_t len)
+{
+    uint32_t off = pos & DLOG_RING_MASK;
+    uint32_t first = DLOG_RING_SIZE - off;
+    if (first > len) first = len;
+    memcpy(dst, &dlog_ring[off], first);
+    memcpy((uint8_t *)dst + first, dlog_ring, len - first);
+}
+
+/* ==== PUBLIC API ==== */
+
+void DLog_Init(void)
+{
+    dlog_head = 0;
+    dlog_tail = 0;
+    dlog_lost = 0;
+    memset(&dlog_stats, 0, sizeof(dlog_stats));
+}
+
+/**
+ * @brief Record one entry, all or nothing (use the DLOG() macro)
+ * @note  Any context
+ */
+void DLog_Write(uint16_t id, const uint32_t *args, uint8_t n)
+{
+    uint8_t hdr[TLM_LOG_ENTRY_SIZE];
+    uint32_t tick = HAL_GetTick();
+    uint32_t len = TLM_LOG_ENTRY_SIZE + 4U * n;
+
+    memcpy(hdr, &id, 2);
+    hdr[2] = n;
+    memcpy(&hdr[3], &tick, 4);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t head = dlog_head;
+    uint32_t used = head - dlog_tail;
+    if (len > DLOG_RING_SIZE - used) {
+        dlog_stats.dropped++;
+        dlog_lost++;
+        __set_PRIMASK(primask);
+        return;
+    }
+    DLog_Put(head, hdr, TLM_LOG_ENTRY_SIZE);
+    DLog_Put(head + TLM_LOG_ENTRY_SIZE, args, 4U * n);
+    dlog_head = head + len;
+    dlog_stats.entries++;
+    if (used + len > dlog_stats.high_watermark)
+        dlog_stats.high_watermark = used + len;
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @retval 1 if entries or a drop count wait for DLog_Fill()
+ */
+uint8_t DLog_Pending(void)
+{
+    return dlog_head != dlog_tail || dlog_lost != 0U;
+}
+
+/**
+ * @brief Append the TLM_CHAN_LOG payload: drop count, then whole entries
+ * @note  Main loop context only (single reader)
+ * @param max_len payload bytes available, at least TLM_LOG_HEADER_SIZE
+ */
+void DLog_Fill(TLM_WriterTypeDef *w, uint16_t max_len)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t lost = dlog_lost;
+    dlog_lost = 0;
+    __set_PRIMASK(primask);
+
+    TLM_PutU16(w, (uint16_t)(lost > 0xFFFFU ? 0xFFFFU : lost));
+    uint32_t room = max_len - TLM_LOG_HEADER_SIZE;
+    uint32_t tail = dlog_tail;
+    uint32_t head = dlog_head;
+    while (tail != head) {
+        uint8_t n;
+        DLog_Get(tail + 2U, &n, 1);
+        uint32_t len = TLM_LOG_ENTRY_SIZE + 4U * n;
+        if (len > room) break;
+        DLog_Get(tail, w->p, len);
+        w->p += len;
+        room -= len;
+        tail += len;
+    }
+    dlog_tail = tail;
+}
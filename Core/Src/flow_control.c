@@ -0,0 +1,173 @@
+/**
+ * @file flow_control.c
+ * @brief Backpressure policy implementation
+ */
+
+#include "flow_control.h"
+#include "usbd_cdc_if.h"
+#include <string.h>
+
+#define FLOW_HIGH_BYTES     (CDC_TX_RING_SIZE / 8U * FLOW_HIGH_EIGHTHS)
+#define FLOW_LOW_BYTES      (CDC_TX_RING_SIZE / 8U * FLOW_LOW_EIGHTHS)
+
+/* What each level does to the streams */
+typedef struct {
+    uint8_t  audio_decim;       // 0 = raw audio shed
+    uint16_t feature_div;
+} FLOW_LevelTypeDef;
+
+static const FLOW_LevelTypeDef flow_levels[TLM_FLOW_LEVELS] = {
+    [TLM_FLOW_FULL]      = { 1U, 1U },
+    [TLM_FLOW_AUDIO_LOW] = { FLOW_AUDIO_DECIM, 1U },
+    [TLM_FLOW_FEATURES]  = { 0U, 1U },
+    [TLM_FLOW_SUMMARY]   = { 0U, FLOW_SUMMARY_DIV },
+};
+
+/* ==== INTERNAL HELPERS ==== */
+
+/* Device-side losses in any unit; only its changes matter */
+static uint32_t Flow_DropEvents(const FLOW_HandleTypeDef *flow)
+{
+    uint32_t n = flow->audio->stats.samples_dropped + cdc_tx_stats.drops;
+    for (uint8_t c = 0; c < TLM_CHAN_COUNT; c++)
+        n += flow->tlm->dropped[c];
+    return n;
+}
+
+/* Frames dropped on the device, as the host counts them in seq gaps */
+static uint32_t Flow_DroppedFrames(const FLOW_HandleTypeDef *flow)
+{
+    uint32_t n = flow->audio->stats.packets_dropped;
+    for (uint8_t c = 0; c < TLM_CHAN_COUNT; c++)
+        n += flow->tlm->dropped[c];
+    return n;
+}
+
+static void Flow_Apply(FLOW_HandleTypeDef *flow)
+{
+    const FLOW_LevelTypeDef *lv = &flow_levels[flow->level];
+    AudioPkt_SetDecimation(flow->audio, lv->audio_decim);
+    for (uint8_t id = 0; id < flow->sched->n_jobs; id++)
+        if (flow->feature_jobs & (1UL << id))
+            Sched_SetDivider(flow->sched, id, lv->feature_div);
+}
+
+static void Flow_Step(FLOW_HandleTypeDef *flow, uint8_t level, uint8_t reason)
+{
+    flow->level = level;
+    flow->reason = reason;
+    flow->report_pending = 1;
+    Flow_Apply(flow);
+}
+
+/* Announce the current level; retried until it fits in the queue */
+static void Flow_Report(FLOW_HandleTypeDef *flow)
+{
+    uint8_t buf[TLM_OVERHEAD + TLM_FLOW_SIZE];
+    TLM_WriterTypeDef w;
+    const FLOW_LevelTypeDef *lv = &flow_levels[flow->level];
+
+    if (!flow->report_pending || !CDC_HostListening()) return;
+    if (CDC_TxQueue_Free() < sizeof(buf)) {
+        flow->stats.report_retries++;
+        return;
+    }
+
+    TLM_Begin(flow->tlm, &w, buf, TLM_CHAN_FLOW, HAL_GetTick());
+    TLM_PutU8(&w, flow->level);
+    TLM_PutU8(&w, flow->reported);
+    TLM_PutU8(&w, flow->reason);
+    TLM_PutU8(&w, lv->audio_decim);
+    TLM_PutU8(&w, (uint8_t)lv->feature_div);
+    TLM_PutU16(&w, (uint16_t)(CDC_TX_RING_SIZE - CDC_TxQueue_Free()));
+    TLM_PutU32(&w, Flow_DroppedFrames(flow));
+    if (CDC_Transmit_FS(buf, TLM_End(&w)) != USBD_OK) {
+        flow->tlm->dropped[TLM_CHAN_FLOW]++;    // seq already spent, try again
+        return;
+    }
+    flow->reported = flow->level;
+    flow->report_pending = 0;
+}
+
+/* ==== PUBLIC API ==== */
+
+/**
+ * @param feature_jobs bit n set: scheduler job n is a feature stream,
+ *        thinned at TLM_FLOW_SUMMARY
+ */
+HAL_StatusTypeDef Flow_Init(FLOW_HandleTypeDef *flow, SCHED_HandleTypeDef *sched,
+                            AUDIO_PKT_HandleTypeDef *audio, TLM_EncoderTypeDef *tlm,
+                            uint32_t feature_jobs)
+{
+    if (!flow || !sched || !audio || !tlm) return HAL_ERROR;
+    memset(flow, 0, sizeof(*flow));
+    flow->sched = sched;
+    flow->audio = audio;
+    flow->tlm = tlm;
+    flow->feature_jobs = feature_jobs;
+    Flow_Reset(flow);
+    return HAL_OK;
+}
+
+/**
+ * @brief Back to TLM_FLOW_FULL and announce it, e.g. when a host opens the port
+ */
+void Flow_Reset(FLOW_HandleTypeDef *flow)
+{
+    uint32_t now = HAL_GetTick();
+    flow->drops_seen = Flow_DropEvents(flow);
+    flow->hold_ms = FLOW_RECOVER_MS;
+    flow->down_ms = now - FLOW_SETTLE_MS;
+    flow->up_ms = now - FLOW_RECOVER_MAX_MS;
+    flow->calm_ms = now;
+    flow->reported = TLM_FLOW_FULL;
+    Flow_Step(flow, TLM_FLOW_FULL, TLM_FLOW_REASON_START);
+}
+
+/**
+ * @brief Evaluate the link and step the level if needed
+ * @note  Main loop context (scheduler job)
+ */
+void Flow_Update(FLOW_HandleTypeDef *flow)
+{
+    uint32_t now = HAL_GetTick();
+    uint32_t queued = CDC_TX_RING_SIZE - CDC_TxQueue_Free();
+    uint8_t backlog = AudioPkt_Backlog(flow->audio);
+    uint32_t drops = Flow_DropEvents(flow);
+    uint8_t dropped = drops != flow->drops_seen;
+    flow->drops_seen = drops;
+
+    uint8_t high = queued >= FLOW_HIGH_BYTES || backlog >= AUDIO_PKT_SLOT_COUNT - 1U;
+    uint8_t low = queued <= FLOW_LOW_BYTES && backlog <= 1U;
+    /* Right after a step up that held, the next one needs only the base time */
+    uint32_t hold = now - flow->up_ms < now - flow->down_ms ? FLOW_RECOVER_MS : flow->hold_ms;
+
+    if (high || dropped) {
+        flow->calm_ms = now;
+        if (flow->level + 1U < TLM_FLOW_LEVELS && now - flow->down_ms >= FLOW_SETTLE_MS) {
+            /* Undoing a recent step up: wait longer before the next one */
+            if (now - flow->up_ms < flow->hold_ms) {
+                flow->hold_ms *= 2U;
+                if (flow->hold_ms > FLOW_RECOVER_MAX_MS) flow->hold_ms = FLOW_RECOVER_MAX_MS;
+            }
+            Flow_Step(flow, (uint8_t)(flow->level + 1U),
+                      dropped ? TLM_FLOW_REASON_DROPS : TLM_FLOW_REASON_QUEUE);
+            flow->down_ms = now;
+            flow->stats.steps_down++;
+        }
+    } else if (!low) {
+        flow->calm_ms = now;
+    } else if (now - flow->calm_ms >= hold) {
+        if (flow->level > TLM_FLOW_FULL) {
+            /* The previous step up held: probe faster again */
+            Flow_Step(flow, (uint8_t)(flow->level - 1U), TLM_FLOW_REASON_DRAINED);
+            flow->up_ms = now;
+            flow->stats.steps_up++;
+        } else {
+            flow->hold_ms = FLOW_RECOVER_MS;    // stable at FULL again
+        }
+        flow->calm_ms = now;
+    }
+
+    Flow_Report(flow);
+}
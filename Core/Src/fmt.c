@@ -0,0 +1,164 @@
+/**
+ * @file fmt.c
+ * @brief Number-to-text conversions, two decimal digits per step from a table
+ */
+
+#include "fmt.h"
+#include <string.h>
+
+static const char fmt_digits2[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const uint32_t fmt_pow10[10] = {
+    1U, 10U, 100U, 1000U, 10000U, 100000U, 1000000U, 10000000U, 100000000U, 1000000000U
+};
+
+/* ==== INTERNAL HELPERS ==== */
+
+/* v in decimal, zero padded to at least min digits (<= 10), not terminated */
+static char *Fmt_Digits(char *p, uint32_t v, uint8_t min)
+{
+    char tmp[10];
+    char *t = tmp + sizeof(tmp);
+
+    while (v >= 100U) {
+        uint32_t r = v % 100U;
+        v /= 100U;
+        t -= 2;
+        memcpy(t, &fmt_digits2[2U * r], 2);
+    }
+    if (v >= 10U) {
+        t -= 2;
+        memcpy(t, &fmt_digits2[2U * v], 2);
+    } else {
+        *--t = (char)('0' + v);
+    }
+    while (t > tmp + sizeof(tmp) - min)
+        *--t = '0';
+
+    size_t n = (size_t)(tmp + sizeof(tmp) - t);
+    memcpy(p, t, n);
+    return p + n;
+}
+
+/* ==== PUBLIC API ==== */
+
+char *Fmt_Str(char *p, const char *s)
+{
+    size_t n = strlen(s);
+    memcpy(p, s, n + 1U);
+    return p + n;
+}
+
+/* As "%u" */
+char *Fmt_U32(char *p, uint32_t v)
+{
+    p = Fmt_Digits(p, v, 1);
+    *p = '\0';
+    return p;
+}
+
+/* As "%d" */
+char *Fmt_I32(char *p, int32_t v)
+{
+    if (v < 0) *p++ = '-';
+    p = Fmt_Digits(p, v < 0 ? 0U - (uint32_t)v : (uint32_t)v, 1);
+    *p = '\0';
+    return p;
+}
+
+/* As "%0*X" with digits <= 8 */
+char *Fmt_Hex(char *p, uint32_t v, uint8_t digits)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    uint8_t n = 1;
+    while (n < 8U && (v >> (4U * n)) != 0U)
+        n++;
+    if (n < digits) n = digits > 8U ? 8U : digits;
+    for (uint8_t i = n; i > 0U; i--)
+        *p++ = hex[(v >> (4U * (i - 1U))) & 0xFU];
+    *p = '\0';
+    return p;
+}
+
+/**
+ * @brief v / 10^decimals, e.g. centidegrees (2345, 2) -> "23.45", (-5, 2) -> "-0.05"
+ * @param decimals at most FMT_FIXED_MAX_DECIMALS
+ */
+char *Fmt_Fixed(char *p, int32_t v, uint8_t decimals)
+{
+    if (decimals > FMT_FIXED_MAX_DECIMALS) decimals = FMT_FIXED_MAX_DECIMALS;
+    uint32_t u = v < 0 ? 0U - (uint32_t)v : (uint32_t)v;
+    if (v < 0) *p++ = '-';
+    p = Fmt_Digits(p, u / fmt_pow10[decimals], 1);
+    if (decimals > 0U) {
+        *p++ = '.';
+        p = Fmt_Digits(p, u % fmt_pow10[decimals], decimals);
+    }
+    *p = '\0';
+    return p;
+}
+
+/**
+ * @brief As "%.*f": the exact value of x rounded half to even
+ * @param decimals at most FMT_FLOAT_MAX_DECIMALS
+ * @note  |x| >= 2^43 (8.8e12) prints "ovf"; NaN "nan", infinities "inf"/"-inf"
+ */
+char *Fmt_Float(char *p, float x, uint8_t decimals)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, 4);
+    uint32_t exp = (bits >> 23) & 0xFFU;
+    uint32_t m = bits & 0x7FFFFFU;
+
+    if (decimals > FMT_FLOAT_MAX_DECIMALS) decimals = FMT_FLOAT_MAX_DECIMALS;
+    if (exp == 0xFFU && m != 0U) return Fmt_Str(p, "nan");
+    if (bits >> 31) *p++ = '-';
+    if (exp == 0xFFU) return Fmt_Str(p, "inf");
+
+    /* x = m * 2^e exactly; scale by 10^decimals (< 2^20) in 64 bits: m * 10^d < 2^44 */
+    int32_t e = exp == 0U ? -149 : (int32_t)exp - 150;
+    if (exp != 0U) m |= 1U << 23;
+    uint64_t s = (uint64_t)m * fmt_pow10[decimals];
+    uint64_t q;
+    if (e >= 0) {
+        if (e > 19) return Fmt_Str(p, "ovf");
+        q = s << e;
+    } else if (e < -44) {
+        q = 0;                      // s / 2^-e < 1/2: rounds to zero
+    } else {
+        uint32_t sh = (uint32_t)-e;
+        uint64_t rem = s & ((1ULL << sh) - 1U);
+        uint64_t half = 1ULL << (sh - 1U);
+        q = s >> sh;
+        if (rem > half || (rem == half && (q & 1U)))
+            q++;
+    }
+
+    uint32_t p10 = fmt_pow10[decimals];
+    uint64_t ip;
+    uint32_t fr;
+    if (q <= 0xFFFFFFFFU) {         // 32-bit division: the common case
+        ip = (uint32_t)q / p10;
+        fr = (uint32_t)q % p10;
+    } else {
+        ip = q / p10;
+        fr = (uint32_t)(q % p10);
+    }
+    if (ip >= 1000000000U) {
+        p = Fmt_Digits(p, (uint32_t)(ip / 1000000000U), 1);
+        p = Fmt_Digits(p, (uint32_t)(ip % 1000000000U), 9);
+    } else {
+        p = Fmt_Digits(p, (uint32_t)ip, 1);
+    }
+    if (decimals > 0U) {
+        *p++ = '.';
+        p = Fmt_Digits(p, fr, decimals);
+    }
+    *p = '\0';
+    return p;
+}
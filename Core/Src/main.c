@@ -35,6 +35,18 @@
 #include "ens160_sensor.h"
 #include "humidity_temp_sensor.h"
 #include "microphone_sensor.h"
+#include "audio_sync.h"
+#include "audio_packetizer.h"
+#include "telemetry.h"
+#include "scheduler.h"
+#include "command.h"
+#include "bench.h"
+#include "flow_control.h"
+#include "stream_mux.h"
+#include "uart_tx.h"
+#include "dlog.h"
+#include "console.h"
+#include "fmt.h"
 #include <stdlib.h>
 #include "methods.h"
 
@@ -48,7 +60,23 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
-
+// 各输出通道的发送频率 (Hz)，周期必须是 1 ms 的整数倍
+#define RATE_PROX_HZ        50U
+#define RATE_AUDIO_LVL_HZ   100U
+#define RATE_SCHED_HZ       1U
+#define RATE_LOSS_HZ        1U
+#define RATE_FLOW_HZ        100U
+#define RATE_AUDIO_CLK_HZ   1U
+#define RATE_LOG_HZ         20U
+
+#define LOG_FRAME_PAYLOAD   256U
+
+// 发送队列紧张时低优先级通道先让出空间, 0 最高
+#define PRIO_AUDIO_CLK      0U
+#define PRIO_LOSS           1U
+#define PRIO_PROX           2U
+#define PRIO_AUDIO_LVL      2U
+#define PRIO_SCHED          3U
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -68,6 +96,14 @@ extern UART_HandleTypeDef huart1;
 // ENS160_HandleTypeDef ens160;
 // HDC302x_HandleTypeDef hdc1, hdc2, hdc3, hdc4;
 MIC_HandleTypeDef mic;
+AUDIO_SYNC_HandleTypeDef audio_sync;
+AUDIO_PKT_HandleTypeDef audio_pkt;
+TLM_EncoderTypeDef tlm;
+SCHED_HandleTypeDef sched;
+BENCH_HandleTypeDef bench;
+CMD_HandleTypeDef cmd;
+FLOW_HandleTypeDef flow;
+MUX_HandleTypeDef mux;
 
 
 /* USER CODE END PV */
@@ -76,7 +112,20 @@ MIC_HandleTypeDef mic;
 void SystemClock_Config(void);
 /* USER CODE BEGIN PFP */
 
-void Data_Send(void)
+// 帧完成后放入发送队列；队列满时跳过这一次，而不是写入后被丢弃
+// 跳过的帧同样占用该通道的序号 (TLM_Drop)，主机据此发现缺口
+static void TLM_Send(TLM_WriterTypeDef *w)
+{
+  if (CDC_Transmit_FS(w->base, TLM_End(w)) != USBD_OK)
+    tlm.dropped[w->base[3] & (TLM_CHAN_COUNT - 1U)]++;
+}
+
+// 周期输出通道都登记在复用器 (stream_mux) 中, 各有速率和优先级; 同一节拍到期的帧合并成一次写入
+// Fill_xxx 只写记录字段, 队列空间检查和丢帧计数由复用器完成
+// 慢变传感器通道只发送与上一条记录的差值 (TLM_CHAN_DELTA), 定期及丢帧后发送完整关键帧
+static TLM_DeltaTypeDef prox_delta;
+
+static void Fill_Prox(TLM_WriterTypeDef *w, void *ctx)
 {
   // uint8_t aqi;
   // uint16_t tvoc;
@@ -96,10 +145,129 @@ void Data_Send(void)
   // HDC302x_ReadData(&hdc3, &T3, &H3);
   // HDC302x_ReadData(&hdc4, &T4, &H4);
   
-  char msg[256];
-  int len = snprintf(msg, sizeof(msg), "%u,%u,%ld\n", als, ps, mic.audio_result);
-  CDC_Transmit_FS((uint8_t*)msg, len);
-  
+  UNUSED(ctx);
+  TLM_PutU16(w, als);
+  TLM_PutU16(w, ps);
+}
+
+static void Fill_AudioLevel(TLM_WriterTypeDef *w, void *ctx)
+{
+  UNUSED(ctx);
+  TLM_PutI32(w, mic.audio_result);
+}
+
+// 每秒上报一次 I2S 实际采样率 (相对 USB SOF 测得, 即主机时间), 主机据此校正音频导出的采样率和时长
+// 锁相环未进入跟踪状态时测量值为 0
+static void Fill_AudioClock(TLM_WriterTypeDef *w, void *ctx)
+{
+  AUDIO_SYNC_HandleTypeDef *sync = (AUDIO_SYNC_HandleTypeDef *)ctx;
+  TLM_PutU32(w, sync->mic->hi2s->Init.AudioFreq);
+  TLM_PutU32(w, sync->state == AUDIO_SYNC_TRACK ? (uint32_t)(AudioSync_GetRateHz(sync) * 1000.0f + 0.5f) : 0U);
+}
+
+// 每秒上报一次各任务的启动延迟/抖动 (us)，然后开始新的统计窗口
+// 复用器的任务只标记到期, 组帧耗时不计入 exec_max
+static void Fill_SchedStats(TLM_WriterTypeDef *w, void *ctx)
+{
+  SCHED_HandleTypeDef *s = (SCHED_HandleTypeDef *)ctx;
+  for (uint8_t i = 0; i < s->n_jobs; i++) {
+    const SCHED_JobStatsTypeDef *st = &s->job[i].stats;
+    TLM_PutU8(w, i);
+    TLM_PutU32(w, st->runs);
+    TLM_PutU32(w, st->overruns);
+    TLM_PutU32(w, st->runs ? st->lat_min : 0);
+    TLM_PutU32(w, st->lat_max);
+    TLM_PutU32(w, st->runs ? (uint32_t)(st->lat_sum / st->runs) : 0);
+    TLM_PutU32(w, st->exec_max);
+  }
+  Sched_ResetStats(s);
+}
+
+// 每秒上报各通道的下一个序号和设备端丢弃的帧数 (发送队列满)
+// 主机按序号缺口统计的丢帧数减去设备端丢弃数, 即链路/主机读取停顿造成的丢失
+static void Fill_LossSummary(TLM_WriterTypeDef *w, void *ctx)
+{
+  UNUSED(ctx);
+  for (uint8_t c = 0; c < TLM_CHAN_COUNT; c++) {
+    uint16_t seq = tlm.seq[c];
+    uint32_t dropped = tlm.dropped[c];
+    if (c == TLM_CHAN_AUDIO) {
+      seq = audio_pkt.seq;
+      dropped = audio_pkt.stats.packets_dropped;
+    }
+    if (seq == 0 && dropped == 0) continue;
+    TLM_PutU8(w, c);
+    TLM_PutU16(w, seq);
+    TLM_PutU32(w, dropped);
+  }
+}
+
+// 主机读取跟不上时按发送队列深度逐级降级 (音频降采样 -> 仅特征 -> 仅摘要), 队列排空后逐级恢复
+// 每次切换都在 TLM_CHAN_FLOW 上报告
+static void Job_FlowControl(void *ctx)
+{
+  Flow_Update((FLOW_HandleTypeDef *)ctx);
+}
+
+// 延迟日志 (DLOG): 调用处只记录格式编号、时刻和参数, 这里打包成 TLM_CHAN_LOG 帧
+// 由主机用固件 ELF 中的格式表格式化 (tlm_dump -e); 队列没有空间时条目留在环中下次再发
+static void Job_Log(void *ctx)
+{
+  uint8_t buf[TLM_OVERHEAD + LOG_FRAME_PAYLOAD];
+  TLM_WriterTypeDef w;
+
+  UNUSED(ctx);
+  if (!DLog_Pending() || CDC_TxQueue_Free() < sizeof(buf)) return;
+  TLM_Begin(&tlm, &w, buf, TLM_CHAN_LOG, HAL_GetTick());
+  DLog_Fill(&w, LOG_FRAME_PAYLOAD);
+  TLM_Send(&w);
+}
+
+// 主机未打开串口 (DTR=0)、挂起或拔出时暂停调度输出和音频打包, 省下 CPU 和功耗
+// 本板没有本地存储, 暂停期间的数据直接跳过, 恢复时上报暂停时长和跳过的采样数
+static uint8_t link_up;
+static uint32_t link_down_tick;
+static uint32_t link_down_skipped;
+
+static void Link_Pause(void)
+{
+  link_up = 0;
+  link_down_tick = HAL_GetTick();
+  link_down_skipped = audio_pkt.stats.samples_skipped;
+  Sched_Suspend(&sched);
+  AudioPkt_SetPaused(&audio_pkt, 1);
+  Bench_SetMode(&bench, TLM_BENCH_OFF, 0);
+  uint16_t stale = CDC_TxQueue_Discard();   // 上一个会话未发出的字节不留给下一个主机
+  DLOG("link: host gone, output paused, %u queued bytes discarded", stale);
+}
+
+static void Link_Resume(void)
+{
+  uint8_t buf[TLM_OVERHEAD + 9];
+  TLM_WriterTypeDef w;
+
+  link_up = 1;
+  Flow_Reset(&flow);    // 新的主机从满速开始
+  Mux_Reset(&mux);      // 并先收到关键帧
+  AudioPkt_SetPaused(&audio_pkt, 0);
+  Sched_ResetStats(&sched);
+  Sched_Resume(&sched);
+
+  TLM_Begin(&tlm, &w, buf, TLM_CHAN_LINK, HAL_GetTick());
+  TLM_PutU8(&w, CDC_GetLineState());
+  TLM_PutU32(&w, HAL_GetTick() - link_down_tick);
+  TLM_PutU32(&w, audio_pkt.stats.samples_skipped - link_down_skipped);
+  TLM_Send(&w);
+  DLOG("link: host connected, line state 0x%02x", CDC_GetLineState());
+}
+
+static void Link_Service(void)
+{
+  uint8_t up = CDC_HostListening();
+  if (up && !link_up)
+    Link_Resume();
+  else if (!up && link_up)
+    Link_Pause();
 }
 
 /* USER CODE END PFP */
@@ -127,7 +295,7 @@ int main(void)
   HAL_Init();
 
   /* USER CODE BEGIN Init */
-
+  DLog_Init();
   /* USER CODE END Init */
 
   /* Configure the system clock */
@@ -142,11 +310,13 @@ int main(void)
   MX_GPIO_Init();
   MX_DMA_Init();
   MX_I2C1_Init();
-  // MX_USART1_UART_Init();
+  MX_USART1_UART_Init();
   MX_I2S1_Init();
   MX_USB_DEVICE_Init();
   /* USER CODE BEGIN 2 */
   RGB_LED_Init();
+  UartTx_Init(&huart1);
+  Console_Init(CONSOLE_DEFAULT_ROUTES);
 
   // 尝试复位I2C总线，防止死锁
   // I2C_BusRecover(); // 如果实现了该函数
@@ -165,7 +335,44 @@ int main(void)
   // HDC302x_Init(&hdc3, &hi2c1, HDC302x_ADDR_46);
   // HDC302x_Init(&hdc4, &hi2c1, HDC302x_ADDR_47);
   MIC_Init(&mic, &hi2s1);
+  AudioSync_Init(&audio_sync, &mic);
+  AudioPkt_Init(&audio_pkt);
   MIC_Start(&mic);
+
+  // 任务编号即登记顺序 (命令 SET_RATE/ENABLE 和流控按编号操作)
+  // 登记失败 (超过 SCHED_MAX_JOBS 个任务) 时停机, 否则缺少的任务会让编号整体错位
+  Sched_Init(&sched);
+  Mux_Init(&mux, &tlm, &sched);
+  if (Mux_AddStream(&mux, "prox", TLM_CHAN_PROX, RATE_PROX_HZ, PRIO_PROX, 4, Fill_Prox, NULL, &prox_delta) != HAL_OK ||
+      Mux_AddStream(&mux, "audio_lvl", TLM_CHAN_AUDIO_LVL, RATE_AUDIO_LVL_HZ, PRIO_AUDIO_LVL, 4, Fill_AudioLevel,
+                    NULL, NULL) != HAL_OK ||
+      Mux_AddStream(&mux, "sched", TLM_CHAN_SCHED, RATE_SCHED_HZ, PRIO_SCHED, SCHED_MAX_JOBS * TLM_SCHED_JOB_SIZE,
+                    Fill_SchedStats, &sched, NULL) != HAL_OK ||
+      Mux_AddStream(&mux, "loss", TLM_CHAN_LOSS, RATE_LOSS_HZ, PRIO_LOSS, TLM_CHAN_COUNT * TLM_LOSS_ENTRY_SIZE,
+                    Fill_LossSummary, NULL, NULL) != HAL_OK ||
+      Sched_AddJob(&sched, "flow", Job_FlowControl, &flow, RATE_FLOW_HZ) != HAL_OK ||
+      Mux_AddStream(&mux, "audio_clk", TLM_CHAN_AUDIO_CLK, RATE_AUDIO_CLK_HZ, PRIO_AUDIO_CLK, TLM_AUDIO_CLK_SIZE,
+                    Fill_AudioClock, &audio_sync, NULL) != HAL_OK ||
+      Sched_AddJob(&sched, "log", Job_Log, NULL, RATE_LOG_HZ) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  // 降到 SUMMARY 级别时只对特征任务 (prox, audio_lvl) 抽稀, 统计类任务保持原速
+  if (Flow_Init(&flow, &sched, &audio_pkt, &tlm,
+                Mux_JobMask(&mux, (1UL << TLM_CHAN_PROX) | (1UL << TLM_CHAN_AUDIO_LVL))) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  Sched_Start(&sched);
+
+  // 主机命令通道: 可在线调整各通道速率、启停任务、切换音频模式
+  Bench_Init(&bench, &tlm);
+  Cmd_Init(&cmd, &sched, &audio_pkt, &bench, &tlm);
+
+  DLOG("boot: sysclk %u Hz, I2S %u Hz", HAL_RCC_GetSysClockFreq(), hi2s1.Init.AudioFreq);
+
+  // 上电时还没有主机打开串口
+  Link_Pause();
  
   /* USER CODE END 2 */
 
@@ -175,7 +382,13 @@ int main(void)
   {
 
     /* USER CODE END WHILE */
-    Data_Send();
+    CDC_TxQueue_Kick();
+    Link_Service();
+    Cmd_Poll(&cmd);
+    Bench_Service(&bench);
+    Sched_RunPending(&sched);
+    Mux_Service(&mux);
+    Sched_Idle(&sched);
     // HAL_Delay(1000);
     // I2C_Scan();
 
@@ -252,8 +465,19 @@ float T1, H1, T2, H2, T3, H3, T4, H4;
         HTS_ReadData(&hts3, &T3, &H3);
         HTS_ReadData(&hts4, &T4, &H4);
 
-        printf("[S1] T=%.2f°C RH=%.1f%% | [S2] T=%.2f°C RH=%.1f%%\r\n", T1, H1, T2, H2);
-        printf("[S3] T=%.2f°C RH=%.1f%% | [S4] T=%.2f°C RH=%.1f%%\r\n", T3, H3, T4, H4);
+        // 未链接 _printf_float, 浮点数用 Fmt_Float 转换
+        const float T[4] = { T1, T2, T3, T4 }, H[4] = { H1, H2, H3, H4 };
+        char line[48], *p;
+        for (int i = 0; i < 4; i++) {
+            p = Fmt_Str(line, "[S");
+            p = Fmt_U32(p, i + 1);
+            p = Fmt_Str(p, "] T=");
+            p = Fmt_Float(p, T[i], 2);
+            p = Fmt_Str(p, "°C RH=");
+            p = Fmt_Float(p, H[i], 1);
+            Fmt_Str(p, "%\r\n");
+            fputs(line, stdout);
+        }
 
 
 uint16_t als, ps;
@@ -50,10 +50,12 @@ void USART_Print(const char *format, ...)
     char buffer[128];
     va_list args;
     va_start(args, format);
-    vsnprintf(buffer, sizeof(buffer), format, args);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
     va_end(args);
-    // 发送格式化的字符串通过UART
-    HAL_UART_Transmit(&huart1, (uint8_t *)buffer, strlen(buffer), 100);
+    if (len <= 0) return;
+    if (len >= (int)sizeof(buffer)) len = sizeof(buffer) - 1;
+    // 放入 DMA 发送环, 立即返回; 环满时整条丢弃并计数 (uart_tx_stats)
+    UartTx_Write((const uint8_t *)buffer, (uint16_t)len);
 }
 void Send_Raw_Bytes(uint16_t data)
 {
@@ -63,16 +65,14 @@ void Send_Raw_Bytes(uint16_t data)
     bytes[0] = (uint8_t)(data & 0xFF);        // 低字节 (LSB)
     bytes[1] = (uint8_t)((data >> 8) & 0xFF); // 高字节 (MSB)
     
-    // 发送字节数据
-    HAL_UART_Transmit(&huart1, bytes, 2, HAL_MAX_DELAY);
+    UartTx_Write(bytes, 2);
 }
 
 void Send_Buffer_Bytes(uint16_t *buffer, uint16_t count)
 {
-    for (uint16_t i = 0; i < count; i++)
-    {
-        Send_Raw_Bytes(buffer[i]);
-    }
+    // 小端内存布局即低字节在前, 与 Send_Raw_Bytes 相同; 整块一次写入
+    if (count > 0x7FFFU) count = 0x7FFFU;     // 超过环大小, 由 UartTx_Write 丢弃计数
+    UartTx_Write((const uint8_t *)buffer, (uint16_t)(count * 2U));
 }
 
 void I2C_Scan(void)
@@ -99,7 +99,23 @@ void USB_Print(const char *format, ...)
     va_start(args, format);
     int len = vsnprintf(buffer, sizeof(buffer), format, args);
     va_end(args);
-    CDC_Transmit_FS((uint8_t*)buffer, len);
+    if (len <= 0) return;
+    if (len >= (int)sizeof(buffer)) len = sizeof(buffer) - 1;
+    // Console port, kept out of the telemetry stream
+    CDC_Log_Write((const uint8_t*)buffer, (uint16_t)len);
+}
+
+/**
+ * @brief 使能 DWT 周期计数器, 供 CYCLE_COUNT() 做性能测量
+ */
+void DWT_CycleCounter_Init(void)
+{
+    if (!(CoreDebug->DEMCR & CoreDebug_DEMCR_TRCENA_Msk))
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
 }
 
 /* ==== I2C Protected Transfer Functions ==== */
@@ -5,8 +5,7 @@
 
 #include "microphone_sensor.h"
 #include <string.h>
-__attribute__((section(".bss"))) uint32_t dma_buffer[4];// 原始DMA接收缓冲
-extern uint32_t  dma_buffer[MIC_BUFFER_SIZE]; 
+__attribute__((section(".bss"))) uint32_t dma_buffer[MIC_DMA_XFER_WORDS];// 原始DMA接收缓冲
 
 HAL_StatusTypeDef MIC_Init(MIC_HandleTypeDef *mic, I2S_HandleTypeDef *hi2s)
 {
@@ -15,6 +14,7 @@ HAL_StatusTypeDef MIC_Init(MIC_HandleTypeDef *mic, I2S_HandleTypeDef *hi2s)
     mic->half_ready = 0;
     mic->full_ready = 0;
     mic->audio_result = 0;
+    mic->block_count = 0;
     return HAL_OK;
 }
 
@@ -28,4 +28,33 @@ HAL_StatusTypeDef MIC_Start(MIC_HandleTypeDef *mic)
     return HAL_I2S_Receive_DMA(mic->hi2s, (uint16_t*)dma_buffer, MIC_BUFFER_SIZE);
 }
 
+/**
+ * @brief 解码一个立体声帧的左声道 (符号扩展到 32bit)
+ */
+int32_t MIC_DecodeFrame(const uint32_t *frame)
+{
+    uint32_t val = MIC_UNPACK24(frame[0], frame[1]);
+    if (val & 0x800000)
+        return (int32_t)(val | 0xFF000000); // 符号扩展
+    return (int32_t)val;
+}
+
+/**
+ * @brief 半缓冲完成处理, 在 I2S DMA 回调中调用
+ * @param second_half 0: 半传输回调, 1: 全传输回调
+ * @retval 刚完成的半缓冲起始地址 (MIC_FRAMES_PER_HALF 帧)
+ */
+const uint32_t *MIC_ProcessBlock(MIC_HandleTypeDef *mic, uint8_t second_half)
+{
+    const uint32_t *block = &dma_buffer[second_half ? (MIC_DMA_XFER_WORDS / 2) : 0];
+
+    mic->audio_result = MIC_DecodeFrame(block);
+    if (second_half)
+        mic->full_ready = 1;
+    else
+        mic->half_ready = 1;
+    mic->block_count++;
+    return block;
+}
+
 
@@ -0,0 +1,282 @@
+/**
+ * @file scheduler.c
+ * @brief TIM2 driven periodic job scheduler implementation
+ *
+ * TIM2 is programmed at register level (the HAL TIM driver is not part of
+ * this build): PSC divides the APB1 timer clock down to 1 MHz, ARR is left
+ * at 0xFFFFFFFF and CC1 in frozen output-compare mode provides the tick.
+ */
+
+#include "scheduler.h"
+#include <string.h>
+
+/* ==== INTERNAL HELPERS ==== */
+static uint32_t Sched_TimerClock(void)
+{
+    /* APB1 timers run at 2 x PCLK1 whenever the APB1 prescaler is not 1 */
+    uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+    if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1)
+        pclk1 *= 2U;
+    return pclk1;
+}
+
+/* Period in us for rate_hz, or 0 if it is not a whole number of ticks */
+static uint32_t Sched_PeriodOf(uint32_t rate_hz)
+{
+    if (rate_hz == 0U) return 0;
+    uint32_t period = SCHED_TIMEBASE_HZ / rate_hz;
+    if (period * rate_hz != SCHED_TIMEBASE_HZ || period % SCHED_TICK_US != 0U) return 0;
+    return period;
+}
+
+/* First tick-aligned release one period from now */
+static uint32_t Sched_FirstDue(const SCHED_HandleTypeDef *sched, uint32_t period)
+{
+    uint32_t due = sched->tim->CNT + period;
+    return due - due % SCHED_TICK_US;
+}
+
+static void Sched_ClearStats(SCHED_JobStatsTypeDef *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->lat_min = UINT32_MAX;
+}
+
+/* ==== PUBLIC API ==== */
+
+/**
+ * @brief Configure TIM2 as the 1 MHz timebase (counter stopped)
+ */
+HAL_StatusTypeDef Sched_Init(SCHED_HandleTypeDef *sched)
+{
+    if (!sched) return HAL_ERROR;
+    memset(sched, 0, sizeof(*sched));
+    sched->tim = SCHED_TIM;
+
+    uint32_t clk = Sched_TimerClock();
+    if (clk % SCHED_TIMEBASE_HZ != 0U) return HAL_ERROR;
+
+    __HAL_RCC_TIM2_CLK_ENABLE();
+    TIM_TypeDef *tim = sched->tim;
+    tim->CR1 = 0;
+    tim->DIER = 0;
+    tim->PSC = clk / SCHED_TIMEBASE_HZ - 1U;
+    tim->ARR = 0xFFFFFFFFU;
+    tim->CCMR1 = 0;             // CC1 output compare, frozen: interrupt only
+    tim->CCER = 0;
+    tim->CNT = 0;
+    tim->CCR1 = SCHED_TICK_US;
+    tim->EGR = TIM_EGR_UG;      // load PSC now
+    tim->SR = 0;
+    return HAL_OK;
+}
+
+/**
+ * @brief Register a job released rate_hz times per second
+ * @note  The period must be a whole number of ticks
+ */
+HAL_StatusTypeDef Sched_AddJob(SCHED_HandleTypeDef *sched, const char *name, SCHED_JobFn fn,
+                               void *ctx, uint32_t rate_hz)
+{
+    if (!sched || !fn || sched->n_jobs >= SCHED_MAX_JOBS) return HAL_ERROR;
+
+    uint32_t period = Sched_PeriodOf(rate_hz);
+    if (period == 0U) return HAL_ERROR;
+
+    SCHED_JobTypeDef *j = &sched->job[sched->n_jobs];
+    memset(j, 0, sizeof(*j));
+    j->name = name;
+    j->fn = fn;
+    j->ctx = ctx;
+    j->period_us = period;
+    j->due_us = Sched_FirstDue(sched, period);
+    j->enabled = 1;
+    j->divider = 1;
+    Sched_ClearStats(&j->stats);
+    sched->n_jobs++;
+    return HAL_OK;
+}
+
+/**
+ * @brief Enable the tick interrupt and start counting
+ */
+HAL_StatusTypeDef Sched_Start(SCHED_HandleTypeDef *sched)
+{
+    if (!sched) return HAL_ERROR;
+    TIM_TypeDef *tim = sched->tim;
+
+    tim->SR = 0;
+    tim->DIER = TIM_DIER_CC1IE;
+    HAL_NVIC_SetPriority(SCHED_TIM_IRQn, SCHED_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(SCHED_TIM_IRQn);
+    tim->CR1 = TIM_CR1_CEN;
+    return HAL_OK;
+}
+
+/**
+ * @brief Stop the tick interrupt; nothing is released until Sched_Resume()
+ * @note  The timebase keeps counting, so Sched_Micros() stays valid, and the
+ *        CPU only wakes for other interrupts
+ */
+void Sched_Suspend(SCHED_HandleTypeDef *sched)
+{
+    sched->tim->DIER &= ~TIM_DIER_CC1IE;
+    sched->suspended = 1;
+}
+
+/**
+ * @brief Restart the tick; every job is next released one period from now
+ *        (no catch-up burst for the time spent suspended)
+ */
+void Sched_Resume(SCHED_HandleTypeDef *sched)
+{
+    if (!sched->suspended) return;
+    TIM_TypeDef *tim = sched->tim;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint8_t i = 0; i < sched->n_jobs; i++)
+        sched->job[i].due_us = Sched_FirstDue(sched, sched->job[i].period_us);
+    /* Next tick boundary, far enough ahead not to be passed before CC1IE is set */
+    uint32_t now = tim->CNT;
+    uint32_t next = now - now % SCHED_TICK_US + SCHED_TICK_US;
+    if (next - now < SCHED_TICK_US / 2U)
+        next += SCHED_TICK_US;
+    tim->CCR1 = next;
+    tim->SR = (uint32_t)~TIM_SR_CC1IF;
+    tim->DIER |= TIM_DIER_CC1IE;
+    sched->suspended = 0;
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Change the rate of a registered job; the new cadence starts one
+ *        period from now
+ * @note  Main loop context
+ */
+HAL_StatusTypeDef Sched_SetRate(SCHED_HandleTypeDef *sched, uint8_t id, uint32_t rate_hz)
+{
+    if (!sched || id >= sched->n_jobs) return HAL_ERROR;
+    uint32_t period = Sched_PeriodOf(rate_hz);
+    if (period == 0U) return HAL_ERROR;
+
+    SCHED_JobTypeDef *j = &sched->job[id];
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    j->period_us = period;
+    j->due_us = Sched_FirstDue(sched, period);
+    __set_PRIMASK(primask);
+    Sched_ClearStats(&j->stats);
+    return HAL_OK;
+}
+
+/**
+ * @brief Stop or resume releasing a job (a run already released completes)
+ */
+HAL_StatusTypeDef Sched_EnableJob(SCHED_HandleTypeDef *sched, uint8_t id, uint8_t enable)
+{
+    if (!sched || id >= sched->n_jobs) return HAL_ERROR;
+    sched->job[id].enabled = enable ? 1U : 0U;
+    return HAL_OK;
+}
+
+/**
+ * @brief Release a job only on every divider-th due time (1 = every time);
+ *        rate and cadence are kept, so divider 1 restores the configured rate
+ */
+HAL_StatusTypeDef Sched_SetDivider(SCHED_HandleTypeDef *sched, uint8_t id, uint16_t divider)
+{
+    if (!sched || id >= sched->n_jobs || divider == 0U) return HAL_ERROR;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    sched->job[id].divider = divider;
+    sched->job[id].div_count = 0;
+    __set_PRIMASK(primask);
+    return HAL_OK;
+}
+
+/**
+ * @brief Tick: release every job whose time has come
+ * @note  Called from TIM2_IRQHandler
+ */
+void Sched_OnTick(SCHED_HandleTypeDef *sched)
+{
+    TIM_TypeDef *tim = sched->tim;
+    if ((tim->SR & TIM_SR_CC1IF) == 0U) return;
+    tim->SR = (uint32_t)~TIM_SR_CC1IF;   // rc_w0: write 0 to clear only CC1IF
+
+    uint32_t now = tim->CCR1;   // exact time of this tick
+    uint32_t next = now + SCHED_TICK_US;
+    /* Interrupt held off past the next tick: skip it rather than wait for the wrap */
+    while ((int32_t)(tim->CNT - next) >= 0)
+        next += SCHED_TICK_US;
+    tim->CCR1 = next;
+    sched->ticks++;
+
+    for (uint8_t i = 0; i < sched->n_jobs; i++) {
+        SCHED_JobTypeDef *j = &sched->job[i];
+        if ((int32_t)(now - j->due_us) < 0) continue;
+        /* A disabled job keeps its cadence so re-enabling it does not burst */
+        if (j->enabled && ++j->div_count >= j->divider) {
+            j->div_count = 0;
+            if (j->pending) {
+                j->stats.overruns++;
+            } else {
+                j->release_us = j->due_us;
+                j->pending = 1;
+            }
+        }
+        j->due_us += j->period_us;
+    }
+}
+
+/**
+ * @brief Run released jobs in registration order
+ * @note  Main loop context
+ */
+void Sched_RunPending(SCHED_HandleTypeDef *sched)
+{
+    for (uint8_t i = 0; i < sched->n_jobs; i++) {
+        SCHED_JobTypeDef *j = &sched->job[i];
+        if (!j->pending) continue;
+
+        uint32_t start = sched->tim->CNT;
+        j->fn(j->ctx);
+        uint32_t end = sched->tim->CNT;
+
+        SCHED_JobStatsTypeDef *st = &j->stats;
+        uint32_t lat = start - j->release_us;
+        uint32_t exec = end - start;
+        st->runs++;
+        st->lat_last = lat;
+        st->lat_sum += lat;
+        if (lat < st->lat_min) st->lat_min = lat;
+        if (lat > st->lat_max) st->lat_max = lat;
+        if (exec > st->exec_max) st->exec_max = exec;
+        /* Cleared after the run: a release during a long run counts as an overrun */
+        j->pending = 0;
+    }
+}
+
+/**
+ * @brief Sleep until the next interrupt unless a job is already released
+ */
+void Sched_Idle(SCHED_HandleTypeDef *sched)
+{
+    __disable_irq();
+    uint8_t busy = 0;
+    for (uint8_t i = 0; i < sched->n_jobs; i++)
+        busy |= sched->job[i].pending;
+    if (!busy)
+        __WFI();                // wakes on a pending interrupt even with PRIMASK set
+    __enable_irq();
+}
+
+/**
+ * @brief Start a new statistics window for every job
+ */
+void Sched_ResetStats(SCHED_HandleTypeDef *sched)
+{
+    for (uint8_t i = 0; i < sched->n_jobs; i++)
+        Sched_ClearStats(&sched->job[i].stats);
+}
@@ -23,6 +23,9 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include "microphone_sensor.h"
+#include "audio_packetizer.h"
+#include "scheduler.h"
+#include "uart_tx.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -58,10 +61,13 @@
 /* External variables --------------------------------------------------------*/
 extern PCD_HandleTypeDef hpcd_USB_OTG_FS;
 extern DMA_HandleTypeDef hdma_spi1_rx;
+extern DMA_HandleTypeDef hdma_usart1_tx;
+extern UART_HandleTypeDef huart1;
 /* USER CODE BEGIN EV */
 extern MIC_HandleTypeDef mic;
 extern I2S_HandleTypeDef hi2s1;
-extern uint32_t dma_buffer[4];
+extern AUDIO_PKT_HandleTypeDef audio_pkt;
+extern SCHED_HandleTypeDef sched;
 
 
 /* USER CODE END EV */
@@ -218,6 +224,20 @@ void DMA2_Stream0_IRQHandler(void)
   /* USER CODE END DMA2_Stream0_IRQn 1 */
 }
 
+/**
+  * @brief This function handles USART1 global interrupt.
+  */
+void USART1_IRQHandler(void)
+{
+  /* USER CODE BEGIN USART1_IRQn 0 */
+
+  /* USER CODE END USART1_IRQn 0 */
+  HAL_UART_IRQHandler(&huart1);
+  /* USER CODE BEGIN USART1_IRQn 1 */
+
+  /* USER CODE END USART1_IRQn 1 */
+}
+
 /**
   * @brief This function handles USB On The Go FS global interrupt.
   */
@@ -232,25 +252,36 @@ void OTG_FS_IRQHandler(void)
   /* USER CODE END OTG_FS_IRQn 1 */
 }
 
-/* USER CODE BEGIN 1 */
-void HAL_I2S_RxHalfCpltCallback(I2S_HandleTypeDef *hi2s)
+/**
+  * @brief This function handles DMA2 stream7 global interrupt.
+  */
+void DMA2_Stream7_IRQHandler(void)
 {
-  if (hi2s == &hi2s1)
-  {
+  /* USER CODE BEGIN DMA2_Stream7_IRQn 0 */
 
-    // static uint16_t cb_cnt = 0;
-    // cb_cnt++; // 回调次数计数
+  /* USER CODE END DMA2_Stream7_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_usart1_tx);
+  /* USER CODE BEGIN DMA2_Stream7_IRQn 1 */
 
-    uint32_t val = (dma_buffer[0]<<8) + (dma_buffer[1]>>8);
-    if (val & 0x800000)
-      mic.audio_result = val | 0xFF000000; // 符号扩展
-    else
-      mic.audio_result = val;
+  /* USER CODE END DMA2_Stream7_IRQn 1 */
+}
 
-    mic.half_ready = 1;
+/* USER CODE BEGIN 1 */
+/**
+  * @brief This function handles TIM2 global interrupt (output scheduler tick).
+  */
+void TIM2_IRQHandler(void)
+{
+  Sched_OnTick(&sched);
+}
 
-    // if (cb_cnt % 10 == 0)
-    //   Debug_Print("%d\n", mic.audio_buffer[0]);
+void HAL_I2S_RxHalfCpltCallback(I2S_HandleTypeDef *hi2s)
+{
+  if (hi2s == &hi2s1)
+  {
+    uint32_t first_frame = mic.block_count * MIC_FRAMES_PER_HALF;
+    const uint32_t *block = MIC_ProcessBlock(&mic, 0);
+    AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, first_frame);
   }
 }
 
@@ -258,8 +289,15 @@ void HAL_I2S_RxCpltCallback(I2S_HandleTypeDef *hi2s)
 {
   if (hi2s == &hi2s1)
   {
-    mic.full_ready = 1;
+    uint32_t first_frame = mic.block_count * MIC_FRAMES_PER_HALF;
+    const uint32_t *block = MIC_ProcessBlock(&mic, 1);
+    AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, first_frame);
   }
 }
 
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+  UartTx_OnComplete(huart);
+}
+
 /* USER CODE END 1 */
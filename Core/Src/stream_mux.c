@@ -0,0 +1,144 @@
+/**
+ * @file stream_mux.c
+ * @brief Telemetry stream multiplexer implementation
+ */
+
+#include "stream_mux.h"
+#include "usbd_cdc_if.h"
+#include <string.h>
+
+/* ==== INTERNAL HELPERS ==== */
+
+/* Scheduler job of a stream: only marks it, Mux_Service() builds the frame */
+static void Mux_Release(void *ctx)
+{
+    ((MUX_StreamTypeDef *)ctx)->due = 1;
+}
+
+/* Queue the staged frames in one write; a failed write drops all of them */
+static void Mux_Flush(MUX_HandleTypeDef *mux, uint16_t len, const uint8_t *ids, uint8_t n)
+{
+    if (n == 0U) return;
+    if (CDC_Transmit_FS(mux->batch, len) != USBD_OK) {
+        for (uint8_t i = 0; i < n; i++) {
+            MUX_StreamTypeDef *s = &mux->stream[ids[i]];
+            mux->tlm->dropped[s->chan]++;       // seq already spent
+            s->stats.dropped++;
+        }
+        return;
+    }
+    for (uint8_t i = 0; i < n; i++)
+        mux->stream[ids[i]].stats.frames++;
+    mux->stats.batches++;
+    mux->stats.frames += n;
+    if (n > mux->stats.max_frames) mux->stats.max_frames = n;
+}
+
+/* ==== PUBLIC API ==== */
+
+HAL_StatusTypeDef Mux_Init(MUX_HandleTypeDef *mux, TLM_EncoderTypeDef *tlm, SCHED_HandleTypeDef *sched)
+{
+    if (!mux || !tlm || !sched) return HAL_ERROR;
+    memset(mux, 0, sizeof(*mux));
+    mux->tlm = tlm;
+    mux->sched = sched;
+    return HAL_OK;
+}
+
+/**
+ * @brief Register a producer; its scheduler job id is stream->job
+ * @param prio 0 (highest) .. MUX_PRIO_LEVELS - 1
+ * @param max_len record bytes the fill function appends at most
+ * @param delta reference of a delta coded channel (TLM_EndDelta), or NULL
+ */
+HAL_StatusTypeDef Mux_AddStream(MUX_HandleTypeDef *mux, const char *name, uint8_t chan, uint32_t rate_hz,
+                                uint8_t prio, uint16_t max_len, MUX_FillFn fill, void *ctx,
+                                TLM_DeltaTypeDef *delta)
+{
+    if (!mux || !fill || mux->n_streams >= MUX_MAX_STREAMS || chan >= TLM_CHAN_COUNT ||
+        prio >= MUX_PRIO_LEVELS || TLM_OVERHEAD + max_len > MUX_BATCH_SIZE)
+        return HAL_ERROR;
+
+    MUX_StreamTypeDef *s = &mux->stream[mux->n_streams];
+    memset(s, 0, sizeof(*s));
+    s->job = mux->sched->n_jobs;
+    if (Sched_AddJob(mux->sched, name, Mux_Release, s, rate_hz) != HAL_OK) return HAL_ERROR;
+    s->chan = chan;
+    s->prio = prio;
+    s->max_len = max_len;
+    s->fill = fill;
+    s->ctx = ctx;
+    s->delta = delta;
+    if (delta) TLM_DeltaReset(delta);
+
+    /* Insertion by priority, stable */
+    uint8_t i = mux->n_streams;
+    while (i > 0 && mux->stream[mux->order[i - 1U]].prio > prio) {
+        mux->order[i] = mux->order[i - 1U];
+        i--;
+    }
+    mux->order[i] = mux->n_streams++;
+    return HAL_OK;
+}
+
+/**
+ * @brief Scheduler job bits of the streams on the given channels (Flow_Init)
+ * @param chans one bit per TLM channel id
+ */
+uint32_t Mux_JobMask(const MUX_HandleTypeDef *mux, uint32_t chans)
+{
+    uint32_t jobs = 0;
+    for (uint8_t i = 0; i < mux->n_streams; i++)
+        if ((chans >> mux->stream[i].chan) & 1U) jobs |= 1UL << mux->stream[i].job;
+    return jobs;
+}
+
+/**
+ * @brief Build every due stream, highest priority first, into shared queue writes
+ * @note  Main loop context, right after Sched_RunPending()
+ */
+void Mux_Service(MUX_HandleTypeDef *mux)
+{
+    uint8_t ids[MUX_MAX_STREAMS];
+    uint8_t n = 0;
+    uint16_t pos = 0;
+    uint32_t free = CDC_TxQueue_Free();
+
+    for (uint8_t k = 0; k < mux->n_streams; k++) {
+        uint8_t id = mux->order[k];
+        MUX_StreamTypeDef *s = &mux->stream[id];
+        if (!s->due) continue;
+        s->due = 0;
+
+        uint16_t need = (uint16_t)(TLM_OVERHEAD + s->max_len);
+        if (pos + need > MUX_BATCH_SIZE) {
+            Mux_Flush(mux, pos, ids, n);
+            free = CDC_TxQueue_Free();
+            pos = 0;
+            n = 0;
+        }
+        if (free < pos + need + (uint32_t)s->prio * MUX_PRIO_HEADROOM) {
+            TLM_Drop(mux->tlm, s->chan);
+            s->stats.dropped++;
+            continue;
+        }
+
+        TLM_WriterTypeDef w;
+        TLM_Begin(mux->tlm, &w, &mux->batch[pos], s->chan, HAL_GetTick());
+        s->fill(&w, s->ctx);
+        pos = (uint16_t)(pos + (s->delta ? TLM_EndDelta(mux->tlm, &w, s->delta) : TLM_End(&w)));
+        ids[n++] = id;
+    }
+    Mux_Flush(mux, pos, ids, n);
+}
+
+/**
+ * @brief Delta coded streams start over with a keyframe (a new host)
+ */
+void Mux_Reset(MUX_HandleTypeDef *mux)
+{
+    for (uint8_t i = 0; i < mux->n_streams; i++) {
+        mux->stream[i].due = 0;
+        if (mux->stream[i].delta) TLM_DeltaReset(mux->stream[i].delta);
+    }
+}
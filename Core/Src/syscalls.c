@@ -29,6 +29,8 @@
 #include <time.h>
 #include <sys/time.h>
 #include <sys/times.h>
+#include <unistd.h>
+#include "console.h"
 
 
 /* Variables */
@@ -64,29 +66,26 @@ void _exit (int status)
   while (1) {}    /* Make sure we hang here */
 }
 
+/* stdin: what was typed into the USB console, never waits (console.h) */
 __attribute__((weak)) int _read(int file, char *ptr, int len)
 {
-  (void)file;
-  int DataIdx;
-
-  for (DataIdx = 0; DataIdx < len; DataIdx++)
+  if (file != STDIN_FILENO)
   {
-    *ptr++ = __io_getchar();
+    errno = EBADF;
+    return -1;
   }
-
-  return len;
+  return Console_Read(ptr, len);
 }
 
+/* stdout/stderr: queued on the console rings, never waits (console.h) */
 __attribute__((weak)) int _write(int file, char *ptr, int len)
 {
-  (void)file;
-  int DataIdx;
-
-  for (DataIdx = 0; DataIdx < len; DataIdx++)
+  if (file != STDOUT_FILENO && file != STDERR_FILENO)
   {
-    __io_putchar(*ptr++);
+    errno = EBADF;
+    return -1;
   }
-  return len;
+  return Console_Write(ptr, len);
 }
 
 int _close(int file)
@@ -0,0 +1,393 @@
+/**
+ * @file telemetry.c
+ * @brief Binary telemetry framing: encoder and reference stream decoder
+ */
+
+#include "telemetry.h"
+
+/* ==== CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), table driven ==== */
+static const uint16_t tlm_crc_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0,
+};
+
+uint16_t TLM_CRC16(uint16_t crc, const uint8_t *data, size_t len)
+{
+    while (len--)
+        crc = (uint16_t)((crc << 8) ^ tlm_crc_table[(uint8_t)((crc >> 8) ^ *data++)]);
+    return crc;
+}
+
+/* ==== ENCODER ==== */
+
+/**
+ * @brief Write a frame header in place (payload is filled by the caller)
+ */
+void TLM_WriteHeader(uint8_t *buf, uint8_t chan, uint16_t seq, uint32_t ts, uint16_t len)
+{
+    buf[0] = TLM_SYNC0;
+    buf[1] = TLM_SYNC1;
+    buf[2] = TLM_VERSION;
+    buf[3] = chan;
+    memcpy(&buf[4], &seq, 2);
+    memcpy(&buf[6], &ts, 4);
+    memcpy(&buf[10], &len, 2);
+}
+
+/**
+ * @brief Append the CRC to a frame whose header and payload are complete
+ * @retval total frame length in bytes
+ */
+uint16_t TLM_Seal(uint8_t *frame)
+{
+    uint16_t len = TLM_GetU16(&frame[10]);
+    uint16_t crc = TLM_CRC16(0xFFFF, &frame[2], TLM_HEADER_SIZE - 2U + len);
+    memcpy(&frame[TLM_HEADER_SIZE + len], &crc, 2);
+    return (uint16_t)(TLM_OVERHEAD + len);
+}
+
+/**
+ * @brief Start a frame in buf; fields are appended with TLM_PutXxx()
+ */
+void TLM_Begin(TLM_EncoderTypeDef *enc, TLM_WriterTypeDef *w, uint8_t *buf, uint8_t chan, uint32_t ts)
+{
+    TLM_WriteHeader(buf, chan, enc->seq[chan & (TLM_CHAN_COUNT - 1U)]++, ts, 0);
+    w->base = buf;
+    w->p = buf + TLM_HEADER_SIZE;
+}
+
+/**
+ * @brief Finish the frame started by TLM_Begin()
+ * @retval total frame length in bytes
+ */
+uint16_t TLM_End(TLM_WriterTypeDef *w)
+{
+    uint16_t len = (uint16_t)(w->p - w->base - TLM_HEADER_SIZE);
+    memcpy(&w->base[10], &len, 2);
+    return TLM_Seal(w->base);
+}
+
+/* ==== DELTA CODING ==== */
+
+/* Field widths of one record group; HUMTEMP repeats its group per sensor */
+typedef struct {
+    uint8_t chan;
+    uint8_t size;           // group bytes
+    uint8_t fields;
+    uint8_t width[3];
+} TLM_DeltaLayoutTypeDef;
+
+static const TLM_DeltaLayoutTypeDef tlm_delta_layout[] = {
+    { TLM_CHAN_PROX,    4, 2, { 2, 2 } },       // als, ps
+    { TLM_CHAN_GAS,     5, 3, { 1, 2, 2 } },    // aqi, tvoc, eco2
+    { TLM_CHAN_HUMTEMP, 4, 2, { 2, 2 } },       // centi-degC, centi-%RH
+};
+
+static const TLM_DeltaLayoutTypeDef *TLM_DeltaLayout(uint8_t chan, uint16_t len)
+{
+    for (size_t i = 0; i < sizeof(tlm_delta_layout) / sizeof(tlm_delta_layout[0]); i++)
+        if (tlm_delta_layout[i].chan == chan)
+            return len <= TLM_DELTA_MAX_RECORD && len % tlm_delta_layout[i].size == 0U
+                   ? &tlm_delta_layout[i] : NULL;
+    return NULL;
+}
+
+static uint32_t TLM_GetField(const uint8_t *p, uint8_t width)
+{
+    uint32_t v = 0;
+    memcpy(&v, p, width);
+    return v;
+}
+
+/**
+ * @brief Delta of rec against ref into out[cap]
+ * @retval bytes written without the trailing zero differences, -1 if over cap
+ */
+static int TLM_DeltaCode(const TLM_DeltaLayoutTypeDef *lay, const uint8_t *rec, const uint8_t *ref,
+                         uint16_t len, uint8_t *out, uint16_t cap)
+{
+    uint16_t n = 0, used = 0, off = 0;
+
+    while (off < len) {
+        for (uint8_t i = 0; i < lay->fields; i++) {
+            uint8_t width = lay->width[i];
+            uint8_t shift = (uint8_t)(32U - 8U * width);
+            int32_t d = (int32_t)((TLM_GetField(rec + off, width) - TLM_GetField(ref + off, width)) << shift) >> shift;
+            uint32_t z = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+            do {
+                if (n >= cap) return -1;
+                out[n++] = (uint8_t)((z & 0x7FU) | (z > 0x7FU ? 0x80U : 0U));
+                z >>= 7;
+            } while (z);
+            if (out[n - 1] != 0U) used = n;     // only a zero difference ends in 0x00
+            off = (uint16_t)(off + width);
+        }
+    }
+    return used;
+}
+
+void TLM_DeltaReset(TLM_DeltaTypeDef *d)
+{
+    d->valid = 0;
+}
+
+/**
+ * @brief Finish the frame started by TLM_Begin(), delta coded when possible
+ *
+ * The plain record becomes the reference either way; a frame that then
+ * fails to queue must be counted in enc->dropped so the next one is a key.
+ * @retval total frame length in bytes
+ */
+uint16_t TLM_EndDelta(TLM_EncoderTypeDef *enc, TLM_WriterTypeDef *w, TLM_DeltaTypeDef *d)
+{
+    uint8_t *rec = w->base + TLM_HEADER_SIZE;
+    uint16_t len = (uint16_t)(w->p - rec);
+    uint8_t chan = w->base[3] & (TLM_CHAN_COUNT - 1U);
+    uint16_t seq = TLM_GetU16(&w->base[4]);
+    const TLM_DeltaLayoutTypeDef *lay = TLM_DeltaLayout(chan, len);
+    uint8_t delta[TLM_DELTA_MAX_RECORD];
+    int n = -1;
+
+    if (lay == NULL) {
+        d->valid = 0;
+        return TLM_End(w);
+    }
+    if (d->valid && d->ref_len == len && d->ref_seq == (uint16_t)(seq - 1U) &&
+        d->ref_dropped == enc->dropped[chan] && d->since_key < TLM_DELTA_KEY_INTERVAL - 1U)
+        n = TLM_DeltaCode(lay, rec, d->ref, len, delta, len);
+    if (n >= (int)len) n = -1;      // not shorter
+
+    memcpy(d->ref, rec, len);
+    d->ref_len = len;
+    d->ref_seq = seq;
+    d->ref_dropped = enc->dropped[chan];
+    d->valid = 1;
+    if (n < 0) {
+        d->since_key = 0;
+        return TLM_End(w);
+    }
+    d->since_key++;
+    w->base[3] = chan | TLM_CHAN_DELTA;
+    memcpy(rec, delta, (size_t)n);
+    w->p = rec + n;
+    return TLM_End(w);
+}
+
+/* ==== REFERENCE DECODER ==== */
+
+void TLM_DecoderInit(TLM_DecoderTypeDef *dec)
+{
+    memset(dec, 0, sizeof(*dec));
+}
+
+/* Drop buf[0] and everything up to the next possible sync byte */
+static void TLM_DecoderSkip(TLM_DecoderTypeDef *dec)
+{
+    uint16_t i = 1;
+    while (i < dec->pos && dec->buf[i] != TLM_SYNC0)
+        i++;
+    dec->skipped_bytes += i;
+    dec->pos = (uint16_t)(dec->pos - i);
+    memmove(dec->buf, &dec->buf[i], dec->pos);
+}
+
+/* Gap accounting; the first frame of a channel only sets the expectation */
+static void TLM_DecoderTrackSeq(TLM_DecoderTypeDef *dec, uint8_t chan, uint16_t seq)
+{
+    chan &= (uint8_t)~TLM_CHAN_DELTA;
+    if (chan >= TLM_CHAN_COUNT) return;
+    TLM_SeqStatsTypeDef *st = &dec->chan[chan];
+    uint16_t delta = (uint16_t)(seq - st->next_seq);
+
+    if (st->synced && delta != 0U) {
+        if (delta < 0x8000U) {
+            st->lost += delta;
+            st->gaps++;
+        } else if ((uint16_t)-delta <= TLM_SEQ_MAX_MISORDER) {
+            /* Already counted as lost when the gap was seen; keep the expectation */
+            st->reordered++;
+            st->frames++;
+            return;
+        } else {
+            st->resyncs++;
+        }
+    }
+    st->next_seq = (uint16_t)(seq + 1U);
+    st->synced = 1;
+    st->frames++;
+}
+
+static void TLM_DecoderProcess(TLM_DecoderTypeDef *dec, TLM_FrameCallback cb, void *ctx)
+{
+    while (dec->pos > 0) {
+        if (dec->buf[0] != TLM_SYNC0) {
+            TLM_DecoderSkip(dec);
+            continue;
+        }
+        if (dec->pos < 2) return;
+        if (dec->buf[1] != TLM_SYNC1) {
+            TLM_DecoderSkip(dec);
+            continue;
+        }
+        if (dec->pos < TLM_HEADER_SIZE) return;
+
+        uint16_t len = TLM_GetU16(&dec->buf[10]);
+        if (dec->buf[2] != TLM_VERSION || len > TLM_MAX_PAYLOAD) {
+            dec->bad_headers++;
+            TLM_DecoderSkip(dec);
+            continue;
+        }
+
+        uint16_t total = (uint16_t)(TLM_OVERHEAD + len);
+        if (dec->pos < total) return;
+
+        uint16_t crc = TLM_CRC16(0xFFFF, &dec->buf[2], TLM_HEADER_SIZE - 2U + len);
+        if (crc != TLM_GetU16(&dec->buf[TLM_HEADER_SIZE + len])) {
+            dec->crc_errors++;
+            TLM_DecoderSkip(dec);
+            continue;
+        }
+
+        TLM_FrameTypeDef f;
+        f.version = dec->buf[2];
+        f.chan = dec->buf[3];
+        f.seq = TLM_GetU16(&dec->buf[4]);
+        f.ts = TLM_GetU32(&dec->buf[6]);
+        f.len = len;
+        f.payload = &dec->buf[TLM_HEADER_SIZE];
+        dec->frames_ok++;
+        TLM_DecoderTrackSeq(dec, f.chan, f.seq);
+        if (cb) cb(&f, ctx);
+
+        dec->pos = (uint16_t)(dec->pos - total);
+        memmove(dec->buf, &dec->buf[total], dec->pos);
+    }
+}
+
+/**
+ * @brief Feed raw stream bytes; cb is called once per valid frame
+ *
+ * Resynchronizes on the sync word after garbage, truncated frames or CRC
+ * errors, and keeps per-channel seq gap counts in dec->chan[]. The payload
+ * pointer passed to cb is only valid during the call.
+ */
+void TLM_DecoderFeed(TLM_DecoderTypeDef *dec, const uint8_t *data, size_t len,
+                     TLM_FrameCallback cb, void *ctx)
+{
+    while (len > 0) {
+        size_t n = sizeof(dec->buf) - dec->pos;
+        if (n > len) n = len;
+        memcpy(&dec->buf[dec->pos], data, n);
+        dec->pos = (uint16_t)(dec->pos + n);
+        data += n;
+        len -= n;
+        TLM_DecoderProcess(dec, cb, ctx);
+    }
+}
+
+/* ==== DELTA EXPANSION ==== */
+
+void TLM_DeltaDecoderInit(TLM_DeltaDecoderTypeDef *dd)
+{
+    memset(dd, 0, sizeof(*dd));
+}
+
+/* Varint at p[*pos], at most 32 bits; past the end of the payload reads 0 */
+static int TLM_GetVarint(const uint8_t *p, uint16_t len, uint16_t *pos, uint32_t *v)
+{
+    *v = 0;
+    if (*pos == len) return 1;      // trailing zero differences left out
+    for (uint8_t bits = 0; *pos < len && bits <= 28U; bits = (uint8_t)(bits + 7U)) {
+        uint8_t b = p[(*pos)++];
+        if (bits == 28U && (b & 0xF0U) != 0U) return 0;
+        *v |= (uint32_t)(b & 0x7FU) << bits;
+        if ((b & 0x80U) == 0U) return 1;
+    }
+    return 0;
+}
+
+int TLM_DeltaExpand(TLM_DeltaDecoderTypeDef *dd, TLM_FrameTypeDef *f)
+{
+    uint8_t chan = f->chan & (uint8_t)~TLM_CHAN_DELTA;
+    TLM_DeltaTypeDef *r;
+
+    if ((f->chan & TLM_CHAN_DELTA) == 0U) {
+        if (chan < TLM_CHAN_COUNT && TLM_DeltaLayout(chan, f->len) != NULL) {
+            r = &dd->chan[chan];
+            memcpy(r->ref, f->payload, f->len);
+            r->ref_len = f->len;
+            r->ref_seq = f->seq;
+            r->valid = 1;
+            dd->key_frames++;
+        }
+        return 1;
+    }
+    if (chan >= TLM_CHAN_COUNT) {
+        dd->invalid++;
+        return 0;
+    }
+    r = &dd->chan[chan];
+    if (!r->valid || r->ref_seq != (uint16_t)(f->seq - 1U)) {
+        dd->unresolved++;
+        return 0;
+    }
+
+    const TLM_DeltaLayoutTypeDef *lay = TLM_DeltaLayout(chan, r->ref_len);
+    uint8_t rec[TLM_DELTA_MAX_RECORD];
+    uint16_t pos = 0;
+    int ok = lay != NULL;
+
+    for (uint16_t off = 0; ok && off < r->ref_len;) {
+        for (uint8_t i = 0; ok && i < lay->fields; i++) {
+            uint8_t width = lay->width[i];
+            uint32_t z, v;
+            ok = TLM_GetVarint(f->payload, f->len, &pos, &z) && (width == 4U || (z >> (8U * width)) == 0U);
+            v = TLM_GetField(r->ref + off, width) + ((z >> 1) ^ (0U - (z & 1U)));
+            memcpy(rec + off, &v, width);
+            off = (uint16_t)(off + width);
+        }
+    }
+    if (!ok || pos != f->len) {
+        r->valid = 0;
+        dd->invalid++;
+        return 0;
+    }
+
+    memcpy(r->ref, rec, r->ref_len);
+    r->ref_seq = f->seq;
+    dd->delta_frames++;
+    f->chan = chan;
+    f->len = r->ref_len;
+    f->payload = r->ref;
+    return 1;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file uart_tx.c
+ * @brief USART1 transmit ring drained by DMA
+ *
+ * Single producer (main loop) writes at head; the DMA sends from tail.
+ * head/tail are free running byte counters. A transfer covers the pending
+ * run up to the ring wrap and is started by the write that finds the DMA
+ * idle or chained from the previous completion.
+ */
+
+#include "uart_tx.h"
+#include <string.h>
+
+#define UART_TX_RING_MASK   (UART_TX_RING_SIZE - 1U)
+
+#if (UART_TX_RING_SIZE & UART_TX_RING_MASK) != 0U
+#error "UART_TX_RING_SIZE must be a power of two"
+#endif
+
+UART_TxStatsTypeDef uart_tx_stats;
+
+static UART_HandleTypeDef *tx_uart;
+static uint8_t tx_ring[UART_TX_RING_SIZE];
+static volatile uint32_t tx_head;
+static volatile uint32_t tx_tail;
+static volatile uint32_t tx_inflight;   // ring bytes owned by the DMA
+
+/* ==== INTERNAL HELPERS ==== */
+
+/* Interrupts masked or DMA interrupt context */
+static void UartTx_Start(void)
+{
+    if (tx_uart == NULL || tx_inflight != 0U) return;
+
+    uint32_t used = tx_head - tx_tail;
+    if (used == 0U) return;
+    uint32_t off = tx_tail & UART_TX_RING_MASK;
+    uint32_t len = UART_TX_RING_SIZE - off;
+    if (len > used) len = used;
+
+    tx_inflight = len;
+    if (HAL_UART_Transmit_DMA(tx_uart, &tx_ring[off], (uint16_t)len) != HAL_OK) {
+        /* retried by the next write */
+        tx_inflight = 0;
+        uart_tx_stats.errors++;
+    }
+}
+
+/* ==== PUBLIC API ==== */
+
+/**
+ * @brief Bind the ring to an initialised UART whose hdmatx is linked
+ */
+void UartTx_Init(UART_HandleTypeDef *huart)
+{
+    tx_uart = huart;
+    tx_head = 0;
+    tx_tail = 0;
+    tx_inflight = 0;
+    memset(&uart_tx_stats, 0, sizeof(uart_tx_stats));
+}
+
+/**
+ * @brief Queue bytes for the UART, all or nothing
+ * @note  Main loop context only (single producer)
+ * @retval len when queued, 0 if the ring lacks space
+ */
+uint16_t UartTx_Write(const uint8_t *buf, uint16_t len)
+{
+    uint32_t head = tx_head;
+    uint32_t used = head - tx_tail;
+    if (len > UART_TX_RING_SIZE - used) {
+        uart_tx_stats.drops++;
+        uart_tx_stats.dropped_bytes += len;
+        return 0;
+    }
+
+    uint32_t off = head & UART_TX_RING_MASK;
+    uint32_t first = UART_TX_RING_SIZE - off;
+    if (first > len) first = len;
+    memcpy(&tx_ring[off], buf, first);
+    memcpy(tx_ring, buf + first, len - first);
+    tx_head = head + len;
+
+    used += len;
+    if (used > uart_tx_stats.high_watermark)
+        uart_tx_stats.high_watermark = used;
+    uart_tx_stats.bytes_queued += len;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    UartTx_Start();
+    __set_PRIMASK(primask);
+    return len;
+}
+
+/**
+ * @retval Bytes that UartTx_Write() accepts right now
+ */
+uint16_t UartTx_Free(void)
+{
+    return (uint16_t)(UART_TX_RING_SIZE - (tx_head - tx_tail));
+}
+
+/**
+ * @brief Release the span just sent and start the next one
+ * @note  From HAL_UART_TxCpltCallback (USART1 interrupt context)
+ */
+void UartTx_OnComplete(UART_HandleTypeDef *huart)
+{
+    if (huart != tx_uart || tx_inflight == 0U) return;
+    uart_tx_stats.bytes_sent += tx_inflight;
+    uart_tx_stats.transfers++;
+    tx_tail += tx_inflight;
+    tx_inflight = 0;
+    UartTx_Start();
+}
@@ -0,0 +1,378 @@
+/**
+ * @file agg_check.cpp
+ * @brief Check and load test of the multi-device aggregator (tlm_agg.hpp)
+ *
+ *   - merge: 8 simulated boards on ptys with unrelated clocks (one about to
+ *     wrap its 32-bit ms counter), bursty writes, garbage on one port and
+ *     one board unplugged halfway; every frame must come out once, under
+ *     the right serial, the merged stream in time order, and the mapped
+ *     times must line up across boards to within a few ms;
+ *   - load: N boards at 500 frames/s each; delivered rate, aggregator CPU
+ *     and release latency (-b for the full table up to 256 boards).
+ *
+ * The boards are a child process writing BENCH frames into the pty
+ * masters: u32 counter, u32 board, u64 host time of the frame's ts, pattern.
+ *
+ * Usage: agg_check [-b]
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "check.h"
+#include "tlm_agg.hpp"
+
+/* ==== HELPERS ==== */
+static const uint32_t END_COUNTER = 0xFFFFFFFFU;
+static const uint16_t PAYLOAD = 48;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000U + (uint64_t)ts.tv_nsec / 1000U;
+}
+
+static void sleep_us(long us)
+{
+    struct timespec ts = { us / 1000000L, (us % 1000000L) * 1000L };
+    nanosleep(&ts, nullptr);
+}
+
+static std::string sim_serial(unsigned k)
+{
+    char s[16];
+    snprintf(s, sizeof(s), "SIM%09X", 0x4E0000U + k);
+    return s;
+}
+
+/* ==== SIMULATED BOARDS ==== */
+struct SimConfig {
+    unsigned boards;
+    unsigned rate_hz;           // frames per second per board
+    unsigned burst_ms;          // a board writes what is due every burst_ms
+    unsigned duration_ms;
+    int garbage_board;          // -1: none
+    int unplug_board;           // closes its port at half time, -1: none
+};
+
+struct SimBoard {
+    int master;
+    int64_t boot_us;            // host time of ts 0
+    uint32_t counter;
+    uint64_t next_event;
+    uint64_t next_burst;
+    TLM_EncoderTypeDef enc;
+};
+
+static uint16_t sim_frame(SimBoard &b, unsigned k, uint8_t *buf, uint32_t counter, uint64_t event_us)
+{
+    TLM_WriterTypeDef w;
+    TLM_Begin(&b.enc, &w, buf, TLM_CHAN_BENCH, (uint32_t)(((int64_t)event_us - b.boot_us) / 1000));
+    TLM_PutU32(&w, counter);
+    TLM_PutU32(&w, k);
+    std::memcpy(w.p, &event_us, 8);
+    w.p += 8;
+    for (uint16_t i = 16; i < PAYLOAD; i++)
+        TLM_PutU8(&w, TLM_BENCH_PATTERN(i));
+    return TLM_End(&w);
+}
+
+static void write_all(int fd, const uint8_t *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+/* Child process: runs until the parent closes done_fd; returns the frames sent per board */
+static void run_sim(const SimConfig &cfg, std::vector<SimBoard> &boards, int go_fd, int result_fd, int done_fd)
+{
+    std::vector<uint8_t> out;
+    uint8_t frame[TLM_MAX_FRAME];
+    char c;
+    if (read(go_fd, &c, 1) != 1) _exit(1);
+
+    const uint64_t t0 = now_us(), period = 1000000U / cfg.rate_hz, end = t0 + cfg.duration_ms * 1000ULL;
+    for (unsigned k = 0; k < cfg.boards; k++) {
+        boards[k].next_event = t0;
+        boards[k].next_burst = t0 + (uint64_t)k * cfg.burst_ms * 1000U / cfg.boards;
+    }
+    for (uint64_t now = t0; now < end; now = now_us()) {
+        for (unsigned k = 0; k < cfg.boards; k++) {
+            SimBoard &b = boards[k];
+            if (b.master < 0 || now < b.next_burst) continue;
+            b.next_burst += cfg.burst_ms * 1000U;
+            out.clear();
+            for (; b.next_event <= now; b.next_event += period) {
+                uint16_t n = sim_frame(b, k, frame, b.counter++, b.next_event);
+                out.insert(out.end(), frame, frame + n);
+                if ((int)k == cfg.garbage_board && b.counter % 100U == 0) {
+                    for (int g = 0; g < 7; g++)
+                        out.push_back((uint8_t)lcg_next());
+                    frame[n / 2] ^= 0x10;               // a corrupted copy of the frame
+                    out.insert(out.end(), frame, frame + n);
+                }
+            }
+            write_all(b.master, out.data(), out.size());
+            if ((int)k == cfg.unplug_board && now - t0 > cfg.duration_ms * 500ULL) {
+                close(b.master);
+                b.master = -1;
+            }
+        }
+        sleep_us(500);
+    }
+    for (unsigned k = 0; k < cfg.boards; k++) {
+        SimBoard &b = boards[k];
+        if (b.master < 0) continue;
+        uint16_t n = sim_frame(b, k, frame, END_COUNTER, now_us());
+        write_all(b.master, frame, n);
+    }
+    for (unsigned k = 0; k < cfg.boards; k++)
+        if (write(result_fd, &boards[k].counter, 4) != 4) _exit(1);
+    while (read(done_fd, &c, 1) > 0) {}     // keep the ports up until the parent has read them
+    _exit(0);
+}
+
+/* ==== RECEIVING SIDE ==== */
+struct Seen {
+    uint32_t next;
+    uint64_t frames;
+    uint64_t misorder;          // counter not the next one
+    uint64_t wrong_key;         // payload board does not match the serial
+    bool ended;
+};
+
+struct Run {
+    std::vector<uint32_t> sent;
+    std::vector<Seen> seen;
+    std::vector<int64_t> align_us;      // mapped time - host time of the ts
+    std::vector<uint64_t> latency_us;   // release - host time of the ts
+    uint64_t disorder;                  // merged stream going back in time
+    double cpu_s, wall_s;
+};
+
+static Run run(const SimConfig &cfg, unsigned workers, bool verbose, tlm::Aggregator **keep = nullptr)
+{
+    Run r = {};
+    std::vector<SimBoard> boards(cfg.boards);
+    std::vector<std::string> paths(cfg.boards);
+    std::vector<int> slaves(cfg.boards);
+    int go[2], result[2], done[2];
+    if (pipe(go) != 0 || pipe(result) != 0 || pipe(done) != 0) {
+        perror("pipe");
+        failures++;
+        return r;
+    }
+
+    const int64_t t = (int64_t)now_us();
+    for (unsigned k = 0; k < cfg.boards; k++) {
+        char name[64];
+        struct termios tio;
+        SimBoard &b = boards[k];
+        b.master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (b.master < 0 || grantpt(b.master) != 0 || unlockpt(b.master) != 0 ||
+            ptsname_r(b.master, name, sizeof(name)) != 0) {
+            perror("pty");
+            failures++;
+            return r;
+        }
+        paths[k] = name;
+        /* held until the aggregator has it open; raw so frames pass unchanged */
+        slaves[k] = open(name, O_RDWR | O_NOCTTY);
+        if (slaves[k] >= 0 && tcgetattr(slaves[k], &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(slaves[k], TCSANOW, &tio);
+        }
+        /* unrelated boot times; board 0 wraps its ms counter 300 ms in */
+        b.boot_us = k == 0 ? t - (int64_t)(0xFFFFFFFFULL - 300U) * 1000 : t - (int64_t)(lcg_next() % 86400000U) * 1000;
+        b.counter = 0;
+        b.enc = TLM_EncoderTypeDef{};
+    }
+
+    pid_t sim = fork();
+    if (sim == 0) {
+        close(go[1]);
+        close(result[0]);
+        close(done[1]);
+        for (int s : slaves)
+            close(s);
+        run_sim(cfg, boards, go[0], result[1], done[0]);
+    }
+    close(go[0]);
+    close(result[1]);
+    close(done[0]);
+    fcntl(result[0], F_SETFL, O_NONBLOCK);
+    for (SimBoard &b : boards)
+        close(b.master);
+
+    auto *agg = new tlm::Aggregator(workers);
+    for (unsigned k = 0; k < cfg.boards; k++) {
+        agg->add(paths[k], sim_serial(k));
+        close(slaves[k]);
+    }
+    r.seen.assign(cfg.boards, Seen{});
+    uint64_t last_time = 0;
+    agg->set_sink([&](const tlm::AggFrame &f) {
+        uint64_t now = now_us();
+        if (f.frame.chan != TLM_CHAN_BENCH || f.frame.len < 16) return;
+        uint32_t counter = TLM_GetU32(f.frame.payload), k = TLM_GetU32(f.frame.payload + 4);
+        uint64_t event;
+        std::memcpy(&event, f.frame.payload + 8, 8);
+        if (k >= cfg.boards) return;
+        Seen &s = r.seen[f.device < cfg.boards ? f.device : 0];
+        if (f.device != k || sim_serial(k) != f.serial) s.wrong_key++;
+        if (f.time_us < last_time) r.disorder++;
+        last_time = f.time_us;
+        if (counter == END_COUNTER) {
+            s.ended = true;
+            return;
+        }
+        if (counter != s.next) s.misorder++;
+        s.next = counter + 1U;
+        s.frames++;
+        r.align_us.push_back((int64_t)(f.time_us - event));
+        r.latency_us.push_back(now - event);
+    });
+
+    struct rusage ru0, ru1;
+    getrusage(RUSAGE_SELF, &ru0);
+    uint64_t w0 = now_us();
+    if (write(go[1], "g", 1) != 1) failures++;
+
+    r.sent.assign(cfg.boards, 0);
+    size_t got = 0;
+    const uint64_t deadline = w0 + (cfg.duration_ms + 10000ULL) * 1000U;
+    for (;;) {
+        agg->poll(20);
+        if (got < cfg.boards * 4U) {
+            ssize_t n = read(result[0], (uint8_t *)r.sent.data() + got, cfg.boards * 4U - got);
+            if (n > 0) got += (size_t)n;
+        }
+        bool all = got == cfg.boards * 4U;
+        for (unsigned k = 0; k < cfg.boards && all; k++)
+            all = r.seen[k].ended || (int)k == cfg.unplug_board;
+        if (all || now_us() > deadline) break;
+    }
+    agg->flush();
+    r.wall_s = (now_us() - w0) / 1e6;
+    getrusage(RUSAGE_SELF, &ru1);
+    r.cpu_s = (ru1.ru_utime.tv_sec - ru0.ru_utime.tv_sec) + (ru1.ru_stime.tv_sec - ru0.ru_stime.tv_sec) +
+              ((ru1.ru_utime.tv_usec - ru0.ru_utime.tv_usec) + (ru1.ru_stime.tv_usec - ru0.ru_stime.tv_usec)) / 1e6;
+
+    if (verbose)
+        for (unsigned k = 0; k < cfg.boards; k++) {
+            tlm::AggDeviceStats d = agg->device(k);
+            printf("    %s %-12s %6llu frames %3llu crc %5llu skipped  offset %+.3f s  %s\n", d.serial.c_str(),
+                   d.path.c_str(), (unsigned long long)r.seen[k].frames, (unsigned long long)d.scan.crc_errors,
+                   (unsigned long long)d.scan.skipped_bytes, d.offset_us / 1e6, d.connected ? "up" : "down");
+        }
+
+    close(go[1]);
+    close(done[1]);
+    close(result[0]);
+    if (keep)
+        *keep = agg;
+    else
+        delete agg;
+    waitpid(sim, nullptr, 0);
+    return r;
+}
+
+template <class T>
+static T pct(std::vector<T> v, unsigned p)
+{
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, v.size() * p / 100U)];
+}
+
+/* ==== MERGE ==== */
+static void check_merge(void)
+{
+    SimConfig cfg = { 8, 1000, 4, 1000, 1, 3 };
+    tlm::Aggregator *agg = nullptr;
+    Run r = run(cfg, 2, true, &agg);
+    if (!agg) return;
+
+    for (unsigned k = 0; k < cfg.boards; k++) {
+        const Seen &s = r.seen[k];
+        CHECK(s.wrong_key == 0 && s.misorder == 0, "merge: board %u: %llu under the wrong serial, %llu out of order",
+              k, (unsigned long long)s.wrong_key, (unsigned long long)s.misorder);
+        if ((int)k == cfg.unplug_board) {
+            CHECK(!agg->device(k).connected && s.frames > 0 && s.frames <= r.sent[k],
+                  "merge: unplugged board %u: %llu frames of %u, %s", k, (unsigned long long)s.frames, r.sent[k],
+                  agg->device(k).connected ? "still up" : "down");
+        } else {
+            CHECK(s.ended && s.frames == r.sent[k], "merge: board %u: %llu of %u frames", k,
+                  (unsigned long long)s.frames, r.sent[k]);
+        }
+    }
+    tlm::AggStats st = agg->stats();
+    tlm::AggDeviceStats g = agg->device((size_t)cfg.garbage_board);
+    CHECK(r.disorder == 0 && st.late == 0, "merge: merged stream went back in time %llu times (%llu late)",
+          (unsigned long long)r.disorder, (unsigned long long)st.late);
+    CHECK(g.scan.crc_errors >= r.sent[cfg.garbage_board] / 100U && g.scan.skipped_bytes > 0,
+          "merge: garbage board: %llu crc errors, %llu bytes skipped", (unsigned long long)g.scan.crc_errors,
+          (unsigned long long)g.scan.skipped_bytes);
+
+    int64_t lo = pct(r.align_us, 1), hi = pct(r.align_us, 99);
+    CHECK(lo > -1500 && hi < 5000, "merge: boards aligned to %.2f..%.2f ms", lo / 1e3, hi / 1e3);
+    printf("  merge: %u boards, %llu frames in time order, alignment p1 %+.2f ms p99 %+.2f ms, release p99 %.1f ms\n",
+           cfg.boards, (unsigned long long)st.frames, lo / 1e3, hi / 1e3, pct(r.latency_us, 99) / 1e3);
+    delete agg;
+}
+
+/* ==== LOAD ==== */
+static void bench_load(unsigned boards, unsigned duration_ms)
+{
+    SimConfig cfg = { boards, 500, 8, duration_ms, -1, -1 };
+    Run r = run(cfg, 0, false);
+
+    uint64_t frames = 0, sent = 0, bad = 0;
+    for (unsigned k = 0; k < boards && k < r.seen.size(); k++) {
+        frames += r.seen[k].frames;
+        sent += r.sent[k];
+        bad += r.seen[k].misorder + r.seen[k].wrong_key + !r.seen[k].ended;
+    }
+    CHECK(frames == sent && bad == 0 && r.disorder == 0, "load: %u boards: %llu of %llu frames, %llu errors", boards,
+          (unsigned long long)frames, (unsigned long long)sent, (unsigned long long)bad);
+    printf("  load %3u boards: %7.0f frames/s, aggregator CPU %5.1f%%, release latency p50 %6.1f ms p99 %6.1f ms\n",
+           boards, frames / r.wall_s, 100.0 * r.cpu_s / r.wall_s, pct(r.latency_us, 50) / 1e3,
+           pct(r.latency_us, 99) / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    lcg_state = 11;
+    int full = argc > 1 && strcmp(argv[1], "-b") == 0;
+    if (argc > 1 && !full) {
+        fprintf(stderr, "usage: %s [-b]\n", argv[0]);
+        return 2;
+    }
+
+    check_merge();
+
+    const unsigned boards[] = { 16, 64, 128, 256 };
+    for (unsigned n : boards) {
+        if (!full && n > 64) continue;
+        bench_load(n, full ? 3000 : 1000);
+    }
+
+    return check_result();
+}
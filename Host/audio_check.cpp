@@ -0,0 +1,671 @@
+/**
+ * @file audio_check.cpp
+ * @brief Check and benchmark of the microphone export (tlm_audio.hpp)
+ *
+ * A simulated device streams a tone through the firmware framing: I2S at
+ * 15943.37 Hz in host time (the 16 kHz I2SDIV rounding), 1 Hz clock
+ * records, the frame index wrapping through zero early on, and along the
+ * way lost packets, a stretch at half rate, a shed second and a pause
+ * longer than the gap limit. The same frames go to a WAV and a FLAC export.
+ *
+ *   - length: the file is as long as the capture took in host time, less
+ *     the cut pause (a file at the I2S rate would be 0.35% short);
+ *   - content: the tone in every segment lines up with host time;
+ *   - gaps: one marker per loss, shed and pause, decimation changes marked,
+ *     silence exactly where the markers say;
+ *   - files: the WAV chunks (fmt, data, cue, labl/ltxt) parse back, the
+ *     FLAC decodes (CRCs checked, fixed/constant/verbatim subframes) to the
+ *     same samples and carries the markers as comments;
+ *   - restart and no clock records: output continues, marked, at the
+ *     configured rate;
+ *   - bounded memory and conversion rate (-b: a 3 hour capture).
+ *
+ * Usage: audio_check [-b] [-s seconds]
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "check.h"
+#include "audio_packetizer.h"
+#include "tlm_audio.hpp"
+
+/* ==== HELPERS ==== */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static long max_rss_kb(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+/* ==== SIMULATED DEVICE ==== */
+static const double I2S_HZ = 15943.37;          // in host time
+static const unsigned OUT_HZ = 16000;
+static const double AMPL = 1 << 20;
+static const double TONE_HZ = 440.0;
+static const int64_t FIRST_FRAME = 0xFFFFFFFFLL - 3 * 15943;    // ts wraps after 3 s
+
+static double tone(double t)
+{
+    return AMPL * sin(2.0 * M_PI * TONE_HZ * t);
+}
+
+struct Scenario {
+    double seconds;
+    bool clock;                 // send TLM_CHAN_AUDIO_CLK
+    double lost_at;             // 3 packets lost (seq spent)
+    double half_from, half_to;  // decimation 2
+    double shed_at, shed_s;     // no audio, no seq spent
+    double pause_at, pause_s;
+    double restart_at;          // device reboots: frame index and seq start over
+};
+
+struct SynthInfo {
+    double first_pos, last_pos;         // I2S positions of the first and last sample sent
+    uint64_t packets, samples;
+    double cut_from, cut_to;            // host times of the pause
+    uint64_t gen_ns;
+};
+
+/* Host time of I2S frame f (before a restart) */
+static double host_time(double f)
+{
+    return (f - (double)FIRST_FRAME) / I2S_HZ;
+}
+
+static void simulate(const Scenario &sc, SynthInfo &info, const std::function<void(const tlm::Frame &)> &sink)
+{
+    TLM_EncoderTypeDef enc = {};
+    uint16_t audio_seq = 0;
+    uint8_t buf[TLM_MAX_FRAME];
+    int64_t frame = FIRST_FRAME, boot = FIRST_FRAME;
+    double next_clock = 0.5;
+    int lost = 0;
+    bool lost_done = false, restarted = false;
+    info = {};
+    info.first_pos = -1;
+
+    auto deliver = [&](uint16_t n) {
+        tlm::FrameRange fr(buf, n);
+        tlm::Frame f;
+        if (fr.next(f)) sink(f);
+    };
+
+    for (;;) {
+        uint64_t g = now_ns();
+        double t = (frame - boot) / I2S_HZ + (restarted ? sc.restart_at : 0.0);
+        if (t >= sc.seconds) break;
+
+        if (sc.clock && t >= next_clock) {
+            TLM_WriterTypeDef w;
+            TLM_Begin(&enc, &w, buf, TLM_CHAN_AUDIO_CLK, (uint32_t)(t * 1000));
+            TLM_PutU32(&w, OUT_HZ);
+            TLM_PutU32(&w, (uint32_t)llround(I2S_HZ * 1000.0));
+            uint16_t n = TLM_End(&w);
+            info.gen_ns += now_ns() - g;
+            deliver(n);
+            next_clock += 1.0;
+            continue;
+        }
+        if (sc.restart_at > 0 && !restarted && t >= sc.restart_at) {
+            restarted = true;
+            boot = frame = 1000;            // new boot: I2S index and audio seq from scratch
+            audio_seq = 0;
+            continue;
+        }
+
+        unsigned d = (t >= sc.half_from && t < sc.half_to) ? 2U : 1U;
+        const unsigned n = AUDIO_PKT_SAMPLES;
+        bool shed = (sc.shed_s > 0 && t >= sc.shed_at && t < sc.shed_at + sc.shed_s) ||
+                    (sc.pause_s > 0 && t >= sc.pause_at && t < sc.pause_at + sc.pause_s);
+        if (sc.pause_s > 0 && t >= sc.pause_at && info.cut_from == 0) info.cut_from = t;
+        if (sc.pause_s > 0 && t >= sc.pause_at + sc.pause_s && info.cut_to == 0) info.cut_to = t;
+        if (sc.lost_at > 0 && !lost_done && t >= sc.lost_at) lost++;
+        if (lost > 3) lost_done = true;
+
+        if (shed) {
+            frame += n * d;
+            continue;
+        }
+        if (lost && !lost_done) {
+            audio_seq++;                    // spent, never arrives
+            frame += n * d;
+            continue;
+        }
+
+        TLM_WriterTypeDef w;
+        TLM_Begin(&enc, &w, buf, TLM_CHAN_AUDIO, (uint32_t)frame);
+        buf[4] = (uint8_t)audio_seq;        // the packetizer numbers audio itself
+        buf[5] = (uint8_t)(audio_seq >> 8);
+        audio_seq++;
+        for (unsigned i = 0; i < n; i++) {
+            double acc = 0;
+            for (unsigned k = 0; k < d; k++)
+                acc += tone((frame - boot + i * d + k) / I2S_HZ + (restarted ? sc.restart_at : 0.0));
+            int32_t v = (int32_t)lround(acc / d) + (int32_t)(lcg_next() >> 26) - 32;
+            *w.p++ = (uint8_t)v;
+            *w.p++ = (uint8_t)(v >> 8);
+            *w.p++ = (uint8_t)(v >> 16);
+        }
+        uint16_t len = TLM_End(&w);
+        if (info.first_pos < 0) info.first_pos = (double)frame;
+        if (!restarted) info.last_pos = (double)(frame + (n - 1) * d) + (d - 1) / 2.0;
+        info.packets++;
+        info.samples += n;
+        frame += n * d;
+        info.gen_ns += now_ns() - g;
+        deliver(len);
+    }
+}
+
+/* ==== WAV READER ==== */
+struct Cue {
+    uint32_t sample;
+    uint32_t samples;
+    std::string label;
+};
+
+struct Wav {
+    void *map = MAP_FAILED;
+    size_t len = 0;
+    unsigned rate = 0, bits = 0, channels = 0;
+    const uint8_t *data = nullptr;
+    uint64_t samples = 0;
+    std::vector<Cue> cues;
+
+    int32_t at(uint64_t i) const { return TLM_GetS24(data + i * 3U); }
+    ~Wav()
+    {
+        if (map != MAP_FAILED) munmap(map, len);
+    }
+};
+
+static bool read_wav(const std::string &path, Wav &w)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) return false;
+    w.len = (size_t)st.st_size;
+    w.map = mmap(nullptr, w.len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (w.map == MAP_FAILED || w.len < 12) return false;
+    const uint8_t *p = (const uint8_t *)w.map;
+    if (memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4) || TLM_GetU32(p + 4) != w.len - 8) return false;
+
+    for (size_t off = 12; off + 8 <= w.len;) {
+        const uint8_t *c = p + off;
+        uint32_t size = TLM_GetU32(c + 4);
+        if (off + 8 + size > w.len) return false;
+        if (!memcmp(c, "fmt ", 4)) {
+            w.channels = TLM_GetU16(c + 10);
+            w.rate = TLM_GetU32(c + 12);
+            w.bits = TLM_GetU16(c + 22);
+        } else if (!memcmp(c, "data", 4)) {
+            w.data = c + 8;
+            w.samples = size / 3U;
+        } else if (!memcmp(c, "cue ", 4)) {
+            for (uint32_t i = 0; i < TLM_GetU32(c + 8); i++)
+                w.cues.push_back({ TLM_GetU32(c + 12 + 24 * i + 4), 0, "" });
+        } else if (!memcmp(c, "LIST", 4) && !memcmp(c + 8, "adtl", 4)) {
+            for (size_t s = 12; s + 8 <= size + 8;) {
+                const uint8_t *sub = c + s;
+                uint32_t ssize = TLM_GetU32(sub + 4), id = TLM_GetU32(sub + 8);
+                if (id >= 1 && id <= w.cues.size()) {
+                    if (!memcmp(sub, "labl", 4)) w.cues[id - 1].label = (const char *)(sub + 12);
+                    if (!memcmp(sub, "ltxt", 4)) w.cues[id - 1].samples = TLM_GetU32(sub + 12);
+                }
+                s += 8 + ssize + (ssize & 1U);
+            }
+        }
+        off += 8 + size + (size & 1U);
+    }
+    return w.data != nullptr;
+}
+
+/* ==== FLAC READER ==== */
+class BitReader {
+public:
+    BitReader(const uint8_t *p, size_t len) : p_(p), len_(len) {}
+
+    uint32_t get(unsigned n)
+    {
+        uint64_t v = 0;
+        for (unsigned i = 0; i < n; i++, bit_++)
+            v = v << 1 | (bit_ / 8 < len_ ? (p_[bit_ / 8] >> (7 - bit_ % 8)) & 1U : 0U);
+        return (uint32_t)v;
+    }
+    int32_t sget(unsigned n)
+    {
+        uint32_t v = get(n);
+        return n < 32 && (v >> (n - 1)) ? (int32_t)(v | ~((1U << n) - 1U)) : (int32_t)v;
+    }
+    uint32_t unary()
+    {
+        uint32_t q = 0;
+        while (!get(1) && bit_ / 8 < len_)
+            q++;
+        return q;
+    }
+    void align() { bit_ = (bit_ + 7) & ~(size_t)7; }
+    size_t byte() const { return bit_ / 8; }
+    bool over() const { return bit_ / 8 > len_; }
+
+private:
+    const uint8_t *p_;
+    size_t len_, bit_ = 0;
+};
+
+static uint8_t ref_crc8(const uint8_t *p, size_t n)
+{
+    uint8_t crc = 0;
+    while (n--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++)
+            crc = (uint8_t)(crc & 0x80U ? (crc << 1) ^ 0x07U : crc << 1);
+    }
+    return crc;
+}
+
+static uint16_t ref_crc16(const uint8_t *p, size_t n)
+{
+    uint16_t crc = 0;
+    while (n--) {
+        crc ^= (uint16_t)(*p++ << 8);
+        for (int i = 0; i < 8; i++)
+            crc = (uint16_t)(crc & 0x8000U ? (crc << 1) ^ 0x8005U : crc << 1);
+    }
+    return crc;
+}
+
+struct FlacInfo {
+    unsigned rate, bits;
+    uint64_t total;
+    std::vector<std::string> comments;
+    uint64_t frames, samples;
+    uint64_t subframes[3];      // constant, verbatim, fixed
+    std::string error;
+};
+
+/* Decode a 24-bit mono stream of the subset tlm_audio writes; each block goes to cb */
+static bool read_flac(const std::string &path, FlacInfo &fi, const std::function<void(const int32_t *, uint32_t)> &cb)
+{
+    fi = {};
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) return false;
+    size_t len = (size_t)st.st_size;
+    void *map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    const uint8_t *p = (const uint8_t *)map;
+    auto fail = [&](const char *why) {
+        fi.error = why;
+        munmap(map, len);
+        return false;
+    };
+    if (len < 8 || memcmp(p, "fLaC", 4)) return fail("no fLaC marker");
+
+    size_t off = 4;
+    for (bool last = false; !last;) {
+        if (off + 4 > len) return fail("metadata past the end");
+        last = p[off] & 0x80U;
+        uint8_t type = p[off] & 0x7FU;
+        uint32_t size = (uint32_t)p[off + 1] << 16 | (uint32_t)p[off + 2] << 8 | p[off + 3];
+        const uint8_t *b = p + off + 4;
+        if (type == 0) {
+            BitReader r(b, size);
+            r.get(16 + 16 + 24 + 24);
+            fi.rate = r.get(20);
+            if (r.get(3) != 0) return fail("not mono");
+            fi.bits = r.get(5) + 1U;
+            fi.total = (uint64_t)r.get(4) << 32 | r.get(32);
+        } else if (type == 4) {
+            const uint8_t *c = b + 4 + TLM_GetU32(b);
+            uint32_t n = TLM_GetU32(c);
+            c += 4;
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t l = TLM_GetU32(c);
+                fi.comments.emplace_back((const char *)c + 4, l);
+                c += 4 + l;
+            }
+        }
+        off += 4 + size;
+    }
+
+    std::vector<int32_t> x;
+    while (off < len) {
+        BitReader r(p + off, len - off);
+        if (r.get(16) != 0xFFF8) return fail("frame sync");
+        unsigned bs = r.get(4), sr = r.get(4), ch = r.get(4), ss = r.get(3);
+        r.get(1);
+        if (sr != 0 || ch != 0 || ss != 6) return fail("frame header fields");
+        uint32_t first = r.get(8);
+        int extra = 0;
+        while (extra < 7 && (first & (0x80U >> extra)))
+            extra++;
+        for (int i = 1; i < extra; i++)
+            r.get(8);
+        uint32_t n = bs == 12 ? 4096U : bs == 7 ? r.get(16) + 1U : bs == 6 ? r.get(8) + 1U : 0U;
+        if (!n) return fail("block size code");
+        size_t hdr = r.byte();
+        if (r.get(8) != ref_crc8(p + off, hdr)) return fail("header CRC-8");
+
+        x.assign(n, 0);
+        if (r.get(1)) return fail("subframe padding");
+        unsigned type = r.get(6);
+        if (r.get(1)) return fail("wasted bits");
+        if (type == 0) {
+            int32_t v = r.sget(24);
+            std::fill(x.begin(), x.end(), v);
+            fi.subframes[0]++;
+        } else if (type == 1) {
+            for (uint32_t i = 0; i < n; i++)
+                x[i] = r.sget(24);
+            fi.subframes[1]++;
+        } else if (type >= 8 && type <= 12) {
+            unsigned order = type - 8;
+            for (unsigned i = 0; i < order; i++)
+                x[i] = r.sget(24);
+            unsigned method = r.get(2), po = r.get(4);
+            unsigned pbits = method ? 5 : 4, escape = method ? 31 : 15;
+            uint32_t i = order;
+            for (uint32_t part = 0; part < (1U << po); part++) {
+                uint32_t cnt = (n >> po) - (part ? 0 : order);
+                unsigned k = r.get(pbits);
+                for (uint32_t j = 0; j < cnt; j++, i++) {
+                    int32_t res;
+                    if (k == escape) {
+                        return fail("escaped partition");
+                    } else {
+                        uint32_t u = r.unary() << k | r.get(k);
+                        res = (int32_t)(u >> 1) ^ -(int32_t)(u & 1U);
+                    }
+                    int64_t pred = 0;
+                    switch (order) {
+                    case 1: pred = x[i - 1]; break;
+                    case 2: pred = 2 * (int64_t)x[i - 1] - x[i - 2]; break;
+                    case 3: pred = 3 * (int64_t)x[i - 1] - 3 * (int64_t)x[i - 2] + x[i - 3]; break;
+                    case 4: pred = 4 * (int64_t)x[i - 1] - 6 * (int64_t)x[i - 2] + 4 * (int64_t)x[i - 3] - x[i - 4]; break;
+                    }
+                    x[i] = (int32_t)(pred + res);
+                }
+            }
+            fi.subframes[2]++;
+        } else {
+            return fail("subframe type");
+        }
+        r.align();
+        size_t body = r.byte();
+        if (r.over() || off + body + 2 > len) return fail("frame past the end");
+        if (((uint16_t)p[off + body] << 8 | p[off + body + 1]) != ref_crc16(p + off, body)) return fail("frame CRC-16");
+        cb(x.data(), n);
+        fi.frames++;
+        fi.samples += n;
+        off += body + 2;
+    }
+    munmap(map, len);
+    return true;
+}
+
+/* ==== CHECKS ==== */
+static std::string tmp_path(const char *ext)
+{
+    return "/tmp/audio_check_" + std::to_string(getpid()) + ext;
+}
+
+static bool has_marker(const std::vector<tlm::AudioMarker> &m, const char *label, double at_s, double tol_s,
+                       double len_s = -1)
+{
+    for (const tlm::AudioMarker &x : m) {
+        if (x.label.find(label) == std::string::npos) continue;
+        if (fabs((double)x.sample / OUT_HZ - at_s) > tol_s) continue;
+        if (len_s >= 0 && fabs((double)x.samples / OUT_HZ - len_s) > tol_s) continue;
+        return true;
+    }
+    return false;
+}
+
+/* RMS and peak error of the tone over [from, to) output samples, best of a few sample offsets */
+static void tone_error(const Wav &w, uint64_t from, uint64_t to, double t0, int search, double *rms, double *peak)
+{
+    *rms = *peak = 1e30;
+    for (int o = -search; o <= search; o++) {
+        double sum = 0, pk = 0;
+        for (uint64_t k = from; k < to; k++) {
+            double e = fabs(w.at(k) - tone(t0 + ((double)k + o) / OUT_HZ));
+            sum += e * e;
+            pk = std::max(pk, e);
+        }
+        double r = sqrt(sum / (double)(to - from));
+        if (r < *rms) {
+            *rms = r;
+            *peak = pk;
+        }
+    }
+}
+
+static void check_export(double seconds)
+{
+    Scenario sc = {};
+    sc.seconds = seconds;
+    sc.clock = true;
+    sc.lost_at = 10.0;
+    sc.half_from = 20.0;
+    sc.half_to = 25.0;
+    sc.shed_at = 30.0;
+    sc.shed_s = 1.0;
+    sc.pause_at = 60.0;
+    sc.pause_s = 90.0;
+
+    std::string wav_path = tmp_path(".wav"), flac_path = tmp_path(".flac");
+    tlm::AudioExport wav, flac;
+    CHECK(wav.open(wav_path) && flac.open(flac_path), "export: cannot create the output files");
+    uint64_t wav_ns = 0, flac_ns = 0;
+    long rss0 = max_rss_kb();
+    SynthInfo info;
+    uint64_t t0 = now_ns();
+    simulate(sc, info, [&](const tlm::Frame &f) {
+        uint64_t a = now_ns();
+        wav.add(f);
+        uint64_t b = now_ns();
+        flac.add(f);
+        wav_ns += b - a;
+        flac_ns += now_ns() - b;
+    });
+    CHECK(wav.close() && flac.close(), "export: close failed");
+    double total_s = (now_ns() - t0) / 1e9;
+    long rss1 = max_rss_kb();
+
+    const tlm::AudioExportStats &s = wav.stats();
+    struct stat ws, fs;
+    stat(wav_path.c_str(), &ws);
+    stat(flac_path.c_str(), &fs);
+    printf("  export: %.0f s of audio (%" PRIu64 " packets): WAV %.1f Msamples/s, FLAC %.1f Msamples/s, "
+           "%.1f s total with the simulation\n", seconds, info.packets, s.samples_out / (wav_ns / 1e9) / 1e6,
+           s.samples_out / (flac_ns / 1e9) / 1e6, total_s);
+    printf("  size:   WAV %.1f MB, FLAC %.1f MB (%.1f%%), peak RSS +%ld kB\n", ws.st_size / 1e6, fs.st_size / 1e6,
+           100.0 * fs.st_size / ws.st_size, rss1 - rss0);
+    CHECK(rss1 - rss0 < 16 * 1024, "memory: peak RSS grew by %ld kB", rss1 - rss0);
+    CHECK(fs.st_size * 10 < ws.st_size * 8, "size: FLAC not 20%% below WAV");
+
+    /* length: host time of the capture less the pause that was cut */
+    double cut = info.cut_to - info.cut_from;
+    double host_s = host_time(info.last_pos) - host_time(info.first_pos);
+    double expect = (host_s - cut) * OUT_HZ;
+    printf("  length: %" PRIu64 " samples at %u Hz for %.3f s of host time less %.3f s cut (expected %.0f, %+.1f); "
+           "at the I2S rate the file would be %+.3f s off\n", s.samples_out, wav.rate(), host_s, cut, expect,
+           (double)s.samples_out - expect, host_s * (I2S_HZ - OUT_HZ) / OUT_HZ);
+    CHECK(wav.rate() == OUT_HZ, "length: rate %u", wav.rate());
+    CHECK(fabs((double)s.samples_out - expect) <= 3.0, "length: %" PRIu64 " samples, expected %.0f", s.samples_out,
+          expect);
+    CHECK(fabs(s.source_hz - I2S_HZ) < 0.001 && s.clock_records >= (uint64_t)seconds - 95,
+          "length: source %.3f Hz from %" PRIu64 " records", s.source_hz, s.clock_records);
+
+    /* markers */
+    const std::vector<tlm::AudioMarker> &m = wav.markers();
+    const double pkt_s = AUDIO_PKT_SAMPLES / I2S_HZ;
+    CHECK(s.lost_packets == 3 && s.gaps == 3 && s.restarts == 0,
+          "gaps: %" PRIu64 " lost packets, %" PRIu64 " gaps, %" PRIu64 " restarts", s.lost_packets, s.gaps, s.restarts);
+    CHECK(has_marker(m, "lost 3 packets", 10.0, pkt_s * 2, 3 * pkt_s), "gaps: no marker for the lost packets");
+    CHECK(has_marker(m, "decimation 2", 20.0, pkt_s * 2) && has_marker(m, "decimation 1", 25.0, pkt_s * 3),
+          "gaps: decimation changes not marked");
+    CHECK(has_marker(m, "no audio", 30.0, pkt_s * 2, 1.0), "gaps: no marker for the shed second");
+    CHECK(has_marker(m, "s cut", 60.0, pkt_s * 2), "gaps: no marker for the cut pause");
+    CHECK(fabs(s.cut_s - cut) < 2 * pkt_s, "gaps: %.3f s cut, paused %.3f s", s.cut_s, cut);
+    for (const tlm::AudioMarker &x : m)
+        printf("           %9.3f s  %-26s %6" PRIu64 " samples\n", (double)x.sample / OUT_HZ, x.label.c_str(),
+               x.samples);
+
+    /* WAV back */
+    Wav w;
+    CHECK(read_wav(wav_path, w), "wav: does not parse");
+    CHECK(w.rate == OUT_HZ && w.bits == 24 && w.channels == 1 && w.samples == s.samples_out,
+          "wav: %u Hz %u bits %u channels, %" PRIu64 " samples", w.rate, w.bits, w.channels, w.samples);
+    bool cues_ok = w.cues.size() == m.size();
+    for (size_t i = 0; cues_ok && i < m.size(); i++)
+        cues_ok = w.cues[i].sample == m[i].sample && w.cues[i].samples == m[i].samples && w.cues[i].label == m[i].label;
+    CHECK(cues_ok, "wav: %zu cue points for %zu markers, or they differ", w.cues.size(), m.size());
+
+    /* silence exactly inside the filled gaps, the tone everywhere else */
+    uint64_t nonzero = 0;
+    for (const tlm::AudioMarker &x : m)
+        for (uint64_t k = x.sample; k < x.sample + x.samples && k < w.samples; k++)
+            nonzero += w.at(k) != 0;
+    CHECK(nonzero == 0, "gaps: %" PRIu64 " non-zero samples inside the filled gaps", nonzero);
+
+    std::vector<uint64_t> edges = { 0 };
+    for (const tlm::AudioMarker &x : m) {
+        edges.push_back(x.sample);
+        if (x.samples) edges.push_back(x.sample + x.samples);
+    }
+    edges.push_back(w.samples);
+    std::sort(edges.begin(), edges.end());
+    uint64_t cut_sample = 0;
+    for (const tlm::AudioMarker &x : m)
+        if (x.label.find("s cut") != std::string::npos) cut_sample = x.sample;
+    /* [0]: full rate, [1]: decimated stretch, interpolated from half as many samples */
+    double worst_rms[2] = {}, worst_peak[2] = {};
+    const double t_first = host_time(info.first_pos);
+    for (size_t i = 0; i + 1 < edges.size(); i++) {
+        uint64_t from = edges[i] + 3, to = edges[i + 1] > 3 ? edges[i + 1] - 3 : 0;
+        if (to <= from + 100) continue;
+        bool gap = false, half = false;
+        for (const tlm::AudioMarker &x : m) {
+            gap = gap || (x.samples && edges[i] == x.sample);
+            half = half || (x.label == "decimation 2" && edges[i] == x.sample);
+        }
+        if (gap) continue;
+        double rms, peak;
+        /* the cut skips a whole number of output samples, known to a sample or two */
+        bool after = cut_sample && edges[i] >= cut_sample;
+        double t0 = t_first + (after ? std::round(cut * OUT_HZ) / OUT_HZ : 0.0);
+        tone_error(w, from, to, t0, after ? 2 : 0, &rms, &peak);
+        worst_rms[half] = std::max(worst_rms[half], rms);
+        worst_peak[half] = std::max(worst_peak[half], peak);
+    }
+    printf("  tone:   %zu segments against host time: RMS error %.3f%% (peak %.3f%%) of full scale, %.3f%% (%.3f%%) "
+           "where decimated\n", edges.size() - 1, 100 * worst_rms[0] / AMPL, 100 * worst_peak[0] / AMPL,
+           100 * worst_rms[1] / AMPL, 100 * worst_peak[1] / AMPL);
+    CHECK(worst_rms[0] < 0.005 * AMPL && worst_peak[0] < 0.01 * AMPL, "tone: RMS %.0f, peak %.0f", worst_rms[0],
+          worst_peak[0]);
+    CHECK(worst_rms[1] < 0.02 * AMPL && worst_peak[1] < 0.04 * AMPL, "tone: decimated RMS %.0f, peak %.0f",
+          worst_rms[1], worst_peak[1]);
+
+    /* FLAC back, sample for sample against the WAV */
+    FlacInfo fi;
+    uint64_t pos = 0, diff = 0;
+    bool ok = read_flac(flac_path, fi, [&](const int32_t *x, uint32_t n) {
+        for (uint32_t i = 0; i < n; i++, pos++)
+            diff += pos >= w.samples || x[i] != w.at(pos);
+    });
+    CHECK(ok, "flac: %s", fi.error.c_str());
+    CHECK(fi.rate == OUT_HZ && fi.bits == 24 && fi.total == w.samples && fi.samples == w.samples && diff == 0,
+          "flac: %u Hz %u bits, %" PRIu64 "/%" PRIu64 " samples, %" PRIu64 " differ from the WAV", fi.rate, fi.bits,
+          fi.samples, fi.total, diff);
+    size_t markers = 0;
+    for (const std::string &c : fi.comments)
+        markers += c.compare(0, 11, "TLM_MARKER=") == 0;
+    CHECK(markers == m.size(), "flac: %zu marker comments for %zu markers", markers, m.size());
+    printf("  flac:   %" PRIu64 " frames decoded, CRCs good, subframes %" PRIu64 " constant / %" PRIu64 " verbatim / %"
+           PRIu64 " fixed, %zu marker comments\n", fi.frames, fi.subframes[0], fi.subframes[1], fi.subframes[2],
+           markers);
+
+    unlink(wav_path.c_str());
+    unlink(flac_path.c_str());
+}
+
+static void check_restart_and_no_clock(void)
+{
+    std::string path = tmp_path("_r.wav");
+    Scenario sc = {};
+    sc.seconds = 10.0;
+    sc.clock = true;
+    sc.restart_at = 5.0;
+    tlm::AudioExport ex;
+    SynthInfo info;
+    CHECK(ex.open(path), "restart: cannot create %s", path.c_str());
+    simulate(sc, info, [&](const tlm::Frame &f) { ex.add(f); });
+    CHECK(ex.close(), "restart: close failed");
+    const tlm::AudioExportStats &s = ex.stats();
+    CHECK(s.restarts == 1 && s.gaps == 0 && has_marker(ex.markers(), "device restart", 5.0, 0.05),
+          "restart: %" PRIu64 " restarts, %" PRIu64 " gaps", s.restarts, s.gaps);
+    CHECK(fabs((double)s.samples_out - 10.0 * OUT_HZ) < 2 * AUDIO_PKT_SAMPLES, "restart: %" PRIu64 " samples for 10 s",
+          s.samples_out);
+
+    /* old firmware: no clock records, samples pass at the default rate */
+    sc = {};
+    sc.seconds = 5.0;
+    tlm::AudioExport raw;
+    CHECK(raw.open(path), "no clock: cannot create %s", path.c_str());
+    simulate(sc, info, [&](const tlm::Frame &f) { raw.add(f); });
+    CHECK(raw.close(), "no clock: close failed");
+    const tlm::AudioExportStats &r = raw.stats();
+    CHECK(raw.rate() == tlm::AUDIO_DEFAULT_RATE && r.clock_records == 0 && r.samples_out + 1 == r.samples_in,
+          "no clock: %u Hz, %" PRIu64 " samples in, %" PRIu64 " out", raw.rate(), r.samples_in, r.samples_out);
+    printf("  restart: marked at %.3f s, output continues; without clock records %" PRIu64 " of %" PRIu64
+           " samples pass at %u Hz\n", ex.markers().empty() ? 0.0 : (double)ex.markers()[0].sample / OUT_HZ,
+           r.samples_out, r.samples_in, raw.rate());
+    unlink(path.c_str());
+}
+
+int main(int argc, char **argv)
+{
+    lcg_state = 3;
+    int opt;
+    double seconds = 240;
+    while ((opt = getopt(argc, argv, "bs:")) != -1) {
+        switch (opt) {
+        case 'b': seconds = 3 * 3600; break;
+        case 's': seconds = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-b] [-s seconds]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (seconds < 160) seconds = 160;       // past the pause
+
+    check_export(seconds);
+    check_restart_and_no_clock();
+
+    return check_result();
+}
@@ -0,0 +1,319 @@
+/**
+ * @file cdc_bench.c
+ * @brief Link benchmark client: throughput, loss, ordering and echo latency
+ *
+ * Talks to the firmware benchmark (TLM_CMD_BENCH) over /dev/ttyACM* or any
+ * tty, e.g. the pty stand-in started by cdc_sim:
+ *   - stream: the device fills the link with counter + pattern frames for
+ *     the given time; reports MB/s, frames lost (counter gaps), ordering
+ *     errors, pattern and CRC errors;
+ *   - echo: frames carrying a host timestamp are sent one at a time and
+ *     returned by the device; reports round-trip percentiles.
+ * Exit status is non-zero on any loss, reordering, corruption or timeout.
+ *
+ * Usage: cdc_bench [-t seconds] [-n payload] [-e echoes] [-p echo payload] DEVICE
+ *   cdc_bench /dev/ttyACM0
+ *   cdc_sim build/cdc_bench -t 1     (CI: pty stand-in running the firmware code)
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+
+static int fd = -1;
+static TLM_DecoderTypeDef dec;
+static TLM_EncoderTypeDef enc;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* ==== RECEIVE STATE ==== */
+typedef struct {
+    /* command responses */
+    uint16_t rsp_id;
+    int      rsp_status;        // -1 until the awaited response arrives
+
+    /* stream */
+    int      streaming;
+    uint32_t next;              // expected counter
+    uint64_t frames;
+    uint64_t payload_bytes;
+    uint64_t lost;
+    uint64_t reordered;
+    uint64_t pattern_errors;
+    uint64_t t_first, t_last;
+    uint64_t bytes_first;       // wire bytes received before the first stream frame
+
+    /* echo */
+    uint32_t echo_wait;         // index of the echo in flight
+    int      echo_ok;
+    uint64_t echo_rtt;
+} BENCH_RxTypeDef;
+
+static BENCH_RxTypeDef st;
+static uint64_t wire_bytes;
+
+static void on_frame(const TLM_FrameTypeDef *f, void *ctx)
+{
+    (void)ctx;
+    if (f->chan == TLM_CHAN_CMD_RSP && f->len >= TLM_CMD_RSP_SIZE) {
+        if (TLM_GetU16(f->payload) == st.rsp_id) st.rsp_status = f->payload[3];
+        return;
+    }
+    if (f->chan != TLM_CHAN_BENCH || f->len < 4) return;
+
+    uint32_t c = TLM_GetU32(f->payload);
+    if (!st.streaming) {
+        if (f->len >= 12 && c == st.echo_wait) {
+            uint64_t t;
+            memcpy(&t, &f->payload[4], 8);
+            st.echo_rtt = now_ns() - t;
+            st.echo_ok = 1;
+        }
+        return;
+    }
+
+    uint64_t t = now_ns();
+    if (st.frames == 0) {
+        st.t_first = t;
+        st.bytes_first = wire_bytes;
+        st.next = c;
+    }
+    if (c != st.next) {
+        if ((int32_t)(c - st.next) > 0) st.lost += c - st.next;
+        else st.reordered++;
+    }
+    st.next = c + 1U;
+    for (uint16_t i = 4; i < f->len; i++)
+        if (f->payload[i] != TLM_BENCH_PATTERN(i)) {
+            st.pattern_errors++;
+            break;
+        }
+    st.frames++;
+    st.payload_bytes += f->len;
+    st.t_last = t;
+}
+
+/* Read whatever arrives within timeout_ms; returns 0 on EOF/error */
+static int pump(int timeout_ms)
+{
+    static uint8_t buf[16384];
+    struct pollfd p = { .fd = fd, .events = POLLIN };
+
+    int r = poll(&p, 1, timeout_ms);
+    if (r < 0) return errno == EINTR;
+    if (r == 0) return 1;
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0) return n < 0 && (errno == EAGAIN || errno == EINTR);
+    wire_bytes += (uint64_t)n;
+    TLM_DecoderFeed(&dec, buf, (size_t)n, on_frame, NULL);
+    return 1;
+}
+
+static int write_all(const uint8_t *p, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                pump(1);
+                continue;
+            }
+            return 0;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+/* Send a command and wait for its response; returns the status or -1 */
+static int command(uint8_t op, const uint8_t *arg, uint16_t n, int timeout_ms)
+{
+    uint8_t buf[TLM_OVERHEAD + TLM_CMD_REQ_SIZE + 16];
+    TLM_WriterTypeDef w;
+    static uint16_t id;
+
+    st.rsp_id = ++id;
+    st.rsp_status = -1;
+    TLM_Begin(&enc, &w, buf, TLM_CHAN_CMD, 0);
+    TLM_PutU16(&w, st.rsp_id);
+    TLM_PutU8(&w, op);
+    for (uint16_t i = 0; i < n; i++)
+        TLM_PutU8(&w, arg[i]);
+    if (!write_all(buf, TLM_End(&w))) return -1;
+
+    uint64_t end = now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+    while (st.rsp_status < 0 && now_ns() < end)
+        if (!pump(10)) return -1;
+    return st.rsp_status;
+}
+
+static int bench_mode(uint8_t mode, uint16_t size)
+{
+    uint8_t arg[3] = { mode, (uint8_t)size, (uint8_t)(size >> 8) };
+    return command(TLM_CMD_BENCH, arg, sizeof(arg), 1000);
+}
+
+/* ==== TESTS ==== */
+static int run_stream(double seconds, uint16_t size)
+{
+    int status;
+
+    memset(&st, 0, sizeof(st));
+    st.streaming = 1;
+    if ((status = bench_mode(TLM_BENCH_STREAM, size)) != TLM_CMD_OK) {
+        fprintf(stderr, "stream: BENCH command failed (%d)\n", status);
+        return 1;
+    }
+    uint64_t end = now_ns() + (uint64_t)(seconds * 1e9);
+    while (now_ns() < end)
+        if (!pump(50)) break;
+    status = bench_mode(TLM_BENCH_OFF, 0);
+    /* frames already queued on the device */
+    for (int i = 0; i < 20; i++)
+        pump(10);
+    st.streaming = 0;
+
+    double dt = (double)(st.t_last - st.t_first) * 1e-9;
+    double wire = (double)(wire_bytes - st.bytes_first);
+    printf("stream  payload %u B: %" PRIu64 " frames in %.2f s, %.3f MB/s payload, %.3f MB/s wire\n",
+           size, st.frames, dt, dt > 0 ? (double)st.payload_bytes / dt / 1e6 : 0.0,
+           dt > 0 ? wire / dt / 1e6 : 0.0);
+    printf("        lost %" PRIu64 ", reordered %" PRIu64 ", pattern errors %" PRIu64
+           ", crc errors %" PRIu32 ", skipped bytes %" PRIu32 "\n", st.lost, st.reordered,
+           st.pattern_errors, dec.crc_errors, dec.skipped_bytes);
+
+    return status != TLM_CMD_OK || st.frames == 0 || st.lost || st.reordered || st.pattern_errors ||
+           dec.crc_errors;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int run_echo(uint32_t count, uint16_t size)
+{
+    uint64_t *rtt = calloc(count, sizeof(uint64_t));
+    uint8_t buf[TLM_OVERHEAD + TLM_MAX_PAYLOAD];
+    uint32_t got = 0, timeouts = 0;
+    int status;
+
+    if (!rtt) return 1;
+    memset(&st, 0, sizeof(st));
+    if ((status = bench_mode(TLM_BENCH_ECHO, 0)) != TLM_CMD_OK) {
+        fprintf(stderr, "echo: BENCH command failed (%d)\n", status);
+        free(rtt);
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        TLM_WriterTypeDef w;
+        TLM_Begin(&enc, &w, buf, TLM_CHAN_BENCH, i);
+        st.echo_wait = i;
+        st.echo_ok = 0;
+        uint64_t t = now_ns();
+        TLM_PutU32(&w, i);
+        memcpy(w.p, &t, 8);
+        w.p += 8;
+        for (uint16_t k = 12; k < size; k++)
+            TLM_PutU8(&w, TLM_BENCH_PATTERN(k));
+        if (!write_all(buf, TLM_End(&w))) break;
+
+        uint64_t end = t + 1000000000ULL;
+        while (!st.echo_ok && now_ns() < end)
+            if (!pump(5)) break;
+        if (st.echo_ok) rtt[got++] = st.echo_rtt;
+        else timeouts++;
+    }
+    status = bench_mode(TLM_BENCH_OFF, 0);
+
+    qsort(rtt, got, sizeof(rtt[0]), cmp_u64);
+    if (got > 0) {
+        printf("echo    payload %u B: %u round trips, rtt us p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+               size, got, rtt[got / 2] / 1e3, rtt[got * 9 / 10] / 1e3, rtt[got * 99 / 100] / 1e3,
+               rtt[got - 1] / 1e3);
+    }
+    printf("        timeouts %u\n", timeouts);
+    free(rtt);
+    return status != TLM_CMD_OK || got == 0 || timeouts != 0;
+}
+
+static int open_tty(const char *path)
+{
+    struct termios tio;
+    int bits = TIOCM_DTR | TIOCM_RTS;
+
+    fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    ioctl(fd, TIOCMBIS, &bits);     // opens the device side (DTR); not on a pty
+    tcflush(fd, TCIOFLUSH);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 3.0;
+    unsigned size = 498, echoes = 1000, echo_size = 16;
+    const char *path = NULL;
+    int opt, fail = 0;
+
+    while ((opt = getopt(argc, argv, "t:n:e:p:")) != -1) {
+        switch (opt) {
+        case 't': seconds = atof(optarg); break;
+        case 'n': size = (unsigned)atoi(optarg); break;
+        case 'e': echoes = (unsigned)atoi(optarg); break;
+        case 'p': echo_size = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-t seconds] [-n payload] [-e echoes] [-p echo payload] DEVICE\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc || echo_size < 12 || echo_size > 512U - TLM_OVERHEAD) {
+        fprintf(stderr, "usage: %s [-t seconds] [-n payload] [-e echoes] [-p echo payload 12..498] DEVICE\n", argv[0]);
+        return 2;
+    }
+    path = argv[optind];
+    if (!open_tty(path)) return 1;
+
+    TLM_DecoderInit(&dec);
+    /* stale output from before we opened the port */
+    for (int i = 0; i < 10; i++)
+        pump(10);
+    if (command(TLM_CMD_PING, NULL, 0, 1000) != TLM_CMD_OK) {
+        fprintf(stderr, "%s: no answer to PING\n", path);
+        return 1;
+    }
+    TLM_DecoderInit(&dec);
+
+    if (seconds > 0) fail |= run_stream(seconds, (uint16_t)size);
+    if (echoes > 0) fail |= run_echo(echoes, (uint16_t)echo_size);
+
+    printf("%s\n", fail ? "FAILED" : "OK");
+    close(fd);
+    return fail;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file cdc_sim.c
+ * @brief Pseudo-terminal stand-in for the device, for running cdc_bench in CI
+ *
+ * Runs the unmodified command.c, bench.c and CDC receive/transmit queues
+ * against the HAL shim and connects the shim's endpoints to a pty:
+ *   - bytes written by the host become 64-byte OUT packets, NAKed packets
+ *     stay in the pty until the receive queue has room again;
+ *   - an IN transfer is only taken once the previous one is fully in the
+ *     pty, so a host that stops reading backs up into the transmit queue;
+ *   - the HAL tick, SOF and scheduler timebase follow the real clock.
+ * Throughput is that of the pty, not of USB: the numbers check the code
+ * path and the tool, the hardware run gives the link figures.
+ *
+ * Usage: cdc_sim PROGRAM [ARGS...]
+ *   PROGRAM is started with the pty path appended to ARGS; the exit status
+ *   is that of PROGRAM.
+ *   cdc_sim build/cdc_bench -t 1 -e 200
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#undef CR1                      // termios output flag, clashes with the TIM2 register model
+
+#include "hal_shim.h"
+#include "microphone_sensor.h"
+#include "audio_packetizer.h"
+#include "audio_sync.h"
+#include "scheduler.h"
+#include "command.h"
+#include "bench.h"
+#include "telemetry.h"
+#include "usbd_cdc_if.h"
+
+MIC_HandleTypeDef mic;
+AUDIO_PKT_HandleTypeDef audio_pkt;
+AUDIO_SYNC_HandleTypeDef audio_sync;
+SCHED_HandleTypeDef sched;
+TLM_EncoderTypeDef tlm;
+BENCH_HandleTypeDef bench;
+CMD_HandleTypeDef cmd;
+
+static uint32_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000U + (uint64_t)ts.tv_nsec / 1000000U);
+}
+
+static uint32_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000U + (uint64_t)ts.tv_nsec / 1000U);
+}
+
+static int open_pty(char *name, size_t size, int *slave)
+{
+    struct termios tio;
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 ||
+        ptsname_r(master, name, size) != 0) {
+        perror("pty");
+        return -1;
+    }
+    /* Held open so the master never sees EIO between host opens, and raw
+     * so the line discipline neither echoes nor rewrites binary frames */
+    *slave = open(name, O_RDWR | O_NOCTTY);
+    if (*slave < 0 || tcgetattr(*slave, &tio) != 0) {
+        perror(name);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(*slave, TCSANOW, &tio);
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    return master;
+}
+
+static void dummy_job(void *ctx) { UNUSED(ctx); }
+
+int main(int argc, char **argv)
+{
+    char name[64];
+    int slave, status = 1;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s PROGRAM [ARGS...]\n", argv[0]);
+        return 2;
+    }
+    int master = open_pty(name, sizeof(name), &slave);
+    if (master < 0) return 1;
+
+    HalShim_Reset();
+    HalShim_SetTick(now_ms());
+    USBD_Interface_fops_FS.Init();
+    HalShim_SetLineState(CDC_LINE_DTR | CDC_LINE_RTS);
+    AudioPkt_Init(&audio_pkt);
+    Sched_Init(&sched);
+    Sched_AddJob(&sched, "prox", dummy_job, NULL, 50);
+    Sched_AddJob(&sched, "audio_lvl", dummy_job, NULL, 100);
+    Sched_AddJob(&sched, "sched", dummy_job, NULL, 1);
+    Bench_Init(&bench, &tlm);
+    Cmd_Init(&cmd, &sched, &audio_pkt, &bench, &tlm);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        char **args = calloc((size_t)argc + 1U, sizeof(char *));
+        for (int i = 1; i < argc; i++)
+            args[i - 1] = argv[i];
+        args[argc - 1] = name;
+        close(master);
+        execv(args[0], args);
+        perror(args[0]);
+        _exit(127);
+    }
+
+    uint8_t out[CDC_RX_RING_SIZE];
+    uint32_t out_len = 0;
+    static uint8_t in[APP_TX_DATA_SIZE];
+    uint32_t in_len = 0, in_off = 0;
+    uint32_t tick = now_ms();
+
+    for (;;) {
+        if (waitpid(pid, &status, WNOHANG) == pid) break;
+
+        /* tick and SOF; the jobs are not run, so the timebase is just set */
+        for (uint32_t t = now_ms(); tick != t; ) {
+            HalShim_SetTick(++tick);
+            CDC_TxQueue_OnSOF();
+        }
+        sched.tim->CNT = now_us();
+
+        /* host -> OUT endpoint, one max-size packet at a time until NAKed */
+        if (out_len < sizeof(out)) {
+            ssize_t n = read(master, &out[out_len], sizeof(out) - out_len);
+            if (n > 0) out_len += (uint32_t)n;
+        }
+        while (out_len > 0) {
+            uint32_t n = out_len < CDC_DATA_FS_MAX_PACKET_SIZE ? out_len : CDC_DATA_FS_MAX_PACKET_SIZE;
+            if (!HalShim_RxPacket(out, n)) break;
+            memmove(out, &out[n], out_len - n);
+            out_len -= n;
+        }
+
+        Cmd_Poll(&cmd);
+        Bench_Service(&bench);
+
+        /* IN endpoint -> host; TakeTx and TransmitCplt back to back as in DataIn */
+        uint8_t *p_tx;
+        if (in_off == in_len && (p_tx = HalShim_TakeTx(&in_len)) != NULL) {
+            memcpy(in, p_tx, in_len);
+            in_off = 0;
+            USBD_Interface_fops_FS.TransmitCplt(p_tx, &in_len, CDC_IN_EP);
+        }
+        if (in_off < in_len) {
+            ssize_t n = write(master, &in[in_off], in_len - in_off);
+            if (n > 0) in_off += (uint32_t)n;
+            if (in_off == in_len) continue;
+        }
+
+        struct pollfd p = { .fd = master, .events = (short)(in_off < in_len ? POLLOUT : 0) };
+        if (out_len < sizeof(out)) p.events |= POLLIN;
+        poll(&p, 1, 1);
+    }
+
+    close(master);
+    close(slave);
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    return 1;
+}
@@ -0,0 +1,38 @@
+/**
+ * @file check.h
+ * @brief What every host check shares: the failure count, CHECK, the LCG and the result line
+ *
+ * Included once by each check's main file, C or C++; the counter and the
+ * generator state are per check. A check seeds lcg_state before each
+ * sequence it wants reproducible, and ends main() with
+ *
+ *   return check_result();
+ *
+ * which prints "OK (0 failures)" or "FAILED (n failures)" for make check.
+ */
+
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (!(cond)) { failures++; printf("FAIL: " __VA_ARGS__); printf("\n"); } } while (0)
+
+static uint32_t lcg_state;
+static inline uint32_t lcg_next(void)
+{
+    lcg_state = lcg_state * 1664525U + 1013904223U;
+    return lcg_state;
+}
+
+/* Result line and exit status */
+static inline int check_result(void)
+{
+    printf("%s (%d failure%s)\n", failures ? "FAILED" : "OK", failures, failures == 1 ? "" : "s");
+    return failures ? 1 : 0;
+}
+
+#endif /* __CHECK_H__ */
@@ -0,0 +1,381 @@
+/**
+ * @file cmd_check.c
+ * @brief Host-native check of the host-to-device command channel
+ *
+ * Runs the unmodified command.c, CDC receive/transmit queues and scheduler
+ * against the HAL shim's OUT/IN endpoint model:
+ *   - every request is answered once with its request id, errors carry the
+ *     right status and no data; PING and TIME_SYNC report the HAL tick and
+ *     the scheduler timebase;
+ *   - SET_RATE / ENABLE / AUDIO_MODE reach the scheduler and packetizer;
+ *   - requests split across packets at random, mixed with garbage and a
+ *     corrupted frame, are parsed incrementally and answered in order;
+ *   - a flood of requests against an undrained IN endpoint NAKs the host
+ *     instead of overflowing the receive queue or dropping responses;
+ *   - in echo mode a long echo waits for room in the transmit queue
+ *     instead of being dropped.
+ *
+ * Usage: cmd_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "hal_shim.h"
+#include "microphone_sensor.h"
+#include "audio_packetizer.h"
+#include "audio_sync.h"
+#include "scheduler.h"
+#include "command.h"
+#include "telemetry.h"
+#include "usbd_cdc_if.h"
+
+MIC_HandleTypeDef mic;
+AUDIO_PKT_HandleTypeDef audio_pkt;
+AUDIO_SYNC_HandleTypeDef audio_sync;
+SCHED_HandleTypeDef sched;
+TLM_EncoderTypeDef tlm;
+BENCH_HandleTypeDef bench;
+CMD_HandleTypeDef cmd;
+
+/* ==== HELPERS ==== */
+typedef struct {
+    uint16_t id;
+    uint8_t  op;
+    uint8_t  status;
+    uint16_t len;           // data bytes after the status
+    uint8_t  data[CMD_MAX_RSP_DATA];
+} RSP_TypeDef;
+
+#define MAX_RSP 1024
+static RSP_TypeDef rsp[MAX_RSP];
+static uint32_t n_rsp;
+static TLM_DecoderTypeDef dec;
+static uint32_t now_ms;
+
+static void rsp_frame(const TLM_FrameTypeDef *f, void *ctx)
+{
+    UNUSED(ctx);
+    if (f->chan != TLM_CHAN_CMD_RSP || f->len < TLM_CMD_RSP_SIZE || n_rsp >= MAX_RSP) return;
+    RSP_TypeDef *r = &rsp[n_rsp++];
+    r->id = TLM_GetU16(f->payload);
+    r->op = f->payload[2];
+    r->status = f->payload[3];
+    r->len = (uint16_t)(f->len - TLM_CMD_RSP_SIZE);
+    memcpy(r->data, &f->payload[TLM_CMD_RSP_SIZE], r->len);
+}
+
+static void drain_all(void)
+{
+    uint32_t len;
+    uint8_t *p;
+
+    CDC_TxQueue_Kick();
+    for (uint32_t i = 0; i <= CDC_TX_FLUSH_MS; i++) {
+        while ((p = HalShim_TakeTx(&len)) != NULL) {
+            TLM_DecoderFeed(&dec, p, len, rsp_frame, NULL);
+            USBD_Interface_fops_FS.TransmitCplt(p, &len, CDC_IN_EP);
+        }
+        HalShim_SetTick(++now_ms);
+        CDC_TxQueue_OnSOF();
+    }
+}
+
+static TLM_EncoderTypeDef host_enc;
+
+static uint16_t make_request(uint8_t *buf, uint16_t id, uint8_t op, const uint8_t *arg, uint16_t n)
+{
+    TLM_WriterTypeDef w;
+    TLM_Begin(&host_enc, &w, buf, TLM_CHAN_CMD, 0);
+    TLM_PutU16(&w, id);
+    TLM_PutU8(&w, op);
+    for (uint16_t i = 0; i < n; i++)
+        TLM_PutU8(&w, arg[i]);
+    return TLM_End(&w);
+}
+
+/* Send bytes as full OUT packets; the endpoint must accept all of them */
+static void host_send(const uint8_t *data, uint32_t len)
+{
+    while (len > 0) {
+        uint32_t n = len < CDC_DATA_FS_MAX_PACKET_SIZE ? len : CDC_DATA_FS_MAX_PACKET_SIZE;
+        CHECK(HalShim_RxPacket(data, n), "OUT packet NAKed");
+        data += n;
+        len -= n;
+    }
+}
+
+/* One request/response round trip */
+static const RSP_TypeDef *transact(uint16_t id, uint8_t op, const uint8_t *arg, uint16_t n)
+{
+    uint8_t buf[TLM_OVERHEAD + TLM_CMD_REQ_SIZE + 16];
+    uint32_t before = n_rsp;
+
+    host_send(buf, make_request(buf, id, op, arg, n));
+    Cmd_Poll(&cmd);
+    drain_all();
+    CHECK(n_rsp == before + 1U, "op 0x%02X: %u responses", op, n_rsp - before);
+    if (n_rsp != before + 1U) {
+        static RSP_TypeDef none;
+        return &none;
+    }
+    CHECK(rsp[before].id == id && rsp[before].op == op, "op 0x%02X: response id %u op 0x%02X",
+          op, rsp[before].id, rsp[before].op);
+    return &rsp[before];
+}
+
+static void dummy_job(void *ctx) { UNUSED(ctx); }
+
+static void setup(void)
+{
+    HalShim_Reset();
+    HalShim_SetTick(now_ms);
+    drain_all();
+    while (CDC_RxQueue_Count() > 0U) {
+        uint8_t junk[64];
+        CDC_RxQueue_Read(junk, sizeof(junk));
+    }
+    USBD_Interface_fops_FS.Init();
+    HalShim_SetLineState(CDC_LINE_DTR | CDC_LINE_RTS);
+    AudioPkt_Init(&audio_pkt);
+    Sched_Init(&sched);
+    Sched_AddJob(&sched, "prox", dummy_job, NULL, 50);
+    Sched_AddJob(&sched, "audio_lvl", dummy_job, NULL, 100);
+    Sched_AddJob(&sched, "sched", dummy_job, NULL, 1);
+    Bench_Init(&bench, &tlm);
+    Cmd_Init(&cmd, &sched, &audio_pkt, &bench, &tlm);
+    memset(&cdc_rx_stats, 0, sizeof(cdc_rx_stats));
+    TLM_DecoderInit(&dec);
+    n_rsp = 0;
+}
+
+/* ==== REQUESTS, STATUS CODES ==== */
+static void check_requests(void)
+{
+    const RSP_TypeDef *r;
+    uint8_t arg[4];
+
+    setup();
+    HalShim_SetTick(now_ms = 12345);
+    r = transact(0x1234, TLM_CMD_PING, NULL, 0);
+    CHECK(r->status == TLM_CMD_OK && r->len == 5 && r->data[0] == TLM_VERSION, "ping: status %u len %u",
+          r->status, r->len);
+    CHECK(TLM_GetU32(&r->data[1]) == 12345U, "ping: uptime %u", TLM_GetU32(&r->data[1]));
+    sched.tim->CNT = 0xFFFFFF9CU;
+    uint32_t tick = now_ms;
+    r = transact(0x1235, TLM_CMD_TIME_SYNC, NULL, 0);
+    CHECK(r->status == TLM_CMD_OK && r->len == TLM_TIME_SYNC_SIZE && TLM_GetU32(&r->data[0]) == tick &&
+          TLM_GetU32(&r->data[4]) == 0xFFFFFF9CU, "time sync: status %u len %u, %u ms %u us", r->status, r->len,
+          TLM_GetU32(&r->data[0]), TLM_GetU32(&r->data[4]));
+
+    r = transact(1, 0x7F, NULL, 0);
+    CHECK(r->status == TLM_CMD_ERR_OP && r->len == 0, "unknown op: status %u len %u", r->status, r->len);
+    r = transact(2, 0x00, NULL, 0);
+    CHECK(r->status == TLM_CMD_ERR_OP, "op 0: status %u", r->status);
+    arg[0] = 0;
+    r = transact(3, TLM_CMD_PING, arg, 1);
+    CHECK(r->status == TLM_CMD_ERR_LEN && r->len == 0, "ping with argument: status %u", r->status);
+    r = transact(3, TLM_CMD_TIME_SYNC, arg, 1);
+    CHECK(r->status == TLM_CMD_ERR_LEN && r->len == 0, "time sync with argument: status %u", r->status);
+
+    arg[0] = 9; arg[1] = 10; arg[2] = 0;
+    r = transact(4, TLM_CMD_SET_RATE, arg, 3);
+    CHECK(r->status == TLM_CMD_ERR_ARG, "rate of job 9: status %u", r->status);
+    arg[0] = 0; arg[1] = 3; arg[2] = 0;
+    r = transact(5, TLM_CMD_SET_RATE, arg, 3);
+    CHECK(r->status == TLM_CMD_ERR_ARG && sched.job[0].period_us == 20000U, "3 Hz: status %u", r->status);
+    arg[0] = 0; arg[1] = 2;
+    r = transact(6, TLM_CMD_ENABLE, arg, 2);
+    CHECK(r->status == TLM_CMD_ERR_ARG, "enable 2: status %u", r->status);
+    arg[0] = 5;
+    r = transact(7, TLM_CMD_AUDIO_MODE, arg, 1);
+    CHECK(r->status == TLM_CMD_ERR_ARG, "audio mode 5: status %u", r->status);
+    CHECK(cmd.stats.requests == 10 && cmd.stats.errors == 8, "stats: %u requests %u errors",
+          cmd.stats.requests, cmd.stats.errors);
+}
+
+/* ==== EFFECTS ==== */
+static void check_control(void)
+{
+    const RSP_TypeDef *r;
+    uint8_t arg[4];
+
+    setup();
+    arg[0] = 0; arg[1] = 10; arg[2] = 0;
+    r = transact(10, TLM_CMD_SET_RATE, arg, 3);
+    CHECK(r->status == TLM_CMD_OK && sched.job[0].period_us == 100000U, "set rate: status %u period %u",
+          r->status, sched.job[0].period_us);
+    arg[0] = 1; arg[1] = 0;
+    r = transact(11, TLM_CMD_ENABLE, arg, 2);
+    CHECK(r->status == TLM_CMD_OK && !sched.job[1].enabled, "disable: status %u", r->status);
+
+    r = transact(12, TLM_CMD_GET_JOBS, NULL, 0);
+    CHECK(r->status == TLM_CMD_OK && r->len == 3 * 6, "get jobs: status %u len %u", r->status, r->len);
+    CHECK(r->data[0] == 0 && r->data[1] == 1 && TLM_GetU32(&r->data[2]) == 100000U, "get jobs: job 0");
+    CHECK(r->data[6] == 1 && r->data[7] == 0 && TLM_GetU32(&r->data[8]) == 10000U, "get jobs: job 1");
+    CHECK(r->data[12] == 2 && r->data[13] == 1 && TLM_GetU32(&r->data[14]) == 1000000U, "get jobs: job 2");
+
+    /* Disabled job is never released, the retuned one at its new cadence */
+    uint32_t runs[2] = { 0, 0 };
+    Sched_Start(&sched);
+    for (uint32_t ms = 0; ms < 1000; ms++) {
+        HalShim_TimAdvance(SCHED_TICK_US);
+        for (int i = 0; i < 2; i++)
+            runs[i] += sched.job[i].pending;
+        Sched_RunPending(&sched);
+    }
+    CHECK(runs[0] == 10 && runs[1] == 0, "after 1 s: job 0 ran %u times, job 1 %u times", runs[0], runs[1]);
+
+    /* Audio off: blocks are discarded; on again: packets resume */
+    static uint32_t block[MIC_FRAMES_PER_HALF * MIC_DMA_WORDS_PER_FRAME];
+    arg[0] = TLM_AUDIO_OFF;
+    r = transact(13, TLM_CMD_AUDIO_MODE, arg, 1);
+    CHECK(r->status == TLM_CMD_OK && !audio_pkt.enabled, "audio off: status %u", r->status);
+    AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, 0);
+    CHECK(audio_pkt.stats.samples_in == 0, "audio off: %u samples packed", audio_pkt.stats.samples_in);
+    arg[0] = TLM_AUDIO_STREAM;
+    r = transact(14, TLM_CMD_AUDIO_MODE, arg, 1);
+    AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, 0);
+    CHECK(r->status == TLM_CMD_OK && audio_pkt.stats.samples_in == MIC_FRAMES_PER_HALF,
+          "audio on: %u samples packed", audio_pkt.stats.samples_in);
+}
+
+/* ==== INCREMENTAL PARSING ==== */
+static void check_parsing(void)
+{
+    static uint8_t stream[4096];
+    uint32_t len = 0, garbage = 0;
+    const uint16_t n_req = 100, bad = 37;
+
+    setup();
+    lcg_state = 5;
+    for (uint16_t i = 0; i < n_req; i++) {
+        uint32_t junk = lcg_next() % 8;
+        for (uint32_t k = 0; k < junk; k++)
+            stream[len++] = (uint8_t)lcg_next();
+        garbage += junk;
+        uint16_t n = make_request(&stream[len], i, TLM_CMD_PING, NULL, 0);
+        if (i == bad) {
+            stream[len + n - 1] ^= 0x40;
+            garbage += n;
+        }
+        len += n;
+    }
+
+    /* Random OUT packet sizes, parsing between packets */
+    for (uint32_t pos = 0; pos < len; ) {
+        uint32_t n = 1 + lcg_next() % CDC_DATA_FS_MAX_PACKET_SIZE;
+        if (n > len - pos) n = len - pos;
+        CHECK(HalShim_RxPacket(&stream[pos], n), "OUT packet NAKed");
+        pos += n;
+        if ((lcg_next() >> 16) & 1U) {
+            Cmd_Poll(&cmd);
+            drain_all();
+        }
+    }
+    Cmd_Poll(&cmd);
+    drain_all();
+
+    uint16_t expect = 0;
+    uint32_t misordered = 0;
+    for (uint32_t i = 0; i < n_rsp; i++, expect++) {
+        if (expect == bad) expect++;
+        if (rsp[i].id != expect || rsp[i].status != TLM_CMD_OK) misordered++;
+    }
+    CHECK(n_rsp == n_req - 1U && misordered == 0, "parsing: %u responses, %u out of order", n_rsp, misordered);
+    CHECK(cmd.dec.crc_errors == 1, "parsing: %u crc errors", cmd.dec.crc_errors);
+    CHECK(cmd.dec.skipped_bytes == garbage, "parsing: %u bytes skipped, %u garbage", cmd.dec.skipped_bytes, garbage);
+    printf("  parsing: %u bytes in random packets, %u answered, %u crc error, %u garbage bytes skipped\n",
+           len, n_rsp, cmd.dec.crc_errors, cmd.dec.skipped_bytes);
+}
+
+/* ==== FLOW CONTROL ==== */
+static void check_flow_control(void)
+{
+    static uint8_t stream[600 * (TLM_OVERHEAD + TLM_CMD_REQ_SIZE)];
+    uint32_t len = 0, pos = 0, naks = 0;
+    const uint16_t n_req = 600;
+
+    setup();
+    for (uint16_t i = 0; i < n_req; i++)
+        len += make_request(&stream[len], i, TLM_CMD_PING, NULL, 0);
+
+    /* Host pushes as fast as it is allowed, device drains IN only now and then */
+    for (uint32_t iter = 0; pos < len && iter < 100000; iter++) {
+        for (int k = 0; k < 8 && pos < len; k++) {
+            uint32_t n = len - pos < CDC_DATA_FS_MAX_PACKET_SIZE ? len - pos : CDC_DATA_FS_MAX_PACKET_SIZE;
+            if (!HalShim_RxPacket(&stream[pos], n)) {
+                naks++;
+                break;
+            }
+            pos += n;
+        }
+        Cmd_Poll(&cmd);
+        if (iter % 64 == 63) drain_all();
+    }
+    for (int i = 0; i < 64 && n_rsp < n_req; i++) {
+        Cmd_Poll(&cmd);
+        drain_all();
+    }
+
+    uint32_t misordered = 0;
+    for (uint32_t i = 0; i < n_rsp; i++)
+        if (rsp[i].id != i) misordered++;
+    CHECK(n_rsp == n_req && misordered == 0, "flood: %u of %u answered, %u out of order", n_rsp, n_req, misordered);
+    CHECK(cdc_rx_stats.overflows == 0, "flood: %u receive overflows", cdc_rx_stats.overflows);
+    CHECK(cmd.stats.rsp_dropped == 0, "flood: %u responses dropped", cmd.stats.rsp_dropped);
+    CHECK(naks > 0 && cdc_rx_stats.pauses > 0, "flood: endpoint never paused");
+
+    const RSP_TypeDef *r = transact(0xBEEF, TLM_CMD_GET_STATS, NULL, 0);
+    CHECK(r->status == TLM_CMD_OK && r->len == 4 * TLM_STAT_COUNT, "get stats: status %u len %u", r->status, r->len);
+    CHECK(TLM_GetU32(&r->data[4 * TLM_STAT_CMD_REQUESTS]) == n_req &&
+          TLM_GetU32(&r->data[4 * TLM_STAT_RX_BYTES]) == len + TLM_OVERHEAD + TLM_CMD_REQ_SIZE,
+          "get stats: %u requests, %u rx bytes", TLM_GetU32(&r->data[4 * TLM_STAT_CMD_REQUESTS]),
+          TLM_GetU32(&r->data[4 * TLM_STAT_RX_BYTES]));
+    printf("  flood: %u requests, %u NAKs, %u endpoint pauses, rx watermark %u, tx watermark %u\n",
+           n_req, naks, cdc_rx_stats.pauses, cdc_rx_stats.high_watermark, cdc_tx_stats.high_watermark);
+}
+
+static void check_echo_reserve(void)
+{
+    static uint8_t fill[APP_TX_DATA_SIZE], frame[TLM_OVERHEAD + BENCH_MAX_PAYLOAD];
+    const uint16_t payload = 400;
+    TLM_WriterTypeDef w;
+
+    setup();
+    CHECK(Bench_SetMode(&bench, TLM_BENCH_ECHO, 0) == HAL_OK, "echo: mode refused");
+    TLM_Begin(&host_enc, &w, frame, TLM_CHAN_BENCH, 0);
+    for (uint16_t i = 0; i < payload; i++)
+        TLM_PutU8(&w, TLM_BENCH_PATTERN(i));
+    uint16_t len = TLM_End(&w);
+
+    /* Room for the command responses of a chunk, not for the echo */
+    uint32_t free = CDC_TxQueue_Free(), keep = CMD_RX_RESERVE + 16U;
+    CDC_TxQueue_Write(fill, (uint16_t)(free - keep));
+    host_send(frame, len);
+    for (int i = 0; i < 16; i++)
+        Cmd_Poll(&cmd);
+    CHECK(bench.stats.echoes == 0 && bench.stats.echo_dropped == 0, "echo: %u sent, %u dropped while the queue is full",
+          bench.stats.echoes, bench.stats.echo_dropped);
+
+    for (int i = 0; i < 4; i++) {
+        drain_all();
+        Cmd_Poll(&cmd);
+    }
+    CHECK(bench.stats.echoes == 1 && bench.stats.echo_dropped == 0, "echo: %u sent, %u dropped once drained",
+          bench.stats.echoes, bench.stats.echo_dropped);
+    printf("  echo: %u-byte echo held with %u bytes free, sent once drained\n", len, keep);
+}
+
+int main(void)
+{
+    check_requests();
+    check_control();
+    check_parsing();
+    check_flow_control();
+    check_echo_reserve();
+
+    return check_result();
+}
@@ -0,0 +1,403 @@
+/**
+ * @file col_check.cpp
+ * @brief Check and benchmark of the column capture files (tlm_col.hpp)
+ *
+ *   - write: a multi-day synthetic capture (prox 10 Hz, microphone level
+ *     50 Hz, gas and humidity/temperature 1 Hz per board) goes through the
+ *     device framing and ColumnWriter; write rate and size against the same
+ *     rows as CSV;
+ *   - read back: every stream read in full must reproduce the rows exactly;
+ *   - seek: random timestamps over the whole capture must land on the first
+ *     row at or after them; latency percentiles of seek + first row;
+ *   - recovery: the file cut inside its last chunks (writer killed) still
+ *     opens, with every complete chunk readable;
+ *   - corrupt footer: a footer whose offsets, lengths or stream ids do not
+ *     fit the file is ignored and the chunks are walked instead; a bad
+ *     source chunk ends the walk.
+ *
+ * Values are a function of the row number, so any row can be checked
+ * without keeping the capture in memory.
+ *
+ * Usage: col_check [-b] [-d days]    (-b: 7 days, 2 boards, more seeks)
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "check.h"
+#include "tlm_col.hpp"
+
+/* ==== HELPERS ==== */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t mix(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static unsigned digits(int64_t v)
+{
+    unsigned n = v < 0 ? 2 : 1;
+    for (uint64_t u = v < 0 ? (uint64_t)-v : (uint64_t)v; u >= 10; u /= 10)
+        n++;
+    return n;
+}
+
+/* ==== SYNTHETIC BOARDS ==== */
+static const int64_t T0_US = 1000000;           // first row 1 s after boot
+static const int64_t TICK_US = 20000;
+
+struct Synth {
+    uint8_t chan;
+    int64_t period_us;
+};
+
+static const Synth synth[] = {
+    { TLM_CHAN_AUDIO_LVL, 20000 },
+    { TLM_CHAN_PROX, 100000 },
+    { TLM_CHAN_GAS, 1000000 },
+    { TLM_CHAN_HUMTEMP, 1000000 },
+};
+
+/* Fields of row i of a board's channel: slowly varying sensors, a noisy level */
+static void synth_row(unsigned board, uint8_t chan, uint64_t i, int64_t *v)
+{
+    uint64_t k = (uint64_t)board << 56 | (uint64_t)chan << 48;
+    switch (chan) {
+    case TLM_CHAN_AUDIO_LVL:
+        v[0] = (int64_t)(mix(k ^ i) % 4001U) - 2000;
+        break;
+    case TLM_CHAN_PROX:
+        v[0] = 300 + (int64_t)(mix(k ^ (i >> 5)) % 16U);
+        v[1] = 5 + (int64_t)(mix(k ^ 0x100000000ULL ^ (i >> 8)) % 4U);
+        break;
+    case TLM_CHAN_GAS:
+        v[0] = 1 + (int64_t)(mix(k ^ (i >> 10)) % 3U);
+        v[1] = 100 + (int64_t)(mix(k ^ 0x100000000ULL ^ (i >> 4)) % 10U);
+        v[2] = 400 + (int64_t)(mix(k ^ 0x200000000ULL ^ (i >> 4)) % 20U);
+        break;
+    case TLM_CHAN_HUMTEMP:
+        v[0] = 2200 + (int64_t)(mix(k ^ (i >> 6)) % 20U);
+        v[1] = 4500 + (int64_t)(mix(k ^ 0x100000000ULL ^ (i >> 6)) % 30U);
+        break;
+    }
+}
+
+static uint16_t synth_frame(TLM_EncoderTypeDef *enc, uint8_t *buf, uint8_t chan, int64_t time_us, const int64_t *v)
+{
+    TLM_WriterTypeDef w;
+    TLM_Begin(enc, &w, buf, chan, (uint32_t)(time_us / 1000));
+    switch (chan) {
+    case TLM_CHAN_AUDIO_LVL: TLM_PutU32(&w, (uint32_t)v[0]); break;
+    case TLM_CHAN_PROX: TLM_PutU16(&w, (uint16_t)v[0]); TLM_PutU16(&w, (uint16_t)v[1]); break;
+    case TLM_CHAN_GAS: TLM_PutU8(&w, (uint8_t)v[0]); TLM_PutU16(&w, (uint16_t)v[1]); TLM_PutU16(&w, (uint16_t)v[2]); break;
+    case TLM_CHAN_HUMTEMP: TLM_PutU16(&w, (uint16_t)v[0]); TLM_PutU16(&w, (uint16_t)v[1]); break;
+    }
+    return TLM_End(&w);
+}
+
+static std::string board_serial(unsigned b)
+{
+    char s[24];
+    snprintf(s, sizeof(s), "0031003A35%02u", b % 100U);
+    return s;
+}
+
+/* ==== WRITE ==== */
+struct Capture {
+    std::string path;
+    unsigned boards;
+    int64_t span_us;
+    uint64_t rows, frame_bytes, csv_bytes, file_bytes;
+};
+
+static void write_capture(Capture &cap)
+{
+    tlm::ColumnWriter w;
+    CHECK(w.open(cap.path), "write: cannot create %s", cap.path.c_str());
+    std::vector<uint16_t> src;
+    for (unsigned b = 0; b < cap.boards; b++)
+        src.push_back(w.source(board_serial(b)));
+
+    std::vector<TLM_EncoderTypeDef> enc(cap.boards, TLM_EncoderTypeDef{});
+    uint8_t buf[TLM_MAX_FRAME];
+    int64_t v[tlm::COL_MAX_COLUMNS];
+    uint64_t t0 = now_ns(), gen_ns = 0;
+
+    for (int64_t t = T0_US; t < T0_US + cap.span_us; t += TICK_US) {
+        for (unsigned b = 0; b < cap.boards; b++)
+            for (const Synth &s : synth) {
+                if ((t - T0_US) % s.period_us) continue;
+                uint64_t i = (uint64_t)((t - T0_US) / s.period_us);
+                synth_row(b, s.chan, i, v);
+                uint64_t g = now_ns();
+                uint16_t n = synth_frame(&enc[b], buf, s.chan, t, v);
+                tlm::FrameRange fr(buf, n);
+                tlm::Frame f;
+                fr.next(f);
+                gen_ns += now_ns() - g;
+                w.add(src[b], f, t);
+
+                const tlm::ColumnSchema *sc = tlm::column_schema(s.chan);
+                cap.csv_bytes += 12 + 1 + strlen(sc->name) + 1 + digits(t) + 1 + digits(f.seq) + 1;
+                for (unsigned c = 0; c < sc->columns; c++)
+                    cap.csv_bytes += 1 + digits(v[c]);
+                cap.frame_bytes += n;
+                cap.rows++;
+            }
+    }
+    CHECK(w.close(), "write: close failed");
+    double secs = (now_ns() - t0 - gen_ns) / 1e9;
+    struct stat st;
+    stat(cap.path.c_str(), &st);
+    cap.file_bytes = (uint64_t)st.st_size;
+    printf("  write: %.1f days x %u boards, %" PRIu64 " rows in %" PRIu64 " chunks: %.1f Mrows/s (%.0f MB/s of frames)\n",
+           cap.span_us / 86400e6, cap.boards, cap.rows, w.stats().chunks, cap.rows / secs / 1e6,
+           cap.frame_bytes / secs / 1e6);
+    printf("  size:  %.1f MB as CSV, %.1f MB as frames, %.2f MB column file (%.1fx smaller than CSV, %.2f bytes/row)\n",
+           cap.csv_bytes / 1e6, cap.frame_bytes / 1e6, cap.file_bytes / 1e6, (double)cap.csv_bytes / cap.file_bytes,
+           (double)cap.file_bytes / cap.rows);
+    CHECK(cap.file_bytes * 10U < cap.csv_bytes, "size: column file not 10x below CSV");
+}
+
+/* ==== READ BACK ==== */
+static bool row_ok(unsigned board, const tlm::ColumnStream &s, uint64_t i, const tlm::Row &row)
+{
+    int64_t v[tlm::COL_MAX_COLUMNS] = {};
+    int64_t period = 0;
+    for (const Synth &x : synth)
+        if (x.chan == s.schema->chan) period = x.period_us;
+    synth_row(board, s.schema->chan, i, v);
+    if (row.time_us != T0_US + (int64_t)i * period) return false;
+    for (unsigned c = 0; c < s.schema->columns; c++)
+        if (row.v[c] != v[c]) return false;
+    return true;
+}
+
+static unsigned board_of(const tlm::ColumnStream &s)
+{
+    return (unsigned)atoi(s.source.c_str() + 10);
+}
+
+static void check_read(const Capture &cap)
+{
+    tlm::ColumnReader r;
+    CHECK(r.open(cap.path) && !r.recovered(), "read: cannot open %s", cap.path.c_str());
+    CHECK(r.streams() == cap.boards * 4U, "read: %zu streams", r.streams());
+
+    uint64_t t0 = now_ns(), rows = 0, bad = 0;
+    for (size_t i = 0; i < r.streams(); i++) {
+        const tlm::ColumnStream &s = r.stream(i);
+        tlm::ColumnCursor cur = r.seek(i, INT64_MIN);
+        tlm::Row row;
+        uint64_t n = 0;
+        for (; cur.next(row); n++)
+            bad += !row_ok(board_of(s), s, n, row);
+        CHECK(n == s.rows, "read: stream %zu: %" PRIu64 " of %" PRIu64 " rows", i, n, s.rows);
+        rows += n;
+    }
+    double secs = (now_ns() - t0) / 1e9;
+    CHECK(rows == cap.rows && bad == 0, "read: %" PRIu64 " of %" PRIu64 " rows, %" PRIu64 " differ", rows, cap.rows, bad);
+    printf("  read:  all streams in full, %.1f Mrows/s, every row matches\n", rows / secs / 1e6);
+}
+
+/* ==== SEEK ==== */
+static void check_seek(const Capture &cap, unsigned seeks)
+{
+    uint64_t t_open = now_ns();
+    tlm::ColumnReader r;
+    r.open(cap.path);
+    t_open = now_ns() - t_open;
+
+    std::vector<uint64_t> lat;
+    uint64_t bad = 0;
+    for (unsigned k = 0; k < seeks; k++) {
+        size_t si = lcg_next() % r.streams();
+        const tlm::ColumnStream &s = r.stream(si);
+        int64_t t = T0_US + (int64_t)(((uint64_t)lcg_next() << 32 | lcg_next()) % (uint64_t)cap.span_us);
+        int64_t period = 0;
+        for (const Synth &x : synth)
+            if (x.chan == s.schema->chan) period = x.period_us;
+
+        uint64_t g = now_ns();
+        tlm::ColumnCursor cur = r.seek(si, t);
+        tlm::Row row;
+        bool got = cur.next(row);
+        lat.push_back(now_ns() - g);
+
+        uint64_t i = (uint64_t)((t - T0_US + period - 1) / period);
+        if (i >= s.rows)
+            bad += got;
+        else
+            bad += !got || !row_ok(board_of(s), s, i, row);
+    }
+    std::sort(lat.begin(), lat.end());
+    CHECK(bad == 0, "seek: %" PRIu64 " of %u seeks landed on the wrong row", bad, seeks);
+    CHECK(lat[lat.size() * 99 / 100] < 5000000U, "seek: p99 %.2f ms", lat[lat.size() * 99 / 100] / 1e6);
+    printf("  seek:  open %.2f ms, %u random seeks + first row: p50 %.1f us p99 %.1f us max %.1f us\n", t_open / 1e6,
+           seeks, lat[lat.size() / 2] / 1e3, lat[lat.size() * 99 / 100] / 1e3, lat.back() / 1e3);
+}
+
+/* ==== RECOVERY ==== */
+static void check_recovery(const Capture &cap)
+{
+    std::string cut = cap.path + ".cut";
+    FILE *in = fopen(cap.path.c_str(), "rb"), *out = fopen(cut.c_str(), "wb");
+    if (!in || !out) {
+        CHECK(0, "recovery: cannot copy the capture");
+        if (in) fclose(in);
+        if (out) fclose(out);
+        return;
+    }
+    /* keep 90%: the footer and the last chunks are gone, one chunk torn */
+    uint64_t keep = cap.file_bytes * 9U / 10U, done = 0;
+    std::vector<char> buf(1U << 20);
+    while (done < keep) {
+        size_t n = fread(buf.data(), 1, std::min<uint64_t>(buf.size(), keep - done), in);
+        if (n == 0) break;
+        fwrite(buf.data(), 1, n, out);
+        done += n;
+    }
+    fclose(in);
+    fclose(out);
+
+    tlm::ColumnReader r;
+    CHECK(r.open(cut) && r.recovered(), "recovery: cut file not opened as recovered");
+    uint64_t rows = 0, bad = 0;
+    for (size_t i = 0; i < r.streams(); i++) {
+        const tlm::ColumnStream &s = r.stream(i);
+        tlm::ColumnCursor cur = r.seek(i, INT64_MIN);
+        tlm::Row row;
+        uint64_t n = 0;
+        for (; cur.next(row); n++)
+            bad += !row_ok(board_of(s), s, n, row);
+        bad += n != s.rows;
+        rows += n;
+    }
+    CHECK(bad == 0 && rows > cap.rows * 8U / 10U && rows < cap.rows,
+          "recovery: %" PRIu64 " rows of %" PRIu64 ", %" PRIu64 " wrong", rows, cap.rows, bad);
+    printf("  recovery: file cut to 90%%, index rebuilt from %zu streams, %.1f%% of the rows intact\n", r.streams(),
+           100.0 * rows / cap.rows);
+    unlink(cut.c_str());
+}
+
+/* ==== CORRUPT FOOTER ==== */
+static void check_corrupt(const Capture &cap)
+{
+    std::vector<uint8_t> file(cap.file_bytes);
+    FILE *in = fopen(cap.path.c_str(), "rb");
+    bool got = in && fread(file.data(), 1, file.size(), in) == file.size();
+    if (in) fclose(in);
+    if (!got || file.size() < sizeof(tlm::ColFileHeader) + sizeof(tlm::ColChunkHeader) + sizeof(tlm::ColTrailer)) {
+        CHECK(0, "corrupt: cannot read the capture");
+        return;
+    }
+    tlm::ColTrailer t;
+    const size_t at = file.size() - sizeof(t);
+    std::memcpy(&t, &file[at], sizeof(t));
+
+    struct Case {
+        const char *name;
+        size_t off;                     // where the bad bytes go
+        uint64_t value;
+        size_t size;
+        bool rows;                      // every chunk still complete
+    };
+    const Case cases[] = {
+        { "streams offset past the end", at + offsetof(tlm::ColTrailer, streams_offset), file.size() * 2, 8, true },
+        { "streams offset after the index", at + offsetof(tlm::ColTrailer, streams_offset), t.index_offset + 8, 8,
+          true },
+        { "source length over the index", (size_t)t.streams_offset, 0xFFFF, 2, true },
+        { "stream table over the index", at + offsetof(tlm::ColTrailer, streams), 0xFFFFFFFFU, 4, true },
+        { "index entries past the end", at + offsetof(tlm::ColTrailer, index_entries), ~0ULL / 2, 8, true },
+        { "index stream out of range", (size_t)t.index_offset, 0xFFFF, 2, true },
+        { "index out of stream order", (size_t)t.index_offset, t.streams - 1U, 2, true },
+        { "source chunk over its bytes", sizeof(tlm::ColFileHeader) + offsetof(tlm::ColChunkHeader, col_bytes),
+          0xFFFFFFF0U, 4, false },
+    };
+
+    std::string path = cap.path + ".bad";
+    unsigned ok = 0;
+    for (const Case &c : cases) {
+        std::vector<uint8_t> bad = file;
+        std::memcpy(&bad[c.off], &c.value, c.size);
+        if (!c.rows) bad.resize(at);    // no footer to fall back from
+        FILE *out = fopen(path.c_str(), "wb");
+        if (!out || fwrite(bad.data(), 1, bad.size(), out) != bad.size()) {
+            CHECK(0, "corrupt: cannot write %s", path.c_str());
+            if (out) fclose(out);
+            break;
+        }
+        fclose(out);
+
+        tlm::ColumnReader r;
+        if (!r.open(path) || !r.recovered()) {
+            CHECK(0, "corrupt: %s: not opened as recovered", c.name);
+            continue;
+        }
+        uint64_t rows = 0, wrong = 0;
+        for (size_t i = 0; i < r.streams(); i++) {
+            const tlm::ColumnStream &s = r.stream(i);
+            tlm::ColumnCursor cur = r.seek(i, INT64_MIN);
+            tlm::Row row;
+            uint64_t n = 0;
+            for (; cur.next(row); n++)
+                wrong += !row_ok(board_of(s), s, n, row);
+            rows += n;
+        }
+        bool good = c.rows ? rows == cap.rows && wrong == 0 : r.streams() == 0;
+        CHECK(good, "corrupt: %s: %zu streams, %" PRIu64 " rows of %" PRIu64 ", %" PRIu64 " wrong", c.name,
+              r.streams(), rows, cap.rows, wrong);
+        ok += good;
+    }
+    unlink(path.c_str());
+    printf("  corrupt: %u of %zu damaged footers and chunks opened by walking the chunks\n", ok,
+           sizeof(cases) / sizeof(cases[0]));
+}
+
+int main(int argc, char **argv)
+{
+    lcg_state = 5;
+    int full = 0, opt;
+    double days = 2;
+    while ((opt = getopt(argc, argv, "bd:")) != -1) {
+        switch (opt) {
+        case 'b': full = 1; days = 7; break;
+        case 'd': days = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-b] [-d days]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    Capture cap = {};
+    cap.path = "/tmp/col_check_" + std::to_string(getpid()) + ".tlmc";
+    cap.boards = full ? 2 : 1;
+    cap.span_us = (int64_t)(days * 86400e6);
+
+    write_capture(cap);
+    check_read(cap);
+    check_seek(cap, full ? 100000 : 10000);
+    check_recovery(cap);
+    check_corrupt(cap);
+    unlink(cap.path.c_str());
+
+    return check_result();
+}
@@ -0,0 +1,219 @@
+/**
+ * @file console_check.c
+ * @brief Host-native check of the stdio backend (console.c) on its two rings
+ *
+ * Runs the unmodified console.c over the log console (usbd_cdc_log_if.c)
+ * and USART1 (uart_tx.c) rings, with the HAL shim's endpoint and DMA latches:
+ *   - each route carries exactly the bytes written, both routes the same
+ *     bytes, a disabled route none;
+ *   - with no terminal open and the ring full, writes still return at once
+ *     reporting every byte written; refusals are counted, not retried;
+ *   - a write from interrupt context is dropped and counted, the ring
+ *     untouched;
+ *   - stdin returns what was typed, in order across ring wraps, 0 when
+ *     nothing is pending, and counts what overflowed the receive ring.
+ *
+ * Usage: console_check
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "hal_shim.h"
+#include "microphone_sensor.h"
+#include "audio_packetizer.h"
+#include "audio_sync.h"
+#include "scheduler.h"
+#include "uart_tx.h"
+#include "usbd_cdc_if.h"
+#include "usbd_cdc_log_if.h"
+#include "console.h"
+
+MIC_HandleTypeDef mic;
+AUDIO_PKT_HandleTypeDef audio_pkt;
+AUDIO_SYNC_HandleTypeDef audio_sync;
+SCHED_HandleTypeDef sched;
+
+/* ==== HELPERS ==== */
+static uint8_t usb_out[4096], uart_out[4096];
+static uint32_t usb_len, uart_len;
+
+static void console_reset(uint8_t routes)
+{
+    HalShim_Reset();
+    USBD_LogInterface_fops_FS.Init();
+    UartTx_Init(&huart1);
+    memset(&cdc_log_stats, 0, sizeof(cdc_log_stats));
+    memset(&console_stats, 0, sizeof(console_stats));
+    Console_SetRoutes(routes);
+    usb_len = 0;
+    uart_len = 0;
+}
+
+/* Let both transports run until idle, collecting what they sent */
+static void drain(void)
+{
+    for (int busy = 1; busy;) {
+        uint32_t len;
+        busy = 0;
+        CDC_Log_OnSOF();
+        uint8_t *p = HalShim_TakeLogTx(&len);
+        if (p != NULL) {
+            if (usb_len + len <= sizeof(usb_out)) memcpy(&usb_out[usb_len], p, len);
+            usb_len += len;
+            USBD_LogInterface_fops_FS.TransmitCplt(p, &len, CDC_LOG_IN_EP);
+            busy = 1;
+        }
+        const uint8_t *u = HalShim_TakeUartTx(&len);
+        if (u != NULL) {
+            if (uart_len + len <= sizeof(uart_out)) memcpy(&uart_out[uart_len], u, len);
+            uart_len += len;
+            HAL_UART_TxCpltCallback(&huart1);
+            busy = 1;
+        }
+    }
+}
+
+static uint32_t put_lines(int count, char *expect, uint32_t size)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < count; i++) {
+        char line[64];
+        int k = snprintf(line, sizeof(line), "line %d: t=%u ms\r\n", i, 1000U + 7U * (unsigned)i);
+        CHECK(Console_Write(line, k) == k, "write %d: short count", i);
+        if (n + (uint32_t)k <= size) memcpy(&expect[n], line, (size_t)k);
+        n += (uint32_t)k;
+    }
+    return n;
+}
+
+/* ==== CHECKS ==== */
+static void check_routes(void)
+{
+    static const struct { const char *name; uint8_t routes; } cases[] = {
+        { "usb", CONSOLE_ROUTE_USB },
+        { "uart", CONSOLE_ROUTE_UART },
+        { "both", CONSOLE_ROUTE_USB | CONSOLE_ROUTE_UART },
+    };
+    char expect[4096];
+
+    for (unsigned c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        console_reset(cases[c].routes);
+        HalShim_SetLogLineState(CDC_LINE_DTR | CDC_LINE_RTS);
+        /* several rounds so both rings wrap */
+        for (int round = 0; round < 4; round++) {
+            usb_len = uart_len = 0;
+            uint32_t n = put_lines(20, expect, sizeof(expect));
+            drain();
+            if (cases[c].routes & CONSOLE_ROUTE_USB)
+                CHECK(usb_len == n && memcmp(usb_out, expect, n) == 0,
+                      "%s: usb got %u of %u bytes", cases[c].name, usb_len, n);
+            if (cases[c].routes & CONSOLE_ROUTE_UART)
+                CHECK(uart_len == n && memcmp(uart_out, expect, n) == 0,
+                      "%s: uart got %u of %u bytes", cases[c].name, uart_len, n);
+        }
+        CHECK(!(cases[c].routes & CONSOLE_ROUTE_USB) == (cdc_log_stats.bytes_queued == 0),
+              "%s: usb route %s", cases[c].name, cdc_log_stats.bytes_queued ? "used" : "unused");
+        CHECK(!(cases[c].routes & CONSOLE_ROUTE_UART) == (uart_tx_stats.bytes_queued == 0),
+              "%s: uart route %s", cases[c].name, uart_tx_stats.bytes_queued ? "used" : "unused");
+        CHECK(console_stats.refused == 0, "%s: %u refused", cases[c].name, console_stats.refused);
+    }
+    printf("  routes: usb, uart and both carry the lines intact across wraps\n");
+}
+
+static void check_never_waits(void)
+{
+    char expect[4096];
+
+    /* No terminal: the console keeps output until the ring is full */
+    console_reset(CONSOLE_ROUTE_USB);
+    uint32_t n = put_lines(200, expect, sizeof(expect));
+    CHECK(console_stats.writes == 200 && console_stats.bytes == n,
+          "full: %u writes, %u bytes counted", console_stats.writes, console_stats.bytes);
+    CHECK(console_stats.refused > 0 && console_stats.refused == cdc_log_stats.drops,
+          "full: %u refused, %u dropped by the ring", console_stats.refused, cdc_log_stats.drops);
+    CHECK(cdc_log_stats.bytes_queued + cdc_log_stats.dropped_bytes == n,
+          "full: %u queued + %u dropped of %u", cdc_log_stats.bytes_queued, cdc_log_stats.dropped_bytes, n);
+
+    /* The kept lines are the first ones, whole */
+    HalShim_SetLogLineState(CDC_LINE_DTR | CDC_LINE_RTS);
+    drain();
+    CHECK(usb_len == cdc_log_stats.bytes_queued && memcmp(usb_out, expect, usb_len) == 0,
+          "full: %u bytes sent once opened, expected the first %u", usb_len, cdc_log_stats.bytes_queued);
+
+    /* One route refusing is not a refusal while the other takes the line */
+    console_reset(CONSOLE_ROUTE_USB | CONSOLE_ROUTE_UART);
+    put_lines(200, expect, sizeof(expect));
+    CHECK(cdc_log_stats.drops > 0 && console_stats.refused == 0,
+          "both: %u usb drops, %u refused", cdc_log_stats.drops, console_stats.refused);
+    printf("  never waits: %u of 200 lines refused without a terminal, counted\n", cdc_log_stats.drops);
+}
+
+static void check_isr(void)
+{
+    static const char line[] = "from an interrupt\r\n";
+
+    console_reset(CONSOLE_ROUTE_USB | CONSOLE_ROUTE_UART);
+    hal_shim_ipsr = 0x2BU;      // in an interrupt handler
+    CHECK(Console_Write(line, sizeof(line) - 1) == (int)sizeof(line) - 1, "isr: short count");
+    hal_shim_ipsr = 0;
+    CHECK(console_stats.isr_writes == 1 && console_stats.writes == 0,
+          "isr: %u isr writes, %u writes", console_stats.isr_writes, console_stats.writes);
+    CHECK(cdc_log_stats.bytes_queued == 0 && uart_tx_stats.bytes_queued == 0,
+          "isr: %u/%u bytes queued", cdc_log_stats.bytes_queued, uart_tx_stats.bytes_queued);
+    printf("  isr: dropped and counted, rings untouched\n");
+}
+
+static void check_stdin(void)
+{
+    uint8_t pkt[CDC_DATA_FS_MAX_PACKET_SIZE];
+    char got[CDC_LOG_RX_SIZE];
+    uint8_t next_in = 0, next_out = 0;
+    int order = 1;
+
+    console_reset(CONSOLE_ROUTE_USB);
+    CHECK(Console_Read(got, sizeof(got)) == 0, "stdin: bytes before any were typed");
+
+    /* Packets of varying size, read in smaller pieces, many wraps */
+    for (int i = 0; i < 100; i++) {
+        uint32_t len = 1U + (uint32_t)(i * 7) % sizeof(pkt);
+        for (uint32_t k = 0; k < len; k++)
+            pkt[k] = next_in++;
+        USBD_LogInterface_fops_FS.Receive(pkt, &len);
+        int n;
+        while ((n = Console_Read(got, 13)) > 0)
+            for (int k = 0; k < n; k++)
+                order &= (uint8_t)got[k] == next_out++;
+    }
+    CHECK(order && next_out == next_in, "stdin: bytes out of order or missing");
+    CHECK(console_stats.read_bytes == cdc_log_stats.rx_bytes && cdc_log_stats.rx_dropped == 0,
+          "stdin: %u read of %u typed", console_stats.read_bytes, cdc_log_stats.rx_bytes);
+
+    /* Nobody reading: the ring keeps the first CDC_LOG_RX_SIZE bytes */
+    for (int i = 0; i < 8; i++) {
+        uint32_t len = sizeof(pkt);
+        memset(pkt, 'a' + i, sizeof(pkt));
+        USBD_LogInterface_fops_FS.Receive(pkt, &len);
+    }
+    int n = Console_Read(got, sizeof(got));
+    CHECK(n == (int)CDC_LOG_RX_SIZE && got[0] == 'a' && got[n - 1] == 'a' + (char)(CDC_LOG_RX_SIZE / sizeof(pkt) - 1U),
+          "stdin: %d bytes kept", n);
+    CHECK(cdc_log_stats.rx_dropped == 8U * sizeof(pkt) - CDC_LOG_RX_SIZE,
+          "stdin: %u dropped", cdc_log_stats.rx_dropped);
+    CHECK(Console_Read(got, sizeof(got)) == 0, "stdin: bytes after the ring was emptied");
+    printf("  stdin: typed bytes in order, %u overflowed and counted\n", cdc_log_stats.rx_dropped);
+}
+
+int main(void)
+{
+    /* stdout gets the console's line buffer before anything is printed, as on the device */
+    Console_Init(CONSOLE_DEFAULT_ROUTES);
+
+    check_routes();
+    check_never_waits();
+    check_isr();
+    check_stdin();
+
+    return check_result();
+}
@@ -0,0 +1,473 @@
+/**
+ * @file delta_check.cpp
+ * @brief Check of the delta coded sensor channels (TLM_EndDelta / TLM_DeltaExpand)
+ *
+ *   - traces: an hour of ALS/PS at 50 Hz (lighting steps, the 80 ms ALS
+ *     integration, hand approaches), ENS160 gas and four HDC302x sensors
+ *     at 1 Hz go through TLM_EndDelta, the byte stream, tlm::Reader and
+ *     tlm::DeltaDecoder as well as the reference decoder; every record
+ *     must come back bit exact, and the compression per channel is printed;
+ *   - device drops (queue full, failed send): still exact, and no delta
+ *     frame may ever lack its reference;
+ *   - link loss: no record is expanded wrong, and each loss costs at most
+ *     the records up to the next keyframe that arrives;
+ *   - fuzz: any values, wraps, record length changes;
+ *   - malformed delta payloads are rejected, the next keyframe recovers.
+ *
+ * With a capture file, its PROX, GAS and HUMTEMP records are coded the way
+ * the device would code them (seq gaps taken as device drops) instead of
+ * the traces: the ratios delta coding gives on that capture.
+ *
+ * Usage: delta_check [capture]
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+#include "check.h"
+#include "tlm_stream.hpp"
+
+/* ==== HELPERS ==== */
+/* Uniform in [-k, k] */
+static int noise(int k)
+{
+    return (int)((lcg_next() >> 8) % (uint32_t)(2 * k + 1)) - k;
+}
+
+static bool chance(double p)
+{
+    return (lcg_next() >> 8) < (uint32_t)(p * (double)(1U << 24));
+}
+
+static const uint8_t delta_chans[] = { TLM_CHAN_PROX, TLM_CHAN_GAS, TLM_CHAN_HUMTEMP };
+
+struct Record {
+    uint8_t chan;
+    uint32_t ts;
+    std::vector<uint8_t> v;
+};
+
+static void put16(std::vector<uint8_t> &v, int x)
+{
+    uint16_t u = (uint16_t)x;
+    v.push_back((uint8_t)u);
+    v.push_back((uint8_t)(u >> 8));
+}
+
+/* ==== SENSOR TRACES ==== */
+/* Records in time order, ms timestamps */
+static std::vector<Record> traces(double seconds)
+{
+    std::vector<Record> out;
+    int als = 300, als_target = 300, ps = 8, approach = 0;
+    int aqi = 1, tvoc = 120, eco2 = 450;
+    int temp[4] = { 2231, 2248, 2262, 2219 }, rh[4] = { 4510, 4475, 4390, 4620 };
+
+    for (uint32_t ms = 0; ms < (uint32_t)(seconds * 1000.0); ms += 20) {
+        /* ALS: lights switched every few minutes, a new reading every 80 ms */
+        if (chance(1.0 / 15000)) als_target = 40 + (int)(lcg_next() % 1200U);
+        if (ms % 80 == 0) als += (als_target - als) / 8 + noise(2);
+        /* PS: baseline noise, now and then a hand comes close and leaves */
+        if (approach == 0 && chance(1.0 / 3000)) approach = 100;
+        if (approach > 0) approach--;
+        int hand = approach > 80 ? (100 - approach) * 100 : approach > 20 ? 2000 : approach * 100;
+        ps = 8 + hand + noise(1);
+
+        Record r = { TLM_CHAN_PROX, ms, {} };
+        put16(r.v, als < 0 ? 0 : als);
+        put16(r.v, ps);
+        out.push_back(r);
+
+        if (ms % 1000 != 0) continue;
+        if (chance(1.0 / 600)) aqi = 1 + (int)(lcg_next() % 5U);
+        tvoc = std::max(0, tvoc + noise(3));
+        eco2 = std::max(400, eco2 + noise(5));
+        Record g = { TLM_CHAN_GAS, ms, { (uint8_t)aqi } };
+        put16(g.v, tvoc);
+        put16(g.v, eco2);
+        out.push_back(g);
+
+        Record h = { TLM_CHAN_HUMTEMP, ms, {} };
+        for (int i = 0; i < 4; i++) {
+            temp[i] += noise(2);
+            rh[i] += noise(6);
+            put16(h.v, temp[i]);
+            put16(h.v, rh[i]);
+        }
+        out.push_back(h);
+    }
+    return out;
+}
+
+/* Any values: small and large steps, wraps, HUMTEMP sensor count changing */
+static std::vector<Record> fuzz(unsigned n)
+{
+    std::vector<Record> out;
+    std::vector<uint8_t> last[3];
+
+    for (unsigned i = 0; i < n; i++) {
+        unsigned k = lcg_next() % 3U;
+        Record r = { delta_chans[k], i, {} };
+        size_t len = k == 0 ? 4 : k == 1 ? 5 : 4U * (1U + (lcg_next() >> 8) % 4U);
+        if (k == 2 && last[2].size() && !chance(0.05)) len = last[2].size();
+        r.v.resize(len);
+        for (size_t j = 0; j < len; j++) {
+            uint8_t prev = j < last[k].size() ? last[k][j] : 0;
+            uint32_t sel = (lcg_next() >> 8) % 8U;
+            r.v[j] = sel < 4 ? prev : sel < 6 ? (uint8_t)(prev + noise(3)) : (uint8_t)(lcg_next() >> 24);
+        }
+        last[k] = r.v;
+        out.push_back(r);
+    }
+    return out;
+}
+
+/* ==== DEVICE AND LINK ==== */
+struct Link {
+    double queue_full;          // TLM_Drop before the frame is built
+    double send_fail;           // built, then CDC_Transmit_FS refused it
+    double lost;                // sent, lost on the link
+};
+
+struct Coded {
+    std::vector<uint8_t> stream;
+    std::vector<const Record *> expect;     // per frame in the stream
+    uint64_t device_drops, link_losses;
+};
+
+/* The firmware path: TLM_Begin, fields, TLM_EndDelta, queue */
+static Coded encode(const std::vector<Record> &recs, const Link &link)
+{
+    Coded c = {};
+    TLM_EncoderTypeDef enc = {};
+    TLM_DeltaTypeDef ref[TLM_CHAN_COUNT] = {};
+    uint8_t buf[TLM_OVERHEAD + TLM_DELTA_MAX_RECORD];
+
+    for (const Record &r : recs) {
+        if (chance(link.queue_full)) {
+            TLM_Drop(&enc, r.chan);
+            c.device_drops++;
+            continue;
+        }
+        TLM_WriterTypeDef w;
+        TLM_Begin(&enc, &w, buf, r.chan, r.ts);
+        memcpy(w.p, r.v.data(), r.v.size());
+        w.p += r.v.size();
+        uint16_t len = TLM_EndDelta(&enc, &w, &ref[r.chan]);
+        if (chance(link.send_fail)) {
+            enc.dropped[r.chan]++;
+            c.device_drops++;
+            continue;
+        }
+        if (chance(link.lost)) {
+            c.link_losses++;
+            continue;
+        }
+        c.stream.insert(c.stream.end(), buf, buf + len);
+        c.expect.push_back(&r);
+    }
+    return c;
+}
+
+/* ==== DECODING ==== */
+struct Comp {
+    uint64_t records, keys;
+    uint64_t plain, wire;       // payload bytes
+};
+
+struct Decoded {
+    uint64_t frames, exact, wrong, unresolved, invalid;
+    unsigned max_run;           // longest run of unresolved frames on a channel (a lost keyframe adds one interval)
+    Comp comp[TLM_CHAN_COUNT];
+};
+
+/* tlm::Reader + tlm::DeltaDecoder, every expanded record against the original */
+static Decoded decode(const Coded &c)
+{
+    Decoded d = {};
+    tlm::Reader rd(c.stream.size() + 1U);
+    tlm::DeltaDecoder delta;
+    unsigned run[TLM_CHAN_COUNT] = {};
+    size_t i = 0;
+
+    rd.append(c.stream.data(), c.stream.size());
+    for (const tlm::Frame &wire : rd.frames()) {
+        const Record &r = *c.expect[i++];
+        d.frames++;
+        std::optional<tlm::Frame> f = delta.expand(wire);
+        if (!f) {
+            d.max_run = std::max(d.max_run, ++run[r.chan]);
+            continue;
+        }
+        run[r.chan] = 0;
+        Comp &cp = d.comp[r.chan];
+        cp.records++;
+        cp.keys += (wire.chan & TLM_CHAN_DELTA) ? 0 : 1;
+        cp.plain += f->len;
+        cp.wire += wire.len;
+
+        /* The rebuilt frame must scan as a valid frame of its own */
+        tlm::FrameRange again(f->raw, f->size());
+        tlm::Frame g;
+        bool whole = again.next(g) && g.len == f->len && g.chan == r.chan;
+        if (whole && f->chan == r.chan && f->ts == r.ts && f->len == r.v.size() &&
+            memcmp(f->payload, r.v.data(), r.v.size()) == 0)
+            d.exact++;
+        else
+            d.wrong++;
+    }
+    d.unresolved = delta.stats().unresolved;
+    d.invalid = delta.stats().invalid;
+    return d;
+}
+
+/* The reference decoder must agree record for record */
+struct RefCtx {
+    TLM_DeltaDecoderTypeDef delta;
+    const Coded *c;
+    size_t i;
+    uint64_t exact, wrong;
+};
+
+static void ref_frame(const TLM_FrameTypeDef *wire, void *ctx)
+{
+    RefCtx *x = (RefCtx *)ctx;
+    const Record &r = *x->c->expect[x->i++];
+    TLM_FrameTypeDef f = *wire;
+    if (!TLM_DeltaExpand(&x->delta, &f)) return;
+    if (f.chan == r.chan && f.len == r.v.size() && memcmp(f.payload, r.v.data(), f.len) == 0)
+        x->exact++;
+    else
+        x->wrong++;
+}
+
+static void decode_reference(const Coded &c, const Decoded &d, const char *name)
+{
+    static TLM_DecoderTypeDef dec;
+    static RefCtx x;
+    TLM_DecoderInit(&dec);
+    TLM_DeltaDecoderInit(&x.delta);
+    x.c = &c;
+    x.i = 0;
+    x.exact = x.wrong = 0;
+    for (size_t off = 0; off < c.stream.size(); off += 4096)
+        TLM_DecoderFeed(&dec, c.stream.data() + off, std::min<size_t>(4096, c.stream.size() - off), ref_frame, &x);
+    CHECK(x.wrong == 0 && x.exact == d.exact, "%s: reference decoder %" PRIu64 " exact, %" PRIu64 " wrong, "
+          "stream library %" PRIu64 " exact", name, x.exact, x.wrong, d.exact);
+}
+
+static void print_comp(const Decoded &d)
+{
+    for (uint8_t ch : delta_chans) {
+        const Comp &c = d.comp[ch];
+        if (c.records == 0) continue;
+        uint64_t plain = c.plain + c.records * TLM_OVERHEAD, wire = c.wire + c.records * TLM_OVERHEAD;
+        printf("    chan%u: %8" PRIu64 " records, %5.1f%% key, payload %6.2f B -> %5.2f B (%.2fx), "
+               "frame %5.2f B -> %5.2f B (%.2fx)\n", ch, c.records, 100.0 * (double)c.keys / (double)c.records,
+               (double)c.plain / (double)c.records, (double)c.wire / (double)c.records,
+               c.wire ? (double)c.plain / (double)c.wire : 0.0, (double)plain / (double)c.records,
+               (double)wire / (double)c.records, (double)plain / (double)wire);
+    }
+}
+
+static double payload_ratio(const Decoded &d, uint8_t ch)
+{
+    return d.comp[ch].wire ? (double)d.comp[ch].plain / (double)d.comp[ch].wire : 0.0;
+}
+
+/* ==== CHECKS ==== */
+static void check_traces(const std::vector<Record> &recs)
+{
+    Coded c = encode(recs, Link{ 0, 0, 0 });
+    Decoded d = decode(c);
+    decode_reference(c, d, "traces");
+    printf("  traces: %zu records, %zu bytes on the wire\n", recs.size(), c.stream.size());
+    print_comp(d);
+    CHECK(d.exact == recs.size() && d.wrong == 0 && d.unresolved == 0,
+          "traces: %" PRIu64 " of %zu exact, %" PRIu64 " wrong, %" PRIu64 " unresolved", d.exact, recs.size(),
+          d.wrong, d.unresolved);
+    CHECK(payload_ratio(d, TLM_CHAN_PROX) > 2.5, "traces: PROX payload ratio %.2f", payload_ratio(d, TLM_CHAN_PROX));
+    CHECK(payload_ratio(d, TLM_CHAN_GAS) > 1.5, "traces: GAS payload ratio %.2f", payload_ratio(d, TLM_CHAN_GAS));
+    CHECK(payload_ratio(d, TLM_CHAN_HUMTEMP) > 1.8, "traces: HUMTEMP payload ratio %.2f",
+          payload_ratio(d, TLM_CHAN_HUMTEMP));
+}
+
+static void check_device_drops(const std::vector<Record> &recs)
+{
+    Coded c = encode(recs, Link{ 0.01, 0.01, 0 });
+    Decoded d = decode(c);
+    decode_reference(c, d, "device drops");
+    printf("  device drops: %" PRIu64 " dropped, %" PRIu64 " records exact, %" PRIu64 " unresolved\n",
+           c.device_drops, d.exact, d.unresolved);
+    CHECK(c.device_drops > 0, "device drops: none simulated");
+    CHECK(d.exact == c.expect.size() && d.wrong == 0 && d.unresolved == 0,
+          "device drops: %" PRIu64 " of %zu exact, %" PRIu64 " wrong, %" PRIu64 " unresolved", d.exact,
+          c.expect.size(), d.wrong, d.unresolved);
+}
+
+static void check_link_loss(const std::vector<Record> &recs)
+{
+    Coded c = encode(recs, Link{ 0.005, 0.005, 0.01 });
+    Decoded d = decode(c);
+    decode_reference(c, d, "link loss");
+    printf("  link loss: %" PRIu64 " lost, %" PRIu64 " records exact, %" PRIu64 " unresolved, longest run %u\n",
+           c.link_losses, d.exact, d.unresolved, d.max_run);
+    CHECK(d.wrong == 0, "link loss: %" PRIu64 " records expanded wrong", d.wrong);
+    CHECK(d.exact + d.unresolved == d.frames, "link loss: %" PRIu64 " + %" PRIu64 " of %" PRIu64 " frames",
+          d.exact, d.unresolved, d.frames);
+    CHECK(d.unresolved <= c.link_losses * (TLM_DELTA_KEY_INTERVAL - 1U),
+          "link loss: %" PRIu64 " unresolved after %" PRIu64 " losses", d.unresolved, c.link_losses);
+}
+
+static void check_fuzz(void)
+{
+    std::vector<Record> recs = fuzz(50000);
+    Coded c = encode(recs, Link{ 0.01, 0.01, 0 });
+    Decoded d = decode(c);
+    decode_reference(c, d, "fuzz");
+    uint64_t deltas = 0;
+    for (uint8_t ch : delta_chans)
+        deltas += d.comp[ch].records - d.comp[ch].keys;
+    printf("  fuzz: %zu frames, %" PRIu64 " delta coded, %" PRIu64 " exact\n", c.expect.size(), deltas, d.exact);
+    CHECK(deltas > 10000, "fuzz: only %" PRIu64 " delta frames", deltas);
+    CHECK(d.exact == c.expect.size() && d.wrong == 0 && d.unresolved == 0,
+          "fuzz: %" PRIu64 " of %zu exact, %" PRIu64 " wrong, %" PRIu64 " unresolved", d.exact, c.expect.size(),
+          d.wrong, d.unresolved);
+}
+
+/* Hand-made delta payloads against a GAS keyframe (u8, u16, u16) */
+static void check_malformed(void)
+{
+    static const struct {
+        const char *what;
+        uint8_t len;
+        uint8_t p[8];
+        bool ok;
+    } cases[] = {
+        { "empty (unchanged)",      0, { 0 }, true },
+        { "aqi +1",                 1, { 0x02 }, true },
+        { "tvoc -1, eco2 +64",      3, { 0x00, 0x01, 0x80 }, false },   // cut inside eco2
+        { "tvoc -1, eco2 +64 whole", 4, { 0x00, 0x01, 0x80, 0x01 }, true },
+        { "aqi out of u8 range",    2, { 0x80, 0x02 }, false },
+        { "more than 32 bits",      5, { 0x80, 0x80, 0x80, 0x80, 0x10 }, false },
+        { "bytes after the record", 4, { 0x00, 0x00, 0x02, 0x02 }, false },
+    };
+    static const uint8_t key[5] = { 3, 0x10, 0x00, 0x90, 0x01 };
+    unsigned bad = 0;
+
+    for (const auto &t : cases) {
+        TLM_DeltaDecoderTypeDef dd;
+        TLM_DeltaDecoderInit(&dd);
+        TLM_FrameTypeDef f = { TLM_VERSION, TLM_CHAN_GAS, 7, 0, sizeof(key), key };
+        TLM_DeltaExpand(&dd, &f);
+        TLM_FrameTypeDef x = { TLM_VERSION, TLM_CHAN_GAS | TLM_CHAN_DELTA, 8, 0, t.len, t.p };
+        bool ok = TLM_DeltaExpand(&dd, &x) == 1;
+        CHECK(ok == t.ok && (ok || dd.invalid == 1), "malformed: %s %s", t.what, ok ? "accepted" : "rejected");
+        if (!ok) {
+            bad++;
+            TLM_FrameTypeDef next = { TLM_VERSION, TLM_CHAN_GAS | TLM_CHAN_DELTA, 9, 0, 0, t.p };
+            CHECK(!TLM_DeltaExpand(&dd, &next) && dd.unresolved == 1, "malformed: %s: reference kept", t.what);
+            TLM_FrameTypeDef k = { TLM_VERSION, TLM_CHAN_GAS, 10, 0, sizeof(key), key };
+            TLM_FrameTypeDef after = { TLM_VERSION, TLM_CHAN_GAS | TLM_CHAN_DELTA, 11, 0, 1, cases[1].p };
+            CHECK(TLM_DeltaExpand(&dd, &k) && TLM_DeltaExpand(&dd, &after) && after.payload[0] == 4,
+                  "malformed: %s: keyframe does not recover", t.what);
+        }
+    }
+    TLM_DeltaDecoderTypeDef dd;
+    TLM_DeltaDecoderInit(&dd);
+    TLM_FrameTypeDef f = { TLM_VERSION, TLM_CHAN_GAS, 7, 0, sizeof(key), key };
+    TLM_DeltaExpand(&dd, &f);
+    TLM_FrameTypeDef x = { TLM_VERSION, TLM_CHAN_GAS | TLM_CHAN_DELTA, 8, 0, 4, cases[3].p };
+    CHECK(TLM_DeltaExpand(&dd, &x) && x.chan == TLM_CHAN_GAS && x.len == 5 && x.payload[0] == 3 &&
+          TLM_GetU16(x.payload + 1) == 0x000F && TLM_GetU16(x.payload + 3) == 0x01D0,
+          "malformed: valid delta expands to %u %04X %04X", x.payload[0], TLM_GetU16(x.payload + 1),
+          TLM_GetU16(x.payload + 3));
+    printf("  malformed: %zu payloads, %u rejected\n", sizeof(cases) / sizeof(cases[0]), bad);
+}
+
+/* ==== CAPTURES ==== */
+/* The sensor records of a capture, coded as the device would have */
+static int check_capture(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 2;
+    }
+    tlm::Reader rd;
+    tlm::DeltaDecoder delta;
+    std::vector<Record> recs;
+    uint16_t next_seq[TLM_CHAN_COUNT] = {};
+    bool seen[TLM_CHAN_COUNT] = {};
+    std::vector<uint16_t> gaps;
+    long n;
+
+    while ((n = rd.fill(fd)) > 0) {
+        for (const tlm::Frame &wire : rd.frames()) {
+            std::optional<tlm::Frame> f = delta.expand(wire);
+            if (!f || f->len > TLM_DELTA_MAX_RECORD ||
+                std::find(std::begin(delta_chans), std::end(delta_chans), f->chan) == std::end(delta_chans))
+                continue;
+            /* seq gaps come back as device drops in front of the record */
+            uint16_t gap = seen[f->chan] ? (uint16_t)(f->seq - next_seq[f->chan]) : 0;
+            seen[f->chan] = true;
+            next_seq[f->chan] = (uint16_t)(f->seq + 1U);
+            recs.push_back({ f->chan, f->ts, std::vector<uint8_t>(f->payload, f->payload + f->len) });
+            gaps.push_back(gap < 0x8000U ? gap : 0);
+        }
+        rd.consume();
+    }
+    close(fd);
+
+    Coded c = {};
+    TLM_EncoderTypeDef enc = {};
+    TLM_DeltaTypeDef ref[TLM_CHAN_COUNT] = {};
+    uint8_t buf[TLM_OVERHEAD + TLM_DELTA_MAX_RECORD];
+    for (size_t i = 0; i < recs.size(); i++) {
+        const Record &r = recs[i];
+        for (uint16_t g = 0; g < gaps[i]; g++)
+            TLM_Drop(&enc, r.chan);
+        TLM_WriterTypeDef w;
+        TLM_Begin(&enc, &w, buf, r.chan, r.ts);
+        memcpy(w.p, r.v.data(), r.v.size());
+        w.p += r.v.size();
+        uint16_t len = TLM_EndDelta(&enc, &w, &ref[r.chan]);
+        c.stream.insert(c.stream.end(), buf, buf + len);
+        c.expect.push_back(&r);
+    }
+
+    Decoded d = decode(c);
+    decode_reference(c, d, path);
+    printf("  %s: %zu sensor records\n", path, recs.size());
+    print_comp(d);
+    CHECK(d.exact == recs.size() && d.wrong == 0, "%s: %" PRIu64 " of %zu exact, %" PRIu64 " wrong", path, d.exact,
+          recs.size(), d.wrong);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    lcg_state = 11;
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+        fprintf(stderr, "usage: %s [capture]\n", argv[0]);
+        return 2;
+    }
+    if (argc == 2) {
+        if (check_capture(argv[1])) return 2;
+    } else {
+        std::vector<Record> recs = traces(3600);
+        check_traces(recs);
+        check_device_drops(recs);
+        check_link_loss(recs);
+        check_fuzz();
+        check_malformed();
+    }
+
+    return check_result();
+}
@@ -0,0 +1,494 @@
+/**
+ * @file dsp_check.c
+ * @brief Host-native golden-vector check and micro-benchmarks for the audio path
+ *
+ * Runs the unmodified firmware sources (microphone_sensor.c, the I2S
+ * callbacks in stm32f4xx_it.c, audio_packetizer.c, audio_sync.c) on x86
+ * through the HAL shim in Host/shim:
+ *   - synthetic I2S DMA blocks (sine sweep, noise, clipped sine) are pushed
+ *     through HAL_I2S_RxHalfCpltCallback / HAL_I2S_RxCpltCallback and the
+ *     emitted USB packets are decoded with the reference telemetry decoder
+ *     and compared sample by sample;
+ *   - every output stream is hashed (FNV-1a) and compared with the golden
+ *     hashes below, so any bit change in a kernel is reported;
+ *   - per-channel sequence numbers: drops, late frames and a sender restart
+ *     are told apart by the decoder's gap accounting;
+ *   - the SOF drift loop is driven with a simulated crystal offset.
+ *
+ * Usage: dsp_check [-g]   (-g prints fresh golden hashes instead of checking)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "check.h"
+#include "hal_shim.h"
+#include "microphone_sensor.h"
+#include "audio_packetizer.h"
+#include "audio_sync.h"
+#include "scheduler.h"
+#include "telemetry.h"
+#include "usbd_cdc_if.h"
+
+MIC_HandleTypeDef mic;
+AUDIO_PKT_HandleTypeDef audio_pkt;
+AUDIO_SYNC_HandleTypeDef audio_sync;
+SCHED_HandleTypeDef sched;
+
+extern uint32_t dma_buffer[MIC_DMA_XFER_WORDS];
+
+#define FS_HZ           16000U
+#define VEC_FRAMES      (FS_HZ * 2U)    // 2 s per vector, multiple of a half block
+#define FULL_SCALE      8388607         // 2^23 - 1
+
+/* ==== GOLDEN HASHES (regenerate with -g after an intended change) ==== */
+typedef struct {
+    const char *name;
+    uint64_t packets;   // packet byte stream
+    uint64_t resample;  // AudioSync_Resample output at +150 ppm
+} GOLDEN_TypeDef;
+
+static const GOLDEN_TypeDef golden[] = {
+    { "sweep", 0x4CE66F6FE975F934ULL, 0x04D1FDA43B577B72ULL },
+    { "noise", 0xF71EFC5AD79A77B8ULL, 0xE24CFDE921880E1FULL },
+    { "clip",  0xD94A31BF71B4222BULL, 0xA098FF42D9C7A0CBULL },
+};
+
+static int gen_golden;
+
+/* ==== HELPERS ==== */
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+#define FNV_INIT 0xCBF29CE484222325ULL
+
+static int32_t clamp24(double v)
+{
+    if (v > FULL_SCALE) return FULL_SCALE;
+    if (v < -FULL_SCALE - 1) return -FULL_SCALE - 1;
+    return (int32_t)lrint(v);
+}
+
+static void gen_sweep(int32_t *x, uint32_t n)
+{
+    /* exponential sweep 20 Hz -> 7 kHz, -1 dBFS */
+    double f0 = 20.0, f1 = 7000.0, T = (double)n / FS_HZ, k = log(f1 / f0);
+    for (uint32_t i = 0; i < n; i++) {
+        double t = (double)i / FS_HZ;
+        double ph = 2.0 * M_PI * f0 * T / k * (exp(t / T * k) - 1.0);
+        x[i] = clamp24(0.891 * FULL_SCALE * sin(ph));
+    }
+}
+
+static void gen_noise(int32_t *x, uint32_t n)
+{
+    lcg_state = 0x1234567U;
+    for (uint32_t i = 0; i < n; i++)
+        x[i] = ((int32_t)lcg_next()) >> 8;   // uniform over the full 24-bit range
+}
+
+static void gen_clip(int32_t *x, uint32_t n)
+{
+    /* 1 kHz at +6 dBFS: hard clipped at both rails */
+    for (uint32_t i = 0; i < n; i++)
+        x[i] = clamp24(2.0 * FULL_SCALE * sin(2.0 * M_PI * 1000.0 * i / FS_HZ));
+}
+
+/* 24-bit left sample -> the four DMA words of one I2S frame */
+static void encode_frame(uint32_t *w, int32_t s, uint32_t right)
+{
+    uint32_t u = (uint32_t)s & 0xFFFFFFU;
+    w[0] = u >> 8;
+    w[1] = (u & 0xFF) << 8;
+    w[2] = right >> 8;      // right channel must be ignored
+    w[3] = (right & 0xFF) << 8;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* ==== KERNEL: MIC_DecodeFrame, exhaustive ==== */
+static void check_decode(void)
+{
+    uint32_t w[4];
+    uint32_t bad = 0;
+
+    for (int32_t s = -FULL_SCALE - 1; s <= FULL_SCALE; s++) {
+        encode_frame(w, s, 0xFFFFFFU);
+        if (MIC_DecodeFrame(w) != s) bad++;
+    }
+    CHECK(bad == 0, "MIC_DecodeFrame: %u of 2^24 codes wrong", bad);
+}
+
+/* ==== PIPELINE: DMA -> callbacks -> packetizer -> USB ==== */
+typedef struct {
+    int32_t  rx[VEC_FRAMES];
+    uint32_t n_rx;
+    uint32_t expect_seq;
+    uint32_t bad_hdr;
+} PIPE_RxTypeDef;
+
+static void pipe_frame(const TLM_FrameTypeDef *f, void *ctx)
+{
+    PIPE_RxTypeDef *r = (PIPE_RxTypeDef *)ctx;
+
+    if (f->chan != TLM_CHAN_AUDIO || f->seq != (uint16_t)r->expect_seq || f->ts != r->n_rx ||
+        f->len != AUDIO_PKT_SAMPLES * AUDIO_PKT_BYTES_PER_SMP)
+        r->bad_hdr++;
+    r->expect_seq++;
+    for (uint32_t i = 0; i < AUDIO_PKT_SAMPLES && r->n_rx < VEC_FRAMES; i++)
+        r->rx[r->n_rx++] = TLM_GetS24(&f->payload[i * AUDIO_PKT_BYTES_PER_SMP]);
+}
+
+static uint64_t run_pipeline(const char *name, const int32_t *x, uint32_t n)
+{
+    static PIPE_RxTypeDef r;
+    static TLM_DecoderTypeDef dec;
+    uint32_t n_pkt = 0, bad_len = 0, bad_result = 0;
+    uint64_t h = FNV_INIT;
+
+    memset(&r, 0, sizeof(r));
+    TLM_DecoderInit(&dec);
+    HalShim_Reset();
+    MIC_Init(&mic, &hi2s1);
+    AudioPkt_Init(&audio_pkt);
+    MIC_Start(&mic);
+
+    for (uint32_t f = 0; f < n; f += MIC_FRAMES_PER_HALF) {
+        uint8_t second = (uint8_t)((f / MIC_FRAMES_PER_HALF) & 1U);
+        uint32_t *half = &dma_buffer[second ? (MIC_DMA_XFER_WORDS / 2) : 0];
+        for (uint32_t i = 0; i < MIC_FRAMES_PER_HALF; i++)
+            encode_frame(&half[i * MIC_DMA_WORDS_PER_FRAME], x[f + i], lcg_next());
+
+        if (second)
+            HAL_I2S_RxCpltCallback(&hi2s1);
+        else
+            HAL_I2S_RxHalfCpltCallback(&hi2s1);
+        if (mic.audio_result != x[f]) bad_result++;
+
+        CDC_TxQueue_Kick();
+        uint32_t len;
+        uint8_t *p;
+        while ((p = HalShim_TakeTx(&len)) != NULL) {
+            h = fnv1a(h, p, len);
+            if (len != AUDIO_PKT_SLOT_SIZE) bad_len++;
+            n_pkt++;
+            TLM_DecoderFeed(&dec, p, len, pipe_frame, &r);
+            USBD_Interface_fops_FS.TransmitCplt(p, &len, CDC_IN_EP);
+        }
+    }
+
+    uint32_t n_rx = r.n_rx, mismatch = 0;
+    for (uint32_t i = 0; i < n_rx; i++)
+        if (r.rx[i] != x[i]) mismatch++;
+
+    CHECK(bad_result == 0, "%s: audio_result wrong in %u blocks", name, bad_result);
+    CHECK(bad_len == 0, "%s: %u packets with wrong length", name, bad_len);
+    CHECK(dec.frames_ok == n_pkt && dec.crc_errors == 0 && dec.skipped_bytes == 0,
+          "%s: decoder %u/%u frames, %u crc errors, %u bytes skipped", name, dec.frames_ok, n_pkt,
+          dec.crc_errors, dec.skipped_bytes);
+    CHECK(r.bad_hdr == 0, "%s: %u bad packet headers", name, r.bad_hdr);
+    CHECK(mismatch == 0, "%s: %u of %u samples differ after packetizing", name, mismatch, n_rx);
+    CHECK(audio_pkt.stats.samples_dropped == 0, "%s: %u samples dropped", name,
+          audio_pkt.stats.samples_dropped);
+    CHECK(n_rx == (n / AUDIO_PKT_SAMPLES) * AUDIO_PKT_SAMPLES, "%s: got %u samples", name, n_rx);
+    return h;
+}
+
+/* ==== TELEMETRY: encoder/decoder round trip under corruption ==== */
+static void count_frame(const TLM_FrameTypeDef *f, void *ctx)
+{
+    uint32_t *n = (uint32_t *)ctx;
+    if (f->chan == TLM_CHAN_PROX && f->len == 4 && TLM_GetU16(f->payload) == (uint16_t)f->seq)
+        (*n)++;
+}
+
+static void check_telemetry(void)
+{
+    static uint8_t stream[64 * 1024];
+    static TLM_DecoderTypeDef dec;
+    TLM_EncoderTypeDef enc = { 0 };
+    TLM_WriterTypeDef w;
+    size_t n = 0;
+    uint32_t sent = 0, got = 0, corrupted = 0, last_corrupted = 0, edge = 0;
+
+    /* CRC-16/CCITT-FALSE check value */
+    CHECK(TLM_CRC16(0xFFFF, (const uint8_t *)"123456789", 9) == 0x29B1, "TLM_CRC16 check value");
+
+    lcg_state = 42;
+    while (n + 64 + TLM_MAX_FRAME < sizeof(stream)) {
+        uint32_t r = lcg_next();
+        if ((r & 7) == 0) {                       // line noise between frames
+            for (uint32_t k = (r >> 8) % 9; k > 0; k--)
+                stream[n++] = (uint8_t)(lcg_next() >> 24);
+        }
+        uint16_t seq = enc.seq[TLM_CHAN_PROX];
+        TLM_Begin(&enc, &w, &stream[n], TLM_CHAN_PROX, seq);
+        TLM_PutU16(&w, seq);
+        TLM_PutU16(&w, (uint16_t)~seq);
+        uint16_t len = TLM_End(&w);
+        last_corrupted = (r & 0x30) == 0;
+        if (last_corrupted) {                     // flip one bit
+            stream[n + 2 + (r >> 16) % (len - 2)] ^= (uint8_t)(1U << ((r >> 12) & 7));
+            corrupted++;
+            if (sent == 0) edge++;
+        }
+        n += len;
+        sent++;
+    }
+
+    /* A corrupted length field holds back the frames behind it until the
+     * bogus frame is complete: flush with a frame's worth of idle bytes */
+    memset(&stream[n], 0, TLM_MAX_FRAME);
+    n += TLM_MAX_FRAME;
+
+    /* Feed in odd-sized chunks to exercise frames split across reads */
+    TLM_DecoderInit(&dec);
+    for (size_t off = 0; off < n; ) {
+        size_t k = 1 + lcg_next() % 37;
+        if (k > n - off) k = n - off;
+        TLM_DecoderFeed(&dec, &stream[off], k, count_frame, &got);
+        off += k;
+    }
+
+    CHECK(got == sent - corrupted, "telemetry: %u of %u clean frames decoded", got, sent - corrupted);
+    CHECK(dec.frames_ok == got, "telemetry: %u frames accepted, %u valid", dec.frames_ok, got);
+    /* Every rejected frame is a seq gap, except a leading or trailing one */
+    edge += last_corrupted;
+    CHECK(dec.chan[TLM_CHAN_PROX].lost == corrupted - edge && dec.chan[TLM_CHAN_PROX].reordered == 0,
+          "telemetry: %u frames lost by seq, %u corrupted", dec.chan[TLM_CHAN_PROX].lost, corrupted);
+    printf("  telemetry: %u frames, %u corrupted, %u crc errors, %u bad headers, %u bytes skipped\n",
+           sent, corrupted, dec.crc_errors, dec.bad_headers, dec.skipped_bytes);
+}
+
+/* ==== TELEMETRY: per-channel sequence numbers and gap accounting ==== */
+static void check_seq_gaps(void)
+{
+    static uint8_t stream[16 * 1024];
+    static TLM_DecoderTypeDef dec;
+    TLM_EncoderTypeDef enc = { 0 };
+    TLM_WriterTypeDef w;
+    size_t n = 0, dup = 0;
+    uint32_t dropped_prox = 0, dropped_lvl = 0;
+
+    for (uint32_t i = 0; i < 400; i++) {
+        /* PROX every step, AUDIO_LVL every other step, both lose some frames */
+        if (i % 7 == 3) {
+            TLM_Drop(&enc, TLM_CHAN_PROX);
+            dropped_prox++;
+        } else {
+            TLM_Begin(&enc, &w, &stream[n], TLM_CHAN_PROX, i);
+            TLM_PutU16(&w, (uint16_t)i);
+            n += TLM_End(&w);
+        }
+        if (i & 1U) {
+            if (i % 50 == 1) {
+                TLM_Drop(&enc, TLM_CHAN_AUDIO_LVL);
+                dropped_lvl++;
+                continue;
+            }
+            if (i == 391) dup = n;
+            TLM_Begin(&enc, &w, &stream[n], TLM_CHAN_AUDIO_LVL, i);
+            TLM_PutI32(&w, (int32_t)i);
+            n += TLM_End(&w);
+        }
+    }
+    /* Replay a recent AUDIO_LVL frame: a late frame, no loss */
+    size_t dup_len = TLM_OVERHEAD + 4U;
+    memcpy(&stream[n], &stream[dup], dup_len);
+    n += dup_len;
+    TLM_Begin(&enc, &w, &stream[n], TLM_CHAN_AUDIO_LVL, 0);
+    n += TLM_End(&w);
+    /* Device restart: PROX counts from 0 again */
+    memset(enc.seq, 0, sizeof(enc.seq));
+    for (int k = 0; k < 3; k++) {
+        TLM_Begin(&enc, &w, &stream[n], TLM_CHAN_PROX, 0);
+        n += TLM_End(&w);
+    }
+
+    TLM_DecoderInit(&dec);
+    TLM_DecoderFeed(&dec, stream, n, NULL, NULL);
+
+    const TLM_SeqStatsTypeDef *p = &dec.chan[TLM_CHAN_PROX], *l = &dec.chan[TLM_CHAN_AUDIO_LVL];
+    CHECK(enc.dropped[TLM_CHAN_PROX] == dropped_prox && enc.dropped[TLM_CHAN_AUDIO_LVL] == dropped_lvl,
+          "seq: encoder counted %u/%u drops", enc.dropped[TLM_CHAN_PROX], enc.dropped[TLM_CHAN_AUDIO_LVL]);
+    CHECK(p->lost == dropped_prox && p->gaps == dropped_prox && p->reordered == 0 && p->resyncs == 1 &&
+          p->frames == 403U - dropped_prox, "seq: PROX %u frames, %u lost in %u gaps, %u reordered, %u resyncs",
+          p->frames, p->lost, p->gaps, p->reordered, p->resyncs);
+    /* The first AUDIO_LVL frame (i = 1) is dropped: the decoder syncs on the second */
+    CHECK(l->lost == dropped_lvl - 1U && l->reordered == 1 && l->resyncs == 0 &&
+          l->frames == 200U - dropped_lvl + 2U, "seq: AUDIO_LVL %u frames, %u lost, %u reordered",
+          l->frames, l->lost, l->reordered);
+    CHECK(dec.chan[TLM_CHAN_AUDIO].frames == 0 && dec.chan[TLM_CHAN_AUDIO].lost == 0,
+          "seq: counters leaked into an idle channel");
+}
+
+/* ==== KERNEL: AudioSync_Resample at a fixed ratio ==== */
+static uint64_t run_resample(const char *name, const int32_t *x, uint32_t n)
+{
+    static int32_t out[VEC_FRAMES + 64];
+    uint64_t h = FNV_INIT;
+    uint32_t n_out = 0;
+
+    memset(&audio_sync, 0, sizeof(audio_sync));
+    audio_sync.state = AUDIO_SYNC_TRACK;
+    audio_sync.nominal = 16.0f;
+    audio_sync.freq_dev = 16.0f * 150e-6f;   // input runs 150 ppm fast
+
+    for (uint32_t f = 0; f < n; f += MIC_FRAMES_PER_HALF) {
+        uint16_t k = AudioSync_Resample(&audio_sync, &x[f], MIC_FRAMES_PER_HALF,
+                                        &out[n_out], MIC_FRAMES_PER_HALF + 2);
+        n_out += k;
+    }
+    h = fnv1a(h, out, n_out * sizeof(int32_t));
+
+    /* 150 ppm fast input -> 150 ppm fewer output samples (+-1) */
+    double expect = n / (1.0 + 150e-6);
+    CHECK(fabs(n_out - expect) <= 1.5, "%s: resampler produced %u samples, expected %.1f",
+          name, n_out, expect);
+    return h;
+}
+
+/* ==== LOOP: SOF drift estimation against a simulated crystal ==== */
+static void check_sync(double ppm_true)
+{
+    const double rate = 15943.877551 * (1.0 + ppm_true * 1e-6);   // I2SDIV rounding at 16 kHz
+    const double ppm_expect = (rate / FS_HZ - 1.0) * 1e6;
+
+    HalShim_Reset();
+    MIC_Init(&mic, &hi2s1);
+    MIC_Start(&mic);
+    AudioSync_Init(&audio_sync, &mic);
+
+    for (uint32_t ms = 0; ms < 60000; ms++) {
+        double words = rate * MIC_DMA_WORDS_PER_FRAME * ms / 1000.0;
+        uint64_t w = (uint64_t)words;
+        mic.block_count = (uint32_t)(w / (MIC_DMA_XFER_WORDS / 2));
+        hdma_spi1_rx.ndtr = MIC_DMA_XFER_WORDS - (uint32_t)(w % MIC_DMA_XFER_WORDS);
+        if (ms % 97 == 50) continue;   // occasionally lose a SOF
+        AudioSync_OnSOF(&audio_sync, (uint16_t)(ms & 0x7FF));
+    }
+
+    float ppm = AudioSync_GetPPM(&audio_sync);
+    printf("  sync %+6.1f ppm crystal: measured %+9.2f ppm, expected %+9.2f, locked=%u\n",
+           ppm_true, ppm, ppm_expect, audio_sync.locked);
+    CHECK(fabs(ppm - ppm_expect) < 2.0, "AudioSync: %.2f ppm vs %.2f ppm", ppm, ppm_expect);
+    CHECK(audio_sync.locked, "AudioSync: not locked after 60 s");
+    CHECK(audio_sync.sof_missed > 0, "AudioSync: missed SOFs not detected");
+}
+
+/* ==== MICRO-BENCHMARKS ==== */
+static void bench(const int32_t *x, uint32_t n)
+{
+    static uint32_t words[VEC_FRAMES * MIC_DMA_WORDS_PER_FRAME];
+    static int32_t out[VEC_FRAMES + 64];
+    volatile int32_t sink = 0;
+    const int reps = 50;
+
+    for (uint32_t i = 0; i < n; i++)
+        encode_frame(&words[i * MIC_DMA_WORDS_PER_FRAME], x[i], 0);
+
+    double t0 = now_ns();
+    for (int r = 0; r < reps; r++)
+        for (uint32_t i = 0; i < n; i++)
+            sink += MIC_DecodeFrame(&words[i * MIC_DMA_WORDS_PER_FRAME]);
+    double t_dec = (now_ns() - t0) / ((double)reps * n);
+
+    HalShim_Reset();
+    AudioPkt_Init(&audio_pkt);
+    t0 = now_ns();
+    for (int r = 0; r < reps; r++) {
+        for (uint32_t f = 0; f < n; f += MIC_FRAMES_PER_HALF) {
+            AudioPkt_PushBlock(&audio_pkt, &words[f * MIC_DMA_WORDS_PER_FRAME], MIC_FRAMES_PER_HALF, f);
+            for (uint32_t s = 0; s < AUDIO_PKT_SLOT_COUNT; s++)
+                audio_pkt.state[s] = AUDIO_PKT_SLOT_FREE;   // drain instantly
+        }
+    }
+    double t_pkt = (now_ns() - t0) / ((double)reps * n);
+
+    memset(&audio_sync, 0, sizeof(audio_sync));
+    audio_sync.state = AUDIO_SYNC_TRACK;
+    audio_sync.nominal = 16.0f;
+    audio_sync.freq_dev = 16.0f * 150e-6f;
+    t0 = now_ns();
+    for (int r = 0; r < reps; r++)
+        for (uint32_t f = 0; f < n; f += MIC_FRAMES_PER_HALF)
+            sink += AudioSync_Resample(&audio_sync, &x[f], MIC_FRAMES_PER_HALF, out, MIC_FRAMES_PER_HALF + 2);
+    double t_rs = (now_ns() - t0) / ((double)reps * n);
+
+    /* PROX + AUDIO_LVL frames vs the CSV line they replaced */
+    static uint8_t frame[2 * TLM_OVERHEAD + 8];
+    static char msg[64];
+    TLM_EncoderTypeDef enc = { 0 };
+    TLM_WriterTypeDef w;
+    t0 = now_ns();
+    for (uint32_t i = 0; i < n; i++) {
+        TLM_Begin(&enc, &w, frame, TLM_CHAN_PROX, i);
+        TLM_PutU16(&w, (uint16_t)i);
+        TLM_PutU16(&w, (uint16_t)(i >> 3));
+        uint16_t len = TLM_End(&w);
+        TLM_Begin(&enc, &w, &frame[len], TLM_CHAN_AUDIO_LVL, i);
+        TLM_PutI32(&w, x[i]);
+        sink += len + TLM_End(&w);
+    }
+    double t_tlm = (now_ns() - t0) / n;
+    t0 = now_ns();
+    for (uint32_t i = 0; i < n; i++)
+        sink += snprintf(msg, sizeof(msg), "%u,%u,%ld\n", (unsigned)(uint16_t)i,
+                         (unsigned)(uint16_t)(i >> 3), (long)x[i]);
+    double t_csv = (now_ns() - t0) / n;
+
+    printf("bench (host ns/sample): decode %.2f  packetize %.2f  resample %.2f\n", t_dec, t_pkt, t_rs);
+    printf("bench (host ns/record): telemetry frames %.2f  snprintf csv %.2f\n", t_tlm, t_csv);
+    printf("packetizer: %.3f wire bytes/sample, %.1f host cycles/sample (DWT shim = TSC)\n",
+           AudioPkt_BytesPerSample(), AudioPkt_CyclesPerSample(&audio_pkt));
+    (void)sink;
+}
+
+int main(int argc, char **argv)
+{
+    static int32_t vec[3][VEC_FRAMES];
+    void (*gen[3])(int32_t *, uint32_t) = { gen_sweep, gen_noise, gen_clip };
+
+    gen_golden = (argc > 1 && strcmp(argv[1], "-g") == 0);
+
+    check_decode();
+    check_telemetry();
+    check_seq_gaps();
+
+    for (int v = 0; v < 3; v++) {
+        gen[v](vec[v], VEC_FRAMES);
+        uint64_t hp = run_pipeline(golden[v].name, vec[v], VEC_FRAMES);
+        uint64_t hr = run_resample(golden[v].name, vec[v], VEC_FRAMES);
+        if (gen_golden) {
+            printf("    { \"%s\", 0x%016llXULL, 0x%016llXULL },\n", golden[v].name,
+                   (unsigned long long)hp, (unsigned long long)hr);
+            continue;
+        }
+        CHECK(hp == golden[v].packets, "%s: packet stream hash %016llX != golden", golden[v].name,
+              (unsigned long long)hp);
+        CHECK(hr == golden[v].resample, "%s: resampler hash %016llX != golden", golden[v].name,
+              (unsigned long long)hr);
+    }
+
+    check_sync(0.0);
+    check_sync(+50.0);
+    check_sync(-120.0);
+
+    bench(vec[1], VEC_FRAMES);
+
+    return check_result();
+}
@@ -0,0 +1,317 @@
+/**
+ * @file flow_check.c
+ * @brief Host-native check of the backpressure policy (flow_control.c)
+ *
+ * Runs the unmodified flow control, scheduler, audio packetizer and CDC
+ * transmit queue against the HAL shim with a 1 ms bus model whose packet
+ * budget sets how fast the host reads:
+ *   - decimation averages the raw audio and advances the packet timestamps
+ *     by AUDIO_PKT_SAMPLES * decim; a shed stream is skipped, not dropped;
+ *   - a fast host keeps everything at TLM_FLOW_FULL;
+ *   - a slow host walks the level down one step at a time to the level the
+ *     link can carry, each change announced on TLM_CHAN_FLOW with the level
+ *     it replaces; the feature job is thinned at TLM_FLOW_SUMMARY;
+ *   - a link that only just fails at a level does not oscillate: the hold
+ *     time before the next step up grows each time a step up is undone;
+ *   - once the host is fast again the level climbs back to FULL; only the
+ *     first step up waits for the grown hold time.
+ *
+ * Usage: flow_check
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "hal_shim.h"
+#include "microphone_sensor.h"
+#include "audio_packetizer.h"
+#include "audio_sync.h"
+#include "scheduler.h"
+#include "telemetry.h"
+#include "flow_control.h"
+#include "usbd_cdc_if.h"
+
+MIC_HandleTypeDef mic;
+AUDIO_PKT_HandleTypeDef audio_pkt;
+AUDIO_SYNC_HandleTypeDef audio_sync;
+SCHED_HandleTypeDef sched;
+
+/* ==== HELPERS ==== */
+#define FEATURE_RATE_HZ     500U
+#define FEATURE_PAYLOAD     96U         // ~54 kB/s, about what the raw audio needs
+#define FLOW_RATE_HZ        100U
+#define PKT_TENTHS_FAST     190U        // full FS bulk budget per frame
+#define PKT_TENTHS_SLOW     5U          // 32 kB/s: only SUMMARY fits
+#define PKT_TENTHS_EDGE     12U         // 77 kB/s: FEATURES fits, AUDIO_LOW does not
+
+static TLM_EncoderTypeDef tlm;
+static FLOW_HandleTypeDef flow;
+static TLM_DecoderTypeDef dec;
+
+typedef struct {
+    uint32_t reports;
+    uint32_t bad_chain;         // prev != level of the report before
+    uint32_t bad_step;          // not a single step, or wrong direction for the reason
+    uint32_t bad_params;        // decim/div fields disagree with the level
+    uint8_t  level;             // last announced
+    uint32_t audio;
+    uint32_t audio_half;        // packets at FLOW_AUDIO_DECIM
+    uint32_t audio_bad_ts;
+    uint8_t  have_ts;
+    uint32_t last_ts;
+    uint32_t audio_at[TLM_FLOW_LEVELS];     // audio packets received by announced level
+} RX_TypeDef;
+
+static RX_TypeDef rx;
+static uint32_t now_ms, carry, left;
+static uint32_t audio_frame;
+
+static void rx_frame(const TLM_FrameTypeDef *f, void *ctx)
+{
+    RX_TypeDef *r = (RX_TypeDef *)ctx;
+    const uint8_t *p = f->payload;
+
+    if (f->chan == TLM_CHAN_AUDIO) {
+        uint32_t d = f->ts - r->last_ts;
+        /* consecutive packets: one full or half rate span; after a shed
+         * period the stream restarts later */
+        if (r->have_ts && d != AUDIO_PKT_SAMPLES && d != AUDIO_PKT_SAMPLES * FLOW_AUDIO_DECIM &&
+            d < AUDIO_PKT_SAMPLES * AUDIO_PKT_SLOT_COUNT)
+            r->audio_bad_ts++;
+        if (r->have_ts && d == AUDIO_PKT_SAMPLES * FLOW_AUDIO_DECIM) r->audio_half++;
+        r->have_ts = 1;
+        r->last_ts = f->ts;
+        r->audio++;
+        r->audio_at[r->level]++;
+        return;
+    }
+    if (f->chan != TLM_CHAN_FLOW || f->len < TLM_FLOW_SIZE) return;
+
+    uint8_t level = p[0], prev = p[1], reason = p[2];
+    r->reports++;
+    if (reason == TLM_FLOW_REASON_START) {
+        if (level != TLM_FLOW_FULL) r->bad_step++;
+    } else {
+        if (prev != r->level) r->bad_chain++;
+        if (reason == TLM_FLOW_REASON_DRAINED ? level + 1U != prev : level != prev + 1U) r->bad_step++;
+    }
+    uint8_t decim = level == TLM_FLOW_FULL ? 1U : level == TLM_FLOW_AUDIO_LOW ? FLOW_AUDIO_DECIM : 0U;
+    uint8_t div = level == TLM_FLOW_SUMMARY ? FLOW_SUMMARY_DIV : 1U;
+    if (level >= TLM_FLOW_LEVELS || p[3] != decim || p[4] != div) r->bad_params++;
+    r->level = level;
+}
+
+/* Feature stream: drops (and counts) a frame the queue has no room for */
+static void job_feature(void *ctx)
+{
+    uint8_t buf[TLM_OVERHEAD + FEATURE_PAYLOAD];
+    TLM_WriterTypeDef w;
+
+    UNUSED(ctx);
+    if (CDC_TxQueue_Free() < sizeof(buf)) {
+        TLM_Drop(&tlm, TLM_CHAN_PROX);
+        return;
+    }
+    TLM_Begin(&tlm, &w, buf, TLM_CHAN_PROX, HAL_GetTick());
+    for (uint16_t i = 0; i < FEATURE_PAYLOAD; i++)
+        TLM_PutU8(&w, (uint8_t)i);
+    if (CDC_Transmit_FS(buf, TLM_End(&w)) != USBD_OK)
+        tlm.dropped[TLM_CHAN_PROX]++;
+}
+
+static void job_flow(void *ctx)
+{
+    Flow_Update((FLOW_HandleTypeDef *)ctx);
+}
+
+static void flow_reset(void)
+{
+    HalShim_Reset();
+    now_ms = 0;
+    carry = 0;
+    left = 0;
+    audio_frame = 0;
+    HalShim_SetTick(now_ms);
+    USBD_Interface_fops_FS.Init();
+    HalShim_SetLineState(CDC_LINE_DTR | CDC_LINE_RTS);
+    AudioPkt_Init(&audio_pkt);
+    memset(&cdc_tx_stats, 0, sizeof(cdc_tx_stats));
+    memset(&tlm, 0, sizeof(tlm));
+    memset(&rx, 0, sizeof(rx));
+    TLM_DecoderInit(&dec);
+
+    Sched_Init(&sched);
+    Sched_AddJob(&sched, "feature", job_feature, NULL, FEATURE_RATE_HZ);
+    Sched_AddJob(&sched, "flow", job_flow, &flow, FLOW_RATE_HZ);
+    Flow_Init(&flow, &sched, &audio_pkt, &tlm, 1UL << 0);
+    Sched_Start(&sched);
+}
+
+/* One 1 ms frame: audio block, main loop pass, then the host reads up to
+ * pkt_tenths / 10 packets of the transfer in flight */
+static void run_ms(uint32_t ms, uint32_t pkt_tenths)
+{
+    static uint32_t block[MIC_FRAMES_PER_HALF * MIC_DMA_WORDS_PER_FRAME];
+
+    for (; ms > 0; ms--) {
+        AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, audio_frame);
+        audio_frame += MIC_FRAMES_PER_HALF;
+        HalShim_TimAdvance(1000);
+        Sched_RunPending(&sched);
+        CDC_TxQueue_Kick();
+
+        carry += pkt_tenths;
+        uint32_t budget = carry / 10U;
+        carry %= 10U;
+        while (hal_shim_cdc.TxState != 0U && budget > 0) {
+            uint32_t len = hal_shim_cdc.TxLength;
+            if (left == 0)
+                left = len / CDC_DATA_FS_MAX_PACKET_SIZE + 1U;    // short packet or ZLP ends it
+            uint32_t n = left < budget ? left : budget;
+            budget -= n;
+            if ((left -= n) != 0) break;
+            uint8_t *p = HalShim_TakeTx(&len);
+            TLM_DecoderFeed(&dec, p, len, rx_frame, &rx);
+            USBD_Interface_fops_FS.TransmitCplt(p, &len, CDC_IN_EP);
+        }
+        HalShim_SetTick(++now_ms);
+        CDC_TxQueue_OnSOF();
+    }
+}
+
+/* ==== DECIMATION: averaged samples, timestamps and shedding ==== */
+static void check_decimation(void)
+{
+    static uint32_t block[MIC_FRAMES_PER_HALF * MIC_DMA_WORDS_PER_FRAME];
+    uint32_t bad = 0, n = 0;
+
+    flow_reset();
+    AudioPkt_SetDecimation(&audio_pkt, FLOW_AUDIO_DECIM);
+    CHECK(AudioPkt_SetDecimation(&audio_pkt, AUDIO_PKT_MAX_DECIM + 1U) == HAL_ERROR,
+          "decimation: factor over AUDIO_PKT_MAX_DECIM accepted");
+
+    /* ramp of signed samples, the mean of each pair is known */
+    for (uint32_t f = 0; f < FLOW_AUDIO_DECIM * AUDIO_PKT_SAMPLES; f += MIC_FRAMES_PER_HALF) {
+        for (uint32_t i = 0; i < MIC_FRAMES_PER_HALF; i++) {
+            uint32_t v = (uint32_t)(((int32_t)(f + i) - 200) * 1000) & 0xFFFFFFU;
+            block[i * MIC_DMA_WORDS_PER_FRAME] = v >> 8;
+            block[i * MIC_DMA_WORDS_PER_FRAME + 1] = (v & 0xFFU) << 8;
+        }
+        AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, f);
+    }
+    uint8_t *slot = AudioPkt_Claim(&audio_pkt);
+    CHECK(slot != NULL, "decimation: no packet after %u frames", FLOW_AUDIO_DECIM * AUDIO_PKT_SAMPLES);
+    if (slot != NULL) {
+        CHECK(TLM_GetU32(slot + 4) == 0U, "decimation: packet ts %u", TLM_GetU32(slot + 4));
+        for (uint32_t s = 0; s < AUDIO_PKT_SAMPLES; s++, n++) {
+            int32_t a = ((int32_t)(2 * s) - 200) * 1000, b = a + 1000;
+            if (TLM_GetS24(slot + AUDIO_PKT_HEADER_SIZE + s * AUDIO_PKT_BYTES_PER_SMP) != (a + b) / 2)
+                bad++;
+        }
+        AudioPkt_OnTxComplete(&audio_pkt, slot);
+    }
+    CHECK(bad == 0, "decimation: %u of %u averaged samples wrong", bad, n);
+
+    /* shed: the slot being filled completes at its factor, then whole
+     * blocks are skipped; nothing counts as lost */
+    const uint32_t pushed = 100U * MIC_FRAMES_PER_HALF;
+    uint32_t in0 = audio_pkt.stats.samples_in;
+    AudioPkt_SetDecimation(&audio_pkt, 0);
+    for (uint32_t i = 0; i < 100; i++)
+        AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, 0);
+    uint32_t in = audio_pkt.stats.samples_in - in0;
+    CHECK(in + audio_pkt.stats.samples_skipped == pushed && in < FLOW_AUDIO_DECIM * AUDIO_PKT_SAMPLES &&
+          audio_pkt.stats.samples_dropped == 0 && AudioPkt_Backlog(&audio_pkt) == 1U,
+          "decimation: shed %u in, %u skipped, %u dropped, backlog %u", in, audio_pkt.stats.samples_skipped,
+          audio_pkt.stats.samples_dropped, AudioPkt_Backlog(&audio_pkt));
+    printf("  decimation: %u samples averaged 1/%u, %u frames shed\n", n, FLOW_AUDIO_DECIM,
+           audio_pkt.stats.samples_skipped);
+}
+
+/* ==== FAST HOST: nothing is degraded ==== */
+static void check_fast(void)
+{
+    flow_reset();
+    run_ms(5000, PKT_TENTHS_FAST);
+
+    CHECK(flow.level == TLM_FLOW_FULL && flow.stats.steps_down == 0, "fast: level %u after %u steps down",
+          flow.level, flow.stats.steps_down);
+    CHECK(rx.reports == 1 && rx.bad_step == 0, "fast: %u announcements", rx.reports);
+    CHECK(rx.audio_half == 0 && rx.audio_bad_ts == 0 && rx.audio > 0, "fast: %u audio packets, %u half rate, "
+          "%u bad ts", rx.audio, rx.audio_half, rx.audio_bad_ts);
+    CHECK(tlm.dropped[TLM_CHAN_PROX] == 0 && audio_pkt.stats.samples_dropped == 0 && dec.crc_errors == 0,
+          "fast: %u feature drops, %u audio samples dropped", tlm.dropped[TLM_CHAN_PROX],
+          audio_pkt.stats.samples_dropped);
+}
+
+/* ==== SLOW HOST: step down to SUMMARY, probe rarely, then back up ==== */
+static void check_slow(void)
+{
+    flow_reset();
+    run_ms(1000, PKT_TENTHS_FAST);
+    run_ms(2000, PKT_TENTHS_SLOW);
+
+    CHECK(flow.level == TLM_FLOW_SUMMARY && flow.stats.steps_down == TLM_FLOW_LEVELS - 1U,
+          "slow: level %u after %u steps down", flow.level, flow.stats.steps_down);
+    CHECK(sched.job[0].divider == FLOW_SUMMARY_DIV && audio_pkt.decim_req == 0,
+          "slow: feature divider %u, audio decim %u", sched.job[0].divider, audio_pkt.decim_req);
+    CHECK(rx.level == TLM_FLOW_SUMMARY, "slow: host last told level %u", rx.level);
+    CHECK(rx.audio_half > 0, "slow: no half rate audio seen on the way down");
+
+    /* stays slow: each failed probe doubles the wait for the next one */
+    const uint32_t seconds = 30;
+    run_ms(seconds * 1000U, PKT_TENTHS_SLOW);
+    CHECK(flow.stats.steps_up >= 2U && flow.stats.steps_up <= 4U, "slow: %u probes in %u s",
+          flow.stats.steps_up, seconds);
+    CHECK(flow.hold_ms >= 4U * FLOW_RECOVER_MS, "slow: hold only %u ms", flow.hold_ms);
+    uint32_t probes = flow.stats.steps_up, hold = flow.hold_ms;
+
+    /* host catches up: one level per hold time back to FULL */
+    uint32_t ms = 0;
+    while (flow.level != TLM_FLOW_FULL && ms < TLM_FLOW_LEVELS * FLOW_RECOVER_MAX_MS) {
+        run_ms(100, PKT_TENTHS_FAST);
+        ms += 100;
+    }
+    CHECK(flow.level == TLM_FLOW_FULL && flow.stats.steps_up == probes + TLM_FLOW_LEVELS - 1U,
+          "recover: level %u after %u steps up", flow.level, flow.stats.steps_up - probes);
+    CHECK(ms <= hold + TLM_FLOW_LEVELS * FLOW_RECOVER_MS, "recover: %u ms back to FULL from a %u ms hold", ms, hold);
+    CHECK(sched.job[0].divider == 1U && audio_pkt.decim_req == 1U, "recover: feature divider %u, audio decim %u",
+          sched.job[0].divider, audio_pkt.decim_req);
+    CHECK(rx.level == TLM_FLOW_FULL && rx.bad_chain == 0 && rx.bad_step == 0 && rx.bad_params == 0,
+          "recover: announcements level %u, %u chain, %u step, %u field errors", rx.level, rx.bad_chain,
+          rx.bad_step, rx.bad_params);
+    CHECK(rx.audio_bad_ts == 0 && dec.crc_errors == 0, "recover: %u bad audio ts, %u crc errors",
+          rx.audio_bad_ts, dec.crc_errors);
+    printf("  slow host: %u steps down, %u probes in %u s, back to FULL in %u ms, %u announcements "
+           "(%u deferred), %u feature frames dropped\n", flow.stats.steps_down, probes, seconds, ms, rx.reports,
+           flow.stats.report_retries, tlm.dropped[TLM_CHAN_PROX]);
+}
+
+/* ==== MARGINAL HOST: AUDIO_LOW just does not fit ==== */
+static void check_marginal(void)
+{
+    const uint32_t seconds = 60;
+
+    flow_reset();
+    run_ms(seconds * 1000U, PKT_TENTHS_EDGE);
+
+    /* without the growing hold it would retry every FLOW_RECOVER_MS */
+    CHECK(flow.stats.steps_up <= 5U, "marginal: %u steps up in %u s", flow.stats.steps_up, seconds);
+    CHECK(flow.hold_ms > FLOW_RECOVER_MS, "marginal: hold still %u ms", flow.hold_ms);
+    CHECK(flow.level == TLM_FLOW_FEATURES || flow.level == TLM_FLOW_AUDIO_LOW, "marginal: level %u", flow.level);
+    CHECK(rx.bad_chain == 0 && rx.bad_step == 0 && rx.bad_params == 0 && dec.crc_errors == 0,
+          "marginal: %u chain, %u step, %u field errors", rx.bad_chain, rx.bad_step, rx.bad_params);
+    printf("  marginal host: %u steps down, %u up in %u s, hold now %u ms\n", flow.stats.steps_down,
+           flow.stats.steps_up, seconds, flow.hold_ms);
+}
+
+int main(void)
+{
+    check_decimation();
+    check_fast();
+    check_slow();
+    check_marginal();
+
+    return check_result();
+}
@@ -0,0 +1,209 @@
+/**
+ * @file fmt_check.c
+ * @brief Host-native check of the number formatter (fmt.c) against snprintf
+ *
+ * Runs the unmodified fmt.c and compares every conversion with glibc's
+ * snprintf for the equivalent format:
+ *   - %u, %d and %0*X over edge values and random words;
+ *   - decimal fixed point against the same value split and printed by
+ *     snprintf, all decimal counts, signs and INT32_MIN;
+ *   - %.*f over random float bit patterns of every exponent in range,
+ *     exact ties (round half to even), negative zero, subnormals, the
+ *     sensor range in 1/64 steps, and the inf/nan/overflow texts;
+ *   - each conversion costs a fraction of snprintf (TSC cycles per call).
+ *
+ * Usage: fmt_check
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#include "check.h"
+#include "fmt.h"
+
+/* ==== HELPERS ==== */
+static float from_bits(uint32_t b)
+{
+    float x;
+    memcpy(&x, &b, 4);
+    return x;
+}
+
+/* Compare one output with the reference, end pointer and terminator included */
+static int same(const char *name, const char *got, const char *end, const char *want)
+{
+    if (strcmp(got, want) == 0 && end == got + strlen(want)) return 1;
+    if (failures < 20)
+        CHECK(0, "%s: \"%s\" expected \"%s\"", name, got, want);
+    else
+        failures++;
+    return 0;
+}
+
+static int check_float(float x, uint8_t d)
+{
+    char got[FMT_FLOAT_MAX + 8], want[64];
+    snprintf(want, sizeof(want), "%.*f", d, (double)x);
+    char *end = Fmt_Float(got, x, d);
+    CHECK(end - got < (long)FMT_FLOAT_MAX, "float: %zu bytes for %s", (size_t)(end - got), want);
+    return same("float", got, end, want);
+}
+
+/* ==== CHECKS ==== */
+static void check_integers(void)
+{
+    static const uint32_t edges[] = {
+        0U, 1U, 9U, 10U, 99U, 100U, 101U, 999U, 1000U, 65535U, 65536U, 99999999U, 100000000U,
+        999999999U, 1000000000U, 2147483647U, 2147483648U, 4294967295U,
+    };
+    char got[16], want[32];
+    uint32_t n = 0, ok = 0;
+
+    lcg_state = 1;
+    for (uint32_t i = 0; i < 200000U; i++, n++) {
+        uint32_t v = i < sizeof(edges) / sizeof(edges[0]) ? edges[i] : lcg_next() >> (lcg_next() % 32U);
+        uint8_t digits = (uint8_t)(i % 10U);
+        int good = 1;
+
+        snprintf(want, sizeof(want), "%u", v);
+        good &= same("u32", got, Fmt_U32(got, v), want);
+        snprintf(want, sizeof(want), "%d", (int32_t)v);
+        good &= same("i32", got, Fmt_I32(got, (int32_t)v), want);
+        snprintf(want, sizeof(want), "%0*X", digits > 8 ? 8 : digits, v);
+        good &= same("hex", got, Fmt_Hex(got, v, digits), want);
+        ok += (uint32_t)good;
+    }
+    printf("  integers: %u of %u values as %%u, %%d and %%0*X\n", ok, n);
+}
+
+static void check_fixed(void)
+{
+    char got[16], want[32];
+    uint32_t n = 0, ok = 0;
+
+    lcg_state = 2;
+    for (uint32_t i = 0; i < 100000U; i++, n++) {
+        int32_t v = i == 0 ? INT32_MIN : i == 1 ? INT32_MAX : (int32_t)(lcg_next() >> (lcg_next() % 32U));
+        if (i & 1U) v = -v;
+        uint8_t d = (uint8_t)(i % (FMT_FIXED_MAX_DECIMALS + 1U));
+        long long mag = v < 0 ? -(long long)v : v, p10 = 1;
+        for (uint8_t k = 0; k < d; k++)
+            p10 *= 10;
+        if (d == 0)
+            snprintf(want, sizeof(want), "%s%lld", v < 0 ? "-" : "", mag);
+        else
+            snprintf(want, sizeof(want), "%s%lld.%0*lld", v < 0 ? "-" : "", mag / p10, d, mag % p10);
+        char *end = Fmt_Fixed(got, v, d);
+        CHECK(end - got < (long)FMT_FIXED_MAX, "fixed: %zu bytes for %s", (size_t)(end - got), want);
+        ok += (uint32_t)same("fixed", got, end, want);
+    }
+    printf("  fixed: %u of %u values, 0..%u decimals\n", ok, n, FMT_FIXED_MAX_DECIMALS);
+}
+
+static void check_floats(void)
+{
+    static const float ties[] = {
+        0.125f, 0.375f, 0.5f, 1.5f, 2.5f, -2.5f, 0.0625f, 1.0078125f, 1e-7f, 123.456f, -0.0f,
+        0.0f, 1.17549435e-38f, 1.4e-45f, 8796092497920.0f, 99.995f, 0.95f, -0.005f,
+    };
+    uint32_t n = 0, ok = 0;
+
+    for (unsigned i = 0; i < sizeof(ties) / sizeof(ties[0]); i++)
+        for (uint8_t d = 0; d <= FMT_FLOAT_MAX_DECIMALS; d++, n++)
+            ok += (uint32_t)check_float(ties[i], d);
+
+    /* Random bits: exponents from subnormal up to just under 2^43 */
+    lcg_state = 3;
+    for (uint32_t i = 0; i < 300000U; i++, n++) {
+        uint32_t exp = lcg_next() % (127U + 43U);
+        uint32_t bits = (lcg_next() & 0x807FFFFFU) | (exp << 23);
+        ok += (uint32_t)check_float(from_bits(bits), (uint8_t)(i % (FMT_FLOAT_MAX_DECIMALS + 1U)));
+    }
+
+    /* Temperature / humidity range in sensor-like steps */
+    for (int32_t v = -40 * 64; v <= 125 * 64; v++)
+        for (uint8_t d = 1; d <= 2; d++, n++)
+            ok += (uint32_t)check_float((float)v / 64.0f, d);
+    printf("  floats: %u of %u values as %%.*f, ties to even, 0..%u decimals\n", ok, n, FMT_FLOAT_MAX_DECIMALS);
+
+    char got[FMT_FLOAT_MAX + 8];
+    same("inf", got, Fmt_Float(got, INFINITY, 2), "inf");
+    same("-inf", got, Fmt_Float(got, -INFINITY, 2), "-inf");
+    same("nan", got, Fmt_Float(got, NAN, 2), "nan");
+    same("ovf", got, Fmt_Float(got, 8796093022208.0f, 2), "ovf");
+    same("-ovf", got, Fmt_Float(got, -1e30f, 2), "-ovf");
+    same("chain", got, Fmt_Str(Fmt_Float(Fmt_Str(got, "T="), 23.456f, 2), " C"), "T=23.46 C");
+}
+
+static void check_cost(void)
+{
+    char buf[64];
+    const uint32_t batch = 64, batches = 2000;
+    uint64_t t_fmt[3] = { 0 }, t_ref[3] = { 0 };
+    static const char *const name[3] = { "%d", "%d.%02d", "%.2f" };
+
+    lcg_state = 4;
+    for (uint32_t b = 0; b < batches; b++) {
+        int32_t v[64];
+        float x[64];
+        for (uint32_t i = 0; i < batch; i++) {
+            v[i] = (int32_t)(lcg_next() % 20000U) - 4000;
+            x[i] = (float)v[i] / 100.0f;
+        }
+        uint64_t t0 = __rdtsc();
+        for (uint32_t i = 0; i < batch; i++) {
+            Fmt_I32(buf, v[i]);
+            __asm__ volatile("" : : "r"(buf) : "memory");
+        }
+        uint64_t t1 = __rdtsc();
+        for (uint32_t i = 0; i < batch; i++) {
+            snprintf(buf, sizeof(buf), "%d", (int)v[i]);
+            __asm__ volatile("" : : "r"(buf) : "memory");
+        }
+        uint64_t t2 = __rdtsc();
+        for (uint32_t i = 0; i < batch; i++) {
+            Fmt_Fixed(buf, v[i], 2);
+            __asm__ volatile("" : : "r"(buf) : "memory");
+        }
+        uint64_t t3 = __rdtsc();
+        for (uint32_t i = 0; i < batch; i++) {
+            int m = v[i] < 0 ? -v[i] : v[i];
+            snprintf(buf, sizeof(buf), "%s%d.%02d", v[i] < 0 ? "-" : "", m / 100, m % 100);
+            __asm__ volatile("" : : "r"(buf) : "memory");
+        }
+        uint64_t t4 = __rdtsc();
+        for (uint32_t i = 0; i < batch; i++) {
+            Fmt_Float(buf, x[i], 2);
+            __asm__ volatile("" : : "r"(buf) : "memory");
+        }
+        uint64_t t5 = __rdtsc();
+        for (uint32_t i = 0; i < batch; i++) {
+            snprintf(buf, sizeof(buf), "%.2f", (double)x[i]);
+            __asm__ volatile("" : : "r"(buf) : "memory");
+        }
+        uint64_t t6 = __rdtsc();
+        t_fmt[0] += t1 - t0;
+        t_ref[0] += t2 - t1;
+        t_fmt[1] += t3 - t2;
+        t_ref[1] += t4 - t3;
+        t_fmt[2] += t5 - t4;
+        t_ref[2] += t6 - t5;
+    }
+    for (int k = 0; k < 3; k++) {
+        double f = (double)t_fmt[k] / (batch * batches), r = (double)t_ref[k] / (batch * batches);
+        printf("  cost %-8s Fmt %4.0f TSC cycles, snprintf %5.0f (%.1fx)\n", name[k], f, r, r / f);
+        CHECK(f < r, "cost %s: Fmt %.0f cycles not below snprintf %.0f", name[k], f, r);
+    }
+}
+
+int main(void)
+{
+    check_integers();
+    check_fixed();
+    check_floats();
+    check_cost();
+
+    return check_result();
+}
@@ -0,0 +1,540 @@
+/**
+ * @file link_check.c
+ * @brief Host-native check of the USB CDC transmit path
+ *
+ * Runs the unmodified usbd_cdc_if.c transmit queue and audio packetizer
+ * against the HAL shim's IN endpoint model:
+ *   - random telemetry frames are queued while the endpoint is drained at
+ *     random times; the byte stream must decode to exactly the frames that
+ *     were accepted, in order, interleaved with whole audio packets;
+ *   - a full ring rejects whole writes and counts them;
+ *   - every completion with a full batch pending must chain the next
+ *     transfer;
+ *   - a transfer lost to a bus reset is sent again after re-enumeration;
+ *   - writes are refused (not dropped) until the host raises DTR, and again
+ *     after DTR falls, on suspend and on re-enumeration; a paused
+ *     packetizer skips whole blocks;
+ *   - discarding on pause keeps only the transfer in flight, so the next
+ *     host to open the port starts on a fresh frame;
+ *   - audio packets lost while the host is not reading are counted and
+ *     appear to the decoder as a seq gap of the same size;
+ *   - the log console (second CDC function) keeps output until a terminal
+ *     opens it, flows while the data queue is full, drops and counts whole
+ *     writes when its ring is full and never shows up in the data stream;
+ *   - a 1 ms frame model with the FS bulk packet budget reports throughput,
+ *     packet fill and per-record latency of the coalescing layer.
+ *
+ * Usage: link_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "check.h"
+#include "hal_shim.h"
+#include "microphone_sensor.h"
+#include "audio_packetizer.h"
+#include "audio_sync.h"
+#include "scheduler.h"
+#include "telemetry.h"
+#include "usbd_cdc_if.h"
+#include "usbd_cdc_log_if.h"
+
+MIC_HandleTypeDef mic;
+AUDIO_PKT_HandleTypeDef audio_pkt;
+AUDIO_SYNC_HandleTypeDef audio_sync;
+SCHED_HandleTypeDef sched;
+
+/* ==== HELPERS ==== */
+typedef struct {
+    uint16_t next_seq;      // expected seq of the next PROX frame
+    uint32_t frames;
+    uint32_t audio;
+    uint32_t bad;
+} RX_TypeDef;
+
+static void rx_frame(const TLM_FrameTypeDef *f, void *ctx)
+{
+    RX_TypeDef *rx = (RX_TypeDef *)ctx;
+
+    if (f->chan == TLM_CHAN_AUDIO) {
+        rx->audio++;
+        return;
+    }
+    /* payload: u16 seq, then (seq & 0xFF) repeated */
+    int ok = f->chan == TLM_CHAN_PROX && f->len >= 2 && TLM_GetU16(f->payload) == rx->next_seq;
+    for (uint16_t i = 2; ok && i < f->len; i++)
+        ok = f->payload[i] == (uint8_t)rx->next_seq;
+    if (!ok) rx->bad++;
+    rx->next_seq++;
+    rx->frames++;
+}
+
+static TLM_EncoderTypeDef enc;
+static uint16_t tx_seq;
+
+/* Build the next test frame; the caller decides whether it is queued */
+static uint16_t make_frame(uint8_t *buf, uint16_t payload)
+{
+    TLM_WriterTypeDef w;
+    TLM_Begin(&enc, &w, buf, TLM_CHAN_PROX, tx_seq);
+    TLM_PutU16(&w, tx_seq);
+    for (uint16_t i = 2; i < payload; i++)
+        TLM_PutU8(&w, (uint8_t)tx_seq);
+    return TLM_End(&w);
+}
+
+static TLM_DecoderTypeDef dec;
+static RX_TypeDef rx;
+static uint32_t stalls;
+static uint32_t now_ms;
+
+/* Complete the transfer in flight, as USBD_CDC_DataIn does */
+static int drain_one(void)
+{
+    uint32_t len;
+    uint8_t *p = HalShim_TakeTx(&len);
+    if (p == NULL) return 0;
+    TLM_DecoderFeed(&dec, p, len, rx_frame, &rx);
+    USBD_Interface_fops_FS.TransmitCplt(p, &len, CDC_IN_EP);
+    /* A full batch pending must already be on its way */
+    if (hal_shim_cdc.TxState == 0U && CDC_TX_RING_SIZE - CDC_TxQueue_Free() >= CDC_TX_BATCH_SIZE)
+        stalls++;
+    return 1;
+}
+
+static void tick(void)
+{
+    HalShim_SetTick(++now_ms);
+    CDC_TxQueue_OnSOF();
+}
+
+static void drain_all(void)
+{
+    CDC_TxQueue_Kick();
+    for (uint32_t i = 0; i <= CDC_TX_FLUSH_MS; i++) {
+        while (drain_one())
+            ;
+        tick();
+    }
+    while (drain_one())
+        ;
+}
+
+static void link_reset(void)
+{
+    HalShim_Reset();
+    HalShim_SetTick(now_ms);
+    drain_all();
+    USBD_Interface_fops_FS.Init();
+    HalShim_SetLineState(CDC_LINE_DTR | CDC_LINE_RTS);
+    AudioPkt_Init(&audio_pkt);
+    memset(&cdc_tx_stats, 0, sizeof(cdc_tx_stats));
+    memset(&rx, 0, sizeof(rx));
+    TLM_DecoderInit(&dec);
+    stalls = 0;
+    rx.next_seq = tx_seq;
+}
+
+/* ==== QUEUE: producer with backpressure, random consumer ==== */
+static void check_stream(void)
+{
+    uint8_t buf[TLM_OVERHEAD + 256];
+    uint32_t block[MIC_FRAMES_PER_HALF * MIC_DMA_WORDS_PER_FRAME] = { 0 };
+    uint32_t accepted = 0, skipped = 0, blocks = 0;
+
+    link_reset();
+    lcg_state = 7;
+    for (uint32_t i = 0; i < 200000; i++) {
+        uint32_t r = lcg_next();
+        uint16_t len = make_frame(buf, (uint16_t)(2 + (r >> 8) % 200));
+        if (CDC_TxQueue_Free() >= len) {
+            CHECK(CDC_Transmit_FS(buf, len) == USBD_OK, "stream: write with free space failed");
+            tx_seq++;
+            accepted++;
+        } else {
+            enc.seq[TLM_CHAN_PROX]--;      // frame never left the device
+            skipped++;
+        }
+        if ((r & 0x3F) == 0) {
+            AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, blocks * MIC_FRAMES_PER_HALF);
+            blocks++;
+        }
+        if ((r >> 24) < 0x60) drain_one();
+        if ((r & 0xFFF) == 0x123) CDC_TxQueue_Kick();   // main loop pass
+        if ((r & 0x1FF) == 0x42) tick();
+    }
+    drain_all();
+
+    uint32_t audio_expect = blocks * MIC_FRAMES_PER_HALF / AUDIO_PKT_SAMPLES;
+    CHECK(rx.frames == accepted && rx.bad == 0, "stream: %u/%u frames, %u bad", rx.frames, accepted, rx.bad);
+    CHECK(rx.audio == audio_expect, "stream: %u/%u audio packets", rx.audio, audio_expect);
+    CHECK(dec.crc_errors == 0 && dec.skipped_bytes == 0, "stream: %u crc errors, %u bytes skipped",
+          dec.crc_errors, dec.skipped_bytes);
+    CHECK(cdc_tx_stats.drops == 0, "stream: %u unintended drops", cdc_tx_stats.drops);
+    CHECK(cdc_tx_stats.bytes_sent == cdc_tx_stats.bytes_queued, "stream: %u of %u bytes sent",
+          cdc_tx_stats.bytes_sent, cdc_tx_stats.bytes_queued);
+    CHECK(cdc_tx_stats.high_watermark <= CDC_TX_RING_SIZE, "stream: watermark %u", cdc_tx_stats.high_watermark);
+    CHECK(stalls == 0, "stream: %u completions did not chain pending data", stalls);
+    CHECK(audio_pkt.stats.samples_dropped == 0, "stream: %u audio samples dropped",
+          audio_pkt.stats.samples_dropped);
+    printf("  stream: %u frames (%u deferred by backpressure), %u audio packets, %u transfers, "
+           "%.1f bytes/transfer, watermark %u\n", accepted, skipped, rx.audio, cdc_tx_stats.transfers,
+           (double)cdc_tx_stats.bytes_sent / cdc_tx_stats.transfers, cdc_tx_stats.high_watermark);
+}
+
+/* ==== QUEUE: overflow rejects whole writes ==== */
+static void check_overflow(void)
+{
+    uint8_t buf[TLM_OVERHEAD + 100];
+    uint32_t accepted = 0, rejected = 0;
+
+    link_reset();
+    for (int i = 0; i < 100; i++) {
+        uint16_t len = make_frame(buf, 100);
+        if (CDC_Transmit_FS(buf, len) == USBD_OK) {
+            tx_seq++;
+            accepted++;
+        } else {
+            enc.seq[TLM_CHAN_PROX]--;
+            rejected++;
+        }
+    }
+    CHECK(rejected > 0 && cdc_tx_stats.drops == rejected, "overflow: %u rejected, %u counted", rejected,
+          cdc_tx_stats.drops);
+    CHECK(cdc_tx_stats.dropped_bytes == rejected * (TLM_OVERHEAD + 100), "overflow: %u dropped bytes",
+          cdc_tx_stats.dropped_bytes);
+    CHECK(cdc_tx_stats.high_watermark <= CDC_TX_RING_SIZE, "overflow: watermark %u",
+          cdc_tx_stats.high_watermark);
+
+    drain_all();
+    CHECK(rx.frames == accepted && rx.bad == 0, "overflow: %u/%u frames, %u bad", rx.frames, accepted, rx.bad);
+    CHECK(dec.crc_errors == 0, "overflow: partial frame on the wire");
+}
+
+/* ==== QUEUE: transfer lost to a bus reset ==== */
+static void check_reset(void)
+{
+    uint8_t buf[TLM_OVERHEAD + 64];
+    uint32_t len;
+
+    link_reset();
+    for (int i = 0; i < 8; i++, tx_seq++)
+        CDC_Transmit_FS(buf, make_frame(buf, 64));
+
+    CHECK(HalShim_TakeTx(&len) != NULL, "reset: no transfer started");
+    /* Bus reset: the completion never arrives, the class is re-initialized */
+    USBD_Interface_fops_FS.Init();
+    drain_all();
+    CHECK(rx.frames == 8 && rx.bad == 0, "reset: %u/8 frames after re-enumeration", rx.frames);
+
+    /* Writes while the device is not configured are refused, not queued */
+    hUsbDeviceFS.dev_state = USBD_STATE_DEFAULT;
+    CHECK(CDC_Transmit_FS(buf, make_frame(buf, 8)) != USBD_OK, "reset: write accepted while unconfigured");
+    enc.seq[TLM_CHAN_PROX]--;
+    CHECK(cdc_tx_stats.drops == 0, "reset: link-down write counted as a drop");
+}
+
+/* ==== LINE STATE: DTR gates the producers ==== */
+static void check_line_state(void)
+{
+    uint8_t buf[TLM_OVERHEAD + 8];
+    uint16_t n;
+
+    link_reset();
+    USBD_Interface_fops_FS.Init();
+    n = make_frame(buf, 8);
+    CHECK(!CDC_HostListening() && CDC_TxQueue_Write(buf, n) == 0, "dtr: write accepted before the port was opened");
+
+    HalShim_SetLineState(CDC_LINE_RTS);
+    CHECK(!CDC_HostListening(), "dtr: RTS alone counts as listening");
+    HalShim_SetLineState(CDC_LINE_DTR | CDC_LINE_RTS);
+    CHECK(CDC_GetLineState() == (CDC_LINE_DTR | CDC_LINE_RTS), "dtr: line state %u", CDC_GetLineState());
+    CHECK(CDC_HostListening() && CDC_TxQueue_Write(buf, n) == n, "dtr: write refused with the port open");
+    tx_seq++;
+
+    HalShim_SetLineState(0);
+    n = make_frame(buf, 8);
+    CHECK(!CDC_HostListening() && CDC_TxQueue_Write(buf, n) == 0, "dtr: write accepted after the port was closed");
+
+    HalShim_SetLineState(CDC_LINE_DTR);
+    hUsbDeviceFS.dev_state = USBD_STATE_SUSPENDED;
+    CHECK(!CDC_HostListening(), "dtr: listening while suspended");
+    hUsbDeviceFS.dev_state = USBD_STATE_CONFIGURED;
+    CHECK(CDC_HostListening(), "dtr: not listening after resume");
+    USBD_Interface_fops_FS.Init();
+    CHECK(!CDC_HostListening(), "dtr: line state survived re-enumeration");
+    enc.seq[TLM_CHAN_PROX]--;
+
+    CHECK(cdc_tx_stats.drops == 0, "dtr: %u refused writes counted as drops", cdc_tx_stats.drops);
+    HalShim_SetLineState(CDC_LINE_DTR);
+    drain_all();
+    CHECK(rx.frames == 1 && rx.bad == 0, "dtr: %u frames on the wire, expected 1", rx.frames);
+
+    /* Paused packetizer: no unpacking, a partly filled slot is abandoned */
+    static uint32_t block[MIC_FRAMES_PER_HALF * MIC_DMA_WORDS_PER_FRAME];
+    AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, 0);
+    AudioPkt_SetPaused(&audio_pkt, 1);
+    for (int i = 0; i < 100; i++)
+        AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, (uint32_t)(i + 1) * MIC_FRAMES_PER_HALF);
+    CHECK(audio_pkt.stats.samples_in == MIC_FRAMES_PER_HALF &&
+          audio_pkt.stats.samples_skipped == 100U * MIC_FRAMES_PER_HALF && !AudioPkt_Pending(&audio_pkt),
+          "pause: %u samples packed, %u skipped", audio_pkt.stats.samples_in, audio_pkt.stats.samples_skipped);
+    AudioPkt_SetPaused(&audio_pkt, 0);
+    for (uint32_t f = 0; f < AUDIO_PKT_SAMPLES; f += MIC_FRAMES_PER_HALF)
+        AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, 5000U + f);
+    CHECK(AudioPkt_Pending(&audio_pkt) && TLM_GetU32(&audio_pkt.slot[audio_pkt.rd][6]) == 5000U,
+          "pause: first packet after resume does not start at the resume frame");
+    CHECK(TLM_GetU16(&audio_pkt.slot[audio_pkt.rd][4]) == 0U,
+          "pause: abandoned slot left a gap in the audio seq");
+}
+
+/* ==== DISCARD: a closed port leaves nothing for the next host ==== */
+static void check_discard(void)
+{
+    uint8_t buf[TLM_OVERHEAD + 64];
+    uint32_t len;
+
+    link_reset();
+    for (int i = 0; i < 16; i++, tx_seq++)
+        CDC_TxQueue_Write(buf, make_frame(buf, 64));
+    uint8_t *p = HalShim_TakeTx(&len);
+    CHECK(p != NULL, "discard: no transfer started");
+
+    HalShim_SetLineState(0);
+    uint32_t queued = cdc_tx_stats.bytes_queued;
+    uint16_t n = CDC_TxQueue_Discard();
+    CHECK(n == queued - len && cdc_tx_stats.discarded_bytes == n, "discard: %u of %u unsent bytes discarded", n,
+          queued - len);
+    CHECK(CDC_TxQueue_Free() == CDC_TX_RING_SIZE - len, "discard: %u bytes left behind the transfer in flight",
+          CDC_TX_RING_SIZE - CDC_TxQueue_Free() - len);
+    USBD_Interface_fops_FS.TransmitCplt(p, &len, CDC_IN_EP);
+    drain_all();
+    CHECK(cdc_tx_stats.bytes_sent == len && CDC_TxQueue_Free() == CDC_TX_RING_SIZE,
+          "discard: %u bytes sent, %u expected", cdc_tx_stats.bytes_sent, len);
+
+    /* The next session decodes from its first byte */
+    TLM_DecoderInit(&dec);
+    memset(&rx, 0, sizeof(rx));
+    rx.next_seq = tx_seq;
+    HalShim_SetLineState(CDC_LINE_DTR | CDC_LINE_RTS);
+    for (int i = 0; i < 4; i++, tx_seq++)
+        CDC_TxQueue_Write(buf, make_frame(buf, 64));
+    drain_all();
+    CHECK(rx.frames == 4 && rx.bad == 0 && dec.skipped_bytes == 0, "discard: %u/4 frames, %u bad in the new session",
+          rx.frames, rx.bad);
+}
+
+/* ==== SEQUENCE: audio packets lost to a stalled host show up as seq gaps ==== */
+static void check_audio_loss(void)
+{
+    static uint32_t block[MIC_FRAMES_PER_HALF * MIC_DMA_WORDS_PER_FRAME];
+    uint32_t frame = 0;
+
+    link_reset();
+    /* Host stops reading: the slots fill up and whole packets are lost */
+    for (uint32_t i = 0; i < 4U * AUDIO_PKT_SLOT_COUNT * AUDIO_PKT_SAMPLES / MIC_FRAMES_PER_HALF; i++) {
+        AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, frame);
+        frame += MIC_FRAMES_PER_HALF;
+    }
+    drain_all();
+    /* Reading again: the next packet carries the spent numbers */
+    for (uint32_t f = 0; f < 2U * AUDIO_PKT_SAMPLES; f += MIC_FRAMES_PER_HALF) {
+        AudioPkt_PushBlock(&audio_pkt, block, MIC_FRAMES_PER_HALF, frame);
+        frame += MIC_FRAMES_PER_HALF;
+    }
+    drain_all();
+
+    const TLM_SeqStatsTypeDef *st = &dec.chan[TLM_CHAN_AUDIO];
+    CHECK(audio_pkt.stats.samples_dropped > 0 && audio_pkt.stats.packets_dropped > 0,
+          "audio loss: nothing dropped (%u samples)", audio_pkt.stats.samples_dropped);
+    CHECK(st->lost == audio_pkt.stats.packets_dropped && st->gaps == 1 && st->reordered == 0,
+          "audio loss: decoder lost %u in %u gaps, device dropped %u packets", st->lost, st->gaps,
+          audio_pkt.stats.packets_dropped);
+    CHECK(st->frames == rx.audio, "audio loss: %u frames counted, %u received", st->frames, rx.audio);
+    printf("  audio loss: %u samples dropped -> %u packets, decoder gap of %u\n",
+           audio_pkt.stats.samples_dropped, audio_pkt.stats.packets_dropped, st->lost);
+}
+
+/* ==== COALESCING: 1 ms frames, FS bulk budget of 19 packets per frame ==== */
+#define FS_PACKETS_PER_FRAME  19U
+#define RECORD_PAYLOAD        22U       // 36-byte frame, a PROX + AUDIO_LVL pair
+
+static uint32_t write_ms[65536];
+static uint64_t lat_sum;
+static uint32_t lat_max, lat_n, deliver_ms;
+
+static void lat_frame(const TLM_FrameTypeDef *f, void *ctx)
+{
+    rx_frame(f, ctx);
+    if (f->chan != TLM_CHAN_PROX) return;
+    uint32_t l = deliver_ms - write_ms[f->seq];
+    lat_sum += l;
+    lat_n++;
+    if (l > lat_max) lat_max = l;
+}
+
+static void run_load(const char *name, uint32_t records_per_10ms, uint32_t lat_limit)
+{
+    uint8_t buf[TLM_OVERHEAD + RECORD_PAYLOAD];
+    uint32_t packets = 0, bytes = 0, accepted = 0, carry = 0, left = 0;
+    const uint32_t ms_total = 2000;
+
+    link_reset();
+    lat_sum = 0; lat_max = 0; lat_n = 0;
+
+    for (uint32_t ms = 0; ms < ms_total; ms++) {
+        /* producer: records spread evenly over the frame */
+        carry += records_per_10ms;
+        for (; carry >= 10; carry -= 10) {
+            uint16_t len = make_frame(buf, RECORD_PAYLOAD);
+            write_ms[tx_seq] = now_ms;
+            if (CDC_Transmit_FS(buf, len) == USBD_OK) {
+                tx_seq++;
+                accepted++;
+            } else {
+                enc.seq[TLM_CHAN_PROX]--;
+            }
+        }
+        /* bus: move packets of the transfer in flight while the frame has room */
+        uint32_t budget = FS_PACKETS_PER_FRAME;
+        deliver_ms = now_ms;
+        while (hal_shim_cdc.TxState != 0U && budget > 0) {
+            uint32_t len = hal_shim_cdc.TxLength;
+            if (left == 0)
+                left = len / CDC_DATA_FS_MAX_PACKET_SIZE + 1U;    // short packet or ZLP ends it
+            uint32_t n = left < budget ? left : budget;
+            budget -= n;
+            packets += n;
+            if ((left -= n) != 0) break;
+            bytes += len;
+            uint8_t *p = HalShim_TakeTx(&len);
+            TLM_DecoderFeed(&dec, p, len, lat_frame, &rx);
+            USBD_Interface_fops_FS.TransmitCplt(p, &len, CDC_IN_EP);
+        }
+        tick();
+    }
+
+    double avg = lat_n ? (double)lat_sum / lat_n : 0.0;
+    printf("  %-6s %4u rec/s: %6.1f kB/s, %5.1f bytes/packet, latency avg %.2f ms max %u ms, "
+           "%u flushes, %u zlps\n", name, records_per_10ms * 100U, bytes / (ms_total / 1000.0) / 1000.0,
+           packets ? (double)bytes / packets : 0.0, avg, lat_max, cdc_tx_stats.deadline_flushes,
+           cdc_tx_stats.zlps);
+    CHECK(rx.bad == 0 && dec.crc_errors == 0, "%s: stream corrupted", name);
+    CHECK(lat_max <= lat_limit, "%s: record latency %u ms over %u ms", name, lat_max, lat_limit);
+    CHECK(cdc_tx_stats.drops == 0, "%s: %u drops", name, cdc_tx_stats.drops);
+    drain_all();
+    CHECK(rx.frames == accepted, "%s: %u/%u records delivered", name, rx.frames, accepted);
+}
+
+/* ==== LOG CONSOLE: second CDC function, independent of the data queue ==== */
+static uint8_t log_rx[2 * CDC_LOG_RING_SIZE];
+static uint32_t log_rx_len;
+
+/* Complete the console transfer in flight */
+static int log_drain_one(void)
+{
+    uint32_t len;
+    uint8_t *p = HalShim_TakeLogTx(&len);
+    if (p == NULL) return 0;
+    if (log_rx_len + len <= sizeof(log_rx))
+        memcpy(&log_rx[log_rx_len], p, len);
+    log_rx_len += len;
+    USBD_LogInterface_fops_FS.TransmitCplt(p, &len, CDC_LOG_IN_EP);
+    return 1;
+}
+
+static void check_log_console(void)
+{
+    static const char hello[] = "I2C scan complete.\r\n";
+    const uint16_t n_hello = sizeof(hello) - 1U;
+    uint8_t buf[TLM_OVERHEAD + 100], line[73];
+    uint32_t accepted = 0, queued = 0, rejected = 0, len;
+
+    link_reset();
+    USBD_LogInterface_fops_FS.Init();
+    memset(&cdc_log_stats, 0, sizeof(cdc_log_stats));
+    log_rx_len = 0;
+
+    /* Output before a terminal opens the console is kept, not sent */
+    CHECK(CDC_Log_Write((const uint8_t *)hello, n_hello) == n_hello, "log: boot message refused");
+    CDC_Log_OnSOF();
+    CHECK(HalShim_TakeLogTx(&len) == NULL, "log: sent before the console was opened");
+
+    /* Data queue full and not drained: the console still flows */
+    for (;;) {
+        uint16_t n = make_frame(buf, 100);
+        if (CDC_Transmit_FS(buf, n) != USBD_OK) {
+            enc.seq[TLM_CHAN_PROX]--;
+            break;
+        }
+        tx_seq++;
+        accepted++;
+    }
+    HalShim_SetLogLineState(CDC_LINE_DTR | CDC_LINE_RTS);
+    CHECK(CDC_Log_HostListening(), "log: not listening with DTR set");
+    CDC_Log_OnSOF();
+    while (log_drain_one())
+        ;
+    CHECK(log_rx_len == n_hello && memcmp(log_rx, hello, n_hello) == 0,
+          "log: %u bytes received behind a full data queue, expected %u", log_rx_len, n_hello);
+
+    /* A full ring drops whole writes; the run after the wrap follows the completion */
+    for (uint16_t i = 0; i < sizeof(line); i++)
+        line[i] = (uint8_t)('a' + i % 26U);
+    for (int i = 0; i < 20; i++) {
+        if (CDC_Log_Write(line, sizeof(line)) == sizeof(line)) queued += sizeof(line);
+        else rejected++;
+    }
+    CHECK(rejected > 0 && cdc_log_stats.drops == rejected && cdc_log_stats.dropped_bytes == rejected * sizeof(line),
+          "log: %u rejected, %u counted", rejected, cdc_log_stats.drops);
+    CHECK(cdc_log_stats.high_watermark <= CDC_LOG_RING_SIZE, "log: watermark %u", cdc_log_stats.high_watermark);
+    CDC_Log_OnSOF();
+    while (log_drain_one())
+        ;
+    int same = log_rx_len == n_hello + queued;
+    for (uint32_t i = 0; same && i < queued; i++)
+        same = log_rx[n_hello + i] == line[i % sizeof(line)];
+    CHECK(same, "log: %u bytes received, expected %u", log_rx_len, n_hello + queued);
+    CHECK(cdc_log_stats.bytes_sent == cdc_log_stats.bytes_queued && cdc_log_stats.transfers == 3,
+          "log: %u of %u bytes in %u transfers", cdc_log_stats.bytes_sent, cdc_log_stats.bytes_queued,
+          cdc_log_stats.transfers);
+
+    /* Closing the console holds output again */
+    HalShim_SetLogLineState(0);
+    CDC_Log_Write((const uint8_t *)hello, n_hello);
+    CDC_Log_OnSOF();
+    CHECK(HalShim_TakeLogTx(&len) == NULL, "log: sent after the console was closed");
+
+    /* Nothing of the console leaked into the data function */
+    drain_all();
+    CHECK(rx.frames == accepted && rx.bad == 0, "log: %u/%u data frames, %u bad", rx.frames, accepted, rx.bad);
+    CHECK(dec.crc_errors == 0 && dec.skipped_bytes == 0, "log: %u crc errors, %u bytes skipped in the data stream",
+          dec.crc_errors, dec.skipped_bytes);
+    printf("  log: %u bytes through a full data queue in %u transfers, %u writes dropped\n",
+           cdc_log_stats.bytes_sent, cdc_log_stats.transfers, cdc_log_stats.drops);
+}
+
+static void check_coalescing(void)
+{
+    /* light load: the deadline bounds latency */
+    run_load("light", 5, CDC_TX_FLUSH_MS + 1U);
+    /* medium: mostly full packets */
+    run_load("medium", 100, CDC_TX_FLUSH_MS + 1U);
+    /* near line rate: 900 kB/s offered */
+    run_load("heavy", 250, 4U);
+}
+
+int main(void)
+{
+    check_stream();
+    check_overflow();
+    check_reset();
+    check_line_state();
+    check_discard();
+    check_audio_loss();
+    check_log_console();
+    check_coalescing();
+
+    return check_result();
+}
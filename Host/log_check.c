@@ -0,0 +1,325 @@
+/**
+ * @file log_check.c
+ * @brief Host-native check of the deferred log (dlog.c) and its host decoder (tlm_log.c)
+ *
+ * DLOG() calls in this file put their format strings in the dlog_fmt
+ * section of the check's own ELF, as they do in the firmware ELF, so the
+ * round trip is the real one: entries are recorded by the unmodified
+ * dlog.c, drained into TLM_CHAN_LOG frames, decoded, and formatted from the
+ * table read out of /proc/self/exe:
+ *   - every conversion the formatter supports renders exactly as snprintf
+ *     with the same arguments; ticks and argument counts survive;
+ *   - a synthetic ELF32 image (the firmware's class) yields the same table;
+ *   - a full ring drops whole entries, the next frame reports how many,
+ *     and the entries kept are intact and in order, across ring wraps and
+ *     frames cut at the payload limit;
+ *   - a DLOG() costs a fraction of formatting the same line with snprintf.
+ *
+ * Usage: log_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "hal_shim.h"
+#include "microphone_sensor.h"
+#include "audio_packetizer.h"
+#include "audio_sync.h"
+#include "scheduler.h"
+#include "telemetry.h"
+#include "dlog.h"
+#include "tlm_log.h"
+
+MIC_HandleTypeDef mic;
+AUDIO_PKT_HandleTypeDef audio_pkt;
+AUDIO_SYNC_HandleTypeDef audio_sync;
+SCHED_HandleTypeDef sched;
+
+/* ==== HELPERS ==== */
+#define FRAME_PAYLOAD   256U
+#define MAX_ENTRIES     4096U
+
+static TLM_EncoderTypeDef tlm;
+static TLM_DecoderTypeDef dec;
+static TLM_LogTableTypeDef table;
+
+/* Received entries, in order */
+static TLM_LogEntryTypeDef got[MAX_ENTRIES];
+static uint32_t n_got, lost_reported, truncated;
+
+static void rx_frame(const TLM_FrameTypeDef *f, void *ctx)
+{
+    TLM_LogEntryTypeDef e;
+    uint16_t pos = TLM_LOG_HEADER_SIZE;
+    int rc;
+
+    UNUSED(ctx);
+    if (f->chan != TLM_CHAN_LOG || f->len < TLM_LOG_HEADER_SIZE) return;
+    lost_reported += TLM_GetU16(f->payload);
+    while ((rc = TLM_LogNext(f->payload, f->len, &pos, &e)) > 0)
+        if (n_got < MAX_ENTRIES) got[n_got++] = e;
+    if (rc < 0) truncated++;
+}
+
+/* Drain the ring into frames as the firmware's log job does */
+static uint32_t drain(void)
+{
+    uint8_t buf[TLM_OVERHEAD + FRAME_PAYLOAD];
+    TLM_WriterTypeDef w;
+    uint32_t frames = 0;
+
+    while (DLog_Pending()) {
+        TLM_Begin(&tlm, &w, buf, TLM_CHAN_LOG, HAL_GetTick());
+        DLog_Fill(&w, FRAME_PAYLOAD);
+        uint16_t len = TLM_End(&w);
+        CHECK(len <= sizeof(buf), "drain: frame of %u bytes", len);
+        TLM_DecoderFeed(&dec, buf, len, rx_frame, NULL);
+        frames++;
+    }
+    return frames;
+}
+
+static void log_reset(void)
+{
+    HalShim_Reset();
+    DLog_Init();
+    memset(&tlm, 0, sizeof(tlm));
+    TLM_DecoderInit(&dec);
+    n_got = 0;
+    lost_reported = 0;
+    truncated = 0;
+}
+
+/* ==== FORMATTING ROUND TRIP ==== */
+typedef struct {
+    char text[160];
+    uint32_t tick;
+} EXPECT_TypeDef;
+
+static EXPECT_TypeDef expect[32];
+static uint32_t n_expect;
+
+#define EXPECT(...) do { \
+        snprintf(expect[n_expect].text, sizeof(expect[0].text), __VA_ARGS__); \
+        expect[n_expect++].tick = HAL_GetTick(); \
+    } while (0)
+
+static void check_format(void)
+{
+    static const char name[] = "prox";
+    char text[256];
+
+    log_reset();
+    HalShim_SetTick(1000);
+    DLOG("plain text, no arguments");
+    EXPECT("plain text, no arguments");
+    HalShim_SetTick(1001);
+    DLOG("d=%d u=%u x=%08X", -42, 3000000000U, 0xBEEFU);
+    EXPECT("d=%d u=%u x=%08X", -42, 3000000000U, 0xBEEFU);
+    DLOG("[%-6d|%+d|%5.3u|%#x|%o|%c]", 7, 9, 42, 255, 8, 'Z');
+    EXPECT("[%-6d|%+d|%5.3u|%#x|%o|%c]", 7, 9, 42, 255, 8, 'Z');
+    HalShim_SetTick(0xFFFFFFF0U);
+    DLOG("[%*d|%-*u|%.*f]", 6, 123, 4, 5, 2, DLOG_F(3.14159f));
+    EXPECT("[%*d|%-*u|%.*f]", 6, 123, 4, 5, 2, (double)3.14159f);
+    DLOG("f=%f e=%.3e g=%g G=%G", DLOG_F(-1.5f), DLOG_F(12345.678f), DLOG_F(0.0001f), DLOG_F(1e20f));
+    EXPECT("f=%f e=%.3e g=%g G=%G", -1.5, (double)12345.678f, (double)0.0001f, (double)1e20f);
+    DLOG("l=%ld lu=%lu hh=%hhx h=%hd", -5, 6, 0x1FF, 0x18000);
+    EXPECT("l=%ld lu=%lu hh=%hhx h=%hd", -5L, 6LU, (unsigned char)0xFF, (short)-32768);
+    DLOG("%d%% of %u jobs", 50, 8);
+    EXPECT("%d%% of %u jobs", 50, 8);
+    DLOG("eight %u %u %u %u %u %u %u %u", 1, 2, 3, 4, 5, 6, 7, 8);
+    EXPECT("eight %u %u %u %u %u %u %u %u", 1, 2, 3, 4, 5, 6, 7, 8);
+    DLOG("job %s at %p", (uint32_t)(uintptr_t)name, 0x20001234U);
+    EXPECT("job <0x%08x> at <0x20001234>", (unsigned)(uint32_t)(uintptr_t)name);
+    DLOG("short %d %d", 1);
+    EXPECT("short 1 <?>");
+    drain();
+
+    CHECK(TLM_LogLoad(&table, "/proc/self/exe") == 0, "format: no dlog_fmt section in /proc/self/exe");
+    CHECK(n_got == n_expect && truncated == 0 && dec.crc_errors == 0, "format: %u of %u entries, %u truncated",
+          n_got, n_expect, truncated);
+    uint32_t bad = 0;
+    for (uint32_t i = 0; i < n_got && i < n_expect; i++) {
+        const char *fmt = TLM_LogString(&table, got[i].id);
+        if (fmt == NULL) {
+            bad++;
+            printf("FAIL: format: entry %u id %u not in the table\n", i, got[i].id);
+            continue;
+        }
+        TLM_LogFormat(fmt, got[i].args, got[i].n, text, sizeof(text));
+        if (strcmp(text, expect[i].text) != 0 || got[i].tick != expect[i].tick) {
+            bad++;
+            printf("FAIL: format: \"%s\" t=%u, expected \"%s\" t=%u\n", text, got[i].tick, expect[i].text,
+                   expect[i].tick);
+        }
+    }
+    failures += (int)bad;
+    printf("  format: %u entries, %zu table bytes, %u mismatches\n", n_got, table.size, bad);
+
+    /* truncation behaves as snprintf */
+    DLOG("truncate %u", 123456789U);
+    drain();
+    int k = TLM_LogFormat(TLM_LogString(&table, got[n_got - 1].id), got[n_got - 1].args, got[n_got - 1].n, text, 8);
+    CHECK(k == 18 && strcmp(text, "truncat") == 0, "format: truncation gave %d \"%s\"", k, text);
+}
+
+/* ==== ELF32 ==== */
+static void put(uint8_t *p, uint32_t v, unsigned n)
+{
+    while (n-- > 0) {
+        *p++ = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+/* ELF32 with a null section, .shstrtab, a decoy and dlog_fmt, as arm-none-eabi-ld lays it out */
+static void check_elf32(void)
+{
+    static const char shstr[] = "\0.shstrtab\0.text\0dlog_fmt";
+    static const char fmts[] = "boot: sysclk %u Hz\0link: host gone";
+    uint8_t img[512];
+    const uint32_t shoff = 256, strs = 64, data = 128;
+
+    memset(img, 0, sizeof(img));
+    memcpy(img, "\x7f" "ELF", 4);
+    img[4] = 1;                         // ELFCLASS32
+    img[5] = 1;                         // little endian
+    put(img + 0x20, shoff, 4);
+    put(img + 0x2E, 40, 2);             // e_shentsize
+    put(img + 0x30, 4, 2);              // e_shnum
+    put(img + 0x32, 1, 2);              // e_shstrndx
+    memcpy(img + strs, shstr, sizeof(shstr));
+    memcpy(img + data, fmts, sizeof(fmts));
+    uint8_t *sh = img + shoff;
+    put(sh + 40 + 0, 1, 4);             // .shstrtab
+    put(sh + 40 + 0x10, strs, 4);
+    put(sh + 40 + 0x14, sizeof(shstr), 4);
+    put(sh + 80 + 0, 11, 4);            // .text
+    put(sh + 80 + 0x10, 0, 4);
+    put(sh + 80 + 0x14, 16, 4);
+    put(sh + 120 + 0, 17, 4);           // dlog_fmt
+    put(sh + 120 + 0x10, data, 4);
+    put(sh + 120 + 0x14, sizeof(fmts), 4);
+
+    const char *path = "build/log_check_elf32.bin";
+    FILE *f = fopen(path, "wb");
+    CHECK(f != NULL, "elf32: cannot write %s", path);
+    if (f == NULL) return;
+    fwrite(img, 1, sizeof(img), f);
+    fclose(f);
+
+    TLM_LogTableTypeDef t32;
+    char text[64];
+    uint32_t arg = 180000000U;
+    int rc = TLM_LogLoad(&t32, path);
+    const char *s0 = rc == 0 ? TLM_LogString(&t32, 0) : NULL;
+    const char *s1 = rc == 0 ? TLM_LogString(&t32, 19) : NULL;
+    if (s0) TLM_LogFormat(s0, &arg, 1, text, sizeof(text));
+    CHECK(rc == 0 && s0 && s1 && strcmp(text, "boot: sysclk 180000000 Hz") == 0 && strcmp(s1, "link: host gone") == 0,
+          "elf32: table not read (rc %d)", rc);
+    CHECK(TLM_LogString(&t32, (uint16_t)sizeof(fmts)) == NULL, "elf32: id past the table accepted");
+    TLM_LogFree(&t32);
+    remove(path);
+
+    img[5] = 2;                         // big endian: refused
+    f = fopen(path, "wb");
+    if (f != NULL) {
+        fwrite(img, 1, sizeof(img), f);
+        fclose(f);
+    }
+    CHECK(TLM_LogLoad(&t32, path) != 0, "elf32: big endian image accepted");
+    remove(path);
+    printf("  elf32: table of %zu bytes read\n", sizeof(fmts));
+}
+
+/* ==== OVERFLOW AND WRAP ==== */
+static void check_overflow(void)
+{
+    uint32_t i, written = 0;
+
+    log_reset();
+    for (i = 0; i < 400; i++, written++)
+        DLOG("entry %u of %u", i, 400U);
+    uint32_t dropped = dlog_stats.dropped;
+    uint32_t frames = drain();
+    printf("  overflow: %u of %u entries kept in %u frames, %u dropped, %u reported\n", n_got, written, frames,
+           dropped, lost_reported);
+    CHECK(dropped > 0 && dlog_stats.entries + dropped == written && dlog_stats.high_watermark <= DLOG_RING_SIZE,
+          "overflow: %u recorded + %u dropped of %u", dlog_stats.entries, dropped, written);
+    CHECK(lost_reported == dropped && n_got == dlog_stats.entries, "overflow: %u reported, %u received",
+          lost_reported, n_got);
+    uint32_t bad = 0;
+    for (i = 0; i < n_got; i++)
+        bad += got[i].n != 2 || got[i].args[0] != i || got[i].args[1] != 400U;
+    CHECK(bad == 0 && truncated == 0, "overflow: %u entries out of order, %u truncated", bad, truncated);
+
+    /* varying entry sizes over many wraps, drained at random points */
+    log_reset();
+    uint32_t seed = 3, expect_seq = 0;
+    written = 0;
+    bad = 0;
+    for (uint32_t round = 0; round < 2000; round++) {
+        seed = seed * 1664525U + 1013904223U;
+        switch ((seed >> 24) % 4U) {
+        case 0: DLOG("a %u", written); break;
+        case 1: DLOG("b %u %u", written, ~written); break;
+        case 2: DLOG("c %u %u %u %u %u %u %u %u", written, 1, 2, 3, 4, 5, 6, 7); break;
+        default: DLOG("d %u %u %u", written, written * 3U, 0xA5A5A5A5U); break;
+        }
+        written++;
+        if ((seed >> 8) % 7U == 0U) {
+            n_got = 0;
+            drain();
+            for (i = 0; i < n_got; i++, expect_seq++)
+                bad += got[i].n == 0 || got[i].args[0] != expect_seq;
+        }
+    }
+    n_got = 0;
+    drain();
+    for (i = 0; i < n_got; i++, expect_seq++)
+        bad += got[i].args[0] != expect_seq;
+    CHECK(bad == 0 && expect_seq == written && dlog_stats.dropped == 0 && truncated == 0,
+          "wrap: %u of %u entries, %u bad, %u dropped", expect_seq, written, bad, dlog_stats.dropped);
+    printf("  wrap: %u entries of 11..39 bytes through a %u byte ring\n", written, DLOG_RING_SIZE);
+}
+
+/* ==== COST ==== */
+static void check_cost(void)
+{
+    char buf[128];
+    uint64_t t_log = 0, t_fmt = 0;
+    const uint32_t batch = 32, batches = 2000;
+
+    log_reset();
+    for (uint32_t b = 0; b < batches; b++) {
+        uint64_t t0 = __rdtsc();
+        for (uint32_t i = 0; i < batch; i++)
+            DLOG("job %u lat %u us exec %u us", i, b, i * b);
+        uint64_t t1 = __rdtsc();
+        for (uint32_t i = 0; i < batch; i++) {
+            snprintf(buf, sizeof(buf), "job %u lat %u us exec %u us", i, b, i * b);
+            __asm__ volatile("" : : "r"(buf) : "memory");
+        }
+        uint64_t t2 = __rdtsc();
+        t_log += t1 - t0;
+        t_fmt += t2 - t1;
+        n_got = 0;
+        drain();
+    }
+    double log_cyc = (double)t_log / (batch * batches), fmt_cyc = (double)t_fmt / (batch * batches);
+    printf("  cost: DLOG %.0f TSC cycles, snprintf %.0f (%.1fx)\n", log_cyc, fmt_cyc, fmt_cyc / log_cyc);
+    CHECK(log_cyc < fmt_cyc, "cost: DLOG %.0f cycles not below snprintf %.0f", log_cyc, fmt_cyc);
+}
+
+int main(void)
+{
+    check_format();
+    check_elf32();
+    check_overflow();
+    check_cost();
+    TLM_LogFree(&table);
+
+    return check_result();
+}
@@ -0,0 +1,293 @@
+/**
+ * @file mux_check.c
+ * @brief Host-native check of the telemetry stream multiplexer (stream_mux.c)
+ *
+ * Runs the unmodified multiplexer, scheduler and CDC transmit queue against
+ * the HAL shim with the 1 ms bus model of flow_check:
+ *   - rates: a 1 kHz level, a 10 Hz delta coded ALS/PS, a 1 Hz gas record
+ *     and a 200 Hz bulk stream each arrive at their own rate, the records
+ *     intact; streams due in the same tick share one queue write; a rate
+ *     change by job id (TLM_CMD_SET_RATE) takes effect; the job mask of a
+ *     set of channels (Flow_Init) holds exactly their streams' jobs;
+ *   - priorities: with a host far slower than the bulk stream, the high
+ *     priority streams lose nothing while the bulk stream drops, where
+ *     with equal priorities the fast stream loses frames as well;
+ *   - host gone: frames whose queue write fails are counted as device
+ *     drops, and the delta coded stream resumes with a keyframe.
+ *
+ * Usage: mux_check
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "hal_shim.h"
+#include "microphone_sensor.h"
+#include "audio_packetizer.h"
+#include "audio_sync.h"
+#include "scheduler.h"
+#include "telemetry.h"
+#include "stream_mux.h"
+#include "usbd_cdc_if.h"
+
+MIC_HandleTypeDef mic;
+AUDIO_PKT_HandleTypeDef audio_pkt;
+AUDIO_SYNC_HandleTypeDef audio_sync;
+SCHED_HandleTypeDef sched;
+
+/* ==== STREAMS ==== */
+#define LVL_HZ          1000U
+#define PROX_HZ         10U
+#define GAS_HZ          1U
+#define BULK_HZ         200U
+#define BULK_LEN        100U
+#define PKT_TENTHS_FAST 190U        // full FS bulk budget per frame
+#define PKT_TENTHS_SLOW 10U         // 64 kB/s: the bulk stream alone wants 6 packets per ms
+
+static TLM_EncoderTypeDef tlm;
+static MUX_HandleTypeDef mux;
+static TLM_DeltaTypeDef prox_delta;
+static TLM_DecoderTypeDef dec;
+static uint32_t now_ms, carry, left;
+
+/* Record values are a function of the tick, so the receiver can check them */
+static void fill_lvl(TLM_WriterTypeDef *w, void *ctx)
+{
+    UNUSED(ctx);
+    TLM_PutI32(w, (int32_t)(HAL_GetTick() * 7U));
+}
+
+static uint16_t prox_als(uint32_t t) { return (uint16_t)(300U + t / 1000U); }
+static uint16_t prox_ps(uint32_t t)  { return (uint16_t)(8U + (t / 100U) % 3U); }
+
+static void fill_prox(TLM_WriterTypeDef *w, void *ctx)
+{
+    UNUSED(ctx);
+    TLM_PutU16(w, prox_als(HAL_GetTick()));
+    TLM_PutU16(w, prox_ps(HAL_GetTick()));
+}
+
+static void fill_gas(TLM_WriterTypeDef *w, void *ctx)
+{
+    UNUSED(ctx);
+    TLM_PutU8(w, 1);
+    TLM_PutU16(w, 120);
+    TLM_PutU16(w, (uint16_t)(400U + HAL_GetTick() / 1000U));
+}
+
+static void fill_bulk(TLM_WriterTypeDef *w, void *ctx)
+{
+    UNUSED(ctx);
+    for (uint16_t i = 0; i < BULK_LEN; i++)
+        TLM_PutU8(w, (uint8_t)i);
+}
+
+/* ==== RECEIVER ==== */
+typedef struct {
+    uint32_t frames[TLM_CHAN_COUNT];
+    uint32_t bad;               // record not what was filled in at its ts
+    uint32_t deltas;
+    TLM_DeltaDecoderTypeDef delta;
+} RX_TypeDef;
+
+static RX_TypeDef rx;
+
+static void rx_frame(const TLM_FrameTypeDef *wire, void *ctx)
+{
+    RX_TypeDef *r = (RX_TypeDef *)ctx;
+    TLM_FrameTypeDef f = *wire;
+    if (!TLM_DeltaExpand(&r->delta, &f)) {
+        r->bad++;
+        return;
+    }
+    if (f.chan >= TLM_CHAN_COUNT) return;
+    r->frames[f.chan]++;
+    r->deltas += (wire->chan & TLM_CHAN_DELTA) ? 1U : 0U;
+
+    const uint8_t *p = f.payload;
+    switch (f.chan) {
+    case TLM_CHAN_AUDIO_LVL:
+        if (f.len != 4 || TLM_GetU32(p) != f.ts * 7U) r->bad++;
+        break;
+    case TLM_CHAN_PROX:
+        if (f.len != 4 || TLM_GetU16(p) != prox_als(f.ts) || TLM_GetU16(p + 2) != prox_ps(f.ts)) r->bad++;
+        break;
+    case TLM_CHAN_GAS:
+        if (f.len != 5 || TLM_GetU16(p + 3) != 400U + f.ts / 1000U) r->bad++;
+        break;
+    case TLM_CHAN_SCHED:
+        if (f.len != BULK_LEN || p[BULK_LEN - 1U] != BULK_LEN - 1U) r->bad++;
+        break;
+    default:
+        break;
+    }
+}
+
+/* ==== HELPERS ==== */
+/* Streams as the firmware registers them, job ids 0..3 */
+static void mux_reset(uint8_t prio_lvl, uint8_t prio_prox, uint8_t prio_gas, uint8_t prio_bulk, uint32_t bulk_hz)
+{
+    HalShim_Reset();
+    now_ms = 0;
+    carry = 0;
+    left = 0;
+    HalShim_SetTick(now_ms);
+    USBD_Interface_fops_FS.Init();
+    HalShim_SetLineState(CDC_LINE_DTR | CDC_LINE_RTS);
+    AudioPkt_Init(&audio_pkt);
+    memset(&cdc_tx_stats, 0, sizeof(cdc_tx_stats));
+    memset(&tlm, 0, sizeof(tlm));
+    memset(&rx, 0, sizeof(rx));
+    TLM_DecoderInit(&dec);
+    TLM_DeltaDecoderInit(&rx.delta);
+
+    Sched_Init(&sched);
+    Mux_Init(&mux, &tlm, &sched);
+    Mux_AddStream(&mux, "lvl", TLM_CHAN_AUDIO_LVL, LVL_HZ, prio_lvl, 4, fill_lvl, NULL, NULL);
+    Mux_AddStream(&mux, "prox", TLM_CHAN_PROX, PROX_HZ, prio_prox, 4, fill_prox, NULL, &prox_delta);
+    Mux_AddStream(&mux, "gas", TLM_CHAN_GAS, GAS_HZ, prio_gas, 5, fill_gas, NULL, NULL);
+    Mux_AddStream(&mux, "bulk", TLM_CHAN_SCHED, bulk_hz, prio_bulk, BULK_LEN, fill_bulk, NULL, NULL);
+    Sched_Start(&sched);
+}
+
+/* One 1 ms frame: main loop pass, then the host reads up to pkt_tenths / 10
+ * packets of the transfer in flight */
+static void run_ms(uint32_t ms, uint32_t pkt_tenths)
+{
+    for (; ms > 0; ms--) {
+        HalShim_TimAdvance(1000);
+        Sched_RunPending(&sched);
+        Mux_Service(&mux);
+        CDC_TxQueue_Kick();
+
+        carry += pkt_tenths;
+        uint32_t budget = carry / 10U;
+        carry %= 10U;
+        while (hal_shim_cdc.TxState != 0U && budget > 0) {
+            uint32_t len = hal_shim_cdc.TxLength;
+            if (left == 0)
+                left = len / CDC_DATA_FS_MAX_PACKET_SIZE + 1U;    // short packet or ZLP ends it
+            uint32_t n = left < budget ? left : budget;
+            budget -= n;
+            if ((left -= n) != 0) break;
+            uint8_t *p = HalShim_TakeTx(&len);
+            TLM_DecoderFeed(&dec, p, len, rx_frame, &rx);
+            USBD_Interface_fops_FS.TransmitCplt(p, &len, CDC_IN_EP);
+        }
+        HalShim_SetTick(++now_ms);
+        CDC_TxQueue_OnSOF();
+    }
+}
+
+/* Let the queue drain so every frame sent has arrived */
+static void drain(void)
+{
+    Sched_Suspend(&sched);
+    run_ms(100, PKT_TENTHS_FAST);
+    Sched_Resume(&sched);
+}
+
+static uint32_t near(uint32_t got, uint32_t want)
+{
+    return got + 1U >= want && got <= want + 1U;
+}
+
+/* ==== RATES AND SHARED WRITES ==== */
+static void check_rates(void)
+{
+    mux_reset(1, 2, 2, 3, BULK_HZ);
+    run_ms(5000, PKT_TENTHS_FAST);
+    drain();
+
+    uint32_t lvl = rx.frames[TLM_CHAN_AUDIO_LVL], prox = rx.frames[TLM_CHAN_PROX];
+    uint32_t gas = rx.frames[TLM_CHAN_GAS], bulk = rx.frames[TLM_CHAN_SCHED];
+    printf("  rates: lvl %u, prox %u (%u delta), gas %u, bulk %u in 5 s; %u frames in %u writes, up to %u\n",
+           lvl, prox, rx.deltas, gas, bulk, mux.stats.frames, mux.stats.batches, mux.stats.max_frames);
+    CHECK(near(lvl, 5 * LVL_HZ) && near(prox, 5 * PROX_HZ) && near(gas, 5 * GAS_HZ) && near(bulk, 5 * BULK_HZ),
+          "rates: lvl %u, prox %u, gas %u, bulk %u", lvl, prox, gas, bulk);
+    CHECK(rx.bad == 0 && dec.crc_errors == 0, "rates: %u bad records, %u crc errors", rx.bad, dec.crc_errors);
+    CHECK(rx.deltas > 0 && rx.delta.unresolved == 0, "rates: %u delta frames, %u unresolved", rx.deltas,
+          rx.delta.unresolved);
+    CHECK(mux.stats.max_frames == 4U && mux.stats.batches < mux.stats.frames,
+          "rates: co-due streams not sharing writes (%u frames, %u writes, max %u)", mux.stats.frames,
+          mux.stats.batches, mux.stats.max_frames);
+    for (uint8_t c = 0; c < TLM_CHAN_COUNT; c++)
+        CHECK(tlm.dropped[c] == 0, "rates: chan%u dropped %u", c, tlm.dropped[c]);
+
+    /* TLM_CMD_SET_RATE goes by job id: prox is job 1 */
+    uint32_t before = rx.frames[TLM_CHAN_PROX];
+    CHECK(mux.stream[1].job == 1U && Sched_SetRate(&sched, mux.stream[1].job, 50) == HAL_OK,
+          "rates: prox job id %u", mux.stream[1].job);
+    run_ms(2000, PKT_TENTHS_FAST);
+    drain();
+    CHECK(near(rx.frames[TLM_CHAN_PROX] - before, 100), "rates: %u prox frames in 2 s at 50 Hz",
+          rx.frames[TLM_CHAN_PROX] - before);
+
+    /* lvl is job 0, gas job 2; nothing streams on TLM_CHAN_LOSS */
+    uint32_t jobs = Mux_JobMask(&mux, (1UL << TLM_CHAN_AUDIO_LVL) | (1UL << TLM_CHAN_GAS) | (1UL << TLM_CHAN_LOSS));
+    CHECK(jobs == ((1UL << 0) | (1UL << 2)), "rates: job mask 0x%02X for lvl and gas", (unsigned)jobs);
+}
+
+/* ==== PRIORITIES ON A SLOW HOST ==== */
+static void check_priorities(void)
+{
+    const uint32_t bulk_hz = 1000U;
+
+    mux_reset(0, 1, 1, 3, bulk_hz);
+    run_ms(5000, PKT_TENTHS_SLOW);
+    drain();
+    uint32_t lvl = rx.frames[TLM_CHAN_AUDIO_LVL], bulk = rx.frames[TLM_CHAN_SCHED];
+    printf("  priorities: lvl %u, prox %u, gas %u received, bulk %u of %u (%u dropped)\n", lvl,
+           rx.frames[TLM_CHAN_PROX], rx.frames[TLM_CHAN_GAS], bulk, 5 * bulk_hz, tlm.dropped[TLM_CHAN_SCHED]);
+    CHECK(tlm.dropped[TLM_CHAN_AUDIO_LVL] == 0 && tlm.dropped[TLM_CHAN_PROX] == 0 && tlm.dropped[TLM_CHAN_GAS] == 0,
+          "priorities: high priority drops lvl %u, prox %u, gas %u", tlm.dropped[TLM_CHAN_AUDIO_LVL],
+          tlm.dropped[TLM_CHAN_PROX], tlm.dropped[TLM_CHAN_GAS]);
+    CHECK(near(lvl, 5 * LVL_HZ) && near(rx.frames[TLM_CHAN_PROX], 5 * PROX_HZ) &&
+          near(rx.frames[TLM_CHAN_GAS], 5 * GAS_HZ), "priorities: lvl %u, prox %u, gas %u", lvl,
+          rx.frames[TLM_CHAN_PROX], rx.frames[TLM_CHAN_GAS]);
+    CHECK(tlm.dropped[TLM_CHAN_SCHED] > bulk_hz && rx.bad == 0, "priorities: bulk dropped only %u, %u bad records",
+          tlm.dropped[TLM_CHAN_SCHED], rx.bad);
+
+    /* the same load with one priority for all: the level stream suffers too */
+    mux_reset(0, 0, 0, 0, bulk_hz);
+    run_ms(5000, PKT_TENTHS_SLOW);
+    drain();
+    printf("  equal priorities: lvl %u dropped, bulk %u dropped\n", tlm.dropped[TLM_CHAN_AUDIO_LVL],
+           tlm.dropped[TLM_CHAN_SCHED]);
+    CHECK(tlm.dropped[TLM_CHAN_AUDIO_LVL] > 0, "equal priorities: the level stream lost nothing");
+}
+
+/* ==== HOST GONE ==== */
+static void check_host_gone(void)
+{
+    mux_reset(1, 2, 2, 3, BULK_HZ);
+    run_ms(1000, PKT_TENTHS_FAST);
+    HalShim_SetLineState(0);
+    run_ms(500, PKT_TENTHS_FAST);
+    HalShim_SetLineState(CDC_LINE_DTR | CDC_LINE_RTS);
+    run_ms(1500, PKT_TENTHS_FAST);
+    drain();
+
+    uint32_t dropped = 0;
+    for (uint8_t i = 0; i < mux.n_streams; i++)
+        dropped += mux.stream[i].stats.dropped;
+    printf("  host gone: %u frames dropped, prox %u received, %u unresolved\n", dropped, rx.frames[TLM_CHAN_PROX],
+           rx.delta.unresolved);
+    CHECK(tlm.dropped[TLM_CHAN_AUDIO_LVL] >= 499U && tlm.dropped[TLM_CHAN_PROX] >= 4U && dropped == tlm.dropped[TLM_CHAN_AUDIO_LVL] +
+          tlm.dropped[TLM_CHAN_PROX] + tlm.dropped[TLM_CHAN_GAS] + tlm.dropped[TLM_CHAN_SCHED],
+          "host gone: lvl %u, prox %u dropped, streams %u", tlm.dropped[TLM_CHAN_AUDIO_LVL],
+          tlm.dropped[TLM_CHAN_PROX], dropped);
+    CHECK(rx.delta.unresolved == 0 && rx.bad == 0 && dec.chan[TLM_CHAN_PROX].lost == tlm.dropped[TLM_CHAN_PROX],
+          "host gone: %u unresolved, %u bad, prox %u lost for %u dropped", rx.delta.unresolved, rx.bad,
+          dec.chan[TLM_CHAN_PROX].lost, tlm.dropped[TLM_CHAN_PROX]);
+}
+
+int main(void)
+{
+    check_rates();
+    check_priorities();
+    check_host_gone();
+
+    return check_result();
+}
@@ -0,0 +1,232 @@
+/**
+ * @file hal_shim.c
+ * @brief Host shim: HAL/USB stubs backing the firmware audio path on x86
+ *
+ * The USB IN endpoint is modelled as a single transfer register: TransmitPacket
+ * latches the buffer and sets TxState, HalShim_TakeTx() hands it to the test
+ * and clears TxState, exactly as the DataIn stage does on the target.
+ * The OUT endpoint is armed by the class init and by ReceivePacket;
+ * HalShim_RxPacket() delivers one packet only while it is armed (else NAK).
+ * The log console function of the composite has its own IN endpoint model
+ * (hal_shim_log, HalShim_TakeLogTx()). A USART1 DMA transmit is latched the
+ * same way until HalShim_TakeUartTx(); the test then raises the completion.
+ */
+
+#include "hal_shim.h"
+#include "stm32f4xx_it.h"
+#include "usbd_cdc_if.h"
+#include "usbd_cdc_log_if.h"
+
+DWT_Type hal_shim_dwt;
+CoreDebug_Type hal_shim_coredebug;
+uint32_t hal_shim_primask;
+uint32_t hal_shim_ipsr;
+TIM_TypeDef hal_shim_tim2;
+RCC_TypeDef hal_shim_rcc;
+
+I2S_HandleTypeDef hi2s1;
+DMA_HandleTypeDef hdma_spi1_rx;
+UART_HandleTypeDef huart1;
+DMA_HandleTypeDef hdma_usart1_tx;
+PCD_HandleTypeDef hpcd_USB_OTG_FS;
+USBD_HandleTypeDef hUsbDeviceFS;
+USBD_CDC_HandleTypeDef hal_shim_cdc;
+USBD_CDC_HandleTypeDef hal_shim_log;
+
+static uint32_t shim_tick;
+static uint8_t shim_rx_armed;
+
+/* ==== SHIM CONTROL ==== */
+void HalShim_Reset(void)
+{
+    memset(&hi2s1, 0, sizeof(hi2s1));
+    memset(&hdma_spi1_rx, 0, sizeof(hdma_spi1_rx));
+    memset(&huart1, 0, sizeof(huart1));
+    memset(&hdma_usart1_tx, 0, sizeof(hdma_usart1_tx));
+    memset(&hUsbDeviceFS, 0, sizeof(hUsbDeviceFS));
+    memset(&hal_shim_cdc, 0, sizeof(hal_shim_cdc));
+    memset(&hal_shim_log, 0, sizeof(hal_shim_log));
+    memset(&hal_shim_tim2, 0, sizeof(hal_shim_tim2));
+    hal_shim_rcc.CFGR = RCC_CFGR_PPRE1_DIV2;    // as SystemClock_Config: APB1 = 36 MHz
+
+    hi2s1.Init.AudioFreq = I2S_AUDIOFREQ_16K;
+    hi2s1.hdmarx = &hdma_spi1_rx;
+    huart1.hdmatx = &hdma_usart1_tx;
+    hUsbDeviceFS.dev_state = USBD_STATE_CONFIGURED;
+    hUsbDeviceFS.pClassData = &hal_shim_cdc;
+    hal_shim_ipsr = 0;
+    shim_tick = 0;
+    shim_rx_armed = 1;
+}
+
+void HalShim_SetTick(uint32_t tick)
+{
+    shim_tick = tick;
+}
+
+uint8_t *HalShim_TakeTx(uint32_t *len)
+{
+    if (hal_shim_cdc.TxState == 0U) return NULL;
+    *len = hal_shim_cdc.TxLength;
+    hal_shim_cdc.TxState = 0U;
+    return hal_shim_cdc.TxBuffer;
+}
+
+/* Host OUT packet: returns 0 (NAK) unless the endpoint is armed */
+int HalShim_RxPacket(const uint8_t *data, uint32_t len)
+{
+    if (!shim_rx_armed || hal_shim_cdc.RxBuffer == NULL || len > CDC_DATA_FS_MAX_PACKET_SIZE) return 0;
+    shim_rx_armed = 0;
+    memcpy(hal_shim_cdc.RxBuffer, data, len);
+    hal_shim_cdc.RxLength = len;
+    USBD_Interface_fops_FS.Receive(hal_shim_cdc.RxBuffer, &hal_shim_cdc.RxLength);
+    return 1;
+}
+
+/* Host SET_CONTROL_LINE_STATE request (no data stage) */
+void HalShim_SetLineState(uint16_t bits)
+{
+    USBD_SetupReqTypedef req = { 0 };
+    req.bmRequest = 0x21;
+    req.bRequest = CDC_SET_CONTROL_LINE_STATE;
+    req.wValue = bits;
+    USBD_Interface_fops_FS.Control(req.bRequest, (uint8_t *)&req, 0);
+}
+
+uint8_t *HalShim_TakeLogTx(uint32_t *len)
+{
+    if (hal_shim_log.TxState == 0U) return NULL;
+    *len = hal_shim_log.TxLength;
+    hal_shim_log.TxState = 0U;
+    return hal_shim_log.TxBuffer;
+}
+
+void HalShim_SetLogLineState(uint16_t bits)
+{
+    USBD_SetupReqTypedef req = { 0 };
+    req.bmRequest = 0x21;
+    req.bRequest = CDC_SET_CONTROL_LINE_STATE;
+    req.wValue = bits;
+    req.wIndex = CDC_DUAL_LOG_ITF;
+    USBD_LogInterface_fops_FS.Control(req.bRequest, (uint8_t *)&req, 0);
+}
+
+const uint8_t *HalShim_TakeUartTx(uint32_t *len)
+{
+    if (huart1.gState == 0U) return NULL;
+    *len = huart1.TxXferSize;
+    huart1.gState = 0U;
+    return huart1.pTxBuffPtr;
+}
+
+/* Count TIM2 up by us ticks, raising CC1 and calling the IRQ handler on match */
+void HalShim_TimAdvance(uint32_t us)
+{
+    while (us-- > 0U && (hal_shim_tim2.CR1 & TIM_CR1_CEN)) {
+        if (++hal_shim_tim2.CNT != hal_shim_tim2.CCR1) continue;
+        hal_shim_tim2.SR |= TIM_SR_CC1IF;
+        if (hal_shim_tim2.DIER & TIM_DIER_CC1IE)
+            TIM2_IRQHandler();
+    }
+}
+
+/* ==== HAL ==== */
+uint32_t HAL_GetTick(void) { return shim_tick; }
+void HAL_IncTick(void) { shim_tick++; }
+void HAL_Delay(uint32_t Delay) { shim_tick += Delay; }
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma) { UNUSED(hdma); }
+void HAL_PCD_IRQHandler(PCD_HandleTypeDef *hpcd) { UNUSED(hpcd); }
+uint32_t HAL_RCC_GetPCLK1Freq(void) { return 36000000U; }
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+    UNUSED(IRQn); UNUSED(PreemptPriority); UNUSED(SubPriority);
+}
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) { UNUSED(IRQn); }
+
+HAL_StatusTypeDef HAL_I2S_Receive_DMA(I2S_HandleTypeDef *hi2s, uint16_t *pData, uint16_t Size)
+{
+    hi2s->pRxBuffPtr = pData;
+    hi2s->RxXferSize = (uint16_t)(Size << 1U);   // 24-bit data: two transfers per sample
+    hi2s->hdmarx->ndtr = hi2s->RxXferSize;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+    if (huart->gState != 0U) return HAL_BUSY;
+    if (pData == NULL || Size == 0U) return HAL_ERROR;
+    huart->pTxBuffPtr = pData;
+    huart->TxXferSize = Size;
+    huart->gState = 1U;
+    return HAL_OK;
+}
+
+void HAL_UART_IRQHandler(UART_HandleTypeDef *huart) { UNUSED(huart); }
+
+/* ==== USB CDC ==== */
+uint8_t USBD_CDC_SetTxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff, uint32_t length)
+{
+    USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
+    hcdc->TxBuffer = pbuff;
+    hcdc->TxLength = length;
+    return (uint8_t)USBD_OK;
+}
+
+uint8_t USBD_CDC_TransmitPacket(USBD_HandleTypeDef *pdev)
+{
+    USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
+    if (hcdc->TxState != 0U) return (uint8_t)USBD_BUSY;
+    hcdc->TxState = 1U;
+    return (uint8_t)USBD_OK;
+}
+
+uint8_t USBD_CDC_SetRxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff)
+{
+    USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
+    hcdc->RxBuffer = pbuff;
+    return (uint8_t)USBD_OK;
+}
+
+uint8_t USBD_CDC_ReceivePacket(USBD_HandleTypeDef *pdev)
+{
+    UNUSED(pdev);
+    shim_rx_armed = 1;
+    return (uint8_t)USBD_OK;
+}
+
+/* ==== USB CDC LOG FUNCTION ==== */
+uint8_t USBD_CDC_LOG_SetTxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff, uint32_t length)
+{
+    UNUSED(pdev);
+    hal_shim_log.TxBuffer = pbuff;
+    hal_shim_log.TxLength = length;
+    return (uint8_t)USBD_OK;
+}
+
+uint8_t USBD_CDC_LOG_TransmitPacket(USBD_HandleTypeDef *pdev)
+{
+    UNUSED(pdev);
+    if (hal_shim_log.TxState != 0U) return (uint8_t)USBD_BUSY;
+    hal_shim_log.TxState = 1U;
+    return (uint8_t)USBD_OK;
+}
+
+uint8_t USBD_CDC_LOG_SetRxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff)
+{
+    UNUSED(pdev);
+    hal_shim_log.RxBuffer = pbuff;
+    return (uint8_t)USBD_OK;
+}
+
+uint8_t USBD_CDC_LOG_ReceivePacket(USBD_HandleTypeDef *pdev)
+{
+    UNUSED(pdev);
+    return (uint8_t)USBD_OK;
+}
+
+/* ==== methods.c ==== */
+void DWT_CycleCounter_Init(void)
+{
+    hal_shim_coredebug.DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    hal_shim_dwt.CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file hal_shim.h
+ * @brief Host shim: hooks for driving firmware code without a board
+ */
+
+#ifndef __HOST_SHIM_HAL_SHIM_H__
+#define __HOST_SHIM_HAL_SHIM_H__
+
+#include "stm32f4xx_hal.h"
+#include "usbd_cdc.h"
+#include "usbd_cdc_dual.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern I2S_HandleTypeDef hi2s1;
+extern DMA_HandleTypeDef hdma_spi1_rx;
+extern UART_HandleTypeDef huart1;
+extern DMA_HandleTypeDef hdma_usart1_tx;
+extern PCD_HandleTypeDef hpcd_USB_OTG_FS;
+extern USBD_HandleTypeDef hUsbDeviceFS;
+extern USBD_CDC_HandleTypeDef hal_shim_cdc;
+extern USBD_CDC_HandleTypeDef hal_shim_log;
+
+void HalShim_Reset(void);
+void HalShim_SetTick(uint32_t tick);
+uint8_t *HalShim_TakeTx(uint32_t *len);
+void HalShim_TimAdvance(uint32_t us);
+int HalShim_RxPacket(const uint8_t *data, uint32_t len);
+void HalShim_SetLineState(uint16_t bits);
+uint8_t *HalShim_TakeLogTx(uint32_t *len);
+void HalShim_SetLogLineState(uint16_t bits);
+const uint8_t *HalShim_TakeUartTx(uint32_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HOST_SHIM_HAL_SHIM_H__ */
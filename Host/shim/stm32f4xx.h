@@ -0,0 +1,11 @@
+/**
+ * @file stm32f4xx.h
+ * @brief Host shim: device header replacement for x86 builds of Core/ sources
+ */
+
+#ifndef __HOST_SHIM_STM32F4XX_H__
+#define __HOST_SHIM_STM32F4XX_H__
+
+#include "stm32f4xx_hal.h"
+
+#endif /* __HOST_SHIM_STM32F4XX_H__ */
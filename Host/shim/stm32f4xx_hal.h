@@ -0,0 +1,158 @@
+/**
+ * @file stm32f4xx_hal.h
+ * @brief Host shim: the subset of the STM32F4 HAL used by the audio path
+ *
+ * Only types and calls reachable from microphone_sensor.c, the I2S and UART
+ * callbacks in stm32f4xx_it.c, usbd_cdc_if.c, uart_tx.c, the scheduler and the
+ * audio modules are provided. Peripheral state is
+ * plain memory the harness can poke (e.g. the DMA NDTR counter), and the DWT
+ * cycle counter reads the x86 time stamp counter.
+ */
+
+#ifndef __HOST_SHIM_STM32F4XX_HAL_H__
+#define __HOST_SHIM_STM32F4XX_HAL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __IO volatile
+#define __PACKED __attribute__((packed))
+#define __STATIC_INLINE static inline
+#define UNUSED(X) (void)(X)
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+#define ENABLE  1U
+#define DISABLE 0U
+
+typedef enum {
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+/* ==== DWT / CoreDebug ==== */
+typedef struct {
+    uint32_t CTRL;
+    uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk          (1UL)
+#define CoreDebug_DEMCR_TRCENA_Msk      (1UL << 24)
+
+extern DWT_Type hal_shim_dwt;
+extern CoreDebug_Type hal_shim_coredebug;
+
+static inline DWT_Type *hal_shim_dwt_read(void)
+{
+    hal_shim_dwt.CYCCNT = (uint32_t)__rdtsc();
+    return &hal_shim_dwt;
+}
+
+#define DWT         (hal_shim_dwt_read())
+#define CoreDebug   (&hal_shim_coredebug)
+
+/* ==== Core intrinsics: the harness is single threaded ==== */
+extern uint32_t hal_shim_primask;
+extern uint32_t hal_shim_ipsr;      // nonzero while the test plays an interrupt
+static inline uint32_t __get_PRIMASK(void) { return hal_shim_primask; }
+static inline uint32_t __get_IPSR(void) { return hal_shim_ipsr; }
+static inline void __set_PRIMASK(uint32_t m) { hal_shim_primask = m; }
+static inline void __disable_irq(void) { hal_shim_primask = 1U; }
+static inline void __enable_irq(void) { hal_shim_primask = 0U; }
+static inline void __WFI(void) { }
+
+/* ==== TIM2 / RCC registers (plain memory, advanced by the harness) ==== */
+typedef struct {
+    uint32_t CR1, DIER, SR, EGR, CCMR1, CCER, CNT, PSC, ARR, CCR1;
+} TIM_TypeDef;
+
+typedef struct {
+    uint32_t CFGR;
+} RCC_TypeDef;
+
+extern TIM_TypeDef hal_shim_tim2;
+extern RCC_TypeDef hal_shim_rcc;
+
+#define TIM2                (&hal_shim_tim2)
+#define RCC                 (&hal_shim_rcc)
+#define TIM2_IRQn           28
+#define TIM_CR1_CEN         (1UL << 0)
+#define TIM_DIER_CC1IE      (1UL << 1)
+#define TIM_SR_CC1IF        (1UL << 1)
+#define TIM_EGR_UG          (1UL << 0)
+#define RCC_CFGR_PPRE1      (7UL << 10)
+#define RCC_CFGR_PPRE1_DIV1 (0UL << 10)
+#define RCC_CFGR_PPRE1_DIV2 (4UL << 10)
+#define __HAL_RCC_TIM2_CLK_ENABLE() do { } while (0)
+
+typedef int IRQn_Type;
+
+/* ==== Peripheral handles ==== */
+typedef struct { uint32_t dummy; } GPIO_TypeDef;
+typedef struct { uint32_t dummy; } I2C_HandleTypeDef;
+typedef struct { void *pData; } PCD_HandleTypeDef;
+
+typedef struct {
+    uint32_t ndtr;          // remaining items, set by the harness
+} DMA_HandleTypeDef;
+
+typedef struct {
+    void *Instance;
+    const uint8_t *pTxBuffPtr;
+    uint16_t TxXferSize;
+    uint32_t gState;        // non-zero while a DMA transmit is latched
+    DMA_HandleTypeDef *hdmatx;
+} UART_HandleTypeDef;
+
+typedef struct {
+    uint32_t Mode;
+    uint32_t Standard;
+    uint32_t DataFormat;
+    uint32_t MCLKOutput;
+    uint32_t AudioFreq;
+} I2S_InitTypeDef;
+
+typedef struct {
+    void *Instance;
+    I2S_InitTypeDef Init;
+    uint16_t *pRxBuffPtr;
+    uint16_t RxXferSize;
+    DMA_HandleTypeDef *hdmarx;
+} I2S_HandleTypeDef;
+
+#define I2S_AUDIOFREQ_16K   16000U
+#define I2C_MEMADD_SIZE_8BIT 0x00000001U
+
+#define __HAL_DMA_GET_COUNTER(__HANDLE__) ((__HANDLE__)->ndtr)
+
+/* ==== Functions (hal_shim.c) ==== */
+uint32_t HAL_GetTick(void);
+void HAL_IncTick(void);
+void HAL_Delay(uint32_t Delay);
+HAL_StatusTypeDef HAL_I2S_Receive_DMA(I2S_HandleTypeDef *hi2s, uint16_t *pData, uint16_t Size);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma);
+void HAL_PCD_IRQHandler(PCD_HandleTypeDef *hpcd);
+void HAL_I2S_RxHalfCpltCallback(I2S_HandleTypeDef *hi2s);
+void HAL_I2S_RxCpltCallback(I2S_HandleTypeDef *hi2s);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size);
+void HAL_UART_IRQHandler(UART_HandleTypeDef *huart);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HOST_SHIM_STM32F4XX_HAL_H__ */
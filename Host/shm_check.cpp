@@ -0,0 +1,467 @@
+/**
+ * @file shm_check.cpp
+ * @brief Check of the capture daemon and the shared-memory frame ring
+ *
+ *   - daemon: tlmd is started on a pty that stands in for the device; the
+ *     stream written into the pty (with garbage and a corrupted frame) must
+ *     reach every one of several reader processes complete and in order, the
+ *     ring header must carry the decoder counters and the reader slots, a
+ *     lost device must show as DISCONNECTED, and SIGTERM must remove the ring;
+ *   - overrun: a reader lapped by the writer discards its copy, counts the
+ *     overrun and resumes at the oldest intact frame;
+ *   - concurrent: a reader racing a writer on a tiny ring never returns a
+ *     torn or reordered frame;
+ *   - fan-out: throughput and wake-up latency with 1..N reader threads, each
+ *     with its own mapping (-b for the full table).
+ *
+ * Usage: shm_check [-b] TLMD
+ *   shm_check build/tlmd
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "check.h"
+#include "tlm_stream.hpp"
+#include "tlm_shm.hpp"
+
+/* ==== HELPERS ==== */
+static const uint32_t END_COUNTER = 0xFFFFFFFFU;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, nullptr);
+}
+
+/* BENCH frame: u32 counter, u64 timestamp, pattern */
+static uint16_t make_frame(uint8_t *buf, TLM_EncoderTypeDef *enc, uint32_t counter, uint16_t payload)
+{
+    TLM_WriterTypeDef w;
+    uint64_t t = now_ns();
+    TLM_Begin(enc, &w, buf, TLM_CHAN_BENCH, (uint32_t)(t / 1000000U));
+    TLM_PutU32(&w, counter);
+    std::memcpy(w.p, &t, 8);
+    w.p += 8;
+    for (uint16_t i = 12; i < payload; i++)
+        TLM_PutU8(&w, TLM_BENCH_PATTERN(i));
+    return TLM_End(&w);
+}
+
+/* What a reader saw */
+struct ReaderResult {
+    uint64_t frames;
+    uint64_t counter_sum;
+    uint64_t bad_order;         // counter not above the previous one
+    uint64_t bad_frames;        // CRC, header or pattern errors in the copy
+    uint64_t overruns;
+    uint64_t lost_bytes;
+    uint32_t first, last;
+    int      ended;             // END_COUNTER seen
+};
+
+/* Read until the end marker, the writer stops or timeout */
+static ReaderResult consume(tlm::ShmReader &rd, int timeout_ms, std::vector<uint64_t> *lat = nullptr)
+{
+    static thread_local std::vector<uint8_t> buf(64U << 10);
+    ReaderResult r = {};
+    uint64_t deadline = now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+    int have_last = 0;
+
+    while (!r.ended && now_ns() < deadline) {
+        size_t n = rd.read(buf.data(), buf.size());
+        if (n == 0) {
+            if (rd.writer_stopped() && rd.lag() == 0) break;
+            rd.wait(50);
+            continue;
+        }
+        tlm::FrameRange frames(buf.data(), n);
+        uint64_t t = lat ? now_ns() : 0;
+        for (const tlm::Frame &f : frames) {
+            auto b = tlm::as<tlm::Bench>(f);
+            if (!b || f.len < 12) {
+                r.bad_frames++;
+                continue;
+            }
+            if (b->counter == END_COUNTER) {
+                r.ended = 1;
+                break;
+            }
+            for (uint16_t i = 12; i < f.len; i++)
+                if (f.payload[i] != TLM_BENCH_PATTERN(i)) {
+                    r.bad_frames++;
+                    break;
+                }
+            if (have_last && b->counter <= r.last) r.bad_order++;
+            if (!have_last) r.first = b->counter;
+            have_last = 1;
+            r.last = b->counter;
+            r.frames++;
+            r.counter_sum += b->counter;
+            if (lat && (b->counter & 63U) == 0) {
+                uint64_t sent;
+                std::memcpy(&sent, f.payload + 4, 8);
+                lat->push_back(t - sent);
+            }
+        }
+        const tlm::ScanStats &st = frames.stats();
+        r.bad_frames += st.crc_errors + st.bad_headers + (st.skipped_bytes ? 1U : 0U);
+    }
+    r.overruns = rd.slot().overruns.load();
+    r.lost_bytes = rd.slot().lost_bytes.load();
+    return r;
+}
+
+static int open_pty(char *name, size_t size, int *slave)
+{
+    struct termios tio;
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 || ptsname_r(master, name, size) != 0) {
+        perror("pty");
+        return -1;
+    }
+    /* Held open so the daemon's opens never see a hung-up pty, and raw so
+     * the line discipline does not rewrite binary frames */
+    *slave = open(name, O_RDWR | O_NOCTTY);
+    if (*slave < 0 || tcgetattr(*slave, &tio) != 0) {
+        perror(name);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(*slave, TCSANOW, &tio);
+    return master;
+}
+
+/* ==== DAEMON: pty device -> tlmd -> reader processes ==== */
+static void check_daemon(const char *tlmd)
+{
+    const int readers = 4;
+    const uint32_t frames = 20000;
+    std::string name = "tlm_check_" + std::to_string(getpid());
+    char pty[64];
+    int slave;
+
+    int master = open_pty(pty, sizeof(pty), &slave);
+    if (master < 0) {
+        failures++;
+        return;
+    }
+    pid_t daemon = fork();
+    if (daemon == 0) {
+        close(master);
+        close(slave);
+        execl(tlmd, tlmd, "-q", "-n", name.c_str(), "-s", "2048", pty, (char *)nullptr);
+        perror(tlmd);
+        _exit(127);
+    }
+
+    /* wait for the ring, then for the daemon to have the port open */
+    tlm::ShmReader probe;
+    for (int i = 0; i < 200 && !probe.open(name); i++)
+        sleep_ms(10);
+    CHECK(probe.header() != nullptr, "daemon: ring /dev/shm/%s never appeared", name.c_str());
+    if (!probe.header()) {
+        kill(daemon, SIGKILL);
+        waitpid(daemon, nullptr, 0);
+        return;
+    }
+    for (int i = 0; i < 200 && probe.header()->state.load() != tlm::SHM_STATE_CONNECTED; i++)
+        sleep_ms(10);
+
+    /* readers in their own processes, attached before the stream starts */
+    int ready[2], result[2];
+    if (pipe(ready) != 0 || pipe(result) != 0) {
+        perror("pipe");
+        failures++;
+        return;
+    }
+    std::vector<pid_t> kids;
+    for (int k = 0; k < readers; k++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            tlm::ShmReader rd;
+            ReaderResult r = {};
+            char c = rd.open(name) ? 1 : 0;
+            if (write(ready[1], &c, 1) != 1) _exit(1);
+            if (c) r = consume(rd, 20000);
+            if (write(result[1], &r, sizeof(r)) != (ssize_t)sizeof(r)) _exit(1);
+            _exit(0);
+        }
+        kids.push_back(pid);
+    }
+    int attached = 0;
+    for (int k = 0; k < readers; k++) {
+        char c = 0;
+        if (read(ready[0], &c, 1) == 1) attached += c;
+    }
+    CHECK(attached == readers, "daemon: %d of %d readers attached", attached, readers);
+
+    /* the device: frames in random-sized writes, some garbage, one bad CRC */
+    TLM_EncoderTypeDef enc = {};
+    std::vector<uint8_t> stream;
+    uint8_t buf[TLM_MAX_FRAME];
+    uint64_t sum = 0, sent = 0;
+    for (uint32_t i = 0; i <= frames; i++) {
+        uint32_t counter = i == frames ? END_COUNTER : i;
+        uint16_t len = make_frame(buf, &enc, counter, (uint16_t)(12U + lcg_next() % 64U));
+        if (i == frames / 2) {
+            buf[len - 1] ^= 0x01;           // corrupted on the link
+        } else if (i != frames) {
+            sum += counter;
+            sent++;
+        }
+        stream.insert(stream.end(), buf, buf + len);
+        if (i % 1000U == 999U)
+            for (uint32_t g = lcg_next() % 32U; g > 0; g--)
+                stream.push_back((uint8_t)lcg_next());
+    }
+    for (size_t off = 0; off < stream.size();) {
+        size_t n = std::min<size_t>(1U + lcg_next() % 4096U, stream.size() - off);
+        ssize_t w = write(master, stream.data() + off, n);
+        if (w < 0 && errno != EINTR) break;
+        if (w > 0) off += (size_t)w;
+    }
+
+    for (int k = 0; k < readers; k++) {
+        ReaderResult r = {};
+        if (read(result[0], &r, sizeof(r)) != (ssize_t)sizeof(r)) {
+            CHECK(0, "daemon: reader %d gave no result", k);
+            continue;
+        }
+        CHECK(r.ended && r.frames == sent && r.counter_sum == sum,
+              "daemon: reader %d got %llu of %llu frames (ended %d)", k, (unsigned long long)r.frames,
+              (unsigned long long)sent, r.ended);
+        CHECK(r.bad_order == 0 && r.bad_frames == 0 && r.overruns == 0,
+              "daemon: reader %d: %llu out of order, %llu bad, %llu overruns", k, (unsigned long long)r.bad_order,
+              (unsigned long long)r.bad_frames, (unsigned long long)r.overruns);
+    }
+    for (pid_t pid : kids)
+        waitpid(pid, nullptr, 0);
+
+    tlm::ShmHeader *h = probe.header();
+    CHECK(h->frames.load() == sent + 1U && h->crc_errors.load() >= 1U && h->skipped_bytes.load() > 0 &&
+          h->bytes_in.load() == stream.size(), "daemon: header frames %llu crc %llu skipped %llu bytes %llu/%zu",
+          (unsigned long long)h->frames.load(), (unsigned long long)h->crc_errors.load(),
+          (unsigned long long)h->skipped_bytes.load(), (unsigned long long)h->bytes_in.load(), stream.size());
+    /* the children exited without detaching; the daemon frees their slots */
+    int slots = 0;
+    for (int i = 0; i < 300; i++) {
+        slots = 0;
+        for (const tlm::ShmReaderSlot &s : h->reader)
+            slots += s.pid.load() != 0;
+        if (slots == 1) break;
+        sleep_ms(10);
+    }
+    CHECK(slots == 1, "daemon: %d reader slots still taken after the readers exited", slots);
+    printf("  daemon: %llu frames from %zu pty bytes to %d reader processes, %llu crc errors, %llu bytes skipped\n",
+           (unsigned long long)h->frames.load(), stream.size(), readers, (unsigned long long)h->crc_errors.load(),
+           (unsigned long long)h->skipped_bytes.load());
+
+    /* the device goes away */
+    close(master);
+    close(slave);
+    for (int i = 0; i < 200 && h->state.load() != tlm::SHM_STATE_DISCONNECTED; i++)
+        sleep_ms(10);
+    CHECK(h->state.load() == tlm::SHM_STATE_DISCONNECTED, "daemon: state %u after the device closed",
+          h->state.load());
+
+    kill(daemon, SIGTERM);
+    int status = -1;
+    waitpid(daemon, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "daemon: exit status %d", status);
+    CHECK(h->state.load() == tlm::SHM_STATE_STOPPED, "daemon: readers not told the writer stopped");
+    probe.close();
+    int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+    CHECK(fd < 0 && errno == ENOENT, "daemon: ring left behind after SIGTERM");
+    if (fd >= 0) close(fd);
+    close(ready[0]); close(ready[1]); close(result[0]); close(result[1]);
+}
+
+/* ==== OVERRUN: the writer laps a stalled reader ==== */
+static void check_overrun(void)
+{
+    std::string name = "tlm_check_ovr_" + std::to_string(getpid());
+    tlm::ShmWriter w;
+    tlm::ShmReader rd, late;
+    TLM_EncoderTypeDef enc = {};
+    uint8_t buf[TLM_MAX_FRAME];
+    const uint32_t frames = 4000;
+
+    CHECK(w.create(name, 64U << 10) && rd.open(name), "overrun: ring setup failed");
+    if (!w.header() || !rd.header()) return;
+    for (uint32_t i = 0; i < frames; i++) {
+        uint16_t len = make_frame(buf, &enc, i, (uint16_t)(12U + lcg_next() % 160U));
+        w.publish(buf, len);
+        if (i % 16U == 15U) w.wake();
+    }
+    make_frame(buf, &enc, END_COUNTER, 12);
+    w.publish(buf, TLM_OVERHEAD + 12U);
+    w.wake();
+
+    CHECK(late.open(name, true), "overrun: late reader failed to attach");
+    ReaderResult r = consume(rd, 1000);
+    ReaderResult o = consume(late, 1000);
+    CHECK(r.ended && r.overruns == 1 && r.lost_bytes > 0 && r.bad_order == 0 && r.bad_frames == 0,
+          "overrun: ended %d, %llu overruns, %llu lost bytes, %llu out of order, %llu bad", r.ended,
+          (unsigned long long)r.overruns, (unsigned long long)r.lost_bytes, (unsigned long long)r.bad_order,
+          (unsigned long long)r.bad_frames);
+    CHECK(r.last - r.first + 1U == r.frames && r.last == frames - 1U,
+          "overrun: resumed frames %u..%u not contiguous (%llu)", r.first, r.last, (unsigned long long)r.frames);
+    CHECK(o.ended && o.overruns == 0 && o.first == r.first && o.frames == r.frames,
+          "overrun: oldest-first reader started at %u (%llu frames), lapped reader resumed at %u", o.first,
+          (unsigned long long)o.frames, r.first);
+    printf("  overrun: 64 KiB ring, reader lapped once, %llu bytes skipped, resumed at frame %u of %u\n",
+           (unsigned long long)r.lost_bytes, r.first, frames);
+}
+
+/* ==== CONCURRENT: torn reads are never returned ==== */
+static void check_concurrent(void)
+{
+    std::string name = "tlm_check_race_" + std::to_string(getpid());
+    tlm::ShmWriter w;
+    tlm::ShmReader rd;
+    const uint32_t frames = 200000;
+
+    CHECK(w.create(name, 4096) && rd.open(name), "concurrent: ring setup failed");
+    if (!w.header() || !rd.header()) return;
+
+    std::thread writer([&] {
+        TLM_EncoderTypeDef enc = {};
+        uint8_t buf[TLM_MAX_FRAME];
+        uint32_t seed = 3;
+        for (uint32_t i = 0; i <= frames; i++) {
+            seed = seed * 1664525U + 1013904223U;
+            uint16_t len = make_frame(buf, &enc, i == frames ? END_COUNTER : i, (uint16_t)(12U + (seed >> 24) % 200U));
+            w.publish(buf, len);
+            if ((seed & 7U) == 0 || i == frames) w.wake();
+        }
+    });
+    ReaderResult r = consume(rd, 20000);
+    writer.join();
+
+    CHECK(r.bad_order == 0 && r.bad_frames == 0, "concurrent: %llu out of order, %llu torn or bad frames",
+          (unsigned long long)r.bad_order, (unsigned long long)r.bad_frames);
+    CHECK(r.frames > 0 && r.frames <= frames, "concurrent: %llu frames", (unsigned long long)r.frames);
+    printf("  concurrent: 4 KiB ring, %llu of %u frames read intact, %llu overruns\n",
+           (unsigned long long)r.frames, frames, (unsigned long long)r.overruns);
+}
+
+/* ==== FAN-OUT BENCHMARK ==== */
+static void bench_fanout(int readers, uint32_t frames, uint32_t rate_hz)
+{
+    std::string name = "tlm_check_fan_" + std::to_string(getpid());
+    tlm::ShmWriter w;
+    if (!w.create(name, 4U << 20)) {
+        CHECK(0, "fan-out: ring setup failed");
+        return;
+    }
+
+    std::vector<ReaderResult> res((size_t)readers);
+    std::vector<std::vector<uint64_t>> lat((size_t)readers);
+    std::vector<std::thread> threads;
+    std::atomic<int> attached{0};
+    for (int k = 0; k < readers; k++)
+        threads.emplace_back([&, k] {
+            tlm::ShmReader rd;
+            if (!rd.open(name)) return;
+            attached++;
+            res[(size_t)k] = consume(rd, 30000, &lat[(size_t)k]);
+        });
+    while (attached.load() < readers)
+        sleep_ms(1);
+
+    TLM_EncoderTypeDef enc = {};
+    uint8_t buf[TLM_MAX_FRAME];
+    const uint16_t payload = 64;
+    uint64_t t0 = now_ns(), bytes = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        if (rate_hz) {
+            uint64_t due = t0 + (uint64_t)i * 1000000000ULL / rate_hz;
+            while (now_ns() < due)
+                sleep_ms(0);
+        }
+        uint16_t len = make_frame(buf, &enc, i, payload);
+        w.publish(buf, len);
+        bytes += len;
+        if (rate_hz || (i & 31U) == 31U) w.wake();
+    }
+    double secs = (now_ns() - t0) / 1e9;
+    make_frame(buf, &enc, END_COUNTER, 12);
+    w.publish(buf, TLM_OVERHEAD + 12U);
+    w.wake();
+    for (std::thread &t : threads)
+        t.join();
+
+    uint64_t min_frames = frames, overruns = 0;
+    std::vector<uint64_t> all;
+    for (int k = 0; k < readers; k++) {
+        min_frames = std::min(min_frames, res[(size_t)k].frames);
+        overruns += res[(size_t)k].overruns;
+        CHECK(res[(size_t)k].bad_order == 0 && res[(size_t)k].bad_frames == 0, "fan-out: reader %d saw bad frames", k);
+        all.insert(all.end(), lat[(size_t)k].begin(), lat[(size_t)k].end());
+    }
+    std::sort(all.begin(), all.end());
+    double p50 = all.empty() ? 0 : all[all.size() / 2] / 1e3, p99 = all.empty() ? 0 : all[all.size() * 99 / 100] / 1e3;
+    printf("  %-6s %2d readers: publish %6.1f MB/s %5.2f Mframes/s, slowest reader %5.1f%% of frames, "
+           "%llu overruns, latency p50 %.1f us p99 %.1f us\n", rate_hz ? "paced" : "burst", readers,
+           bytes / secs / 1e6, frames / secs / 1e6, 100.0 * min_frames / frames, (unsigned long long)overruns,
+           p50, p99);
+    if (rate_hz)
+        CHECK(min_frames == frames && overruns == 0, "fan-out: %d paced readers lost frames", readers);
+}
+
+int main(int argc, char **argv)
+{
+    lcg_state = 7;
+    int full = 0, opt;
+    while ((opt = getopt(argc, argv, "b")) != -1) {
+        if (opt == 'b') {
+            full = 1;
+        } else {
+            fprintf(stderr, "usage: %s [-b] TLMD\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind + 1 != argc) {
+        fprintf(stderr, "usage: %s [-b] TLMD\n", argv[0]);
+        return 2;
+    }
+
+    check_daemon(argv[optind]);
+    check_overrun();
+    check_concurrent();
+
+    const int fan[] = { 1, 2, 4, 8, 16 };
+    for (int n : fan) {
+        if (!full && n != 1 && n != 4) continue;
+        bench_fanout(n, full ? 1000000U : 100000U, 0);
+    }
+    for (int n : fan) {
+        if (!full && n != 4) continue;
+        bench_fanout(n, full ? 20000U : 2000U, 20000U);
+    }
+
+    return check_result();
+}
@@ -0,0 +1,387 @@
+/**
+ * @file sync_check.cpp
+ * @brief Check of the device-to-host clock sync (tlm_sync.hpp) and its use in the aggregator
+ *
+ *   - fit: a simulated board clock (tens of ppm off, arbitrary boot time
+ *     and timebase start) sampled through a link with random USB frame
+ *     waits and requests stuck behind telemetry, hours of host time. Tick
+ *     timestamps must map to the middle of their ms on the host clock to
+ *     well under a ms, skew to a ppm, across the 71 minute timebase
+ *     wrap, a device restart (relocks, counted) and a long silence (relocks);
+ *   - boards: simulated boards on ptys answer TLM_CMD_TIME_SYNC from their
+ *     own skewed clocks while streaming bursty BENCH frames into
+ *     tlm::Aggregator for 30 simulated s; once locked, every board's
+ *     frames must line up with host time to well under a ms and its skew
+ *     must be fitted to a couple of ppm. The Aggregator runs on a simulated
+ *     host clock in lockstep with the boards and the link delays come from
+ *     the fit's model, so the result is the same on every run. A board
+ *     with older firmware (answers TLM_CMD_ERR_OP) keeps the arrival-based
+ *     times and is not asked again; no answer reaches the sink.
+ *
+ * The BENCH payload is: u32 counter, u32 board, u64 host time of the middle
+ * of the frame's tick.
+ *
+ * Usage: sync_check [-b]
+ *   -b: hours more of simulated fit
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <poll.h>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+#include "check.h"
+#include "tlm_agg.hpp"
+#include "tlm_sync.hpp"
+
+/* ==== HELPERS ==== */
+static double uniform(void) { return (lcg_next() >> 8) / 16777216.0; }
+static double expo(double mean) { return -mean * std::log(1.0 - uniform()); }
+
+template <class T>
+static T pct(std::vector<T> v, unsigned p)
+{
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, v.size() * p / 100U)];
+}
+
+/* A board clock: device us since boot run ppm fast; the tick counts its ms,
+ * the timebase is the same count plus the value TIM2 started from */
+struct SimClock {
+    double boot_us;             // host time of device time 0
+    double ppm;
+    int64_t timebase;           // timebase - device us
+
+    int64_t dev(double host) const { return (int64_t)std::floor((host - boot_us) * (1.0 + ppm * 1e-6)); }
+    uint32_t tick(double host) const { return (uint32_t)(dev(host) / 1000); }
+    uint32_t micros(double host) const { return (uint32_t)(dev(host) + timebase); }
+    /* host time of the middle of tick t (unwrapped) */
+    double tick_mid(int64_t t) const { return boot_us + ((double)t * 1000.0 + 500.0) / (1.0 + ppm * 1e-6); }
+};
+
+/* ==== FIT ==== */
+struct FitRun {
+    std::vector<double> err_us;         // mapped - true, locked samples only
+    uint64_t samples;
+    uint64_t unlocked;                  // samples taken before (re)lock
+};
+
+/* Requests per next_request() from host time t for the given span; each
+ * sample is followed by a check of ticks from the last two seconds */
+static void run_fit(tlm::ClockSync &sync, const SimClock &c, double &t, double span_s, FitRun &r, uint64_t &n)
+{
+    const double end = t + span_s * 1e6;
+    while (t < end) {
+        /* both ways: wait for the next USB frame, then some host scheduling;
+         * a third of the answers queue behind telemetry */
+        double out = uniform() * 1000.0 + expo(80);
+        double in = uniform() * 1000.0 + expo(80) + (lcg_next() % 3 == 0 ? uniform() * 20000.0 : 0);
+        double at = t + out;
+        sync.add((uint64_t)t, (uint64_t)(at + in), c.tick(at), c.micros(at));
+        r.samples++;
+
+        if (!sync.locked()) {
+            r.unlocked++;
+        } else {
+            double q = at - uniform() * 2e6;
+            int64_t tick = c.dev(q) / 1000;
+            r.err_us.push_back((double)sync.host_us((uint32_t)tick) - c.tick_mid(tick));
+        }
+        t = (double)tlm::ClockSync::next_request((uint64_t)t, n++);
+    }
+}
+
+static void check_fit(double hours)
+{
+    tlm::ClockSync sync;
+    FitRun r = {};
+    uint64_t n = 0;
+    double t = 5e12;                                    // host up for about two months
+    SimClock c = { t - (4294967296.0 - 7.2e6) * 1000.0, 37.5, 12345 };   // the tick wraps 2^32 ms 2 h in
+
+    run_fit(sync, c, t, hours * 3600.0, r, n);
+    double skew_err = sync.stats().skew_ppm - c.ppm;
+    CHECK(std::fabs(skew_err) < 1.0, "fit: skew %.2f ppm, true %.2f", sync.stats().skew_ppm, c.ppm);
+    CHECK(r.unlocked == tlm::SYNC_LOCK_SAMPLES - 1U && sync.stats().restarts == 0, "fit: %llu samples unlocked, %llu restarts",
+          (unsigned long long)r.unlocked, (unsigned long long)sync.stats().restarts);
+
+    /* restart: boots again, a new crystal temperature, the timebase from 0 */
+    c = { t, -21.0, -300000 };
+    n = 0;
+    uint64_t unlocked = r.unlocked;
+    run_fit(sync, c, t, 600, r, n);
+    CHECK(sync.stats().restarts == 1 && r.unlocked - unlocked == tlm::SYNC_LOCK_SAMPLES - 1U,
+          "restart: %llu restarts, %llu samples to relock", (unsigned long long)sync.stats().restarts,
+          (unsigned long long)(r.unlocked - unlocked));
+
+    /* silence for 40 minutes (host gone): timebase ambiguous, start over, no restart counted */
+    t += 2400e6;
+    n = 0;
+    unlocked = r.unlocked;
+    run_fit(sync, c, t, 600, r, n);
+    CHECK(sync.stats().restarts == 1 && r.unlocked - unlocked == tlm::SYNC_LOCK_SAMPLES - 1U,
+          "silence: %llu restarts, %llu samples to relock", (unsigned long long)sync.stats().restarts,
+          (unsigned long long)(r.unlocked - unlocked));
+
+    std::vector<double> abs_err;
+    for (double e : r.err_us)
+        abs_err.push_back(std::fabs(e));
+    double p50 = pct(abs_err, 50), p99 = pct(abs_err, 99), max = pct(abs_err, 100);
+    CHECK(p99 < 200 && max < 1000, "fit: error p50 %.0f us p99 %.0f us max %.0f us", p50, p99, max);
+    printf("  fit: %.1f h + restart + silence, %llu samples: tick error p50 %.0f us p99 %.0f us max %.0f us, "
+           "skew error %+.2f ppm, residual %.0f us\n", hours, (unsigned long long)r.samples, p50, p99, max, skew_err,
+           sync.stats().residual_us);
+}
+
+/* ==== BOARDS ==== */
+static const unsigned BOARDS = 4;
+static const unsigned OLD_BOARD = 3;            // answers TIME_SYNC with TLM_CMD_ERR_OP
+static const unsigned RATE_HZ = 500;
+static const unsigned BURST_MS = 4;
+static const unsigned STEP_US = 50;             // simulated host time per lockstep round
+static const size_t REQ_BYTES = TLM_OVERHEAD + TLM_CMD_REQ_SIZE;
+
+static uint64_t sim_now;                        // the Aggregator's host clock
+
+struct SimBoard {
+    int master;
+    SimClock clk;
+    bool old_firmware;
+    TLM_EncoderTypeDef enc;
+    TLM_DecoderTypeDef dec;
+    uint32_t counter;
+    uint32_t requests;
+    uint64_t req_bytes;                 // request bytes taken from the port
+    uint64_t written;                   // bytes written to the port
+    uint64_t next_event, next_burst;
+    double last_bench, last_rsp;        // delivery times, each kept in order
+    std::multimap<double, std::vector<uint8_t>> out;    // by host delivery time
+};
+
+static void write_all(int fd, const uint8_t *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+/* A request from the host, answered as command.c would once it has crossed
+ * the link; the answer crosses back, a third of them behind telemetry, and
+ * answers stay in request order */
+static void on_request(const TLM_FrameTypeDef *f, void *ctx)
+{
+    SimBoard &b = *(SimBoard *)ctx;
+    if (f->chan != TLM_CHAN_CMD || f->len < TLM_CMD_REQ_SIZE) return;
+    uint8_t buf[TLM_OVERHEAD + TLM_CMD_RSP_SIZE + TLM_TIME_SYNC_SIZE];
+    TLM_WriterTypeDef w;
+    double at = (double)sim_now + 10.0 + expo(30);
+    b.requests++;
+    TLM_Begin(&b.enc, &w, buf, TLM_CHAN_CMD_RSP, b.clk.tick(at));
+    TLM_PutU16(&w, TLM_GetU16(f->payload));
+    TLM_PutU8(&w, f->payload[2]);
+    if (f->payload[2] != TLM_CMD_TIME_SYNC || b.old_firmware) {
+        TLM_PutU8(&w, TLM_CMD_ERR_OP);
+    } else {
+        TLM_PutU8(&w, TLM_CMD_OK);
+        TLM_PutU32(&w, b.clk.tick(at));
+        TLM_PutU32(&w, b.clk.micros(at));
+    }
+    uint16_t n = TLM_End(&w);
+    at += 10.0 + expo(30) + (lcg_next() % 3 == 0 ? uniform() * 4000.0 : 0);
+    b.last_rsp = std::max(b.last_rsp, at);
+    b.out.emplace(b.last_rsp, std::vector<uint8_t>(buf, buf + n));
+}
+
+/* One round of a board at sim_now: take every request the host has written,
+ * queue due BENCH bursts, write what has crossed the link by now.
+ * false if the port stalled */
+static bool board_step(SimBoard &b, unsigned k, uint64_t requests_written)
+{
+    uint8_t in[256], frame[TLM_MAX_FRAME];
+
+    while (b.req_bytes < requests_written * REQ_BYTES) {
+        struct pollfd pfd = { b.master, POLLIN, 0 };
+        ssize_t n = poll(&pfd, 1, 1000) > 0 ? read(b.master, in, sizeof(in)) : -1;
+        if (n <= 0) return false;
+        b.req_bytes += (uint64_t)n;
+        TLM_DecoderFeed(&b.dec, in, (uint16_t)n, on_request, &b);
+    }
+
+    if (sim_now >= b.next_burst) {
+        b.next_burst += BURST_MS * 1000U;
+        double at = std::max(b.last_bench, (double)sim_now + 10.0 + expo(30));
+        for (; b.next_event <= sim_now; b.next_event += 1000000U / RATE_HZ) {
+            TLM_WriterTypeDef w;
+            int64_t tick = b.clk.dev((double)b.next_event) / 1000;
+            uint64_t mid = (uint64_t)std::llround(b.clk.tick_mid(tick));
+            TLM_Begin(&b.enc, &w, frame, TLM_CHAN_BENCH, (uint32_t)tick);
+            TLM_PutU32(&w, b.counter++);
+            TLM_PutU32(&w, k);
+            std::memcpy(w.p, &mid, 8);
+            w.p += 8;
+            uint16_t n = TLM_End(&w);
+            b.out.emplace(at, std::vector<uint8_t>(frame, frame + n));
+        }
+        b.last_bench = at;
+    }
+
+    while (!b.out.empty() && b.out.begin()->first <= (double)sim_now) {
+        const std::vector<uint8_t> &v = b.out.begin()->second;
+        write_all(b.master, v.data(), v.size());
+        b.written += v.size();
+        b.out.erase(b.out.begin());
+    }
+    return true;
+}
+
+/* Boards on ptys in lockstep with a simulated host clock (Aggregator::set_clock):
+ * time moves on only once every byte written either way has been read, so
+ * the link delays are the model's alone and the result does not depend on
+ * host scheduling */
+static void check_boards(double seconds)
+{
+    std::vector<SimBoard> boards(BOARDS);
+    std::vector<std::string> paths(BOARDS);
+    std::vector<int> slaves(BOARDS);
+    const double ppm[BOARDS] = { -48.0, -3.5, 22.0, 41.0 };
+
+    sim_now = 3000000000000ULL;                 // host up for about a month
+    const double t = (double)sim_now;
+    for (unsigned k = 0; k < BOARDS; k++) {
+        char name[64];
+        struct termios tio;
+        SimBoard &b = boards[k];
+        b.master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (b.master < 0 || grantpt(b.master) != 0 || unlockpt(b.master) != 0 ||
+            ptsname_r(b.master, name, sizeof(name)) != 0) {
+            perror("pty");
+            failures++;
+            return;
+        }
+        paths[k] = name;
+        slaves[k] = open(name, O_RDWR | O_NOCTTY);
+        if (slaves[k] >= 0 && tcgetattr(slaves[k], &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(slaves[k], TCSANOW, &tio);
+        }
+        fcntl(b.master, F_SETFL, O_NONBLOCK);
+        /* unrelated boot times; board 1's timebase wraps a second in */
+        b.clk = { t - (double)(lcg_next() % 86400000U) * 1000.0, ppm[k], (int64_t)lcg_next() };
+        if (k == 1) b.clk.timebase = 0x100000000LL - b.clk.dev(t + 1e6);
+        b.old_firmware = k == OLD_BOARD;
+        b.enc = TLM_EncoderTypeDef{};
+        TLM_DecoderInit(&b.dec);
+        b.counter = 0;
+        b.requests = 0;
+        b.req_bytes = 0;
+        b.written = 0;
+        b.next_event = sim_now;
+        b.next_burst = sim_now + k * BURST_MS * 1000U / BOARDS;
+        b.last_bench = 0;
+        b.last_rsp = 0;
+    }
+
+    tlm::Aggregator agg(1);
+    agg.set_clock([] { return sim_now; });
+    for (unsigned k = 0; k < BOARDS; k++) {
+        agg.add(paths[k], "SYNC" + std::to_string(k));
+        close(slaves[k]);
+    }
+    std::vector<std::vector<int64_t>> err(BOARDS);
+    std::vector<uint64_t> frames(BOARDS);
+    uint64_t leaked = 0;
+    bool locked = false, stalled = false;
+    agg.set_sink([&](const tlm::AggFrame &f) {
+        if (f.frame.chan == TLM_CHAN_CMD_RSP) leaked++;
+        if (f.frame.chan != TLM_CHAN_BENCH || f.frame.len < 16 || f.device >= BOARDS) return;
+        uint64_t mid;
+        std::memcpy(&mid, f.frame.payload + 8, 8);
+        frames[f.device]++;
+        if (locked) err[f.device].push_back((int64_t)(f.time_us - mid));
+    });
+
+    const uint64_t end = sim_now + (uint64_t)(seconds * 1e6);
+    for (; sim_now < end && !stalled; sim_now += STEP_US) {
+        agg.poll(0);
+        bool wrote = false;
+        for (unsigned k = 0; k < BOARDS && !stalled; k++) {
+            uint64_t before = boards[k].written;
+            stalled = !board_step(boards[k], k, agg.device(k).sync_writes);
+            wrote |= boards[k].written != before;
+        }
+        if (!wrote) continue;
+
+        /* everything written is read and decoded before time moves on */
+        for (unsigned k = 0; k < BOARDS && !stalled; k++)
+            for (int i = 0; agg.device(k).bytes < boards[k].written; i++) {
+                if (i == 100) stalled = true;
+                if (stalled) break;
+                agg.poll(10);
+            }
+        agg.flush();
+        if (!locked && agg.device(0).sync.locked && agg.device(1).sync.locked && agg.device(2).sync.locked)
+            locked = true;
+    }
+    agg.flush();
+    for (SimBoard &b : boards)
+        close(b.master);
+
+    CHECK(!stalled, "boards: pty stalled at %.3f s", (double)(sim_now + seconds * 1e6 - end) / 1e6);
+    CHECK(locked, "boards: sync did not lock");
+    CHECK(leaked == 0, "boards: %llu time sync answers passed to the sink", (unsigned long long)leaked);
+    CHECK(boards[OLD_BOARD].requests == 1, "boards: old firmware asked %u times", boards[OLD_BOARD].requests);
+
+    std::vector<int64_t> all;
+    for (unsigned k = 0; k < BOARDS; k++) {
+        tlm::AggDeviceStats d = agg.device(k);
+        int64_t lo = pct(err[k], 1), hi = pct(err[k], 99);
+        char skew[16] = "    --";    // no fit on arrival times
+        if (d.sync.locked)
+            snprintf(skew, sizeof skew, "%+6.1f", d.sync.skew_ppm);
+        printf("    %s %5llu frames  %s  error p1 %+5.2f ms p99 %+5.2f ms  skew %s ppm (true %+5.1f)  rtt %.2f ms\n",
+               d.serial.c_str(), (unsigned long long)frames[k], d.sync.locked ? "synced " : "arrival", lo / 1e3,
+               hi / 1e3, skew, ppm[k], d.sync.rtt_min_us / 1e3);
+        if (k == OLD_BOARD) {
+            CHECK(!d.sync.locked && frames[k] > 0, "boards: old firmware board %s, %llu frames",
+                  d.sync.locked ? "synced" : "not synced", (unsigned long long)frames[k]);
+            continue;
+        }
+        CHECK(d.sync.locked && !err[k].empty(), "boards: board %u not synced", k);
+        CHECK(std::fabs(d.sync.skew_ppm - ppm[k]) < 2.0, "boards: board %u skew %+.1f ppm, true %+.1f", k,
+              d.sync.skew_ppm, ppm[k]);
+        all.insert(all.end(), err[k].begin(), err[k].end());
+    }
+    int64_t lo = pct(all, 1), hi = pct(all, 99);
+    CHECK(lo > -300 && hi < 300, "boards: synced boards aligned to %+.3f..%+.3f ms", lo / 1e3, hi / 1e3);
+    printf("  boards: %u synced to host time p1 %+.3f ms p99 %+.3f ms, old firmware on arrival times\n", BOARDS - 1,
+           lo / 1e3, hi / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    lcg_state = 17;
+    int full = argc > 1 && strcmp(argv[1], "-b") == 0;
+    if (argc > 1 && !full) {
+        fprintf(stderr, "usage: %s [-b]\n", argv[0]);
+        return 2;
+    }
+
+    check_fit(full ? 30.0 : 3.0);
+    check_boards(30.0);
+
+    return check_result();
+}
@@ -0,0 +1,627 @@
+/**
+ * @file tlm_agg.cpp
+ * @brief Multi-device aggregator: epoll I/O thread, decode workers, merge
+ *
+ * The I/O thread only reads: bytes go into 16 KiB chunks queued on their
+ * device, and a device with queued chunks sits once in the work queue. A
+ * worker takes a device, decodes all of its chunks with the device's own
+ * tlm::Reader (so a frame split across reads is joined, and one device is
+ * never decoded by two workers at once), copies the frames into a batch and
+ * puts the device back at the end of the queue if more bytes came in
+ * meanwhile. The I/O thread collects the batches into a min-heap on the
+ * mapped time and releases the frames that are due.
+ */
+
+#include "tlm_agg.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace tlm {
+
+static const size_t CHUNK_SIZE = 16U << 10;
+static const int READS_PER_EVENT = 4;           // then the next ready device
+static const int64_t CLOCK_RESTART_MS = 60000;  // ts this far back: the board restarted
+static const size_t SYNC_MAX_PENDING = 8;       // unanswered time sync requests remembered
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000U + (uint64_t)ts.tv_nsec / 1000U;
+}
+
+/* ==== DEVICE STATE ==== */
+
+namespace {
+struct Chunk {
+    std::unique_ptr<std::vector<uint8_t>> buf;  // null: port reopened, restart the decoder
+    size_t len;
+    uint64_t arrival_us;
+};
+} // namespace
+
+struct Aggregator::Batch {
+    struct Entry {
+        uint32_t off;
+        uint64_t time_us;
+        uint64_t arrival_us;
+    };
+    std::vector<uint8_t> bytes;
+    std::vector<Entry> entries;
+};
+
+struct Aggregator::Device {
+    uint32_t index;
+    std::string serial;
+    std::string path;
+    int fd = -1;
+    bool opened = false;
+    uint64_t reconnects = 0;
+    uint64_t bytes = 0;
+
+    /* shared with the workers */
+    mutable std::mutex lock;
+    std::deque<Chunk> inbox;
+    bool queued = false;                        // in the work queue or being decoded
+    uint64_t working_us = UINT64_MAX;           // arrival of the oldest chunk being decoded
+    std::vector<std::shared_ptr<Batch>> done;
+    ScanStats scan{};
+    uint64_t lost = 0;
+    uint64_t batches = 0;
+    int64_t offset_us = 0;
+    SyncStats sync_stats{};
+    std::deque<std::pair<uint16_t, uint64_t>> sync_sent;    // request id, host send time
+    uint64_t sync_requests = 0;                 // since the board came up or restarted
+    uint64_t sync_writes = 0;                   // all requests written
+    bool sync_unsupported = false;              // answered TLM_CMD_ERR_OP
+
+    /* owned by the I/O thread */
+    TLM_EncoderTypeDef enc{};
+    uint16_t sync_id = 0;
+    uint64_t next_sync_us = 0;
+
+    /* owned by the worker decoding the device */
+    std::unique_ptr<Reader> reader;
+    ScanStats scan_base{};                      // of readers before the last restart
+    SeqTracker seq;
+    DeltaDecoder delta;
+    bool clock_synced = false;
+    uint32_t last_ts = 0;
+    int64_t ts_ext = 0;                         // ts unwrapped past 2^32 ms
+    int64_t offset = 0;
+    ClockSync sync;
+    bool audio_synced = false;
+    uint32_t audio_last = 0;
+    int64_t audio_ext = 0;                      // I2S frame index unwrapped
+    int64_t audio_anchor = 0;                   // frame index placed at audio_anchor_us
+    double audio_anchor_us = 0;
+    double audio_hz = AGG_AUDIO_HZ;
+};
+
+/* ==== SETUP ==== */
+
+Aggregator::Aggregator(unsigned workers, unsigned window_ms) : window_us_((uint64_t)window_ms * 1000U)
+{
+    epfd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (workers == 0) {
+        unsigned cpus = std::thread::hardware_concurrency();
+        workers = cpus > 1 ? cpus - 1 : 1;
+    }
+    for (unsigned i = 0; i < workers; i++)
+        workers_.emplace_back(&Aggregator::worker, this);
+}
+
+Aggregator::~Aggregator()
+{
+    {
+        std::lock_guard<std::mutex> lk(queue_lock_);
+        stopping_ = true;
+    }
+    queue_cv_.notify_all();
+    for (std::thread &t : workers_)
+        t.join();
+    for (auto &d : dev_)
+        if (d->fd >= 0) ::close(d->fd);
+    if (epfd_ >= 0) ::close(epfd_);
+}
+
+static bool read_sysfs(const std::string &path, char *buf, size_t size)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f) return false;
+    bool ok = fgets(buf, (int)size, f) != nullptr;
+    fclose(f);
+    if (ok) buf[strcspn(buf, "\r\n")] = '\0';
+    return ok;
+}
+
+/* /sys/class/tty/ttyACMn/device is the CDC control interface; its parent
+ * is the USB device with the descriptor strings */
+std::string Aggregator::usb_serial(const std::string &path, int *iface, bool *ours)
+{
+    char real[PATH_MAX], buf[64];
+    if (!realpath(path.c_str(), real)) return "";
+    const char *name = strrchr(real, '/');
+    std::string dev = std::string("/sys/class/tty/") + (name ? name + 1 : real) + "/device";
+
+    if (iface) *iface = read_sysfs(dev + "/bInterfaceNumber", buf, sizeof(buf)) ? (int)strtol(buf, nullptr, 16) : -1;
+    if (ours) {
+        char pid[16];
+        *ours = read_sysfs(dev + "/../idVendor", buf, sizeof(buf)) && read_sysfs(dev + "/../idProduct", pid, sizeof(pid)) &&
+                strtol(buf, nullptr, 16) == AGG_USB_VID && strtol(pid, nullptr, 16) == AGG_USB_PID;
+    }
+    return read_sysfs(dev + "/../serial", buf, sizeof(buf)) ? buf : "";
+}
+
+int Aggregator::add(const std::string &path, const std::string &serial)
+{
+    for (auto &d : dev_)
+        if (d->path == path) return -1;
+
+    auto d = std::make_unique<Device>();
+    d->index = (uint32_t)dev_.size();
+    d->path = path;
+    d->serial = serial;
+    if (d->serial.empty()) d->serial = usb_serial(path);
+    if (d->serial.empty()) d->serial = path.substr(path.rfind('/') + 1);
+    d->reader = std::make_unique<Reader>(CHUNK_SIZE * 4U);
+    dev_.push_back(std::move(d));
+    open_device(*dev_.back());
+    return (int)dev_.back()->index;
+}
+
+unsigned Aggregator::scan()
+{
+    glob_t g;
+    unsigned added = 0;
+    if (glob("/dev/ttyACM*", 0, nullptr, &g) != 0) return 0;
+
+    for (size_t i = 0; i < g.gl_pathc; i++) {
+        const std::string path = g.gl_pathv[i];
+        int iface;
+        bool ours;
+        std::string serial = usb_serial(path, &iface, &ours);
+        if (!ours || iface != 0 || serial.empty()) continue;    // function 1 is the log console
+
+        auto it = std::find_if(dev_.begin(), dev_.end(), [&](const std::unique_ptr<Device> &d) {
+            return d->serial == serial;
+        });
+        if (it == dev_.end()) {
+            added += add(path, serial) >= 0;
+        } else if ((*it)->fd < 0) {
+            (*it)->path = path;                 // re-enumerated under another name
+            open_device(**it);
+        }
+    }
+    globfree(&g);
+    return added;
+}
+
+bool Aggregator::open_device(Device &d)
+{
+    struct termios tio;
+    int bits = TIOCM_DTR | TIOCM_RTS;
+
+    int fd = ::open(d.path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return false;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    ioctl(fd, TIOCMBIS, &bits);         // the device only sends with DTR set
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.u32 = d.index;
+    if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        ::close(fd);
+        return false;
+    }
+    if (d.opened) d.reconnects++;
+    d.opened = true;
+    d.fd = fd;
+    d.next_sync_us = 0;
+    std::lock_guard<std::mutex> lk(d.lock);
+    d.sync_sent.clear();
+    d.sync_requests = 0;
+    d.sync_unsupported = false;
+    return true;
+}
+
+void Aggregator::close_device(Device &d)
+{
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, d.fd, nullptr);
+    ::close(d.fd);
+    d.fd = -1;
+
+    /* a partial frame from before the loss must not join the next bytes */
+    std::lock_guard<std::mutex> lk(d.lock);
+    d.inbox.push_back(Chunk{ nullptr, 0, now() });
+    schedule(d);
+}
+
+/* ==== I/O THREAD ==== */
+
+void Aggregator::read_device(Device &d, uint64_t now)
+{
+    for (int i = 0; i < READS_PER_EVENT; i++) {
+        std::unique_ptr<std::vector<uint8_t>> buf;
+        {
+            std::lock_guard<std::mutex> lk(chunk_lock_);
+            if (!chunks_.empty()) {
+                buf = std::move(chunks_.back());
+                chunks_.pop_back();
+            }
+        }
+        if (!buf) buf = std::make_unique<std::vector<uint8_t>>(CHUNK_SIZE);
+
+        ssize_t n = ::read(d.fd, buf->data(), buf->size());
+        if (n <= 0) {
+            bool lost = n == 0 || (errno != EAGAIN && errno != EINTR);
+            {
+                std::lock_guard<std::mutex> lk(chunk_lock_);
+                chunks_.push_back(std::move(buf));
+            }
+            if (lost) close_device(d);
+            return;
+        }
+        d.bytes += (uint64_t)n;
+        {
+            std::lock_guard<std::mutex> lk(d.lock);
+            d.inbox.push_back(Chunk{ std::move(buf), (size_t)n, now });
+            schedule(d);
+        }
+        if ((size_t)n < CHUNK_SIZE) return;
+    }
+}
+
+/* Called with d.lock held */
+void Aggregator::schedule(Device &d)
+{
+    if (d.queued) return;
+    d.queued = true;
+    {
+        std::lock_guard<std::mutex> lk(queue_lock_);
+        queue_.push_back(&d);
+    }
+    queue_cv_.notify_one();
+}
+
+/* One TLM_CMD_TIME_SYNC request; the worker matches the answer by id */
+void Aggregator::send_sync(Device &d)
+{
+    uint8_t buf[TLM_OVERHEAD + TLM_CMD_REQ_SIZE];
+    TLM_WriterTypeDef w;
+    {
+        std::lock_guard<std::mutex> lk(d.lock);
+        if (d.sync_unsupported) return;
+    }
+    TLM_Begin(&d.enc, &w, buf, TLM_CHAN_CMD, 0);
+    TLM_PutU16(&w, ++d.sync_id);
+    TLM_PutU8(&w, TLM_CMD_TIME_SYNC);
+    uint16_t len = TLM_End(&w);
+
+    uint64_t sent = now();
+    if (::write(d.fd, buf, len) != (ssize_t)len) {
+        d.next_sync_us = sent + sync_period_ms_ * 1000ULL;     // port backed up, try later
+        return;
+    }
+    std::lock_guard<std::mutex> lk(d.lock);
+    d.sync_sent.emplace_back(d.sync_id, sent);
+    d.sync_writes++;
+    if (d.sync_sent.size() > SYNC_MAX_PENDING) d.sync_sent.pop_front();
+    d.next_sync_us = ClockSync::next_request(sent, d.sync_requests++, sync_period_ms_);
+}
+
+void Aggregator::poll(int timeout_ms)
+{
+    struct epoll_event ev[64];
+    uint64_t now = this->now();
+    if (sync_period_ms_)
+        for (auto &d : dev_)
+            if (d->fd >= 0 && d->next_sync_us > now) {
+                int wait = (int)std::min<uint64_t>((d->next_sync_us - now + 999U) / 1000U, INT_MAX);
+                if (timeout_ms < 0 || wait < timeout_ms) timeout_ms = wait;
+            }
+    int n = epoll_wait(epfd_, ev, 64, timeout_ms);
+    now = this->now();
+
+    for (int i = 0; i < n; i++) {
+        Device &d = *dev_[ev[i].data.u32];
+        if (d.fd < 0) continue;
+        if (ev[i].events & EPOLLIN)
+            read_device(d, now);
+        else if (ev[i].events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR))
+            close_device(d);
+    }
+
+    if (sync_period_ms_)
+        for (auto &d : dev_)
+            if (d->fd >= 0 && now >= d->next_sync_us) send_sync(*d);
+
+    if (now - last_reopen_ >= AGG_REOPEN_MS * 1000U) {
+        last_reopen_ = now;
+        for (auto &d : dev_)
+            if (d->fd < 0) open_device(*d);
+    }
+
+    uint64_t oldest = collect();
+    uint64_t due = now > window_us_ ? now - window_us_ : 0;
+    release(std::min(due, oldest));
+}
+
+void Aggregator::flush()
+{
+    {
+        std::unique_lock<std::mutex> lk(queue_lock_);
+        idle_cv_.wait(lk, [this] { return queue_.empty() && busy_ == 0; });
+    }
+    collect();
+    release(UINT64_MAX);
+}
+
+/* Move decoded batches into the merge heap; returns the arrival time of the
+ * oldest bytes not decoded yet */
+uint64_t Aggregator::collect()
+{
+    uint64_t oldest = UINT64_MAX;
+    std::vector<std::shared_ptr<Batch>> done;
+
+    for (auto &d : dev_) {
+        {
+            std::lock_guard<std::mutex> lk(d->lock);
+            done.swap(d->done);
+            if (!d->inbox.empty()) oldest = std::min(oldest, d->inbox.front().arrival_us);
+            oldest = std::min(oldest, d->working_us);
+        }
+        for (const std::shared_ptr<Batch> &b : done)
+            for (uint32_t i = 0; i < b->entries.size(); i++)
+                merge_.push(Pending{ b->entries[i].time_us, order_++, d->index, i, b });
+        done.clear();
+    }
+    return oldest;
+}
+
+void Aggregator::release(uint64_t watermark)
+{
+    while (!merge_.empty() && merge_.top().time_us <= watermark) {
+        const Pending &p = merge_.top();
+        const Batch::Entry &e = p.batch->entries[p.index];
+        const uint8_t *raw = p.batch->bytes.data() + e.off;
+
+        AggFrame f;
+        f.device = p.device;
+        f.serial = dev_[p.device]->serial.c_str();
+        f.time_us = p.time_us;
+        f.arrival_us = e.arrival_us;
+        f.frame.raw = raw;
+        f.frame.payload = raw + TLM_HEADER_SIZE;
+        f.frame.chan = raw[3];
+        f.frame.seq = TLM_GetU16(raw + 4);
+        f.frame.ts = TLM_GetU32(raw + 6);
+        f.frame.len = TLM_GetU16(raw + 10);
+
+        if (p.time_us < released_us_)
+            stats_.late++;
+        else
+            released_us_ = p.time_us;
+        stats_.frames++;
+        if (sink_) sink_(f);
+        merge_.pop();
+    }
+}
+
+/* ==== DECODE WORKERS ==== */
+
+void Aggregator::worker()
+{
+    std::unique_lock<std::mutex> lk(queue_lock_);
+    for (;;) {
+        queue_cv_.wait(lk, [this] { return stopping_ || !queue_.empty(); });
+        if (stopping_) return;
+        Device *d = queue_.front();
+        queue_.pop_front();
+        busy_++;
+        lk.unlock();
+        decode(*d);
+        lk.lock();
+        if (--busy_ == 0 && queue_.empty()) idle_cv_.notify_all();
+    }
+}
+
+void Aggregator::decode(Device &d)
+{
+    std::deque<Chunk> work;
+    {
+        std::lock_guard<std::mutex> lk(d.lock);
+        work.swap(d.inbox);
+        d.working_us = work.empty() ? UINT64_MAX : work.front().arrival_us;
+    }
+
+    auto batch = std::make_shared<Batch>();
+    for (Chunk &c : work) {
+        if (!c.buf) {
+            const ScanStats &st = d.reader->stats();
+            d.scan_base.frames += st.frames;
+            d.scan_base.crc_errors += st.crc_errors;
+            d.scan_base.bad_headers += st.bad_headers;
+            d.scan_base.skipped_bytes += st.skipped_bytes;
+            d.reader = std::make_unique<Reader>(CHUNK_SIZE * 4U);
+            d.clock_synced = false;
+            d.audio_synced = false;
+            d.sync.reset();
+            d.delta.reset();
+            continue;
+        }
+
+        for (size_t off = 0; off < c.len;) {
+            off += d.reader->append(c.buf->data() + off, c.len - off);
+            for (const Frame &wire : d.reader->frames()) {
+                d.seq.track(wire);
+                std::optional<Frame> f = d.delta.expand(wire);
+                if (!f || sync_response(d, *f, c.arrival_us)) continue;
+                batch->entries.push_back({ (uint32_t)batch->bytes.size(), map_time(d, *f, c.arrival_us), c.arrival_us });
+                batch->bytes.insert(batch->bytes.end(), f->raw, f->raw + f->size());
+            }
+            d.reader->consume();
+        }
+        std::lock_guard<std::mutex> lk(chunk_lock_);
+        chunks_.push_back(std::move(c.buf));
+    }
+
+    uint64_t lost = 0;
+    for (uint8_t ch = 0; ch < TLM_CHAN_COUNT; ch++)
+        lost += d.seq.chan(ch).lost;
+    const ScanStats &st = d.reader->stats();
+
+    std::lock_guard<std::mutex> lk(d.lock);
+    if (!batch->entries.empty()) d.done.push_back(std::move(batch));
+    d.scan = { d.scan_base.frames + st.frames, d.scan_base.crc_errors + st.crc_errors,
+               d.scan_base.bad_headers + st.bad_headers, d.scan_base.skipped_bytes + st.skipped_bytes };
+    d.lost = lost;
+    d.offset_us = d.sync.locked() ? (int64_t)d.sync.host_us(d.last_ts) - d.ts_ext * 1000 : d.offset;
+    d.sync_stats = d.sync.stats();
+    d.batches++;
+    d.working_us = UINT64_MAX;
+    if (d.inbox.empty()) {
+        d.queued = false;
+    } else {
+        {
+            std::lock_guard<std::mutex> qlk(queue_lock_);
+            queue_.push_back(&d);   // to the back: other devices get their turn
+        }
+        queue_cv_.notify_one();
+    }
+}
+
+/* Answer to one of our TLM_CMD_TIME_SYNC requests: into the clock fit, not
+ * into the stream. Requests are answered in order, so older ids still
+ * waiting will not be answered any more */
+bool Aggregator::sync_response(Device &d, const Frame &f, uint64_t arrival_us)
+{
+    std::optional<CmdRsp> rsp = as<CmdRsp>(f);
+    if (!rsp || rsp->op != TLM_CMD_TIME_SYNC) return false;
+
+    uint64_t sent;
+    {
+        std::lock_guard<std::mutex> lk(d.lock);
+        auto it = std::find_if(d.sync_sent.begin(), d.sync_sent.end(),
+                               [&](const std::pair<uint16_t, uint64_t> &s) { return s.first == rsp->id; });
+        if (it == d.sync_sent.end()) return false;     // another client's request
+        sent = it->second;
+        d.sync_sent.erase(d.sync_sent.begin(), it + 1);
+        if (rsp->status == TLM_CMD_ERR_OP) d.sync_unsupported = true;
+    }
+
+    std::optional<TimeSync> ts = as<TimeSync>(f);
+    if (rsp->status != TLM_CMD_OK || !ts) return true;
+    uint64_t restarts = d.sync.stats().restarts;
+    d.sync.add(sent, arrival_us, ts->tick_ms, ts->micros);
+    if (d.sync.stats().restarts != restarts) {
+        std::lock_guard<std::mutex> lk(d.lock);
+        d.sync_requests = 0;                            // fast requests again
+    }
+    return true;
+}
+
+/* Host time of a frame: the clock fit once locked, else the fastest arrival */
+uint64_t Aggregator::map_time(Device &d, const Frame &f, uint64_t arrival_us)
+{
+    if (f.chan == TLM_CHAN_AUDIO) return audio_time(d, f, arrival_us);
+
+    if (std::optional<AudioClock> clk = as<AudioClock>(f)) {
+        double hz = clk->rate_mhz ? clk->rate_mhz / 1000.0 : (double)clk->nominal_hz;
+        if (hz > 0 && d.audio_synced) {
+            /* re-anchor at the newest packet so the new rate only applies from here */
+            d.audio_anchor_us += (double)(d.audio_ext - d.audio_anchor) * 1e6 / d.audio_hz;
+            d.audio_anchor = d.audio_ext;
+        }
+        if (hz > 0) d.audio_hz = hz;
+    }
+
+    const int64_t arrival = (int64_t)arrival_us;
+    int64_t delta = (int32_t)(f.ts - d.last_ts);
+    if (!d.clock_synced || delta < -CLOCK_RESTART_MS) {
+        if (d.clock_synced) {
+            d.sync.reset();
+            std::lock_guard<std::mutex> lk(d.lock);
+            d.sync_requests = 0;
+        }
+        d.ts_ext = f.ts;
+        d.offset = arrival - (int64_t)f.ts * 1000;
+        d.clock_synced = true;
+    } else {
+        d.ts_ext += delta;
+    }
+    d.last_ts = f.ts;
+    int64_t dev_us = d.ts_ext * 1000;
+    if (arrival - dev_us < d.offset) d.offset = arrival - dev_us;
+
+    if (d.sync.locked()) return d.sync.host_us(f.ts);
+    return (uint64_t)(dev_us + d.offset);
+}
+
+/* Audio ts is the I2S frame index of the first sample: frames advance at
+ * the measured I2S rate from an anchor, pulled back whenever a packet
+ * would otherwise end after it arrived */
+uint64_t Aggregator::audio_time(Device &d, const Frame &f, uint64_t arrival_us)
+{
+    int64_t delta = (int32_t)(f.ts - d.audio_last);
+    if (!d.audio_synced || delta < -(int64_t)(d.audio_hz * CLOCK_RESTART_MS / 1000)) {
+        d.audio_ext = f.ts;
+        d.audio_anchor = f.ts;
+        d.audio_anchor_us = (double)arrival_us;
+        d.audio_synced = true;
+    } else {
+        d.audio_ext += delta;
+    }
+    d.audio_last = f.ts;
+
+    double t = d.audio_anchor_us + (double)(d.audio_ext - d.audio_anchor) * 1e6 / d.audio_hz;
+    double late = t + (f.len / Audio::size) * 1e6 / d.audio_hz - (double)arrival_us;
+    if (late > 0) {
+        d.audio_anchor_us -= late;
+        t -= late;
+    }
+    return t > 0 ? (uint64_t)t : 0;
+}
+
+/* ==== COUNTERS ==== */
+
+AggDeviceStats Aggregator::device(size_t i) const
+{
+    const Device &d = *dev_[i];
+    std::lock_guard<std::mutex> lk(d.lock);
+    return { d.serial, d.path, d.fd >= 0, d.bytes, d.reconnects, d.scan, d.lost, d.offset_us, d.sync_writes,
+             d.sync_stats };
+}
+
+uint64_t Aggregator::now() const
+{
+    return clock_ ? clock_() : now_us();
+}
+
+AggStats Aggregator::stats() const
+{
+    AggStats s = stats_;
+    s.pending = merge_.size();
+    for (const auto &d : dev_) {
+        std::lock_guard<std::mutex> lk(d->lock);
+        s.batches += d->batches;
+    }
+    return s;
+}
+
+} // namespace tlm
@@ -0,0 +1,189 @@
+/**
+ * @file tlm_agg.hpp
+ * @brief Many boards, one process: epoll reads, pooled decoding, time-ordered merge
+ * @version 1.0
+ * @date 2025-10
+ *
+ * A gateway carries dozens of boards; one reader process per tty does not
+ * scale. An Aggregator opens every device port non-blocking under a single
+ * epoll loop, hands the bytes read to a pool of decode workers and merges
+ * the decoded frames of all boards into one stream ordered by time, each
+ * frame keyed by the serial number of the board it came from (the USB
+ * iSerial string built in usbd_desc.c from the STM32 unique ID, read back
+ * from sysfs).
+ *
+ * Time: device timestamps count HAL ticks since boot. Every board is sent
+ * a TLM_CMD_TIME_SYNC request once a second (faster right after it comes
+ * up) and its tlm::ClockSync (tlm_sync.hpp) fits offset and skew of the
+ * board clock against the host CLOCK_MONOTONIC; once locked, each record's
+ * ts is mapped through that fit, which lines boards up to well under a
+ * ms. The answers are consumed here, not passed to the sink. Until then,
+ * or for a board that does not answer (older firmware, sync disabled), the
+ * ts is mapped with the smallest (arrival - ts) seen on that board, i.e.
+ * the frame that crossed the link fastest. Audio frames carry the I2S
+ * frame index instead of a tick; they are placed with the measured I2S
+ * rate from TLM_CHAN_AUDIO_CLK and the same fastest-arrival bound, so they
+ * are only as good as the link latency (tlm::AudioExport for exact audio
+ * timing). Delta coded sensor frames are expanded per board, so the sink
+ * only sees plain records. Frames are released once the merge window has
+ * passed and no board has undecoded bytes older than them; a frame that
+ * still arrives behind the released ones (a board stalled for longer than
+ * the window) is passed on and counted as late.
+ *
+ *   tlm::Aggregator agg;
+ *   agg.scan();                 // every board on the bus, or agg.add(path)
+ *   agg.set_sink([](const tlm::AggFrame &f) { use(f.serial, f.time_us, f.frame); });
+ *   while (running) agg.poll(100);
+ *   agg.flush();
+ *
+ * The sink runs on the thread calling poll()/flush(); the frame views are
+ * valid during the call only.
+ */
+
+#ifndef __TLM_AGG_HPP__
+#define __TLM_AGG_HPP__
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tlm_stream.hpp"
+#include "tlm_sync.hpp"
+
+namespace tlm {
+
+constexpr uint16_t AGG_USB_VID = 0x0483;        // USBD_VID
+constexpr uint16_t AGG_USB_PID = 0x5740;        // USBD_PID_FS
+constexpr unsigned AGG_DEFAULT_WINDOW_MS = 100;
+constexpr unsigned AGG_REOPEN_MS = 500;
+constexpr double AGG_AUDIO_HZ = 16000;          // I2S rate until a TLM_CHAN_AUDIO_CLK record
+
+/* One frame of the merged stream */
+struct AggFrame {
+    uint32_t device;            // index for Aggregator::device()
+    const char *serial;
+    uint64_t time_us;           // device ts on the host CLOCK_MONOTONIC
+    uint64_t arrival_us;        // when the bytes were read
+    Frame frame;
+};
+
+/* Per-board counters, a snapshot */
+struct AggDeviceStats {
+    std::string serial;
+    std::string path;
+    bool connected;
+    uint64_t bytes;
+    uint64_t reconnects;
+    ScanStats scan;
+    uint64_t lost;              // frames missing from the seq numbers, all channels
+    int64_t offset_us;          // host time - device time
+    uint64_t sync_writes;       // time sync requests written to the port
+    SyncStats sync;
+};
+
+struct AggStats {
+    uint64_t frames;            // released to the sink
+    uint64_t late;              // released behind a later frame
+    uint64_t pending;           // decoded, waiting for the window
+    uint64_t batches;           // worker decode passes
+};
+
+class Aggregator {
+public:
+    using Sink = std::function<void(const AggFrame &)>;
+
+    /* workers 0: one per CPU beyond the I/O thread, at least one */
+    explicit Aggregator(unsigned workers = 0, unsigned window_ms = AGG_DEFAULT_WINDOW_MS);
+    ~Aggregator();
+    Aggregator(const Aggregator &) = delete;
+    Aggregator &operator=(const Aggregator &) = delete;
+
+    /* Add a port; serial empty: read from sysfs, else the port name. A lost
+     * port is reopened by path. Returns the device index, -1 if already added */
+    int add(const std::string &path, const std::string &serial = "");
+    /* Add the data port of every board on the bus not yet open (a board that
+     * comes back on another ttyACM keeps its index); returns the count added */
+    unsigned scan();
+    void set_sink(Sink sink) { sink_ = std::move(sink); }
+    /* Time sync request period, 0: no requests, arrival-based times only.
+     * Set before the first poll() */
+    void set_sync(unsigned period_ms) { sync_period_ms_ = period_ms; }
+    /* Host clock in us, CLOCK_MONOTONIC when empty; a simulation that steps
+     * its own time sets it before add() */
+    void set_clock(std::function<uint64_t()> clock) { clock_ = std::move(clock); }
+
+    /* Wait up to timeout_ms for I/O, read, dispatch, release what is due */
+    void poll(int timeout_ms);
+    /* Decode everything read so far and release all of it, in order */
+    void flush();
+
+    size_t devices() const { return dev_.size(); }
+    AggDeviceStats device(size_t i) const;
+    AggStats stats() const;
+
+    /* USB serial of the board behind a ttyACM port, "" if not a USB tty;
+     * iface gets the bInterfaceNumber of the port's CDC function */
+    static std::string usb_serial(const std::string &path, int *iface = nullptr, bool *ours = nullptr);
+
+private:
+    struct Device;
+    struct Batch;
+    struct Pending {
+        uint64_t time_us;
+        uint64_t order;                 // wire order across all boards
+        uint32_t device;
+        uint32_t index;                 // frame in batch
+        std::shared_ptr<Batch> batch;
+        bool operator>(const Pending &o) const
+        {
+            return time_us != o.time_us ? time_us > o.time_us : order > o.order;
+        }
+    };
+
+    bool open_device(Device &d);
+    void close_device(Device &d);
+    void read_device(Device &d, uint64_t now);
+    void schedule(Device &d);
+    void send_sync(Device &d);
+    void decode(Device &d);
+    bool sync_response(Device &d, const Frame &f, uint64_t arrival_us);
+    uint64_t now() const;
+    uint64_t map_time(Device &d, const Frame &f, uint64_t arrival_us);
+    uint64_t audio_time(Device &d, const Frame &f, uint64_t arrival_us);
+    void worker();
+    uint64_t collect();
+    void release(uint64_t watermark);
+
+    std::vector<std::unique_ptr<Device>> dev_;
+    std::vector<std::thread> workers_;
+    std::mutex queue_lock_;
+    std::condition_variable queue_cv_;
+    std::condition_variable idle_cv_;   // queue empty and no decode running
+    std::deque<Device *> queue_;        // devices with bytes to decode
+    unsigned busy_ = 0;                 // devices being decoded
+    bool stopping_ = false;
+
+    std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending>> merge_;
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> chunks_;       // free read buffers
+    std::mutex chunk_lock_;
+    int epfd_ = -1;
+    uint64_t window_us_;
+    uint64_t released_us_ = 0;          // time of the last frame released
+    uint64_t order_ = 0;
+    uint64_t last_reopen_ = 0;
+    unsigned sync_period_ms_ = SYNC_DEFAULT_PERIOD_MS;
+    AggStats stats_{};
+    Sink sink_;
+    std::function<uint64_t()> clock_;
+};
+
+} // namespace tlm
+
+#endif /* __TLM_AGG_HPP__ */
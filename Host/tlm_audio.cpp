@@ -0,0 +1,693 @@
+/**
+ * @file tlm_audio.cpp
+ * @brief Microphone stream export: rate correction, gap filling, WAV and FLAC writers
+ */
+
+#include "tlm_audio.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "audio_packetizer.h"
+
+namespace tlm {
+
+/* ==== SINKS ==== */
+class AudioSink {
+public:
+    explicit AudioSink(FILE *f) : f_(f) {}
+    virtual ~AudioSink()
+    {
+        if (f_) fclose(f_);
+    }
+
+    /* Placeholder header, before the first sample */
+    virtual bool begin(unsigned hz) = 0;
+    virtual bool write(const int32_t *v, size_t n) = 0;
+    /* Trailing metadata and the final header */
+    virtual bool finish(unsigned hz, uint64_t samples, const std::vector<AudioMarker> &markers,
+                        const AudioExportStats &st) = 0;
+
+protected:
+    bool put(const void *p, size_t n) { return fwrite(p, 1, n, f_) == n; }
+    bool close_file()
+    {
+        bool ok = fflush(f_) == 0 && !ferror(f_);
+        ok = (fclose(f_) == 0) && ok;
+        f_ = nullptr;
+        return ok;
+    }
+
+    FILE *f_;
+};
+
+static void le16(std::vector<uint8_t> &b, uint32_t v)
+{
+    b.push_back((uint8_t)v);
+    b.push_back((uint8_t)(v >> 8));
+}
+
+static void le32(std::vector<uint8_t> &b, uint32_t v)
+{
+    le16(b, v & 0xFFFFU);
+    le16(b, v >> 16);
+}
+
+static void fourcc(std::vector<uint8_t> &b, const char *id)
+{
+    b.insert(b.end(), id, id + 4);
+}
+
+/* ---- WAV: RIFF, fmt (24-bit PCM mono), data, then cue + LIST/adtl ---- */
+class WavSink : public AudioSink {
+public:
+    using AudioSink::AudioSink;
+
+    bool begin(unsigned hz) override { return put(header(hz, 0, 0).data(), 44); }
+
+    bool write(const int32_t *v, size_t n) override
+    {
+        if (data_ + n * 3U > 0xFFFFFFFFULL - 0x100000ULL) {
+            errno = EFBIG;
+            return false;
+        }
+        buf_.clear();
+        for (size_t i = 0; i < n; i++) {
+            buf_.push_back((uint8_t)v[i]);
+            buf_.push_back((uint8_t)(v[i] >> 8));
+            buf_.push_back((uint8_t)(v[i] >> 16));
+        }
+        data_ += n * 3U;
+        return put(buf_.data(), buf_.size());
+    }
+
+    bool finish(unsigned hz, uint64_t samples, const std::vector<AudioMarker> &markers,
+                const AudioExportStats &st) override
+    {
+        (void)samples;
+        (void)st;
+        std::vector<uint8_t> b;
+        if (data_ & 1U) b.push_back(0);
+        if (!markers.empty()) {
+            fourcc(b, "cue ");
+            le32(b, 4U + 24U * (uint32_t)markers.size());
+            le32(b, (uint32_t)markers.size());
+            for (uint32_t i = 0; i < markers.size(); i++) {
+                le32(b, i + 1U);
+                le32(b, (uint32_t)markers[i].sample);
+                fourcc(b, "data");
+                le32(b, 0);
+                le32(b, 0);
+                le32(b, (uint32_t)markers[i].sample);
+            }
+            std::vector<uint8_t> adtl;
+            fourcc(adtl, "adtl");
+            for (uint32_t i = 0; i < markers.size(); i++) {
+                const std::string &s = markers[i].label;
+                fourcc(adtl, "labl");
+                le32(adtl, 4U + (uint32_t)s.size() + 1U);
+                le32(adtl, i + 1U);
+                adtl.insert(adtl.end(), s.begin(), s.end());
+                adtl.push_back(0);
+                if (adtl.size() & 1U) adtl.push_back(0);
+                if (!markers[i].samples) continue;
+                fourcc(adtl, "ltxt");
+                le32(adtl, 20);
+                le32(adtl, i + 1U);
+                le32(adtl, (uint32_t)markers[i].samples);
+                fourcc(adtl, "rgn ");
+                le32(adtl, 0);          // country, language
+                le32(adtl, 0);          // dialect, code page
+            }
+            fourcc(b, "LIST");
+            le32(b, (uint32_t)adtl.size());
+            b.insert(b.end(), adtl.begin(), adtl.end());
+        }
+        bool ok = put(b.data(), b.size());
+        std::vector<uint8_t> h = header(hz, data_, 4U + 24U + 8U + data_ + b.size());
+        ok = ok && fseek(f_, 0, SEEK_SET) == 0 && put(h.data(), h.size());
+        return close_file() && ok;
+    }
+
+private:
+    static std::vector<uint8_t> header(unsigned hz, uint64_t data, uint64_t riff)
+    {
+        std::vector<uint8_t> h;
+        fourcc(h, "RIFF");
+        le32(h, (uint32_t)riff);
+        fourcc(h, "WAVE");
+        fourcc(h, "fmt ");
+        le32(h, 16);
+        le16(h, 1);                     // PCM
+        le16(h, 1);                     // mono
+        le32(h, hz);
+        le32(h, hz * 3U);
+        le16(h, 3);
+        le16(h, 24);
+        fourcc(h, "data");
+        le32(h, (uint32_t)data);
+        return h;
+    }
+
+    uint64_t data_ = 0;
+    std::vector<uint8_t> buf_;
+};
+
+/* ---- FLAC: fixed blocks, CONSTANT / FIXED / VERBATIM subframes ---- */
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t> &b) : b_(b) {}
+
+    void put(uint32_t v, unsigned bits)
+    {
+        if (!bits) return;
+        acc_ = (acc_ << bits) | (v & (bits < 32 ? (1U << bits) - 1U : 0xFFFFFFFFU));
+        n_ += bits;
+        while (n_ >= 8) {
+            n_ -= 8;
+            b_.push_back((uint8_t)(acc_ >> n_));
+        }
+    }
+    void zeros(uint32_t n)
+    {
+        for (; n >= 32; n -= 32)
+            put(0, 32);
+        put(0, n);
+    }
+    void align() { put(0, (8U - n_) & 7U); }
+
+private:
+    std::vector<uint8_t> &b_;
+    uint64_t acc_ = 0;
+    unsigned n_ = 0;
+};
+
+static uint8_t crc8(const uint8_t *p, size_t n)
+{
+    uint8_t crc = 0;
+    while (n--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++)
+            crc = (uint8_t)(crc & 0x80U ? (crc << 1) ^ 0x07U : crc << 1);
+    }
+    return crc;
+}
+
+static uint16_t crc16(const uint8_t *p, size_t n)
+{
+    static uint16_t table[256];
+    if (!table[1]) {
+        for (unsigned i = 0; i < 256; i++) {
+            uint16_t c = (uint16_t)(i << 8);
+            for (int k = 0; k < 8; k++)
+                c = (uint16_t)(c & 0x8000U ? (c << 1) ^ 0x8005U : c << 1);
+            table[i] = c;
+        }
+    }
+    uint16_t crc = 0;
+    while (n--)
+        crc = (uint16_t)((crc << 8) ^ table[(crc >> 8) ^ *p++]);
+    return crc;
+}
+
+static inline uint32_t zigzag(int32_t r)
+{
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+class FlacSink : public AudioSink {
+public:
+    using AudioSink::AudioSink;
+
+    bool begin(unsigned hz) override
+    {
+        std::vector<uint8_t> b;
+        fourcc(b, "fLaC");
+        streaminfo(b, hz, 0);
+        block_header(b, true, 1, AUDIO_FLAC_RESERVED);     // PADDING, replaced at finish
+        b.resize(b.size() + AUDIO_FLAC_RESERVED, 0);
+        return put(b.data(), b.size());
+    }
+
+    bool write(const int32_t *v, size_t n) override
+    {
+        bool ok = true;
+        for (size_t i = 0; i < n; i++) {
+            block_.push_back(v[i]);
+            if (block_.size() == AUDIO_FLAC_BLOCK) ok = frame() && ok;
+        }
+        return ok;
+    }
+
+    bool finish(unsigned hz, uint64_t samples, const std::vector<AudioMarker> &markers,
+                const AudioExportStats &st) override
+    {
+        bool ok = block_.empty() || frame();
+
+        std::vector<std::string> comments;
+        char line[160];
+        snprintf(line, sizeof(line), "TLM_SOURCE_HZ=%.3f", st.source_hz);
+        comments.push_back(line);
+        snprintf(line, sizeof(line), "TLM_LOST_PACKETS=%llu", (unsigned long long)st.lost_packets);
+        comments.push_back(line);
+        const size_t room = AUDIO_FLAC_RESERVED - 4U - 64U;     // padding header, omitted count
+        size_t used = 8U + sizeof(VENDOR) - 1U + 4U;
+        for (const std::string &c : comments)
+            used += 4U + c.size();
+        size_t omitted = 0;
+        for (const AudioMarker &m : markers) {
+            snprintf(line, sizeof(line), "TLM_MARKER=%llu %llu %.100s", (unsigned long long)m.sample,
+                     (unsigned long long)m.samples, m.label.c_str());
+            if (used + 4U + strlen(line) > room) {
+                omitted++;
+                continue;
+            }
+            used += 4U + strlen(line);
+            comments.push_back(line);
+        }
+        if (omitted) {
+            snprintf(line, sizeof(line), "TLM_MARKERS_OMITTED=%zu", omitted);
+            comments.push_back(line);
+        }
+
+        std::vector<uint8_t> b;
+        streaminfo(b, hz, samples);
+        std::vector<uint8_t> vc;
+        le32(vc, sizeof(VENDOR) - 1U);
+        vc.insert(vc.end(), VENDOR, VENDOR + sizeof(VENDOR) - 1U);
+        le32(vc, (uint32_t)comments.size());
+        for (const std::string &c : comments) {
+            le32(vc, (uint32_t)c.size());
+            vc.insert(vc.end(), c.begin(), c.end());
+        }
+        block_header(b, false, 4, (uint32_t)vc.size());
+        b.insert(b.end(), vc.begin(), vc.end());
+        block_header(b, true, 1, AUDIO_FLAC_RESERVED - 4U - (uint32_t)vc.size());
+
+        ok = ok && fseek(f_, 4, SEEK_SET) == 0 && put(b.data(), b.size());
+        return close_file() && ok;
+    }
+
+private:
+    static constexpr char VENDOR[] = "tlm_audio";
+
+    static void block_header(std::vector<uint8_t> &b, bool last, uint8_t type, uint32_t len)
+    {
+        b.push_back((uint8_t)((last ? 0x80U : 0U) | type));
+        b.push_back((uint8_t)(len >> 16));
+        b.push_back((uint8_t)(len >> 8));
+        b.push_back((uint8_t)len);
+    }
+
+    void streaminfo(std::vector<uint8_t> &b, unsigned hz, uint64_t samples) const
+    {
+        block_header(b, false, 0, 34);
+        BitWriter w(b);
+        w.put(AUDIO_FLAC_BLOCK, 16);
+        w.put(AUDIO_FLAC_BLOCK, 16);
+        w.put(min_frame_ == UINT32_MAX ? 0 : min_frame_, 24);
+        w.put(max_frame_, 24);
+        w.put(hz, 20);
+        w.put(0, 3);                    // mono
+        w.put(23, 5);                   // 24 bits
+        w.put((uint32_t)(samples >> 32), 4);
+        w.put((uint32_t)samples, 32);
+        b.resize(b.size() + 16, 0);     // MD5 not computed
+    }
+
+    /* Rice parameter for n values summing to sum, and the bits it costs */
+    static unsigned rice_param(uint64_t sum, uint32_t n, uint64_t *bits)
+    {
+        unsigned k = 0;
+        while (k < 30 && ((uint64_t)n << (k + 1)) < sum)
+            k++;
+        *bits = (uint64_t)n * (k + 1U) + (sum >> k);
+        return k;
+    }
+
+    /* Cheapest partition order for the residual, and its size in bits */
+    unsigned partition_order(const int32_t *r, uint32_t n, unsigned order, uint64_t *bits)
+    {
+        const uint32_t size = (uint32_t)block_.size();
+        max_po_ = 0;
+        while (max_po_ < 6 && (size % (2U << max_po_)) == 0 && (size >> (max_po_ + 1)) > order)
+            max_po_++;
+
+        std::fill(sums_, sums_ + 64, 0);
+        for (uint32_t i = 0; i < n; i++)
+            sums_[(i + order) / (size >> max_po_)] += zigzag(r[i]);
+
+        unsigned best_po = 0;
+        *bits = UINT64_MAX;
+        for (unsigned po = 0; po <= max_po_; po++) {
+            uint64_t total = 6;             // coding method, partition order
+            uint32_t parts = 1U << po, per = 1U << (max_po_ - po);
+            for (uint32_t part = 0; part < parts; part++) {
+                uint64_t sum = 0, b;
+                for (uint32_t j = 0; j < per; j++)
+                    sum += sums_[part * per + j];
+                rice_param(sum, (size >> po) - (part ? 0 : order), &b);
+                total += 5U + b;
+            }
+            if (total < *bits) {
+                *bits = total;
+                best_po = po;
+            }
+        }
+        return best_po;
+    }
+
+    /* RICE2 residual (5-bit parameters) with the partitions of partition_order() */
+    void residual(BitWriter &w, const int32_t *r, unsigned order, unsigned po) const
+    {
+        const uint32_t size = (uint32_t)block_.size();
+        uint32_t parts = 1U << po, per = 1U << (max_po_ - po);
+        w.put(1, 2);
+        w.put(po, 4);
+        for (uint32_t part = 0; part < parts; part++) {
+            uint32_t cnt = (size >> po) - (part ? 0 : order);
+            uint64_t sum = 0, b;
+            for (uint32_t j = 0; j < per; j++)
+                sum += sums_[part * per + j];
+            unsigned k = rice_param(sum, cnt, &b);
+            w.put(k, 5);
+            for (uint32_t i = 0; i < cnt; i++) {
+                uint32_t u = zigzag(r[i]);
+                w.zeros(u >> k);
+                w.put(1, 1);
+                w.put(u, k);
+            }
+            r += cnt;
+        }
+    }
+
+    void subframe(BitWriter &w)
+    {
+        const int32_t *x = block_.data();
+        const uint32_t n = (uint32_t)block_.size();
+
+        bool constant = true;
+        for (uint32_t i = 1; i < n && constant; i++)
+            constant = x[i] == x[0];
+        if (constant) {
+            w.put(0x00, 8);                         // CONSTANT
+            w.put((uint32_t)x[0], 24);
+            return;
+        }
+
+        /* Fixed predictor with the smallest total |residual| */
+        unsigned order = 0;
+        if (n > 4) {
+            uint64_t err[5] = {};
+            for (uint32_t i = 4; i < n; i++) {
+                int64_t e0 = x[i], e1 = e0 - x[i - 1], e2 = e1 - (x[i - 1] - x[i - 2]);
+                int64_t e3 = e2 - (x[i - 1] - 2 * (int64_t)x[i - 2] + x[i - 3]);
+                int64_t e4 = e3 - (x[i - 1] - 3 * (int64_t)x[i - 2] + 3 * (int64_t)x[i - 3] - x[i - 4]);
+                err[0] += (uint64_t)llabs(e0);
+                err[1] += (uint64_t)llabs(e1);
+                err[2] += (uint64_t)llabs(e2);
+                err[3] += (uint64_t)llabs(e3);
+                err[4] += (uint64_t)llabs(e4);
+            }
+            for (unsigned o = 1; o <= 4; o++)
+                if (err[o] < err[order]) order = o;
+        }
+        if (n <= order) order = 0;
+
+        res_.resize(n);
+        for (uint32_t i = order; i < n; i++) {
+            int64_t p = 0;
+            switch (order) {
+            case 1: p = x[i - 1]; break;
+            case 2: p = 2 * (int64_t)x[i - 1] - x[i - 2]; break;
+            case 3: p = 3 * (int64_t)x[i - 1] - 3 * (int64_t)x[i - 2] + x[i - 3]; break;
+            case 4: p = 4 * (int64_t)x[i - 1] - 6 * (int64_t)x[i - 2] + 4 * (int64_t)x[i - 3] - x[i - 4]; break;
+            }
+            res_[i - order] = (int32_t)(x[i] - p);
+        }
+
+        uint64_t bits;
+        unsigned po = partition_order(res_.data(), n - order, order, &bits);
+        if (order * 24U + bits >= (uint64_t)n * 24U) {
+            w.put(0x02, 8);                         // VERBATIM
+            for (uint32_t i = 0; i < n; i++)
+                w.put((uint32_t)x[i], 24);
+            return;
+        }
+        w.put(0x10U | (order << 1), 8);             // FIXED
+        for (unsigned i = 0; i < order; i++)
+            w.put((uint32_t)x[i], 24);
+        residual(w, res_.data(), order, po);
+    }
+
+    bool frame()
+    {
+        frame_buf_.clear();
+        const uint32_t n = (uint32_t)block_.size();
+        BitWriter w(frame_buf_);
+        w.put(0xFFF8, 16);                          // sync, fixed block size
+        w.put(n == AUDIO_FLAC_BLOCK ? 12U : 7U, 4); // 4096, or 16-bit n-1 below
+        w.put(0, 4);                                // rate from STREAMINFO
+        w.put(0, 4);                                // mono
+        w.put(6, 3);                                // 24 bits
+        w.put(0, 1);
+        utf8(w, frame_no_++);
+        if (n != AUDIO_FLAC_BLOCK) w.put(n - 1U, 16);
+        w.put(crc8(frame_buf_.data(), frame_buf_.size()), 8);
+        subframe(w);
+        w.align();
+        uint16_t crc = crc16(frame_buf_.data(), frame_buf_.size());
+        frame_buf_.push_back((uint8_t)(crc >> 8));
+        frame_buf_.push_back((uint8_t)crc);
+
+        uint32_t size = (uint32_t)frame_buf_.size();
+        if (size < min_frame_) min_frame_ = size;
+        if (size > max_frame_) max_frame_ = size;
+        block_.clear();
+        return put(frame_buf_.data(), frame_buf_.size());
+    }
+
+    static void utf8(BitWriter &w, uint64_t v)
+    {
+        if (v < 0x80) {
+            w.put((uint32_t)v, 8);
+            return;
+        }
+        unsigned bytes = v < 0x800 ? 2 : v < 0x10000 ? 3 : v < 0x200000 ? 4 : v < 0x4000000 ? 5 : v < 0x80000000ULL ? 6 : 7;
+        w.put(((0xFF00U >> bytes) & 0xFFU) | (bytes < 7 ? (uint32_t)(v >> (6 * (bytes - 1))) : 0U), 8);
+        for (int i = (int)bytes - 2; i >= 0; i--)
+            w.put(0x80U | (uint32_t)((v >> (6 * i)) & 0x3FU), 8);
+    }
+
+    std::vector<int32_t> block_;
+    std::vector<int32_t> res_;
+    std::vector<uint8_t> frame_buf_;
+    uint64_t sums_[64];                 // zig-zag residual per finest partition
+    unsigned max_po_ = 0;
+    uint64_t frame_no_ = 0;
+    uint32_t min_frame_ = UINT32_MAX, max_frame_ = 0;
+};
+
+constexpr char FlacSink::VENDOR[];
+
+/* ==== EXPORT ==== */
+AudioExport::AudioExport() = default;
+
+AudioExport::~AudioExport()
+{
+    close();
+}
+
+bool AudioExport::open(const std::string &path)
+{
+    bool flac = path.size() >= 5 && strcasecmp(path.c_str() + path.size() - 5, ".flac") == 0;
+    return open(path, flac ? AudioFormat::FLAC : AudioFormat::WAV);
+}
+
+bool AudioExport::open(const std::string &path, AudioFormat format)
+{
+    close();
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    if (format == AudioFormat::FLAC)
+        sink_ = std::make_unique<FlacSink>(f);
+    else
+        sink_ = std::make_unique<WavSink>(f);
+    path_ = path;
+    error_ = false;
+    started_ = false;
+    have_ts_ = have_prev_ = false;
+    decim_ = 1;
+    queue_.clear();
+    block_.clear();
+    markers_.clear();
+    stats_ = {};
+    return true;
+}
+
+void AudioExport::add(const Frame &f)
+{
+    if (!sink_) return;
+    if (f.chan == TLM_CHAN_AUDIO_CLK) {
+        if (auto c = as<AudioClock>(f)) on_clock(c->nominal_hz, c->rate_mhz);
+        return;
+    }
+    if (f.chan != TLM_CHAN_AUDIO) return;
+
+    Packet p{};
+    int32_t delta = (int32_t)(f.ts - last_ts_);
+    p.restart = have_ts_ && delta < 0;
+    ts_ext_ = (!have_ts_ || p.restart) ? (int64_t)f.ts : ts_ext_ + delta;
+    have_ts_ = true;
+    last_ts_ = f.ts;
+    p.pos = ts_ext_;
+    p.seq = f.seq;
+    p.v.assign(array<Audio>(f).begin(), array<Audio>(f).end());
+    if (p.v.empty()) return;
+
+    stats_.packets++;
+    stats_.samples_in += p.v.size();
+    queue_.push_back(std::move(p));
+    drain(false);
+}
+
+void AudioExport::on_clock(uint32_t nominal_hz, uint32_t rate_mhz)
+{
+    if (nominal_hz) nominal_hz_ = nominal_hz;
+    if (!rate_mhz) return;
+    double hz = rate_mhz / 1000.0;
+    if (nominal_hz && fabs(hz / nominal_hz - 1.0) > 0.02) return;      // not a plausible lock
+    src_hz_ = hz;
+    stats_.clock_records++;
+    stats_.source_hz = hz;
+    if (started_ && fixed_src_hz_ <= 0) {
+        rebase(pos());
+        step_ = src_hz_ / out_hz_;
+    }
+}
+
+void AudioExport::drain(bool all)
+{
+    if (!started_) {
+        bool rate_known = fixed_src_hz_ > 0 || src_hz_ > 0;
+        bool primed = false;
+        for (const Packet &p : queue_)
+            primed = primed || p.restart;
+        if (!queue_.empty())
+            primed = primed || queue_.back().pos - queue_.front().pos >= AUDIO_PRIME_S * AUDIO_DEFAULT_RATE;
+        if (!rate_known && !primed && !all) return;
+
+        if (!out_hz_) out_hz_ = nominal_hz_ ? nominal_hz_ : AUDIO_DEFAULT_RATE;
+        double src = fixed_src_hz_ > 0 ? fixed_src_hz_ : src_hz_;
+        step_ = src > 0 ? src / out_hz_ : 1.0;
+        started_ = true;
+        if (!sink_->begin(out_hz_)) error_ = true;
+    }
+
+    while (queue_.size() >= 2 || (all && !queue_.empty())) {
+        Packet &p = queue_.front();
+        Packet *next = queue_.size() >= 2 ? &queue_[1] : nullptr;
+        const int64_t n = (int64_t)p.v.size();
+        unsigned d = decim_;
+
+        if (next && !next->restart) {
+            int64_t delta = next->pos - p.pos;
+            uint16_t lost = (uint16_t)(next->seq - p.seq - 1U);
+            if (!lost && delta % n == 0 && delta / n >= 1 && delta / n <= AUDIO_PKT_MAX_DECIM) {
+                d = (unsigned)(delta / n);
+                next->joined = true;
+            } else if (lost) {
+                char label[48];
+                snprintf(label, sizeof(label), "lost %u packet%s", lost, lost == 1 ? "" : "s");
+                next->gap = label;
+                stats_.lost_packets += lost;
+            } else {
+                next->gap = "no audio";
+            }
+        }
+        if (d != decim_) {
+            char label[32];
+            snprintf(label, sizeof(label), "decimation %u", d);
+            mark(0, label);
+            decim_ = d;
+        }
+        emit(p, d);
+        queue_.pop_front();
+    }
+}
+
+void AudioExport::emit(const Packet &p, unsigned decim)
+{
+    if (p.restart) {
+        stats_.restarts++;
+        mark(0, "device restart");
+        have_prev_ = false;
+    }
+    const double centre = (decim - 1U) / 2.0;      // a decimated sample is the mean of decim frames
+    for (size_t i = 0; i < p.v.size(); i++)
+        point((double)p.pos + (double)(i * decim) + centre, p.v[i], i > 0 || p.joined, i ? std::string() : p.gap);
+}
+
+void AudioExport::point(double pos, int32_t v, bool joined, const std::string &gap)
+{
+    if (!have_prev_) {
+        rebase(pos);
+    } else if (joined) {
+        const double span = pos - prev_pos_;
+        for (double x; (x = this->pos()) < pos; steps_++)
+            out((int32_t)llround(prev_v_ + (double)(v - prev_v_) * ((x - prev_pos_) / span)));
+    } else if (this->pos() < pos) {
+        const double src = step_ * out_hz_, missing = pos - this->pos();
+        stats_.gaps++;
+        if (missing > max_gap_s_ * src) {
+            char label[96];
+            snprintf(label, sizeof(label), "%s, %.1f s cut", gap.empty() ? "gap" : gap.c_str(), missing / src);
+            mark(0, label);
+            stats_.cut_s += missing / src;
+            steps_ += (uint64_t)std::ceil(missing / step_);
+        } else {
+            AudioMarker m = { stats_.samples_out, 0, gap.empty() ? "gap" : gap };
+            for (; this->pos() < pos; steps_++)
+                out(0);
+            m.samples = stats_.samples_out - m.sample;
+            stats_.gap_samples += m.samples;
+            markers_.push_back(m);
+        }
+    }
+    prev_pos_ = pos;
+    prev_v_ = v;
+    have_prev_ = true;
+}
+
+void AudioExport::out(int32_t v)
+{
+    if (v > 0x7FFFFF) v = 0x7FFFFF;
+    if (v < -0x800000) v = -0x800000;
+    block_.push_back(v);
+    stats_.samples_out++;
+    if (block_.size() == AUDIO_FLAC_BLOCK) {
+        if (!error_ && !sink_->write(block_.data(), block_.size())) error_ = true;
+        block_.clear();
+    }
+}
+
+void AudioExport::mark(uint64_t samples, const std::string &label)
+{
+    markers_.push_back({ stats_.samples_out, samples, label });
+}
+
+bool AudioExport::close()
+{
+    if (!sink_) return !error_;
+    drain(true);
+    if (!error_ && !block_.empty() && !sink_->write(block_.data(), block_.size())) error_ = true;
+    block_.clear();
+    if (!sink_->finish(out_hz_, stats_.samples_out, markers_, stats_)) error_ = true;
+    sink_.reset();
+    return !error_;
+}
+
+} // namespace tlm
@@ -0,0 +1,160 @@
+/**
+ * @file tlm_audio.hpp
+ * @brief Microphone stream export to WAV or FLAC, drift corrected, with gap markers
+ * @version 1.0
+ * @date 2025-10
+ *
+ * TLM_CHAN_AUDIO carries the I2S samples with the I2S frame index as
+ * timestamp. The I2S clock is neither the configured rate (I2SDIV rounding,
+ * about -3500 ppm at 16 kHz) nor locked to the host, so writing the samples
+ * out as they come gives a file that plays at the wrong speed and drifts
+ * away from wall time. The device measures its rate against the USB SOF and
+ * reports it once a second on TLM_CHAN_AUDIO_CLK; AudioExport resamples the
+ * stream by that rate onto the configured rate (linear interpolation in I2S
+ * frame positions), so one second of file is one second of host time.
+ *
+ *   - decimated packets (flow control) are interpolated back to the full
+ *     rate; each change of factor gets a marker;
+ *   - where the seq numbers show lost packets, or the frame index jumps
+ *     (stream shed or paused, no host), the missing time is filled with
+ *     silence and marked. Gaps longer than max_gap_s are not filled; the
+ *     marker then gives the time cut out. A device restart is marked and
+ *     the output simply continues;
+ *   - markers go into the file: cue points with labels and region lengths
+ *     in WAV, TLM_MARKER=<sample> <samples> <label> comments in FLAC.
+ *
+ * Memory stays bounded for captures of any length: one FLAC block, the
+ * packets of the first seconds while waiting for the first clock record,
+ * and the markers.
+ *
+ *   tlm::AudioExport ex;
+ *   ex.open("mic.flac");
+ *   for (const tlm::Frame &f : rd.frames()) ex.add(f);     // every channel
+ *   ex.close();
+ *
+ * FLAC is written by a small encoder of its own (fixed predictors, Rice
+ * coded residuals, 24-bit mono), no libFLAC needed. WAV is 24-bit PCM and
+ * limited to 4 GiB of samples (about 24 h at 16 kHz).
+ */
+
+#ifndef __TLM_AUDIO_HPP__
+#define __TLM_AUDIO_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tlm_stream.hpp"
+
+namespace tlm {
+
+constexpr unsigned AUDIO_DEFAULT_RATE = 16000;      // until a clock record says otherwise
+constexpr double AUDIO_PRIME_S = 2.0;               // audio held back waiting for the first clock record
+constexpr double AUDIO_MAX_GAP_S = 60.0;            // longer gaps are cut, not filled
+constexpr unsigned AUDIO_FLAC_BLOCK = 4096;
+constexpr uint32_t AUDIO_FLAC_RESERVED = 65536;     // metadata space for the comments written at close
+
+enum class AudioFormat { WAV, FLAC };
+
+struct AudioMarker {
+    uint64_t sample;                // output sample the marker starts at
+    uint64_t samples;               // silence inserted, 0 for a point marker
+    std::string label;
+};
+
+struct AudioExportStats {
+    uint64_t packets;
+    uint64_t samples_in;
+    uint64_t samples_out;
+    uint64_t lost_packets;          // seq gaps
+    uint64_t gaps;                  // filled or cut
+    uint64_t gap_samples;           // silence written
+    double   cut_s;                 // time left out by gaps above max_gap_s
+    uint64_t restarts;
+    uint64_t clock_records;         // locked TLM_CHAN_AUDIO_CLK records used
+    double   source_hz;             // last measured I2S rate, host time
+};
+
+class AudioSink;
+
+class AudioExport {
+public:
+    AudioExport();
+    ~AudioExport();
+    AudioExport(const AudioExport &) = delete;
+    AudioExport &operator=(const AudioExport &) = delete;
+
+    /* Format from the extension when not given (.flac, anything else WAV) */
+    bool open(const std::string &path);
+    bool open(const std::string &path, AudioFormat format);
+    /* Output rate; default the configured rate from the clock records */
+    void set_rate(unsigned hz) { out_hz_ = hz; }
+    /* Fixed I2S rate in host time instead of the clock records */
+    void set_source_rate(double hz) { fixed_src_hz_ = hz; }
+    void set_max_gap(double s) { max_gap_s_ = s; }
+
+    /* Any frame; audio and clock records are used, the rest ignored */
+    void add(const Frame &f);
+    /* Write out what is held back, finish the headers; false on a write error */
+    bool close();
+
+    unsigned rate() const { return out_hz_; }
+    const AudioExportStats &stats() const { return stats_; }
+    const std::vector<AudioMarker> &markers() const { return markers_; }
+
+private:
+    struct Packet {
+        int64_t pos;                // unwrapped I2S frame index of the first sample
+        uint16_t seq;
+        bool restart;               // frame index went back before this packet
+        bool joined;                // continues the previous packet without a gap
+        std::string gap;            // why not, for the marker
+        std::vector<int32_t> v;
+    };
+
+    void on_clock(uint32_t nominal_hz, uint32_t rate_mhz);
+    void drain(bool all);
+    void emit(const Packet &p, unsigned decim);
+    void point(double pos, int32_t v, bool joined, const std::string &gap);
+    void out(int32_t v);
+    void mark(uint64_t samples, const std::string &label);
+
+    std::unique_ptr<AudioSink> sink_;
+    std::string path_;
+    bool error_ = false;
+
+    unsigned out_hz_ = 0;
+    double fixed_src_hz_ = 0;
+    double max_gap_s_ = AUDIO_MAX_GAP_S;
+    double src_hz_ = 0;             // measured, 0 until the first locked record
+    unsigned nominal_hz_ = 0;
+    bool started_ = false;          // rates fixed, output running
+
+    std::deque<Packet> queue_;
+    bool have_ts_ = false;
+    uint32_t last_ts_ = 0;
+    int64_t ts_ext_ = 0;
+    unsigned decim_ = 1;
+
+    bool have_prev_ = false;
+    double prev_pos_ = 0;
+    int32_t prev_v_ = 0;
+    /* I2S frame position of the next output sample: anchor + n x step, so the
+     * position does not collect rounding over hours of samples */
+    double pos() const { return anchor_ + (double)steps_ * step_; }
+    void rebase(double pos) { anchor_ = pos; steps_ = 0; }
+    double anchor_ = 0;
+    uint64_t steps_ = 0;
+    double step_ = 1.0;             // I2S frames per output sample
+
+    std::vector<int32_t> block_;
+    AudioExportStats stats_{};
+    std::vector<AudioMarker> markers_;
+};
+
+} // namespace tlm
+
+#endif /* __TLM_AUDIO_HPP__ */
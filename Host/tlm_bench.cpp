@@ -0,0 +1,318 @@
+/**
+ * @file tlm_bench.cpp
+ * @brief Decode throughput of the C++ stream library against the C reference
+ *
+ * Each capture (raw bytes as read from the port, e.g. `cat /dev/ttyACM0 >
+ * cap.bin`) is loaded into memory and decoded three ways:
+ *   - ref:    TLM_DecoderFeed() in read-sized chunks (copies every frame);
+ *   - range:  one tlm::FrameRange over the whole capture;
+ *   - reader: tlm::Reader fed in read-sized chunks, as from a tty.
+ * Every frame is visited through the typed record views (audio samples
+ * summed, sensor fields read) so the work is comparable. The three must
+ * agree on frames, CRC and header errors, skipped bytes, per-channel seq
+ * accounting and the visit checksum; the exit status is non-zero otherwise.
+ * Without captures a synthetic one is used: the device's channel mix with
+ * seq gaps, bit errors, garbage and cut frames; -w saves it.
+ *
+ * Usage: tlm_bench [-r repeats] [-c chunk bytes] [-s MiB] [-w out.bin] [capture ...]
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "tlm_stream.hpp"
+
+static int repeats = 5;
+static size_t chunk = 4096;
+static size_t synth_mib = 16;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t lcg_state = 1;
+static uint32_t lcg_next(void)
+{
+    lcg_state = lcg_state * 1664525U + 1013904223U;
+    return lcg_state;
+}
+
+/* ==== SYNTHETIC CAPTURE ==== */
+static void put_frame(std::vector<uint8_t> &out, TLM_EncoderTypeDef *enc, uint8_t chan, uint32_t ts,
+                      const uint8_t *payload, uint16_t len)
+{
+    uint8_t buf[TLM_MAX_FRAME];
+    TLM_WriterTypeDef w;
+    TLM_Begin(enc, &w, buf, chan, ts);
+    std::memcpy(w.p, payload, len);
+    w.p += len;
+    uint16_t n = TLM_End(&w);
+
+    /* link damage, roughly one event per 2000 frames */
+    uint32_t r = lcg_next() % 8000U;
+    if (r == 0) {
+        buf[lcg_next() % n] ^= (uint8_t)(1U << (lcg_next() % 8U));     // bit error
+    } else if (r == 1) {
+        n = (uint16_t)(lcg_next() % n);                                 // cut short
+    } else if (r == 2) {
+        for (uint32_t i = lcg_next() % 64U; i > 0; i--)                 // garbage
+            out.push_back((uint8_t)lcg_next());
+    } else if (r == 3) {
+        return;                                                         // lost: seq gap
+    }
+    out.insert(out.end(), buf, buf + n);
+}
+
+/* 1 ms steps: PROX and AUDIO_LVL every ms, 166-sample audio packets at
+ * 16 kHz, SCHED and LOSS once a second */
+static std::vector<uint8_t> synthesize(size_t bytes)
+{
+    std::vector<uint8_t> out;
+    TLM_EncoderTypeDef enc = {};
+    uint8_t p[TLM_MAX_PAYLOAD];
+    const uint16_t samples = (512U - TLM_OVERHEAD) / 3U;
+    uint32_t frame = 0, next_audio = 0;
+
+    out.reserve(bytes + TLM_MAX_FRAME);
+    for (uint32_t ms = 0; out.size() < bytes; ms++) {
+        for (uint16_t i = 0; i < 4; i++)
+            p[i] = (uint8_t)lcg_next();
+        put_frame(out, &enc, TLM_CHAN_PROX, ms, p, 4);
+        put_frame(out, &enc, TLM_CHAN_AUDIO_LVL, ms, p, 4);
+
+        frame += 16U;
+        while (frame >= next_audio + samples) {
+            for (uint16_t i = 0; i < samples * 3U; i++)
+                p[i] = (uint8_t)lcg_next();
+            put_frame(out, &enc, TLM_CHAN_AUDIO, next_audio, p, samples * 3U);
+            next_audio += samples;
+        }
+
+        if (ms % 1000U == 999U) {
+            for (uint16_t i = 0; i < 4U * TLM_SCHED_JOB_SIZE; i++)
+                p[i] = (uint8_t)lcg_next();
+            put_frame(out, &enc, TLM_CHAN_SCHED, ms, p, 4U * TLM_SCHED_JOB_SIZE);
+            for (uint8_t c = 0; c < 4; c++) {
+                p[c * TLM_LOSS_ENTRY_SIZE] = (uint8_t)(c + 1U);
+                std::memcpy(&p[c * TLM_LOSS_ENTRY_SIZE + 1], &enc.seq[c + 1], 2);
+                std::memset(&p[c * TLM_LOSS_ENTRY_SIZE + 3], 0, 4);
+            }
+            put_frame(out, &enc, TLM_CHAN_LOSS, ms, p, 4U * TLM_LOSS_ENTRY_SIZE);
+        }
+    }
+    return out;
+}
+
+/* ==== DECODERS ==== */
+struct Result {
+    tlm::ScanStats scan;
+    TLM_SeqStatsTypeDef chan[TLM_CHAN_COUNT];
+    uint64_t sum;               // visit checksum
+    uint64_t ns;                // best time
+};
+
+/* Typed visit: what an application does with each record */
+static uint64_t visit(const tlm::Frame &f)
+{
+    uint64_t s = f.chan;
+    switch (f.chan) {
+    case TLM_CHAN_AUDIO:
+        for (int32_t v : tlm::array<tlm::Audio>(f))
+            s += (uint64_t)(int64_t)v;
+        break;
+    case TLM_CHAN_PROX:
+        if (auto r = tlm::as<tlm::Prox>(f)) s += r->als + r->ps;
+        break;
+    case TLM_CHAN_AUDIO_LVL:
+        if (auto r = tlm::as<tlm::AudioLevel>(f)) s += (uint64_t)(int64_t)r->sample;
+        break;
+    case TLM_CHAN_SCHED:
+        for (const tlm::SchedJob &j : tlm::array<tlm::SchedJob>(f))
+            s += j.id + j.runs + j.lat_max_us;
+        break;
+    case TLM_CHAN_LOSS:
+        for (const tlm::Loss &l : tlm::array<tlm::Loss>(f))
+            s += l.lost_chan + l.next_seq + l.device_dropped;
+        break;
+    default:
+        s += f.len;
+        break;
+    }
+    return s;
+}
+
+struct RefCtx {
+    uint64_t sum;
+};
+
+static void ref_frame(const TLM_FrameTypeDef *fr, void *ctx)
+{
+    tlm::Frame f = { nullptr, fr->payload, fr->chan, fr->seq, fr->ts, fr->len };
+    ((RefCtx *)ctx)->sum += visit(f);
+}
+
+static Result run_ref(const std::vector<uint8_t> &cap)
+{
+    static TLM_DecoderTypeDef dec;
+    RefCtx ctx = {};
+    for (size_t off = 0; off < cap.size(); off += chunk)
+        TLM_DecoderFeed(&dec, cap.data() + off, std::min(chunk, cap.size() - off), ref_frame, &ctx);
+
+    Result r = {};
+    r.scan = { dec.frames_ok, dec.crc_errors, dec.bad_headers, dec.skipped_bytes };
+    std::memcpy(r.chan, dec.chan, sizeof(r.chan));
+    r.sum = ctx.sum;
+    TLM_DecoderInit(&dec);
+    return r;
+}
+
+static Result run_range(const std::vector<uint8_t> &cap)
+{
+    tlm::FrameRange frames(cap.data(), cap.size());
+    tlm::SeqTracker seq;
+    Result r = {};
+    for (const tlm::Frame &f : frames) {
+        seq.track(f);
+        r.sum += visit(f);
+    }
+    r.scan = frames.stats();
+    for (uint8_t c = 0; c < TLM_CHAN_COUNT; c++)
+        r.chan[c] = seq.chan(c);
+    return r;
+}
+
+static Result run_reader(const std::vector<uint8_t> &cap)
+{
+    tlm::Reader rd(chunk + TLM_MAX_FRAME);
+    tlm::SeqTracker seq;
+    Result r = {};
+    for (size_t off = 0; off < cap.size();) {
+        off += rd.append(cap.data() + off, std::min(chunk, cap.size() - off));
+        for (const tlm::Frame &f : rd.frames()) {
+            seq.track(f);
+            r.sum += visit(f);
+        }
+    }
+    rd.consume();
+    r.scan = rd.stats();
+    for (uint8_t c = 0; c < TLM_CHAN_COUNT; c++)
+        r.chan[c] = seq.chan(c);
+    return r;
+}
+
+static Result timed(Result (*fn)(const std::vector<uint8_t> &), const std::vector<uint8_t> &cap)
+{
+    Result best = {};
+    for (int i = 0; i < repeats; i++) {
+        uint64_t t0 = now_ns();
+        Result r = fn(cap);
+        r.ns = now_ns() - t0;
+        if (i == 0 || r.ns < best.ns) best = r;
+    }
+    return best;
+}
+
+static int same(const Result &a, const Result &b)
+{
+    if (a.scan.frames != b.scan.frames || a.scan.crc_errors != b.scan.crc_errors ||
+        a.scan.bad_headers != b.scan.bad_headers || a.scan.skipped_bytes != b.scan.skipped_bytes || a.sum != b.sum)
+        return 0;
+    for (uint8_t c = 0; c < TLM_CHAN_COUNT; c++) {
+        const TLM_SeqStatsTypeDef &x = a.chan[c], &y = b.chan[c];
+        if (x.frames != y.frames || x.lost != y.lost || x.gaps != y.gaps || x.reordered != y.reordered ||
+            x.resyncs != y.resyncs)
+            return 0;
+    }
+    return 1;
+}
+
+static void report(const char *name, const Result &r, size_t bytes)
+{
+    double s = r.ns / 1e9;
+    printf("  %-6s %8.1f MB/s %7.2f Mframes/s  (%" PRIu64 " frames, %" PRIu64 " crc, %" PRIu64 " bad hdr, %" PRIu64
+           " skipped)\n", name, bytes / s / 1e6, r.scan.frames / s / 1e6, r.scan.frames, r.scan.crc_errors,
+           r.scan.bad_headers, r.scan.skipped_bytes);
+}
+
+static int bench(const char *name, const std::vector<uint8_t> &cap)
+{
+    printf("%s: %zu bytes, chunk %zu, best of %d\n", name, cap.size(), chunk, repeats);
+    Result ref = timed(run_ref, cap);
+    Result range = timed(run_range, cap);
+    Result reader = timed(run_reader, cap);
+    report("ref", ref, cap.size());
+    report("range", range, cap.size());
+    report("reader", reader, cap.size());
+
+    uint64_t lost = 0;
+    for (uint8_t c = 0; c < TLM_CHAN_COUNT; c++)
+        lost += ref.chan[c].lost;
+    printf("  seq: %" PRIu64 " frames missing; speedup range %.2fx, reader %.2fx\n", lost,
+           (double)ref.ns / range.ns, (double)ref.ns / reader.ns);
+
+    int ok = same(ref, range) && same(ref, reader);
+    if (!ok) printf("FAIL: %s: decoders disagree\n", name);
+    return ok;
+}
+
+static int load(const char *path, std::vector<uint8_t> &out)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *save = nullptr;
+    int opt, ok = 1;
+
+    while ((opt = getopt(argc, argv, "r:c:s:w:")) != -1) {
+        switch (opt) {
+        case 'r': repeats = atoi(optarg); break;
+        case 'c': chunk = (size_t)atol(optarg); break;
+        case 's': synth_mib = (size_t)atol(optarg); break;
+        case 'w': save = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-r repeats] [-c chunk bytes] [-s MiB] [-w out.bin] [capture ...]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (repeats < 1) repeats = 1;
+    if (chunk < 1) chunk = 1;
+
+    if (optind == argc) {
+        std::vector<uint8_t> cap = synthesize(synth_mib << 20);
+        if (save) {
+            FILE *f = fopen(save, "wb");
+            if (!f || fwrite(cap.data(), 1, cap.size(), f) != cap.size()) perror(save);
+            if (f) fclose(f);
+        }
+        ok = bench("synthetic", cap);
+    }
+    for (int i = optind; i < argc; i++) {
+        std::vector<uint8_t> cap;
+        ok = load(argv[i], cap) && bench(argv[i], cap) && ok;
+    }
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
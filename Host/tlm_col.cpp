@@ -0,0 +1,559 @@
+/**
+ * @file tlm_col.cpp
+ * @brief Column file writer, memory-mapped reader and the column codec
+ */
+
+#include "tlm_col.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace tlm {
+
+/* ==== SCHEMAS ==== */
+static const ColumnSchema schemas[] = {
+    { TLM_CHAN_AUDIO, "audio", 1, { "sample" } },
+    { TLM_CHAN_PROX, "prox", 2, { "als", "ps" } },
+    { TLM_CHAN_AUDIO_LVL, "audio_lvl", 1, { "sample" } },
+    { TLM_CHAN_GAS, "gas", 3, { "aqi", "tvoc", "eco2" } },
+    { TLM_CHAN_HUMTEMP, "humtemp", 2, { "centi_c", "centi_rh" } },
+    { TLM_CHAN_SCHED, "sched", 7, { "job", "runs", "overruns", "lat_min_us", "lat_max_us", "lat_avg_us", "exec_max_us" } },
+    { TLM_CHAN_CMD_RSP, "cmd_rsp", 3, { "id", "op", "status" } },
+    { TLM_CHAN_LINK, "link", 3, { "line_state", "down_ms", "audio_skipped" } },
+    { TLM_CHAN_BENCH, "bench", 1, { "counter" } },
+    { TLM_CHAN_LOSS, "loss", 3, { "chan", "next_seq", "device_dropped" } },
+    { TLM_CHAN_FLOW, "flow", 7, { "level", "prev", "reason", "audio_decim", "feature_div", "queue_bytes", "device_dropped" } },
+    { TLM_CHAN_AUDIO_CLK, "audio_clk", 2, { "nominal_hz", "rate_mhz" } },
+};
+
+const ColumnSchema *column_schema(uint8_t chan)
+{
+    for (const ColumnSchema &s : schemas)
+        if (s.chan == chan) return &s;
+    return nullptr;
+}
+
+/* ==== COLUMN CODEC ==== */
+/* Each value becomes the zig-zag varint of its delta (order 1) or of the
+ * change of its delta (order 2); a 0 token is followed by the length - 1
+ * of a run of zeros, so nonzero values never encode as 0 */
+
+static inline void put_varint(std::vector<uint8_t> &o, uint64_t v)
+{
+    while (v >= 0x80) {
+        o.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    o.push_back((uint8_t)v);
+}
+
+static inline uint64_t get_varint(const uint8_t *&p, const uint8_t *end)
+{
+    uint64_t v = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) break;
+    }
+    return v;
+}
+
+static inline uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+static inline int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1U); }
+
+static void encode_column(std::vector<uint8_t> &o, const std::vector<int64_t> &v, int order)
+{
+    uint64_t prev = 0, prev_d = 0, zeros = 0;
+    for (int64_t x : v) {
+        uint64_t d = (uint64_t)x - prev;        // wraps like the decoder
+        uint64_t e = order == 2 ? d - prev_d : d;
+        prev = (uint64_t)x;
+        prev_d = d;
+        if (e == 0) {
+            zeros++;
+            continue;
+        }
+        if (zeros) {
+            o.push_back(0);
+            put_varint(o, zeros - 1U);
+            zeros = 0;
+        }
+        put_varint(o, zigzag((int64_t)e));
+    }
+    if (zeros) {
+        o.push_back(0);
+        put_varint(o, zeros - 1U);
+    }
+}
+
+static bool decode_column(const uint8_t *p, size_t len, std::vector<int64_t> &v, size_t rows, int order)
+{
+    const uint8_t *end = p + len;
+    uint64_t prev = 0, prev_d = 0;
+    v.resize(rows);
+    for (size_t i = 0; i < rows;) {
+        if (p >= end) return false;
+        uint64_t t = get_varint(p, end);
+        uint64_t run = 1, e = 0;
+        if (t == 0)
+            run = get_varint(p, end) + 1U;
+        else
+            e = (uint64_t)unzigzag(t);
+        if (run > rows - i) return false;
+        for (; run > 0; run--, i++) {
+            uint64_t d = order == 2 ? prev_d + e : e;
+            prev += d;
+            prev_d = d;
+            v[i] = (int64_t)prev;
+        }
+    }
+    return true;
+}
+
+static size_t pad8(size_t n) { return (n + 7U) & ~(size_t)7U; }
+
+/* ==== WRITER ==== */
+
+bool ColumnWriter::open(const std::string &path)
+{
+    close();
+    f_ = fopen(path.c_str(), "wb");
+    if (!f_) return false;
+    setvbuf(f_, nullptr, _IOFBF, 1U << 20);
+    error_ = false;
+    stats_ = {};
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ColFileHeader h = { COL_MAGIC, COL_VERSION, (uint64_t)ts.tv_sec * 1000000U + (uint64_t)ts.tv_nsec / 1000U };
+    write(&h, sizeof(h));
+    return !error_;
+}
+
+void ColumnWriter::write(const void *p, size_t n)
+{
+    if (fwrite(p, 1, n, f_) != n) error_ = true;
+    stats_.bytes += n;
+}
+
+uint16_t ColumnWriter::source(const std::string &serial)
+{
+    for (size_t i = 0; i < sources_.size(); i++)
+        if (sources_[i] == serial) return (uint16_t)i;
+    sources_.push_back(serial);
+
+    /* recorded in line too, so a file without footer still names its sources */
+    ColChunkHeader h = {};
+    h.magic = COL_CHUNK_MAGIC;
+    h.source = (uint16_t)(sources_.size() - 1U);
+    h.chan = COL_CHAN_SOURCE;
+    h.bytes = (uint32_t)pad8(serial.size());
+    h.col_bytes[0] = (uint32_t)serial.size();
+    static const uint8_t zero[8] = {};
+    write(&h, sizeof(h));
+    write(serial.data(), serial.size());
+    write(zero, h.bytes - serial.size());
+    return h.source;
+}
+
+ColumnWriter::Stream &ColumnWriter::stream(uint16_t source, uint8_t chan)
+{
+    uint32_t key = (uint32_t)source << 8 | chan;
+    auto it = by_key_.find(key);
+    if (it != by_key_.end()) return *it->second;
+
+    auto s = std::make_unique<Stream>();
+    s->id = (uint16_t)streams_.size();
+    s->source = source;
+    s->schema = column_schema(chan);
+    Stream *p = s.get();
+    streams_.push_back(std::move(s));
+    by_key_[key] = p;
+    return *p;
+}
+
+void ColumnWriter::push(Stream &s, int64_t time_us, uint16_t seq, const int64_t *v)
+{
+    if (!s.time.empty() && (s.time.size() >= COL_CHUNK_ROWS || time_us - s.time.front() > COL_CHUNK_SPAN_US))
+        flush(s);
+    s.time.push_back(time_us);
+    s.seq.push_back(seq);
+    for (unsigned c = 0; c < s.schema->columns; c++)
+        s.col[c].push_back(v[c]);
+    stats_.rows++;
+}
+
+void ColumnWriter::add(uint16_t source, const Frame &f, int64_t time_us)
+{
+    const ColumnSchema *schema = column_schema(f.chan);
+    if (!f_ || !schema) return;
+    Stream &s = stream(source, f.chan);
+    int64_t v[COL_MAX_COLUMNS] = {};
+    stats_.frames++;
+
+    switch (f.chan) {
+    case TLM_CHAN_AUDIO:
+        for (int32_t x : array<Audio>(f)) {
+            v[0] = x;
+            push(s, time_us, f.seq, v);
+        }
+        return;
+    case TLM_CHAN_HUMTEMP:
+        for (HumTemp x : array<HumTemp>(f)) {
+            v[0] = x.centi_c;
+            v[1] = x.centi_rh;
+            push(s, time_us, f.seq, v);
+        }
+        return;
+    case TLM_CHAN_SCHED:
+        for (SchedJob x : array<SchedJob>(f)) {
+            v[0] = x.id; v[1] = x.runs; v[2] = x.overruns; v[3] = x.lat_min_us;
+            v[4] = x.lat_max_us; v[5] = x.lat_avg_us; v[6] = x.exec_max_us;
+            push(s, time_us, f.seq, v);
+        }
+        return;
+    case TLM_CHAN_LOSS:
+        for (Loss x : array<Loss>(f)) {
+            v[0] = x.lost_chan; v[1] = x.next_seq; v[2] = x.device_dropped;
+            push(s, time_us, f.seq, v);
+        }
+        return;
+    case TLM_CHAN_PROX:
+        if (auto x = as<Prox>(f)) { v[0] = x->als; v[1] = x->ps; break; }
+        return;
+    case TLM_CHAN_AUDIO_LVL:
+        if (auto x = as<AudioLevel>(f)) { v[0] = x->sample; break; }
+        return;
+    case TLM_CHAN_GAS:
+        if (auto x = as<Gas>(f)) { v[0] = x->aqi; v[1] = x->tvoc; v[2] = x->eco2; break; }
+        return;
+    case TLM_CHAN_CMD_RSP:
+        if (auto x = as<CmdRsp>(f)) { v[0] = x->id; v[1] = x->op; v[2] = x->status; break; }
+        return;
+    case TLM_CHAN_LINK:
+        if (auto x = as<Link>(f)) { v[0] = x->line_state; v[1] = x->down_ms; v[2] = x->audio_skipped; break; }
+        return;
+    case TLM_CHAN_BENCH:
+        if (auto x = as<Bench>(f)) { v[0] = x->counter; break; }
+        return;
+    case TLM_CHAN_FLOW:
+        if (auto x = as<Flow>(f)) {
+            v[0] = x->level; v[1] = x->prev; v[2] = x->reason; v[3] = x->audio_decim;
+            v[4] = x->feature_div; v[5] = x->queue_bytes; v[6] = x->device_dropped;
+            break;
+        }
+        return;
+    case TLM_CHAN_AUDIO_CLK:
+        if (auto x = as<AudioClock>(f)) { v[0] = x->nominal_hz; v[1] = x->rate_mhz; break; }
+        return;
+    default:
+        return;
+    }
+    push(s, time_us, f.seq, v);
+}
+
+void ColumnWriter::flush(Stream &s)
+{
+    if (s.time.empty()) return;
+    ColChunkHeader h = {};
+    h.magic = COL_CHUNK_MAGIC;
+    h.stream = s.id;
+    h.source = s.source;
+    h.chan = s.schema->chan;
+    h.columns = (uint8_t)s.schema->columns;
+    h.rows = (uint32_t)s.time.size();
+    h.t_first = s.time.front();
+    h.t_last = s.time.back();
+
+    out_.clear();
+    size_t mark = 0;
+    encode_column(out_, s.time, 2);
+    h.col_bytes[0] = (uint32_t)(out_.size() - mark);
+    mark = out_.size();
+    encode_column(out_, s.seq, 1);
+    h.col_bytes[1] = (uint32_t)(out_.size() - mark);
+    for (unsigned c = 0; c < s.schema->columns; c++) {
+        mark = out_.size();
+        encode_column(out_, s.col[c], 1);
+        h.col_bytes[c + 2] = (uint32_t)(out_.size() - mark);
+    }
+    out_.resize(pad8(out_.size()), 0);
+    h.bytes = (uint32_t)out_.size();
+
+    index_.push_back({ s.id, 0, h.rows, h.t_first, h.t_last, stats_.bytes });
+    write(&h, sizeof(h));
+    write(out_.data(), out_.size());
+    stats_.chunks++;
+
+    s.time.clear();
+    s.seq.clear();
+    for (unsigned c = 0; c < s.schema->columns; c++)
+        s.col[c].clear();
+}
+
+bool ColumnWriter::close()
+{
+    if (!f_) return true;
+    for (auto &s : streams_)
+        flush(*s);
+
+    static const uint8_t zero[8] = {};
+    ColTrailer t = {};
+    t.streams_offset = stats_.bytes;
+    t.sources = (uint32_t)sources_.size();
+    t.streams = (uint32_t)streams_.size();
+    for (const std::string &src : sources_) {
+        uint16_t n = (uint16_t)src.size();
+        write(&n, 2);
+        write(src.data(), n);
+    }
+    write(zero, pad8(stats_.bytes) - stats_.bytes);
+    for (auto &s : streams_) {
+        ColStreamEntry e = {};
+        e.source = s->source;
+        e.chan = s->schema->chan;
+        write(&e, sizeof(e));
+    }
+
+    /* by stream, each stream's chunks already in time order */
+    std::stable_sort(index_.begin(), index_.end(),
+                     [](const ColIndexEntry &a, const ColIndexEntry &b) { return a.stream < b.stream; });
+    t.index_offset = stats_.bytes;
+    t.index_entries = index_.size();
+    write(index_.data(), index_.size() * sizeof(ColIndexEntry));
+    t.version = COL_VERSION;
+    t.magic = COL_MAGIC;
+    write(&t, sizeof(t));
+
+    bool ok = !error_ && fclose(f_) == 0;
+    f_ = nullptr;
+    sources_.clear();
+    streams_.clear();
+    by_key_.clear();
+    index_.clear();
+    return ok;
+}
+
+/* ==== READER ==== */
+
+/* Sources, stream table and index from the footer; false unless every
+ * offset and length in it lies inside the file and the index is sorted by
+ * stream, as the writer leaves it */
+bool ColumnReader::read_footer(std::vector<std::string> &sources, std::vector<ColStreamEntry> &table)
+{
+    if (len_ < sizeof(ColFileHeader) + sizeof(ColTrailer)) return false;
+    const size_t end = len_ - sizeof(ColTrailer);
+    const ColTrailer *t = (const ColTrailer *)(map_ + end);
+    if (t->magic != COL_MAGIC || t->version != COL_VERSION || t->streams_offset < sizeof(ColFileHeader) ||
+        t->streams_offset > t->index_offset || t->index_offset > end ||
+        t->index_entries > (end - t->index_offset) / sizeof(ColIndexEntry))
+        return false;
+
+    size_t off = (size_t)t->streams_offset;
+    for (uint32_t i = 0; i < t->sources; i++) {
+        uint16_t n;
+        if (t->index_offset - off < 2) return false;
+        std::memcpy(&n, map_ + off, 2);
+        if (t->index_offset - off - 2 < n) return false;
+        sources.emplace_back((const char *)map_ + off + 2, n);
+        off += 2U + n;
+    }
+    off = pad8(off);
+    if (off > t->index_offset || t->streams > (t->index_offset - off) / sizeof(ColStreamEntry)) return false;
+    table.assign((const ColStreamEntry *)(map_ + off), (const ColStreamEntry *)(map_ + off) + t->streams);
+
+    const ColIndexEntry *index = (const ColIndexEntry *)(map_ + t->index_offset);
+    for (size_t i = 0; i < t->index_entries; i++)
+        if (index[i].stream >= table.size() || (i > 0 && index[i].stream < index[i - 1].stream)) return false;
+    index_ = index;
+    index_entries_ = (size_t)t->index_entries;
+    return true;
+}
+
+/* Rebuild the index from the chunks, up to the first torn one */
+void ColumnReader::walk_chunks(std::vector<std::string> &sources, std::vector<ColStreamEntry> &table)
+{
+    size_t off = sizeof(ColFileHeader);
+    while (off + sizeof(ColChunkHeader) <= len_) {
+        const ColChunkHeader *h = (const ColChunkHeader *)(map_ + off);
+        if (h->magic != COL_CHUNK_MAGIC || h->bytes > len_ - off - sizeof(ColChunkHeader)) break;
+        if (h->chan == COL_CHAN_SOURCE) {
+            if (h->col_bytes[0] > h->bytes) break;
+            if (sources.size() <= h->source) sources.resize(h->source + 1U);
+            sources[h->source].assign((const char *)(h + 1), h->col_bytes[0]);
+        } else {
+            if (table.size() <= h->stream) table.resize(h->stream + 1U);
+            table[h->stream].source = h->source;
+            table[h->stream].chan = h->chan;
+            rebuilt_.push_back({ h->stream, 0, h->rows, h->t_first, h->t_last, off });
+        }
+        off += sizeof(ColChunkHeader) + h->bytes;
+    }
+    std::stable_sort(rebuilt_.begin(), rebuilt_.end(),
+                     [](const ColIndexEntry &a, const ColIndexEntry &b) { return a.stream < b.stream; });
+    index_entries_ = rebuilt_.size();
+}
+
+bool ColumnReader::open(const std::string &path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    void *m = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ColFileHeader))
+        m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) return false;
+    map_ = (const uint8_t *)m;
+    len_ = (size_t)st.st_size;
+
+    const ColFileHeader *fh = (const ColFileHeader *)map_;
+    if (fh->magic != COL_MAGIC || fh->version != COL_VERSION) {
+        close();
+        return false;
+    }
+
+    std::vector<std::string> sources;
+    std::vector<ColStreamEntry> table;
+    if (!read_footer(sources, table)) {
+        /* no footer, or one that does not fit the file: walk the chunks */
+        recovered_ = true;
+        sources.clear();
+        table.clear();
+        walk_chunks(sources, table);
+        index_ = rebuilt_.data();
+    }
+    ranges_.assign(table.size(), { 0, 0 });
+    for (size_t i = 0, n = index_entries_; i < n;) {
+        size_t j = i;
+        while (j < n && index_[j].stream == index_[i].stream)
+            j++;
+        ranges_[index_[i].stream] = { i, j };
+        i = j;
+    }
+
+    for (size_t i = 0; i < table.size(); i++) {
+        ColumnStream s = {};
+        s.id = (uint16_t)i;
+        s.source = table[i].source < sources.size() ? sources[table[i].source] : "";
+        s.schema = column_schema(table[i].chan);
+        s.t_first = INT64_MAX;
+        s.t_last = INT64_MIN;
+        for (size_t e = ranges_[i].first; e < ranges_[i].second; e++) {
+            s.rows += index_[e].rows;
+            s.chunks++;
+            s.t_first = std::min(s.t_first, index_[e].t_first);
+            s.t_last = std::max(s.t_last, index_[e].t_last);
+        }
+        streams_.push_back(s);
+    }
+    return true;
+}
+
+void ColumnReader::close()
+{
+    if (map_) munmap((void *)map_, len_);
+    map_ = nullptr;
+    len_ = 0;
+    index_ = nullptr;
+    index_entries_ = 0;
+    recovered_ = false;
+    streams_.clear();
+    ranges_.clear();
+    rebuilt_.clear();
+}
+
+int ColumnReader::find(const std::string &source, uint8_t chan) const
+{
+    for (const ColumnStream &s : streams_)
+        if (s.source == source && s.schema && s.schema->chan == chan) return s.id;
+    return -1;
+}
+
+int64_t ColumnReader::t_first() const
+{
+    int64_t t = INT64_MAX;
+    for (const ColumnStream &s : streams_)
+        if (s.chunks) t = std::min(t, s.t_first);
+    return t;
+}
+
+int64_t ColumnReader::t_last() const
+{
+    int64_t t = INT64_MIN;
+    for (const ColumnStream &s : streams_)
+        if (s.chunks) t = std::max(t, s.t_last);
+    return t;
+}
+
+ColumnCursor ColumnReader::seek(size_t stream, int64_t t) const
+{
+    ColumnCursor c;
+    c.r_ = this;
+    if (stream >= ranges_.size()) return c;
+    const ColIndexEntry *b = index_ + ranges_[stream].first, *e = index_ + ranges_[stream].second;
+
+    /* the first chunk that ends at or after t */
+    const ColIndexEntry *it = std::lower_bound(b, e, t, [](const ColIndexEntry &x, int64_t v) { return x.t_last < v; });
+    c.end_ = ranges_[stream].second;
+    c.entry_ = (size_t)(it - index_);
+    if (it == e || !c.load(c.entry_)) {
+        c.entry_ = c.end_;
+        return c;
+    }
+    c.row_ = (size_t)(std::lower_bound(c.time_.begin(), c.time_.end(), t) - c.time_.begin());
+    return c;
+}
+
+/* ==== CURSOR ==== */
+
+bool ColumnCursor::load(size_t entry)
+{
+    const ColIndexEntry &x = r_->index_[entry];
+    if (x.offset > r_->len_ || r_->len_ - x.offset < sizeof(ColChunkHeader)) return false;
+    const ColChunkHeader *h = (const ColChunkHeader *)(r_->map_ + x.offset);
+    if (h->magic != COL_CHUNK_MAGIC || h->columns > COL_MAX_COLUMNS ||
+        h->bytes > r_->len_ - x.offset - sizeof(ColChunkHeader))
+        return false;
+    uint64_t total = 0;
+    for (unsigned c = 0; c < h->columns + 2U; c++)
+        total += h->col_bytes[c];
+    if (total > h->bytes) return false;
+
+    const uint8_t *p = (const uint8_t *)(h + 1);
+    bool ok = decode_column(p, h->col_bytes[0], time_, h->rows, 2);
+    p += h->col_bytes[0];
+    ok = ok && decode_column(p, h->col_bytes[1], seq_, h->rows, 1);
+    p += h->col_bytes[1];
+    for (unsigned c = 0; ok && c < h->columns; c++) {
+        ok = decode_column(p, h->col_bytes[c + 2], col_[c], h->rows, 1);
+        p += h->col_bytes[c + 2];
+    }
+    row_ = 0;
+    return ok;
+}
+
+bool ColumnCursor::next(Row &row)
+{
+    while (row_ >= time_.size()) {
+        if (entry_ + 1U >= end_ || !load(++entry_)) {
+            entry_ = end_;
+            time_.clear();
+            return false;
+        }
+    }
+    row.time_us = time_[row_];
+    row.seq = (uint16_t)seq_[row_];
+    for (unsigned c = 0; c < COL_MAX_COLUMNS; c++)
+        row.v[c] = row_ < col_[c].size() ? col_[c][row_] : 0;
+    row_++;
+    return true;
+}
+
+} // namespace tlm
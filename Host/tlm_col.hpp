@@ -0,0 +1,248 @@
+/**
+ * @file tlm_col.hpp
+ * @brief Columnar capture files: chunked, delta/varint compressed, time indexed
+ * @version 1.0
+ * @date 2025-10
+ *
+ * A text log of decoded telemetry is large (every field printed in full on
+ * every line) and can only be searched front to back. A column file keeps
+ * the decoded records instead:
+ *
+ *   - a stream is one channel of one source (board serial); its records are
+ *     rows, each with a time, the frame seq and the channel's fields
+ *     (ColumnSchema). Array channels give a row per entry (per audio sample,
+ *     per scheduler job ...) with the time of their frame;
+ *   - rows are cut into chunks (CHUNK_ROWS rows or CHUNK_SPAN_US of time,
+ *     whichever comes first) and each chunk stores column by column: the
+ *     time as delta-of-delta, the other columns as deltas, all zig-zag
+ *     varints with runs of zeros collapsed. Slowly varying sensors and the
+ *     regular time axis shrink to a few bits per value;
+ *   - the footer holds the stream table and a sparse index, one entry per
+ *     chunk with its time range and offset, sorted by stream and time.
+ *
+ * ColumnReader maps the file and seeks with two binary searches: the index
+ * for the chunk, then the decoded chunk for the row. A file whose writer
+ * died has no footer; the reader then rebuilds the index by walking the
+ * chunk headers, losing only the rows that were never flushed.
+ *
+ *   tlm::ColumnWriter w;
+ *   w.open("day.tlmc");
+ *   uint16_t src = w.source("0031003A3532");
+ *   w.add(src, frame, time_us);         // for each decoded frame
+ *   w.close();
+ *
+ *   tlm::ColumnReader r;
+ *   r.open("day.tlmc");
+ *   auto cur = r.seek(r.find(src_serial, TLM_CHAN_PROX), t);
+ *   for (tlm::Row row; cur.next(row);) use(row.time_us, row.v[0], row.v[1]);
+ *
+ * Times are whatever the caller passes (host us from the Aggregator, or the
+ * device ts in us); they must not go backwards within a stream.
+ */
+
+#ifndef __TLM_COL_HPP__
+#define __TLM_COL_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tlm_stream.hpp"
+
+namespace tlm {
+
+/* ==== FILE LAYOUT ==== */
+constexpr uint32_t COL_MAGIC = 0x434D4C54;          // "TLMC", file header and trailer
+constexpr uint32_t COL_CHUNK_MAGIC = 0x4B4E4843;    // "CHNK"
+constexpr uint32_t COL_VERSION = 1;
+constexpr uint8_t  COL_CHAN_SOURCE = 0xFF;          // chunk carrying a source serial, for recovery
+constexpr unsigned COL_MAX_COLUMNS = 8;
+constexpr uint32_t COL_CHUNK_ROWS = 4096;
+constexpr int64_t COL_CHUNK_SPAN_US = 60000000;     // a slow stream still reaches the disk every minute
+
+/* Fields of a channel, in Row::v order */
+struct ColumnSchema {
+    uint8_t chan;
+    const char *name;
+    unsigned columns;
+    const char *column[COL_MAX_COLUMNS];
+};
+
+/* Schema of a channel, nullptr for channels that are not stored (commands) */
+const ColumnSchema *column_schema(uint8_t chan);
+
+struct Row {
+    int64_t time_us;
+    uint16_t seq;
+    int64_t v[COL_MAX_COLUMNS];
+};
+
+/* On disk, little endian, 8-byte aligned */
+struct ColFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t created_us;                // CLOCK_REALTIME when the file was opened
+};
+
+struct ColChunkHeader {
+    uint32_t magic;
+    uint16_t stream;
+    uint16_t source;
+    uint8_t  chan;
+    uint8_t  columns;                   // value columns; time and seq come first
+    uint16_t reserved;
+    uint32_t rows;
+    uint32_t bytes;                     // column data after this header, padded to 8
+    uint32_t reserved2;
+    int64_t  t_first;
+    int64_t  t_last;
+    uint32_t col_bytes[COL_MAX_COLUMNS + 2];
+};
+
+struct ColIndexEntry {
+    uint16_t stream;
+    uint16_t reserved;
+    uint32_t rows;
+    int64_t  t_first;
+    int64_t  t_last;
+    uint64_t offset;                    // of the chunk header
+};
+
+/* Footer: sources (u16 length, serial; padded to 8), streams, index, trailer */
+struct ColStreamEntry {
+    uint16_t source;
+    uint8_t  chan;
+    uint8_t  reserved[5];
+};
+
+struct ColTrailer {
+    uint64_t streams_offset;
+    uint32_t streams;
+    uint32_t sources;
+    uint64_t index_offset;
+    uint64_t index_entries;
+    uint32_t version;
+    uint32_t magic;
+};
+
+/* ==== WRITER ==== */
+struct ColumnStats {
+    uint64_t frames;                    // frames given to add()
+    uint64_t rows;
+    uint64_t chunks;
+    uint64_t bytes;                     // file size so far
+};
+
+class ColumnWriter {
+public:
+    ColumnWriter() = default;
+    ~ColumnWriter() { close(); }
+    ColumnWriter(const ColumnWriter &) = delete;
+    ColumnWriter &operator=(const ColumnWriter &) = delete;
+
+    bool open(const std::string &path);
+    /* Id of a source (board serial), registered on first use */
+    uint16_t source(const std::string &serial);
+    /* Decode one frame into rows of its channel's stream */
+    void add(uint16_t source, const Frame &f, int64_t time_us);
+    /* Flush all streams, write the footer; false on a write error */
+    bool close();
+
+    const ColumnStats &stats() const { return stats_; }
+
+private:
+    struct Stream {
+        uint16_t id;
+        uint16_t source;
+        const ColumnSchema *schema;
+        std::vector<int64_t> time;
+        std::vector<int64_t> seq;
+        std::vector<int64_t> col[COL_MAX_COLUMNS];
+    };
+
+    Stream &stream(uint16_t source, uint8_t chan);
+    void push(Stream &s, int64_t time_us, uint16_t seq, const int64_t *v);
+    void flush(Stream &s);
+    void write(const void *p, size_t n);
+
+    FILE *f_ = nullptr;
+    bool error_ = false;
+    std::vector<std::string> sources_;
+    std::vector<std::unique_ptr<Stream>> streams_;
+    std::map<uint32_t, Stream *> by_key_;       // source << 8 | chan
+    std::vector<ColIndexEntry> index_;
+    std::vector<uint8_t> out_;                  // chunk being encoded
+    ColumnStats stats_{};
+};
+
+/* ==== READER ==== */
+struct ColumnStream {
+    uint16_t id;
+    std::string source;
+    const ColumnSchema *schema;
+    uint64_t rows;
+    uint64_t chunks;
+    int64_t t_first;
+    int64_t t_last;
+};
+
+class ColumnReader;
+
+/* Rows of one stream from a position on; reads chunk by chunk */
+class ColumnCursor {
+public:
+    bool next(Row &row);
+
+private:
+    friend class ColumnReader;
+    bool load(size_t entry);
+
+    const ColumnReader *r_ = nullptr;
+    size_t entry_ = 0, end_ = 0;                // index entries of the stream
+    size_t row_ = 0;
+    std::vector<int64_t> time_, seq_, col_[COL_MAX_COLUMNS];
+};
+
+class ColumnReader {
+public:
+    ColumnReader() = default;
+    ~ColumnReader() { close(); }
+    ColumnReader(const ColumnReader &) = delete;
+    ColumnReader &operator=(const ColumnReader &) = delete;
+
+    /* Map the file; an unfinished file is indexed by scanning its chunks */
+    bool open(const std::string &path);
+    void close();
+
+    bool recovered() const { return recovered_; }
+    size_t streams() const { return streams_.size(); }
+    const ColumnStream &stream(size_t i) const { return streams_[i]; }
+    /* Stream of a source and channel, -1 if none */
+    int find(const std::string &source, uint8_t chan) const;
+    /* First row of the stream with time >= t */
+    ColumnCursor seek(size_t stream, int64_t t) const;
+    int64_t t_first() const;
+    int64_t t_last() const;
+
+private:
+    friend class ColumnCursor;
+    bool read_footer(std::vector<std::string> &sources, std::vector<ColStreamEntry> &table);
+    void walk_chunks(std::vector<std::string> &sources, std::vector<ColStreamEntry> &table);
+
+    const uint8_t *map_ = nullptr;
+    size_t len_ = 0;
+    bool recovered_ = false;
+    std::vector<ColumnStream> streams_;
+    std::vector<std::pair<size_t, size_t>> ranges_;     // index entries per stream
+    const ColIndexEntry *index_ = nullptr;
+    size_t index_entries_ = 0;
+    std::vector<ColIndexEntry> rebuilt_;
+};
+
+} // namespace tlm
+
+#endif /* __TLM_COL_HPP__ */
@@ -0,0 +1,222 @@
+/**
+ * @file tlm_dump.c
+ * @brief Reference telemetry decoder: binary frames -> one text line per frame
+ *
+ * Reads the CDC byte stream from a file, a tty or stdin and prints every
+ * valid frame; decoder statistics and per-channel seq gap counts go to
+ * stderr at EOF. Each TLM_CHAN_LOSS record is printed next to the frames
+ * this decoder found missing on the same channel: what the device did not
+ * drop itself was lost on the link or in a host read stall.
+ *
+ * Delta coded sensor frames are printed expanded, exactly as the plain
+ * record; one whose reference frame was lost is printed as unresolved. At
+ * EOF each delta channel gets its compression: payload and whole frame
+ * bytes as received against the same records sent plain.
+ *
+ * Deferred log frames print one line per entry, formatted with the format
+ * table of the firmware ELF given with -e; without it the format id and the
+ * raw argument words are printed.
+ *
+ * Usage: tlm_dump [-a] [-e firmware.elf] [file]   (-a also prints every audio sample)
+ *   stty -F /dev/ttyACM0 raw && tlm_dump -e build/finger.elf /dev/ttyACM0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "telemetry.h"
+#include "tlm_log.h"
+
+static int show_audio;
+static TLM_DeltaDecoderTypeDef delta;
+static TLM_LogTableTypeDef log_table;
+
+/* Records of the delta channels, as received and expanded */
+static struct {
+    uint32_t records;
+    uint32_t deltas;
+    uint64_t wire;      // payload bytes received
+    uint64_t plain;     // payload bytes expanded
+} comp[TLM_CHAN_COUNT];
+
+/* One line per entry, each with the frame's chan/seq/ts */
+static void print_log(const TLM_FrameTypeDef *f)
+{
+    TLM_LogEntryTypeDef e;
+    char text[512];
+    uint16_t pos = TLM_LOG_HEADER_SIZE;
+    int rc;
+
+    if (f->len < TLM_LOG_HEADER_SIZE) {
+        printf("log len=%u\n", f->len);
+        return;
+    }
+    if (TLM_GetU16(f->payload) != 0)
+        printf("%u %u %" PRIu32 " log %u entries dropped on the device\n", f->chan, f->seq, f->ts,
+               TLM_GetU16(f->payload));
+    while ((rc = TLM_LogNext(f->payload, f->len, &pos, &e)) > 0) {
+        const char *fmt = TLM_LogString(&log_table, e.id);
+        printf("%u %u %" PRIu32 " log t=%" PRIu32 " ", f->chan, f->seq, f->ts, e.tick);
+        if (fmt != NULL) {
+            TLM_LogFormat(fmt, e.args, e.n, text, sizeof(text));
+            printf("%s\n", text);
+            continue;
+        }
+        printf("id=%u", e.id);
+        for (uint8_t i = 0; i < e.n; i++)
+            printf(" %08" PRIX32, e.args[i]);
+        printf("\n");
+    }
+    if (rc < 0)
+        printf("%u %u %" PRIu32 " log truncated entry\n", f->chan, f->seq, f->ts);
+}
+
+static void print_frame(const TLM_FrameTypeDef *wire, void *ctx)
+{
+    TLM_FrameTypeDef frame = *wire;
+    const TLM_FrameTypeDef *f = &frame;
+    const TLM_DecoderTypeDef *dec = (const TLM_DecoderTypeDef *)ctx;
+    uint32_t coded = delta.key_frames + delta.delta_frames;
+
+    if (!TLM_DeltaExpand(&delta, &frame)) {
+        printf("%u %u %" PRIu32 " delta len=%u unresolved\n", wire->chan & (uint8_t)~TLM_CHAN_DELTA, wire->seq,
+               wire->ts, wire->len);
+        return;
+    }
+    if (delta.key_frames + delta.delta_frames != coded) {
+        comp[f->chan].records++;
+        comp[f->chan].deltas += (wire->chan & TLM_CHAN_DELTA) ? 1U : 0U;
+        comp[f->chan].wire += wire->len;
+        comp[f->chan].plain += f->len;
+    }
+
+    if (f->chan == TLM_CHAN_LOG) {
+        print_log(f);
+        return;
+    }
+
+    const uint8_t *p = f->payload;
+    printf("%u %u %" PRIu32 " ", f->chan, f->seq, f->ts);
+    switch (f->chan) {
+    case TLM_CHAN_PROX:
+        if (f->len >= 4) printf("prox als=%u ps=%u", TLM_GetU16(p), TLM_GetU16(p + 2));
+        break;
+    case TLM_CHAN_GAS:
+        if (f->len >= 5) printf("gas aqi=%u tvoc=%u eco2=%u", p[0], TLM_GetU16(p + 1), TLM_GetU16(p + 3));
+        break;
+    case TLM_CHAN_HUMTEMP:
+        printf("humtemp");
+        for (uint16_t i = 0; i + 4U <= f->len; i += 4)
+            printf(" [%.2f C %.2f %%RH]", (int16_t)TLM_GetU16(p + i) / 100.0, TLM_GetU16(p + i + 2) / 100.0);
+        break;
+    case TLM_CHAN_AUDIO_LVL:
+        if (f->len >= 4) printf("audio_lvl %" PRId32, (int32_t)TLM_GetU32(p));
+        break;
+    case TLM_CHAN_SCHED:
+        printf("sched");
+        for (uint16_t i = 0; i + TLM_SCHED_JOB_SIZE <= f->len; i += TLM_SCHED_JOB_SIZE)
+            printf(" [job%u runs=%" PRIu32 " overruns=%" PRIu32 " lat=%" PRIu32 "..%" PRIu32
+                   " avg=%" PRIu32 " exec=%" PRIu32 "]", p[i], TLM_GetU32(p + i + 1),
+                   TLM_GetU32(p + i + 5), TLM_GetU32(p + i + 9), TLM_GetU32(p + i + 13),
+                   TLM_GetU32(p + i + 17), TLM_GetU32(p + i + 21));
+        break;
+    case TLM_CHAN_AUDIO:
+        printf("audio n=%u", f->len / 3U);
+        for (uint16_t i = 0; show_audio && i + 3U <= f->len; i += 3)
+            printf(" %" PRId32, TLM_GetS24(p + i));
+        break;
+    case TLM_CHAN_LINK:
+        if (f->len >= 9)
+            printf("link open dtr=%u rts=%u after %" PRIu32 " ms, %" PRIu32 " audio samples skipped",
+                   p[0] & 1U, (p[0] >> 1) & 1U, TLM_GetU32(p + 1), TLM_GetU32(p + 5));
+        break;
+    case TLM_CHAN_CMD_RSP:
+        if (f->len < TLM_CMD_RSP_SIZE) break;
+        printf("rsp id=%u op=0x%02X status=%u", TLM_GetU16(p), p[2], p[3]);
+        for (uint16_t i = TLM_CMD_RSP_SIZE; i < f->len; i++)
+            printf(" %02X", p[i]);
+        break;
+    case TLM_CHAN_LOSS:
+        printf("loss");
+        for (uint16_t i = 0; i + TLM_LOSS_ENTRY_SIZE <= f->len; i += TLM_LOSS_ENTRY_SIZE) {
+            uint8_t c = p[i] & (TLM_CHAN_COUNT - 1U);
+            printf(" [chan%u seq=%u device_dropped=%" PRIu32 " host_lost=%" PRIu32 "]", c,
+                   TLM_GetU16(p + i + 1), TLM_GetU32(p + i + 3), dec->chan[c].lost);
+        }
+        break;
+    case TLM_CHAN_FLOW:
+        if (f->len >= TLM_FLOW_SIZE)
+            printf("flow level=%u prev=%u reason=%u audio_decim=%u feature_div=%u queue=%u device_dropped=%" PRIu32,
+                   p[0], p[1], p[2], p[3], p[4], TLM_GetU16(p + 5), TLM_GetU32(p + 7));
+        break;
+    case TLM_CHAN_AUDIO_CLK:
+        if (f->len >= TLM_AUDIO_CLK_SIZE)
+            printf("audio_clk nominal=%" PRIu32 " Hz measured=%.3f Hz", TLM_GetU32(p), TLM_GetU32(p + 4) / 1000.0);
+        break;
+    case TLM_CHAN_BENCH:
+        if (f->len >= 4) printf("bench counter=%" PRIu32 " len=%u", TLM_GetU32(p), f->len);
+        break;
+    default:
+        printf("chan%u len=%u", f->chan, f->len);
+        break;
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    static TLM_DecoderTypeDef dec;
+    static uint8_t buf[4096];
+    const char *path = NULL;
+    FILE *in = stdin;
+    size_t n;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-a") == 0) show_audio = 1;
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            if (TLM_LogLoad(&log_table, argv[++i]) != 0) {
+                fprintf(stderr, "%s: no dlog_fmt section\n", argv[i]);
+                return 1;
+            }
+        }
+        else path = argv[i];
+    }
+    if (path && (in = fopen(path, "rb")) == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    TLM_DecoderInit(&dec);
+    TLM_DeltaDecoderInit(&delta);
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        TLM_DecoderFeed(&dec, buf, n, print_frame, &dec);
+        fflush(stdout);
+    }
+
+    fprintf(stderr, "frames %" PRIu32 ", crc errors %" PRIu32 ", bad headers %" PRIu32
+            ", skipped bytes %" PRIu32 "\n", dec.frames_ok, dec.crc_errors, dec.bad_headers,
+            dec.skipped_bytes);
+    for (uint8_t c = 0; c < TLM_CHAN_COUNT; c++) {
+        const TLM_SeqStatsTypeDef *st = &dec.chan[c];
+        if (st->frames == 0) continue;
+        fprintf(stderr, "chan%u: frames %" PRIu32 ", lost %" PRIu32 " in %" PRIu32 " gaps, reordered %"
+                PRIu32 ", resyncs %" PRIu32 "\n", c, st->frames, st->lost, st->gaps, st->reordered,
+                st->resyncs);
+    }
+    for (uint8_t c = 0; c < TLM_CHAN_COUNT; c++) {
+        uint64_t wire = comp[c].wire + (uint64_t)comp[c].records * TLM_OVERHEAD;
+        uint64_t plain = comp[c].plain + (uint64_t)comp[c].records * TLM_OVERHEAD;
+        if (comp[c].deltas == 0) continue;
+        fprintf(stderr, "chan%u delta: %" PRIu32 " records (%" PRIu32 " key), payload %" PRIu64 " -> %" PRIu64
+                " bytes (%.2fx), frames %" PRIu64 " -> %" PRIu64 " bytes (%.2fx)\n", c, comp[c].records,
+                comp[c].records - comp[c].deltas, comp[c].plain, comp[c].wire,
+                comp[c].wire ? (double)comp[c].plain / (double)comp[c].wire : 0.0, plain, wire,
+                (double)plain / (double)wire);
+    }
+    if (delta.unresolved || delta.invalid)
+        fprintf(stderr, "delta frames unresolved %" PRIu32 ", invalid %" PRIu32 "\n", delta.unresolved, delta.invalid);
+    if (in != stdin) fclose(in);
+    TLM_LogFree(&log_table);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file tlm_gw.cpp
+ * @brief Gateway: all boards on the bus merged into one time-ordered stream
+ *
+ * Reads every board with tlm::Aggregator (tlm_agg.hpp) and prints one line
+ * per frame in time order:
+ *   serial host_time_us chan seq ts len
+ * With -a the bus is rescanned every second, so boards plugged in later or
+ * re-enumerated after a reset are picked up (keyed by serial). With -o the
+ * merged stream is also recorded into a column file (tlm_col.hpp), one
+ * stream per board and channel. Host times come from the boards' clock
+ * sync, one request per board every -s ms (0: arrival times only). Per-board
+ * counters go to stderr on SIGINT/SIGTERM, and every -i seconds.
+ *
+ * Usage: tlm_gw [-a] [-j workers] [-w window ms] [-s sync ms] [-i s] [-o FILE.tlmc] [-q] [[SERIAL=]DEVICE ...]
+ *   tlm_gw -a
+ *   tlm_gw -q -o gateway.tlmc /dev/ttyACM0 /dev/ttyACM2
+ */
+
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <unistd.h>
+
+#include "tlm_agg.hpp"
+#include "tlm_col.hpp"
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-a] [-j workers] [-w window ms] [-s sync ms] [-i s] [-o FILE.tlmc] [-q] "
+            "[[SERIAL=]DEVICE ...]\n", prog);
+}
+
+static void print_stats(const tlm::Aggregator &agg)
+{
+    tlm::AggStats s = agg.stats();
+    fprintf(stderr, "tlm_gw: %" PRIu64 " frames, %" PRIu64 " late, %" PRIu64 " pending\n", s.frames, s.late, s.pending);
+    for (size_t i = 0; i < agg.devices(); i++) {
+        tlm::AggDeviceStats d = agg.device(i);
+        fprintf(stderr, "  %-14s %-16s %s %10" PRIu64 " bytes %8" PRIu64 " frames %6" PRIu64 " lost %4" PRIu64
+                " crc %4" PRIu64 " reconnects", d.serial.c_str(), d.path.c_str(), d.connected ? "up  " : "down",
+                d.bytes, d.scan.frames, d.lost, d.scan.crc_errors, d.reconnects);
+        if (d.sync.locked)
+            fprintf(stderr, "  sync %+.1f ppm rtt %.2f ms resid %.0f us\n", d.sync.skew_ppm, d.sync.rtt_min_us / 1e3,
+                    d.sync.residual_us);
+        else
+            fprintf(stderr, "  arrival times\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int auto_scan = 0, quiet = 0, opt;
+    const char *record = nullptr;
+    unsigned workers = 0, window_ms = tlm::AGG_DEFAULT_WINDOW_MS, sync_ms = tlm::SYNC_DEFAULT_PERIOD_MS, interval = 0;
+
+    while ((opt = getopt(argc, argv, "aj:w:s:i:o:q")) != -1) {
+        switch (opt) {
+        case 'a': auto_scan = 1; break;
+        case 'j': workers = (unsigned)atoi(optarg); break;
+        case 'w': window_ms = (unsigned)atoi(optarg); break;
+        case 's': sync_ms = (unsigned)atoi(optarg); break;
+        case 'i': interval = (unsigned)atoi(optarg); break;
+        case 'o': record = optarg; break;
+        case 'q': quiet = 1; break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (!auto_scan && optind == argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    tlm::Aggregator agg(workers, window_ms);
+    agg.set_sync(sync_ms);
+    for (int i = optind; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos)
+            agg.add(arg);
+        else
+            agg.add(arg.substr(eq + 1), arg.substr(0, eq));
+    }
+    if (auto_scan) agg.scan();
+
+    tlm::ColumnWriter col;
+    if (record && !col.open(record)) {
+        perror(record);
+        return 1;
+    }
+    agg.set_sink([&](const tlm::AggFrame &f) {
+        if (record) col.add(col.source(f.serial), f.frame, (int64_t)f.time_us);
+        if (!quiet)
+            printf("%s %" PRIu64 " %u %u %" PRIu32 " %u\n", f.serial, f.time_us, f.frame.chan, f.frame.seq, f.frame.ts,
+                   f.frame.len);
+    });
+
+    struct sigaction sa = {};
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    time_t last_scan = time(nullptr), last_stats = last_scan;
+    while (!stop) {
+        agg.poll(100);
+        time_t now = time(nullptr);
+        if (auto_scan && now != last_scan) {
+            last_scan = now;
+            agg.scan();
+        }
+        if (interval && (unsigned)(now - last_stats) >= interval) {
+            last_stats = now;
+            print_stats(agg);
+        }
+    }
+    agg.flush();
+    fflush(stdout);
+    print_stats(agg);
+    if (record && !col.close()) {
+        perror(record);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,215 @@
+/**
+ * @file tlm_log.c
+ * @brief Deferred log: ELF format table and printf-compatible entry formatting
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tlm_log.h"
+
+#define LOG_SECTION     "dlog_fmt"
+
+/* ==== ELF ==== */
+
+static uint64_t rd(const uint8_t *p, unsigned n)
+{
+    uint64_t v = 0;
+    while (n-- > 0)
+        v = (v << 8) | p[n];
+    return v;
+}
+
+/**
+ * @brief Read the dlog_fmt section of a firmware (or host) ELF file
+ * @retval 0 on success, -1 if the file is unreadable, not a little endian
+ *         ELF or has no dlog_fmt section
+ */
+int TLM_LogLoad(TLM_LogTableTypeDef *t, const char *elf_path)
+{
+    memset(t, 0, sizeof(*t));
+    FILE *f = fopen(elf_path, "rb");
+    if (f == NULL) return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *img = size > 0 ? malloc((size_t)size) : NULL;
+    int ok = img != NULL && fread(img, 1, (size_t)size, f) == (size_t)size;
+    fclose(f);
+
+    int rc = -1;
+    if (!ok || size < 52 || memcmp(img, "\x7f" "ELF", 4) != 0 || img[5] != 1) goto out;
+
+    /* ELF32 and ELF64 differ only in field widths and offsets */
+    int is64 = img[4] == 2;
+    uint64_t shoff = is64 ? rd(img + 0x28, 8) : rd(img + 0x20, 4);
+    unsigned shentsize = (unsigned)rd(img + (is64 ? 0x3A : 0x2E), 2);
+    unsigned shnum = (unsigned)rd(img + (is64 ? 0x3C : 0x30), 2);
+    unsigned shstrndx = (unsigned)rd(img + (is64 ? 0x3E : 0x32), 2);
+    if (shstrndx >= shnum || shoff + (uint64_t)shnum * shentsize > (uint64_t)size) goto out;
+
+#define SH_NAME(s)   rd((s), 4)
+#define SH_OFFSET(s) (is64 ? rd((s) + 0x18, 8) : rd((s) + 0x10, 4))
+#define SH_SIZE(s)   (is64 ? rd((s) + 0x20, 8) : rd((s) + 0x14, 4))
+    const uint8_t *strsh = img + shoff + (uint64_t)shstrndx * shentsize;
+    uint64_t stroff = SH_OFFSET(strsh), strsize = SH_SIZE(strsh);
+    if (stroff + strsize > (uint64_t)size) goto out;
+
+    for (unsigned i = 0; i < shnum; i++) {
+        const uint8_t *sh = img + shoff + (uint64_t)i * shentsize;
+        uint64_t name = SH_NAME(sh), off = SH_OFFSET(sh), len = SH_SIZE(sh);
+        if (name + sizeof(LOG_SECTION) > strsize ||
+            memcmp(img + stroff + name, LOG_SECTION, sizeof(LOG_SECTION)) != 0)
+            continue;
+        if (off + len > (uint64_t)size || (t->fmt = malloc((size_t)len + 1U)) == NULL) break;
+        memcpy(t->fmt, img + off, (size_t)len);
+        t->fmt[len] = '\0';
+        t->size = (size_t)len;
+        rc = 0;
+        break;
+    }
+#undef SH_NAME
+#undef SH_OFFSET
+#undef SH_SIZE
+
+out:
+    free(img);
+    return rc;
+}
+
+void TLM_LogFree(TLM_LogTableTypeDef *t)
+{
+    free(t->fmt);
+    memset(t, 0, sizeof(*t));
+}
+
+/* NULL if id is not the start of a string in the table */
+const char *TLM_LogString(const TLM_LogTableTypeDef *t, uint16_t id)
+{
+    if (t->fmt == NULL || id >= t->size) return NULL;
+    return t->fmt + id;
+}
+
+/* ==== ENTRIES ==== */
+
+/**
+ * @brief Take the next entry of a TLM_CHAN_LOG payload
+ * @param pos in/out; start at TLM_LOG_HEADER_SIZE
+ * @retval 1 with e filled, 0 at the end, -1 if the entry is truncated
+ */
+int TLM_LogNext(const uint8_t *payload, uint16_t len, uint16_t *pos, TLM_LogEntryTypeDef *e)
+{
+    if (*pos >= len) return 0;
+    if (len - *pos < TLM_LOG_ENTRY_SIZE) return -1;
+    const uint8_t *p = payload + *pos;
+    e->id = TLM_GetU16(p);
+    e->n = p[2];
+    e->tick = TLM_GetU32(p + 3);
+    if (e->n > TLM_LOG_MAX_ARGS || len - *pos < TLM_LOG_ENTRY_SIZE + 4U * e->n) return -1;
+    for (uint8_t i = 0; i < e->n; i++)
+        e->args[i] = TLM_GetU32(p + TLM_LOG_ENTRY_SIZE + 4U * i);
+    *pos = (uint16_t)(*pos + TLM_LOG_ENTRY_SIZE + 4U * e->n);
+    return 1;
+}
+
+/**
+ * @brief Render one entry as the device's printf would have
+ * @retval length of the text (as snprintf), truncated to size - 1
+ */
+int TLM_LogFormat(const char *fmt, const uint32_t *args, uint8_t n, char *out, size_t size)
+{
+    size_t len = 0;
+    uint8_t a = 0;
+    char spec[32];
+
+#define EMIT(...) do { \
+        int k_ = snprintf(len < size ? out + len : NULL, len < size ? size - len : 0, __VA_ARGS__); \
+        if (k_ > 0) len += (size_t)k_; \
+    } while (0)
+#define NEXT()  (a < n ? args[a++] : (missing = 1, 0U))
+
+    if (size > 0) out[0] = '\0';
+    while (*fmt) {
+        if (*fmt != '%') {
+            const char *e = strchr(fmt, '%');
+            size_t k = e ? (size_t)(e - fmt) : strlen(fmt);
+            EMIT("%.*s", (int)k, fmt);
+            fmt += k;
+            continue;
+        }
+        if (fmt[1] == '%') {
+            EMIT("%%");
+            fmt += 2;
+            continue;
+        }
+
+        /* %[flags][width][.precision][length]conversion, length dropped */
+        size_t s = 0;
+        int missing = 0, stars = 0, star[2] = { 0, 0 };
+        spec[s++] = *fmt++;
+        while (*fmt && strchr("-+ #0", *fmt) && s < sizeof(spec) - 8U)
+            spec[s++] = *fmt++;
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*fmt != '.') break;
+                spec[s++] = *fmt++;
+            }
+            if (*fmt == '*') {
+                star[stars++] = (int32_t)NEXT();
+                spec[s++] = *fmt++;
+            }
+            while (*fmt >= '0' && *fmt <= '9' && s < sizeof(spec) - 8U)
+                spec[s++] = *fmt++;
+        }
+        int h = 0;
+        while (*fmt && strchr("hlLqjzt", *fmt))
+            h += *fmt++ == 'h';
+        char conv = *fmt;
+        if (conv == '\0') break;
+        fmt++;
+
+        uint32_t v = NEXT();
+        /* the device promoted a char/short argument; %hhx and %hx print it narrowed */
+        if (h == 2) v = (conv == 'd' || conv == 'i') ? (uint32_t)(int8_t)v : (uint8_t)v;
+        if (h == 1) v = (conv == 'd' || conv == 'i') ? (uint32_t)(int16_t)v : (uint16_t)v;
+        if (missing) {
+            EMIT("<?>");
+            continue;
+        }
+        switch (conv) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+            spec[s++] = conv;
+            spec[s] = '\0';
+            if (conv == 'd' || conv == 'i') {
+                if (stars == 2) EMIT(spec, star[0], star[1], (int32_t)v);
+                else if (stars == 1) EMIT(spec, star[0], (int32_t)v);
+                else EMIT(spec, (int32_t)v);
+            } else {
+                if (stars == 2) EMIT(spec, star[0], star[1], (unsigned)v);
+                else if (stars == 1) EMIT(spec, star[0], (unsigned)v);
+                else EMIT(spec, (unsigned)v);
+            }
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+            float x;
+            memcpy(&x, &v, 4);
+            spec[s++] = conv;
+            spec[s] = '\0';
+            if (stars == 2) EMIT(spec, star[0], star[1], (double)x);
+            else if (stars == 1) EMIT(spec, star[0], (double)x);
+            else EMIT(spec, (double)x);
+            break;
+        }
+        case 's': case 'p':
+            EMIT("<0x%08x>", (unsigned)v);
+            break;
+        default:
+            EMIT("<%%%c?>", conv);
+            break;
+        }
+    }
+#undef EMIT
+#undef NEXT
+    return (int)len;
+}
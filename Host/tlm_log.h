@@ -0,0 +1,49 @@
+/**
+ * @file tlm_log.h
+ * @brief Host side of the deferred log (dlog.h): format table from the ELF, entry formatting
+ *
+ * The firmware sends TLM_CHAN_LOG entries carrying only a format ID, the
+ * tick and 32-bit arguments. The ID is the offset of the format string in
+ * the dlog_fmt section of the firmware ELF; TLM_LogLoad() reads that
+ * section (ELF32 or ELF64, little endian) and TLM_LogFormat() renders an
+ * entry as printf would on the device: integer conversions take one
+ * argument word (l/ll/z/j/t read 32 bits, h/hh narrow it), %f/%e/%g/%a
+ * take the bits of a float (DLOG_F), %s and %p show the pointer, and '*'
+ * widths consume a word as printf does.
+ */
+
+#ifndef __TLM_LOG_H__
+#define __TLM_LOG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "telemetry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    char *fmt;              // contents of dlog_fmt
+    size_t size;
+} TLM_LogTableTypeDef;
+
+typedef struct {
+    uint16_t id;
+    uint8_t  n;
+    uint32_t tick;
+    uint32_t args[TLM_LOG_MAX_ARGS];
+} TLM_LogEntryTypeDef;
+
+int TLM_LogLoad(TLM_LogTableTypeDef *t, const char *elf_path);
+void TLM_LogFree(TLM_LogTableTypeDef *t);
+const char *TLM_LogString(const TLM_LogTableTypeDef *t, uint16_t id);
+int TLM_LogNext(const uint8_t *payload, uint16_t len, uint16_t *pos, TLM_LogEntryTypeDef *e);
+int TLM_LogFormat(const char *fmt, const uint32_t *args, uint8_t n, char *out, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TLM_LOG_H__ */
@@ -0,0 +1,289 @@
+/**
+ * @file tlm_shm.cpp
+ * @brief Shared-memory frame ring: writer, readers, futex wake-up
+ */
+
+#include "tlm_shm.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace tlm {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring counters must be lock free across processes");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "futex word must be a plain u32");
+
+/* ==== INTERNAL HELPERS ==== */
+
+/* Data starts on the page after the header */
+static size_t data_offset()
+{
+    return (sizeof(ShmHeader) + 4095U) & ~(size_t)4095U;
+}
+
+static uint64_t record_size(size_t len)
+{
+    return (SHM_RECORD_HEADER + len + SHM_ALIGN - 1U) & ~(uint64_t)(SHM_ALIGN - 1U);
+}
+
+static bool pid_alive(int32_t pid)
+{
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+/* Shared (not private) futex: waiters are in other processes */
+static void futex_wait(std::atomic<uint32_t> *word, uint32_t val, int timeout_ms)
+{
+    struct timespec ts = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L };
+    syscall(SYS_futex, word, FUTEX_WAIT, val, &ts, nullptr, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t> *word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+/* ==== WRITER ==== */
+
+/**
+ * Mode 0660: readers need write access for their slot; share the device
+ * group (e.g. dialout) with the daemon.
+ */
+bool ShmWriter::create(const std::string &name, size_t capacity)
+{
+    close();
+    size_t cap = 4096;
+    while (cap < capacity)
+        cap <<= 1;
+
+    std::string path = "/" + name;
+    shm_unlink(path.c_str());       // left over by a writer that crashed
+    int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0) return false;
+    fchmod(fd, 0660);
+    size_t len = data_offset() + cap;
+    void *m = MAP_FAILED;
+    if (ftruncate(fd, (off_t)len) == 0)
+        m = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) {
+        shm_unlink(path.c_str());
+        return false;
+    }
+
+    hdr_ = new (m) ShmHeader();
+    data_ = (uint8_t *)m + data_offset();
+    map_len_ = len;
+    name_ = path;
+    pos_ = 0;
+    tail_ = 0;
+    hdr_->version = SHM_VERSION;
+    hdr_->capacity = cap;
+    hdr_->writer_pid = (int32_t)getpid();
+    hdr_->state.store(SHM_STATE_STARTING);
+    /* readers check the magic last */
+    std::atomic_thread_fence(std::memory_order_release);
+    hdr_->magic = SHM_MAGIC;
+    return true;
+}
+
+void ShmWriter::publish(const uint8_t *frame, size_t len)
+{
+    const uint64_t cap = hdr_->capacity;
+    const uint64_t n = record_size(len);
+    uint64_t off = pos_ & (cap - 1U);
+    uint64_t start = off + n > cap ? pos_ + (cap - off) : pos_;
+
+    /* Announce the overwrite before doing it */
+    hdr_->reserve.store(start + n, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    /* Records about to be overwritten are no longer the oldest */
+    while (start + n - tail_ > cap) {
+        uint64_t t = tail_ & (cap - 1U);
+        uint32_t l;
+        std::memcpy(&l, data_ + t, 4);
+        tail_ += l == SHM_PAD ? cap - t : record_size(l);
+    }
+    hdr_->tail.store(tail_, std::memory_order_release);
+
+    if (start != pos_) {
+        const uint32_t pad = SHM_PAD;
+        std::memcpy(data_ + off, &pad, 4);
+        off = 0;
+    }
+    const uint32_t hdr[2] = { (uint32_t)len, 0 };
+    std::memcpy(data_ + off, hdr, sizeof(hdr));
+    std::memcpy(data_ + off + SHM_RECORD_HEADER, frame, len);
+    pos_ = start + n;
+}
+
+void ShmWriter::wake()
+{
+    if (!hdr_) return;
+    hdr_->head.store(pos_, std::memory_order_release);
+    hdr_->wake.fetch_add(1);
+    if (hdr_->waiters.load() != 0U)
+        futex_wake(&hdr_->wake);
+}
+
+void ShmWriter::set_state(ShmState s)
+{
+    hdr_->state.store(s);
+    hdr_->wake.fetch_add(1);
+    futex_wake(&hdr_->wake);
+}
+
+unsigned ShmWriter::reap_readers()
+{
+    unsigned n = 0;
+    for (ShmReaderSlot &s : hdr_->reader) {
+        int32_t pid = s.pid.load();
+        if (pid != 0 && !pid_alive(pid) && s.pid.compare_exchange_strong(pid, 0))
+            n++;
+    }
+    return n;
+}
+
+void ShmWriter::close()
+{
+    if (!hdr_) return;
+    wake();
+    set_state(SHM_STATE_STOPPED);
+    munmap(hdr_, map_len_);
+    shm_unlink(name_.c_str());
+    hdr_ = nullptr;
+    data_ = nullptr;
+}
+
+/* ==== READER ==== */
+
+bool ShmReader::open(const std::string &name, bool from_oldest)
+{
+    close();
+    std::string path = "/" + name;
+    int fd = shm_open(path.c_str(), O_RDWR, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    void *m = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size > data_offset())
+        m = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) return false;
+
+    ShmHeader *h = (ShmHeader *)m;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (h->magic != SHM_MAGIC || h->version != SHM_VERSION || data_offset() + h->capacity != (size_t)st.st_size) {
+        munmap(m, (size_t)st.st_size);
+        errno = EPROTO;
+        return false;
+    }
+
+    /* A free slot, or one whose owner died without detaching */
+    const int32_t me = (int32_t)getpid();
+    for (ShmReaderSlot &s : h->reader) {
+        int32_t pid = s.pid.load();
+        if ((pid == 0 || !pid_alive(pid)) && s.pid.compare_exchange_strong(pid, me)) {
+            slot_ = &s;
+            break;
+        }
+    }
+    if (!slot_) {
+        munmap(m, (size_t)st.st_size);
+        errno = EBUSY;
+        return false;
+    }
+
+    hdr_ = h;
+    data_ = (const uint8_t *)m + data_offset();
+    map_len_ = (size_t)st.st_size;
+    pos_ = from_oldest ? h->tail.load(std::memory_order_acquire) : h->head.load(std::memory_order_acquire);
+    slot_->frames.store(0);
+    slot_->overruns.store(0);
+    slot_->lost_bytes.store(0);
+    slot_->cursor.store(pos_);
+    return true;
+}
+
+size_t ShmReader::read(uint8_t *buf, size_t cap)
+{
+    const uint64_t capacity = hdr_->capacity;
+    const uint64_t head = hdr_->head.load(std::memory_order_acquire);
+    uint64_t p = pos_, frames = 0;
+    size_t out = 0;
+
+    while (p < head) {
+        uint64_t off = p & (capacity - 1U);
+        uint32_t len;
+        std::memcpy(&len, data_ + off, 4);
+        if (len == SHM_PAD) {
+            p += capacity - off;
+            continue;
+        }
+        /* a length torn by the writer is caught by the check below */
+        if (len > TLM_MAX_FRAME || off + SHM_RECORD_HEADER + len > capacity || out + len > cap) break;
+        std::memcpy(buf + out, data_ + off + SHM_RECORD_HEADER, len);
+        out += len;
+        p += record_size(len);
+        frames++;
+    }
+
+    /* Were any of the copied bytes overwritten meanwhile? */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t reserve = hdr_->reserve.load(std::memory_order_relaxed);
+    if (reserve - pos_ > capacity) {
+        uint64_t tail = hdr_->tail.load(std::memory_order_acquire);
+        if (tail < pos_) tail = hdr_->head.load(std::memory_order_acquire);
+        slot_->overruns.fetch_add(1, std::memory_order_relaxed);
+        slot_->lost_bytes.fetch_add(tail - pos_, std::memory_order_relaxed);
+        pos_ = tail;
+        slot_->cursor.store(pos_, std::memory_order_relaxed);
+        return 0;
+    }
+
+    pos_ = p;
+    slot_->cursor.store(pos_, std::memory_order_relaxed);
+    slot_->frames.fetch_add(frames, std::memory_order_relaxed);
+    return out;
+}
+
+void ShmReader::wait(int timeout_ms)
+{
+    uint32_t w = hdr_->wake.load();
+    if (hdr_->head.load() != pos_ || writer_stopped()) return;
+    hdr_->waiters.fetch_add(1);
+    futex_wait(&hdr_->wake, w, timeout_ms);
+    hdr_->waiters.fetch_sub(1);
+}
+
+uint64_t ShmReader::lag() const
+{
+    return hdr_->head.load(std::memory_order_acquire) - pos_;
+}
+
+bool ShmReader::writer_stopped() const
+{
+    return hdr_->state.load() == SHM_STATE_STOPPED;
+}
+
+void ShmReader::close()
+{
+    if (!hdr_) return;
+    slot_->pid.store(0);
+    munmap(hdr_, map_len_);
+    hdr_ = nullptr;
+    data_ = nullptr;
+    slot_ = nullptr;
+}
+
+} // namespace tlm
@@ -0,0 +1,157 @@
+/**
+ * @file tlm_shm.hpp
+ * @brief POSIX shared-memory ring of telemetry frames: one writer, many readers
+ * @version 1.0
+ * @date 2025-10
+ *
+ * The capture daemon (tlmd) owns the tty, decodes the stream and publishes
+ * every valid frame, byte for byte as it came off the wire, into a ring in
+ * /dev/shm/<name>. Any number of processes attach with a ShmReader and read
+ * the frames at their own pace.
+ *
+ * Layout: ShmHeader, then `capacity` data bytes (a power of two). A record
+ * is a u32 frame length followed by the frame, padded to 8 bytes; a record
+ * never wraps, the writer leaves a SHM_PAD marker instead. Positions are
+ * free running byte counts.
+ *
+ * The writer never waits for readers: the device must not back up because
+ * one consumer stalls. Before writing a record it announces the end of the
+ * bytes it is about to overwrite (reserve), then writes, then publishes
+ * (head). A reader copies records out and afterwards checks that the writer
+ * has not reserved past them; if it has, the copy is discarded, the reader
+ * jumps to the oldest record still intact (tail) and counts an overrun.
+ * Each reader has a slot in the header with its pid, cursor and counters,
+ * so the daemon (and tools) can see who is attached and how far behind it
+ * is.
+ *
+ * Readers sleep on a futex that the writer bumps after each batch.
+ */
+
+#ifndef __TLM_SHM_HPP__
+#define __TLM_SHM_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "telemetry.h"
+
+namespace tlm {
+
+/* ==== LAYOUT ==== */
+constexpr uint32_t SHM_MAGIC = 0x524D4C54;      // "TLMR"
+constexpr uint32_t SHM_VERSION = 1;
+constexpr uint32_t SHM_MAX_READERS = 32;
+constexpr uint32_t SHM_ALIGN = 8;
+constexpr uint32_t SHM_RECORD_HEADER = 8;       // u32 length, u32 reserved
+constexpr uint32_t SHM_PAD = 0xFFFFFFFFU;       // rest of the ring up to the wrap is unused
+constexpr size_t SHM_DEFAULT_CAPACITY = 4U << 20;
+
+enum ShmState : uint32_t {
+    SHM_STATE_STARTING = 0,
+    SHM_STATE_CONNECTED,        // device port open
+    SHM_STATE_DISCONNECTED,     // waiting for the device to come back
+    SHM_STATE_STOPPED,          // writer exited; no more frames
+};
+
+struct alignas(64) ShmReaderSlot {
+    std::atomic<int32_t>  pid;          // 0: free
+    std::atomic<uint64_t> cursor;       // position of the next record to read
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> overruns;     // times the writer lapped this reader
+    std::atomic<uint64_t> lost_bytes;   // ring bytes skipped on those overruns
+};
+
+struct alignas(64) ShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;                  // data bytes
+    int32_t  writer_pid;
+    std::atomic<uint32_t> state;        // ShmState
+
+    alignas(64) std::atomic<uint64_t> head;     // end of the last published record
+    std::atomic<uint64_t> reserve;      // end of the record being written
+    std::atomic<uint64_t> tail;         // start of the oldest record still intact
+    std::atomic<uint32_t> wake;         // futex word, bumped after each batch
+    std::atomic<uint32_t> waiters;
+
+    /* decoder counters of the writer, stored before the wake() that publishes
+     * the frames they count: a reader that has seen a frame sees them current */
+    alignas(64) std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> bytes_in;
+    std::atomic<uint64_t> crc_errors;
+    std::atomic<uint64_t> bad_headers;
+    std::atomic<uint64_t> skipped_bytes;
+    std::atomic<uint64_t> reconnects;
+
+    ShmReaderSlot reader[SHM_MAX_READERS];
+};
+
+/* ==== WRITER ==== */
+class ShmWriter {
+public:
+    ShmWriter() = default;
+    ~ShmWriter() { close(); }
+    ShmWriter(const ShmWriter &) = delete;
+    ShmWriter &operator=(const ShmWriter &) = delete;
+
+    /* Create (or replace) /dev/shm/<name>; capacity rounded up to a power of two */
+    bool create(const std::string &name, size_t capacity = SHM_DEFAULT_CAPACITY);
+    /* Append one frame; readers see it after the next wake() */
+    void publish(const uint8_t *frame, size_t len);
+    /* Make everything published so far visible and wake sleeping readers */
+    void wake();
+    void set_state(ShmState s);
+    /* Free the slots of readers that exited without detaching */
+    unsigned reap_readers();
+    /* Mark stopped, wake readers and remove the name */
+    void close();
+
+    ShmHeader *header() const { return hdr_; }
+
+private:
+    ShmHeader *hdr_ = nullptr;
+    uint8_t *data_ = nullptr;
+    size_t map_len_ = 0;
+    uint64_t pos_ = 0;                  // writer's own head
+    uint64_t tail_ = 0;
+    std::string name_;
+};
+
+/* ==== READER ==== */
+class ShmReader {
+public:
+    ShmReader() = default;
+    ~ShmReader() { close(); }
+    ShmReader(const ShmReader &) = delete;
+    ShmReader &operator=(const ShmReader &) = delete;
+
+    /* Attach and take a slot; from_oldest starts at the oldest frame still
+     * in the ring instead of the live head */
+    bool open(const std::string &name, bool from_oldest = false);
+    /* Copy whole frames, back to back as on the wire, into buf (at least
+     * TLM_MAX_FRAME bytes); returns the bytes copied, 0 if none are ready.
+     * The copy can be walked with tlm::FrameRange. */
+    size_t read(uint8_t *buf, size_t cap);
+    /* Sleep until frames are published, the writer stops or timeout_ms ends */
+    void wait(int timeout_ms);
+    /* Published bytes not yet read */
+    uint64_t lag() const;
+    bool writer_stopped() const;
+    void close();
+
+    const ShmReaderSlot &slot() const { return *slot_; }
+    ShmHeader *header() const { return hdr_; }
+
+private:
+    ShmHeader *hdr_ = nullptr;
+    const uint8_t *data_ = nullptr;
+    size_t map_len_ = 0;
+    ShmReaderSlot *slot_ = nullptr;
+    uint64_t pos_ = 0;
+};
+
+} // namespace tlm
+
+#endif /* __TLM_SHM_HPP__ */
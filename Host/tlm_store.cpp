@@ -0,0 +1,137 @@
+/**
+ * @file tlm_store.cpp
+ * @brief Column capture files (tlm_col.hpp): convert, list, query
+ *
+ *   -w OUT   decode a raw capture (file, tty or stdin) into a column file;
+ *            times are the device ts (unwrapped) in us, the source is -s or
+ *            the input name
+ *   -i       list the streams of a column file
+ *   default  print rows as CSV, from -t seconds after the start of the file
+ *            (or -T absolute us), -n rows, only channel -c
+ *
+ * Usage: tlm_store -w OUT.tlmc [-s serial] [capture]
+ *        tlm_store -i FILE.tlmc
+ *        tlm_store [-c chan] [-t s | -T us] [-n rows] FILE.tlmc
+ *   cat /dev/ttyACM0 | tlm_store -w day.tlmc -s 0031003A3532
+ *   tlm_store -c 2 -t 3600 -n 10 day.tlmc
+ */
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+#include "tlm_col.hpp"
+
+static int convert(const char *out, const char *in, const char *serial)
+{
+    int fd = in ? open(in, O_RDONLY) : 0;
+    if (fd < 0) {
+        perror(in);
+        return 1;
+    }
+    tlm::ColumnWriter w;
+    if (!w.open(out)) {
+        perror(out);
+        return 1;
+    }
+    uint16_t src = w.source(serial ? serial : in ? in : "stdin");
+
+    tlm::Reader rd;
+    tlm::DeltaDecoder delta;
+    uint64_t bytes = 0;
+    uint32_t last_ts = 0;
+    int64_t ts_ext = 0;
+    bool first = true;
+    long n;
+    while ((n = rd.fill(fd)) > 0) {
+        bytes += (uint64_t)n;
+        for (const tlm::Frame &wire : rd.frames()) {
+            std::optional<tlm::Frame> f = delta.expand(wire);
+            if (!f) continue;
+            ts_ext = first ? f->ts : ts_ext + (int32_t)(f->ts - last_ts);
+            first = false;
+            last_ts = f->ts;
+            w.add(src, *f, ts_ext * 1000);
+        }
+    }
+    rd.consume();
+    tlm::ColumnStats st = w.stats();
+    if (!w.close()) {
+        perror(out);
+        return 1;
+    }
+    fprintf(stderr, "%" PRIu64 " bytes in, %" PRIu64 " frames, %" PRIu64 " rows in %" PRIu64 " chunks, %" PRIu64
+            " bytes out (%.1f%%), %" PRIu64 " crc errors\n", bytes, st.frames, st.rows, st.chunks, st.bytes,
+            bytes ? 100.0 * (double)st.bytes / (double)bytes : 0.0, rd.stats().crc_errors);
+    return 0;
+}
+
+static int list(const tlm::ColumnReader &r)
+{
+    printf("%s%" PRId64 " .. %" PRId64 " us\n", r.recovered() ? "(no footer, index rebuilt) " : "", r.t_first(),
+           r.t_last());
+    for (size_t i = 0; i < r.streams(); i++) {
+        const tlm::ColumnStream &s = r.stream(i);
+        printf("%3zu %-14s %-10s %10" PRIu64 " rows %7" PRIu64 " chunks %" PRId64 " .. %" PRId64 "\n", i,
+               s.source.c_str(), s.schema ? s.schema->name : "?", s.rows, s.chunks, s.t_first, s.t_last);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *out = nullptr, *serial = nullptr;
+    int info = 0, chan = -1, opt;
+    double from_s = 0;
+    int64_t from_us = INT64_MIN;
+    long rows = -1;
+
+    while ((opt = getopt(argc, argv, "w:s:ic:t:T:n:")) != -1) {
+        switch (opt) {
+        case 'w': out = optarg; break;
+        case 's': serial = optarg; break;
+        case 'i': info = 1; break;
+        case 'c': chan = (int)strtol(optarg, nullptr, 0); break;
+        case 't': from_s = atof(optarg); break;
+        case 'T': from_us = strtoll(optarg, nullptr, 0); break;
+        case 'n': rows = atol(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s -w OUT.tlmc [-s serial] [capture] | -i FILE | [-c chan] [-t s | -T us] "
+                    "[-n rows] FILE\n", argv[0]);
+            return 2;
+        }
+    }
+    if (out) return convert(out, optind < argc ? argv[optind] : nullptr, serial);
+    if (optind + 1 != argc) {
+        fprintf(stderr, "usage: %s -w OUT.tlmc [-s serial] [capture] | -i FILE | [-c chan] [-t s | -T us] "
+                "[-n rows] FILE\n", argv[0]);
+        return 2;
+    }
+
+    tlm::ColumnReader r;
+    if (!r.open(argv[optind])) {
+        fprintf(stderr, "%s: not a column file\n", argv[optind]);
+        return 1;
+    }
+    if (info) return list(r);
+
+    int64_t t = from_us != INT64_MIN ? from_us : r.t_first() + (int64_t)(from_s * 1e6);
+    printf("source,chan,time_us,seq,values\n");
+    for (size_t i = 0; i < r.streams(); i++) {
+        const tlm::ColumnStream &s = r.stream(i);
+        if (!s.schema || (chan >= 0 && s.schema->chan != chan)) continue;
+        tlm::ColumnCursor cur = r.seek(i, t);
+        tlm::Row row;
+        for (long n = 0; (rows < 0 || n < rows) && cur.next(row); n++) {
+            printf("%s,%s,%" PRId64 ",%u", s.source.c_str(), s.schema->name, row.time_us, row.seq);
+            for (unsigned c = 0; c < s.schema->columns; c++)
+                printf(",%" PRId64, row.v[c]);
+            printf("\n");
+        }
+    }
+    return 0;
+}
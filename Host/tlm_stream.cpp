@@ -0,0 +1,203 @@
+/**
+ * @file tlm_stream.cpp
+ * @brief Frame scanner, read buffer and sequence accounting
+ *
+ * The scanner makes the same decisions as TLM_DecoderProcess() in
+ * telemetry.c, byte for byte, so both report the same frames and the same
+ * error counts for any input; it only avoids the per-frame copy and finds
+ * the next sync candidate with memchr and checks the CRC eight bytes at a
+ * time.
+ */
+
+#include "tlm_stream.hpp"
+
+#include <cstring>
+#include <unistd.h>
+
+namespace tlm {
+
+/* ==== CRC ==== */
+/* CRC-16/CCITT-FALSE eight bytes per step (slicing-by-8): crc_tab[k][v] is
+ * the CRC of byte v followed by k zero bytes; crc_tab[0] is the table of
+ * TLM_CRC16() */
+static uint16_t crc_tab[8][256];
+
+static struct CrcInit {
+    CrcInit()
+    {
+        for (unsigned v = 0; v < 256; v++) {
+            uint8_t b = (uint8_t)v;
+            crc_tab[0][v] = TLM_CRC16(0, &b, 1);
+        }
+        for (unsigned k = 1; k < 8; k++)
+            for (unsigned v = 0; v < 256; v++) {
+                uint16_t c = crc_tab[k - 1][v];
+                crc_tab[k][v] = (uint16_t)((c << 8) ^ crc_tab[0][c >> 8]);
+            }
+    }
+} crc_init;
+
+static uint16_t crc16(uint16_t crc, const uint8_t *p, size_t len)
+{
+    for (; len >= 8; len -= 8, p += 8) {
+        unsigned x = crc ^ ((unsigned)p[0] << 8 | p[1]);
+        crc = (uint16_t)(crc_tab[7][x >> 8] ^ crc_tab[6][x & 0xFF] ^ crc_tab[5][p[2]] ^ crc_tab[4][p[3]] ^
+                         crc_tab[3][p[4]] ^ crc_tab[2][p[5]] ^ crc_tab[1][p[6]] ^ crc_tab[0][p[7]]);
+    }
+    while (len--)
+        crc = (uint16_t)((crc << 8) ^ crc_tab[0][(uint8_t)((crc >> 8) ^ *p++)]);
+    return crc;
+}
+
+/* ==== SCANNER ==== */
+
+/* Drop the byte at pos_ and everything up to the next possible sync byte */
+void FrameRange::skip()
+{
+    const uint8_t *p = data_ + pos_;
+    const void *q = std::memchr(p + 1, TLM_SYNC0, len_ - pos_ - 1);
+    size_t n = q ? (size_t)((const uint8_t *)q - p) : len_ - pos_;
+    stats_.skipped_bytes += n;
+    pos_ += n;
+}
+
+bool FrameRange::next(Frame &f)
+{
+    while (pos_ < len_) {
+        const uint8_t *p = data_ + pos_;
+        size_t avail = len_ - pos_;
+
+        if (p[0] != TLM_SYNC0) {
+            skip();
+            continue;
+        }
+        if (avail < 2) return false;
+        if (p[1] != TLM_SYNC1) {
+            skip();
+            continue;
+        }
+        if (avail < TLM_HEADER_SIZE) return false;
+
+        uint16_t len = TLM_GetU16(p + 10);
+        if (p[2] != TLM_VERSION || len > TLM_MAX_PAYLOAD) {
+            stats_.bad_headers++;
+            skip();
+            continue;
+        }
+
+        size_t total = TLM_OVERHEAD + len;
+        if (avail < total) return false;
+
+        uint16_t crc = crc16(0xFFFF, p + 2, TLM_HEADER_SIZE - 2U + len);
+        if (crc != TLM_GetU16(p + TLM_HEADER_SIZE + len)) {
+            stats_.crc_errors++;
+            skip();
+            continue;
+        }
+
+        f.raw = p;
+        f.payload = p + TLM_HEADER_SIZE;
+        f.chan = p[3];
+        f.seq = TLM_GetU16(p + 4);
+        f.ts = TLM_GetU32(p + 6);
+        f.len = len;
+        stats_.frames++;
+        pos_ += total;
+        return true;
+    }
+    return false;
+}
+
+/* ==== READ BUFFER ==== */
+
+Reader::Reader(size_t capacity) : buf_(capacity < 2U * TLM_MAX_FRAME ? 2U * TLM_MAX_FRAME : capacity) {}
+
+long Reader::fill(int fd)
+{
+    consume();
+    ssize_t n = ::read(fd, buf_.data() + len_, buf_.size() - len_);
+    if (n > 0) len_ += (size_t)n;
+    return (long)n;
+}
+
+size_t Reader::append(const uint8_t *data, size_t len)
+{
+    consume();
+    size_t n = buf_.size() - len_;
+    if (n > len) n = len;
+    std::memcpy(buf_.data() + len_, data, n);
+    len_ += n;
+    return n;
+}
+
+FrameRange &Reader::frames()
+{
+    consume();
+    range_.emplace(buf_.data(), len_);
+    return *range_;
+}
+
+void Reader::consume()
+{
+    if (!range_) return;
+    const ScanStats &st = range_->stats();
+    stats_.frames += st.frames;
+    stats_.crc_errors += st.crc_errors;
+    stats_.bad_headers += st.bad_headers;
+    stats_.skipped_bytes += st.skipped_bytes;
+
+    /* at most one incomplete frame is left: a short move */
+    size_t done = range_->consumed();
+    std::memmove(buf_.data(), buf_.data() + done, len_ - done);
+    len_ -= done;
+    range_.reset();
+}
+
+/* ==== SEQUENCE ACCOUNTING ==== */
+
+/* Same rules as TLM_DecoderTrackSeq(); the first frame only sets the expectation */
+void SeqTracker::track(const Frame &f)
+{
+    uint8_t chan = f.chan & (uint8_t)~TLM_CHAN_DELTA;
+    if (chan >= TLM_CHAN_COUNT) return;
+    TLM_SeqStatsTypeDef *st = &chan_[chan];
+    uint16_t delta = (uint16_t)(f.seq - st->next_seq);
+
+    if (st->synced && delta != 0U) {
+        if (delta < 0x8000U) {
+            st->lost += delta;
+            st->gaps++;
+        } else if ((uint16_t)-delta <= TLM_SEQ_MAX_MISORDER) {
+            st->reordered++;
+            st->frames++;
+            return;
+        } else {
+            st->resyncs++;
+        }
+    }
+    st->next_seq = (uint16_t)(f.seq + 1U);
+    st->synced = 1;
+    st->frames++;
+}
+
+/* ==== DELTA FRAMES ==== */
+
+void DeltaDecoder::reset()
+{
+    for (TLM_DeltaTypeDef &r : dec_.chan)
+        TLM_DeltaReset(&r);
+}
+
+std::optional<Frame> DeltaDecoder::expand(const Frame &f)
+{
+    TLM_FrameTypeDef x = { TLM_VERSION, f.chan, f.seq, f.ts, f.len, f.payload };
+    if (!TLM_DeltaExpand(&dec_, &x)) return std::nullopt;
+    if (!(f.chan & TLM_CHAN_DELTA)) return f;
+
+    TLM_WriteHeader(frame_, x.chan, x.seq, x.ts, x.len);
+    std::memcpy(frame_ + TLM_HEADER_SIZE, x.payload, x.len);
+    TLM_Seal(frame_);
+    return Frame{ frame_, frame_ + TLM_HEADER_SIZE, x.chan, x.seq, x.ts, x.len };
+}
+
+} // namespace tlm
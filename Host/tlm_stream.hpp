@@ -0,0 +1,339 @@
+/**
+ * @file tlm_stream.hpp
+ * @brief Host C++ telemetry decoder: zero-copy frame and record iteration
+ * @version 1.0
+ * @date 2025-10
+ *
+ * Same framing rules as the reference decoder in telemetry.c (sync hunt,
+ * version/length check, CRC, resync one byte past a bad candidate), but the
+ * frames are not copied out of the caller's buffer: a FrameRange walks a
+ * large read buffer and yields Frame views pointing into it, and the typed
+ * record views below read their fields straight from the payload.
+ *
+ *   tlm::Reader rd;
+ *   while (rd.fill(fd) > 0) {
+ *       for (const tlm::Frame &f : rd.frames())
+ *           if (auto p = tlm::as<tlm::Prox>(f)) use(p->als, p->ps);
+ *       rd.consume();           // keeps only the incomplete tail
+ *   }
+ *
+ * Views are valid until the buffer they point into is refilled. A
+ * FrameRange is a single pass: its statistics and consumed() count follow
+ * the iteration.
+ *
+ * Delta coded sensor frames (TLM_CHAN_DELTA) are yielded as they came;
+ * tools that read records pass every frame of a stream through a
+ * DeltaDecoder first.
+ */
+
+#ifndef __TLM_STREAM_HPP__
+#define __TLM_STREAM_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <vector>
+
+#include "telemetry.h"
+
+namespace tlm {
+
+/* ==== FRAMES ==== */
+struct Frame {
+    const uint8_t *raw;         // sync byte of the frame in the read buffer
+    const uint8_t *payload;
+    uint8_t  chan;
+    uint16_t seq;
+    uint32_t ts;
+    uint16_t len;               // payload bytes
+
+    size_t size() const { return TLM_OVERHEAD + len; }
+};
+
+struct ScanStats {
+    uint64_t frames;
+    uint64_t crc_errors;
+    uint64_t bad_headers;       // wrong version or oversize length
+    uint64_t skipped_bytes;     // discarded while hunting for sync
+};
+
+class FrameRange {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Frame;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Frame *;
+        using reference = const Frame &;
+
+        iterator() = default;
+        reference operator*() const { return frame_; }
+        pointer operator->() const { return &frame_; }
+        iterator &operator++()
+        {
+            if (!range_->next(frame_)) range_ = nullptr;
+            return *this;
+        }
+        bool operator==(const iterator &o) const { return range_ == o.range_; }
+        bool operator!=(const iterator &o) const { return range_ != o.range_; }
+
+    private:
+        friend class FrameRange;
+        explicit iterator(FrameRange *range) : range_(range) { ++*this; }
+        FrameRange *range_ = nullptr;
+        Frame frame_{};
+    };
+
+    FrameRange(const uint8_t *data, size_t len) : data_(data), len_(len) {}
+
+    iterator begin() { return iterator(this); }
+    iterator end() { return iterator(); }
+
+    /* Next valid frame, false once only an incomplete frame (or nothing) is left */
+    bool next(Frame &f);
+    /* Bytes scanned so far; the rest is an incomplete frame to keep */
+    size_t consumed() const { return pos_; }
+    const ScanStats &stats() const { return stats_; }
+
+private:
+    void skip();
+
+    const uint8_t *data_;
+    size_t len_;
+    size_t pos_ = 0;
+    ScanStats stats_{};
+};
+
+/* ==== READ BUFFER ==== */
+class Reader {
+public:
+    explicit Reader(size_t capacity = 1U << 20);
+
+    /* read() once into the free space: bytes read, 0 at EOF, -1 on error */
+    long fill(int fd);
+    /* Append bytes from memory (captures, tests); returns how many fit */
+    size_t append(const uint8_t *data, size_t len);
+    /* Frames in the buffered bytes not yet consumed */
+    FrameRange &frames();
+    /* Drop what the last frames() pass consumed, keep the incomplete tail
+     * and add the pass to stats() */
+    void consume();
+
+    size_t buffered() const { return len_; }
+    const ScanStats &stats() const { return stats_; }
+
+private:
+    std::vector<uint8_t> buf_;
+    size_t len_ = 0;
+    ScanStats stats_{};
+    std::optional<FrameRange> range_;
+};
+
+/* ==== SEQUENCE ACCOUNTING ==== */
+/* Per-channel gaps, late frames and restarts, as TLM_DecoderTypeDef.chan[] */
+class SeqTracker {
+public:
+    void track(const Frame &f);
+    const TLM_SeqStatsTypeDef &chan(uint8_t c) const { return chan_[c & (TLM_CHAN_COUNT - 1U)]; }
+
+private:
+    TLM_SeqStatsTypeDef chan_[TLM_CHAN_COUNT]{};
+};
+
+/* ==== DELTA FRAMES ==== */
+/* TLM_DeltaExpand() on Frame views, one per stream and in stream order.
+ * A delta frame comes back as the plain frame the device would otherwise
+ * have sent (header, record and CRC rebuilt), so raw and size() stay
+ * usable; that view is valid until the next expand() */
+class DeltaDecoder {
+public:
+    DeltaDecoder() { TLM_DeltaDecoderInit(&dec_); }
+    /* Forget the references (port reopened), counters are kept */
+    void reset();
+    /* Plain frames as they are, delta frames expanded; nullopt: drop it */
+    std::optional<Frame> expand(const Frame &f);
+    const TLM_DeltaDecoderTypeDef &stats() const { return dec_; }
+
+private:
+    TLM_DeltaDecoderTypeDef dec_;
+    uint8_t frame_[TLM_OVERHEAD + TLM_DELTA_MAX_RECORD];
+};
+
+/* ==== TYPED RECORDS ==== */
+/* Fixed layout records: R::chan, R::size (minimum payload) and R::read() */
+template <class R>
+std::optional<R> as(const Frame &f)
+{
+    if (f.chan != R::chan || f.len < R::size) return std::nullopt;
+    return R::read(f.payload);
+}
+
+inline int16_t get_i16(const uint8_t *p) { return (int16_t)TLM_GetU16(p); }
+inline int32_t get_i32(const uint8_t *p) { return (int32_t)TLM_GetU32(p); }
+
+struct Prox {
+    static constexpr uint8_t chan = TLM_CHAN_PROX;
+    static constexpr uint16_t size = 4;
+    uint16_t als, ps;
+    static Prox read(const uint8_t *p) { return { TLM_GetU16(p), TLM_GetU16(p + 2) }; }
+};
+
+struct AudioLevel {
+    static constexpr uint8_t chan = TLM_CHAN_AUDIO_LVL;
+    static constexpr uint16_t size = 4;
+    int32_t sample;
+    static AudioLevel read(const uint8_t *p) { return { get_i32(p) }; }
+};
+
+struct Gas {
+    static constexpr uint8_t chan = TLM_CHAN_GAS;
+    static constexpr uint16_t size = 5;
+    uint8_t aqi;
+    uint16_t tvoc, eco2;
+    static Gas read(const uint8_t *p) { return { p[0], TLM_GetU16(p + 1), TLM_GetU16(p + 3) }; }
+};
+
+struct Link {
+    static constexpr uint8_t chan = TLM_CHAN_LINK;
+    static constexpr uint16_t size = 9;
+    uint8_t line_state;
+    uint32_t down_ms, audio_skipped;
+    static Link read(const uint8_t *p) { return { p[0], TLM_GetU32(p + 1), TLM_GetU32(p + 5) }; }
+};
+
+struct Flow {
+    static constexpr uint8_t chan = TLM_CHAN_FLOW;
+    static constexpr uint16_t size = TLM_FLOW_SIZE;
+    uint8_t level, prev, reason, audio_decim, feature_div;
+    uint16_t queue_bytes;
+    uint32_t device_dropped;
+    static Flow read(const uint8_t *p)
+    {
+        return { p[0], p[1], p[2], p[3], p[4], TLM_GetU16(p + 5), TLM_GetU32(p + 7) };
+    }
+};
+
+struct AudioClock {
+    static constexpr uint8_t chan = TLM_CHAN_AUDIO_CLK;
+    static constexpr uint16_t size = TLM_AUDIO_CLK_SIZE;
+    uint32_t nominal_hz;
+    uint32_t rate_mhz;          // in USB SOF (host) time, 0 while the loop is not locked
+    static AudioClock read(const uint8_t *p) { return { TLM_GetU32(p), TLM_GetU32(p + 4) }; }
+};
+
+struct CmdRsp {
+    static constexpr uint8_t chan = TLM_CHAN_CMD_RSP;
+    static constexpr uint16_t size = TLM_CMD_RSP_SIZE;
+    uint16_t id;
+    uint8_t op, status;
+    static CmdRsp read(const uint8_t *p) { return { TLM_GetU16(p), p[2], p[3] }; }
+};
+
+/* Response to TLM_CMD_TIME_SYNC; check op and status with CmdRsp first */
+struct TimeSync {
+    static constexpr uint8_t chan = TLM_CHAN_CMD_RSP;
+    static constexpr uint16_t size = TLM_CMD_RSP_SIZE + TLM_TIME_SYNC_SIZE;
+    uint16_t id;
+    uint32_t tick_ms;
+    uint32_t micros;            // scheduler timebase, read right after the tick
+    static TimeSync read(const uint8_t *p) { return { TLM_GetU16(p), TLM_GetU32(p + 4), TLM_GetU32(p + 8) }; }
+};
+
+struct Bench {
+    static constexpr uint8_t chan = TLM_CHAN_BENCH;
+    static constexpr uint16_t size = 4;
+    uint32_t counter;
+    static Bench read(const uint8_t *p) { return { TLM_GetU32(p) }; }
+};
+
+/* Repeated entries: E::size bytes each, E::read() gives the value */
+template <class E>
+class Array {
+public:
+    using value_type = decltype(E::read(nullptr));     // unevaluated
+
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Array::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        explicit iterator(const uint8_t *p = nullptr) : p_(p) {}
+        value_type operator*() const { return E::read(p_); }
+        value_type operator[](difference_type i) const { return E::read(p_ + i * E::size); }
+        iterator &operator++() { p_ += E::size; return *this; }
+        iterator operator++(int) { iterator t = *this; p_ += E::size; return t; }
+        iterator &operator+=(difference_type n) { p_ += n * E::size; return *this; }
+        iterator operator+(difference_type n) const { return iterator(p_ + n * E::size); }
+        difference_type operator-(const iterator &o) const { return (p_ - o.p_) / E::size; }
+        bool operator==(const iterator &o) const { return p_ == o.p_; }
+        bool operator!=(const iterator &o) const { return p_ != o.p_; }
+
+    private:
+        const uint8_t *p_;
+    };
+
+    Array(const uint8_t *p, uint16_t len) : p_(p), n_(len / E::size) {}
+    size_t size() const { return n_; }
+    value_type operator[](size_t i) const { return E::read(p_ + i * E::size); }
+    iterator begin() const { return iterator(p_); }
+    iterator end() const { return iterator(p_ + n_ * E::size); }
+
+private:
+    const uint8_t *p_;
+    size_t n_;
+};
+
+/* Variable length records: E::chan; empty for another channel, a trailing
+ * partial entry is ignored */
+template <class E>
+Array<E> array(const Frame &f)
+{
+    return Array<E>(f.payload, f.chan == E::chan ? f.len : 0);
+}
+
+struct Audio {
+    static constexpr uint8_t chan = TLM_CHAN_AUDIO;
+    static constexpr uint16_t size = 3;
+    static int32_t read(const uint8_t *p) { return TLM_GetS24(p); }
+};
+
+struct HumTemp {
+    static constexpr uint8_t chan = TLM_CHAN_HUMTEMP;
+    static constexpr uint16_t size = 4;
+    int16_t centi_c;
+    uint16_t centi_rh;
+    static HumTemp read(const uint8_t *p) { return { get_i16(p), TLM_GetU16(p + 2) }; }
+};
+
+struct SchedJob {
+    static constexpr uint8_t chan = TLM_CHAN_SCHED;
+    static constexpr uint16_t size = TLM_SCHED_JOB_SIZE;
+    uint8_t id;
+    uint32_t runs, overruns, lat_min_us, lat_max_us, lat_avg_us, exec_max_us;
+    static SchedJob read(const uint8_t *p)
+    {
+        return { p[0], TLM_GetU32(p + 1), TLM_GetU32(p + 5), TLM_GetU32(p + 9),
+                 TLM_GetU32(p + 13), TLM_GetU32(p + 17), TLM_GetU32(p + 21) };
+    }
+};
+
+struct Loss {
+    static constexpr uint8_t chan = TLM_CHAN_LOSS;
+    static constexpr uint16_t size = TLM_LOSS_ENTRY_SIZE;
+    uint8_t lost_chan;
+    uint16_t next_seq;
+    uint32_t device_dropped;
+    static Loss read(const uint8_t *p)
+    {
+        return { (uint8_t)(p[0] & (TLM_CHAN_COUNT - 1U)), TLM_GetU16(p + 1), TLM_GetU32(p + 3) };
+    }
+};
+
+} // namespace tlm
+
+#endif /* __TLM_STREAM_HPP__ */
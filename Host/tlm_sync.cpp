@@ -0,0 +1,119 @@
+/**
+ * @file tlm_sync.cpp
+ * @brief Clock sync: timebase unwrapping, tick phase and the offset/skew fit
+ */
+
+#include "tlm_sync.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace tlm {
+
+void ClockSync::reset()
+{
+    uint64_t restarts = stats_.restarts;
+    *this = ClockSync();
+    stats_.restarts = restarts;
+}
+
+void ClockSync::add(uint64_t sent_us, uint64_t recv_us, uint32_t tick_ms, uint32_t micros)
+{
+    if (recv_us < sent_us) return;
+
+    if (have_) {
+        int64_t dt = (int32_t)(tick_ms - last_tick_);
+        int64_t du = (int32_t)(micros - last_micros_);
+        bool gap = (int64_t)(recv_us - last_recv_) > SYNC_MAX_GAP_US;
+        if (gap || dt < 0 || du < 0 || std::llabs(du - dt * 1000) > SYNC_JUMP_US) {
+            if (!gap) stats_.restarts++;
+            reset();
+        } else {
+            tick_ext_ += dt;
+            micros_ext_ += du;
+        }
+    }
+    const int64_t mid = (int64_t)(sent_us + (recv_us - sent_us) / 2);
+    if (!have_) {
+        have_ = true;
+        tick_ext_ = tick_ms;
+        micros_ext_ = micros;
+        phase_ = micros_ext_ - tick_ext_ * 1000;
+        base_ = mid - micros_ext_;
+    }
+    last_tick_ = tick_ms;
+    last_micros_ = micros;
+    last_recv_ = recv_us;
+    phase_ = std::min(phase_, micros_ext_ - tick_ext_ * 1000);
+
+    win_.push_back({ micros_ext_, mid - micros_ext_ - base_, (int64_t)(recv_us - sent_us) });
+    if (win_.size() > SYNC_WINDOW) win_.pop_front();
+    stats_.samples++;
+    fit();
+}
+
+/* Least squares of (host midpoint - timebase) on the timebase over the
+ * faster half of the window; the newest sample is the origin so the
+ * offset is current and the numbers stay small */
+void ClockSync::fit()
+{
+    std::vector<const Sample *> v;
+    for (const Sample &s : win_)
+        v.push_back(&s);
+    std::sort(v.begin(), v.end(), [](const Sample *a, const Sample *b) { return a->rtt < b->rtt; });
+    v.resize((v.size() + 1) / 2);
+
+    ref_ = win_.back().dev;
+    double lo = INFINITY, hi = -INFINITY, sx = 0, sy = 0;
+    for (const Sample *s : v) {
+        double x = (double)(s->dev - ref_);
+        lo = std::min(lo, x);
+        hi = std::max(hi, x);
+        sx += x;
+        sy += (double)s->y;
+    }
+    const double n = (double)v.size(), mx = sx / n, my = sy / n;
+    if (v.size() >= 3 && hi - lo >= SYNC_MIN_SPAN_S * 1e6) {
+        double sxx = 0, sxy = 0;
+        for (const Sample *s : v) {
+            double dx = (double)(s->dev - ref_) - mx;
+            sxx += dx * dx;
+            sxy += dx * ((double)s->y - my);
+        }
+        skew_ = sxy / sxx;
+    }
+    off_ = my - skew_ * mx;
+
+    double ss = 0;
+    for (const Sample *s : v) {
+        double r = (double)s->y - (off_ + skew_ * (double)(s->dev - ref_));
+        ss += r * r;
+    }
+    stats_.locked = stats_.samples >= SYNC_LOCK_SAMPLES;
+    stats_.offset_us = (double)base_ + off_;
+    stats_.skew_ppm = (1.0 / (1.0 + skew_) - 1.0) * 1e6;
+    stats_.rtt_min_us = (double)v.front()->rtt;
+    stats_.residual_us = std::sqrt(ss / n);
+}
+
+uint64_t ClockSync::map(int64_t dev) const
+{
+    double t = (double)(dev + base_) + off_ + skew_ * (double)(dev - ref_);
+    return t > 0 ? (uint64_t)std::llround(t) : 0;
+}
+
+uint64_t ClockSync::host_us(uint32_t tick_ms) const
+{
+    int64_t tick = tick_ext_ + (int32_t)(tick_ms - last_tick_);
+    return map(tick * 1000 + phase_ + 500);
+}
+
+uint64_t ClockSync::next_request(uint64_t sent_us, uint64_t n, unsigned period_ms)
+{
+    if (n < SYNC_FAST_SAMPLES)
+        return sent_us + SYNC_FAST_PERIOD_MS * 1000U + (n * 618U) % 1000U;
+    return sent_us + (uint64_t)period_ms * 1000U;
+}
+
+} // namespace tlm
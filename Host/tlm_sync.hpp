@@ -0,0 +1,101 @@
+/**
+ * @file tlm_sync.hpp
+ * @brief Device clock to host CLOCK_MONOTONIC: round-trip samples, offset and skew fit
+ * @version 1.0
+ * @date 2025-10
+ *
+ * Frame timestamps count HAL ticks since the board booted: whole ms, an
+ * unknown origin and a crystal a few tens of ppm off. Placing a record on
+ * the host clock from its arrival alone is only as good as the link
+ * latency, and that varies with the load of the transmit queue.
+ *
+ * TLM_CMD_TIME_SYNC answers with the tick and the 1 MHz scheduler timebase
+ * (TIM2) read back to back. Each round trip gives a sample: the timebase
+ * value was read somewhere between the host's send and receive times.
+ * ClockSync keeps the last SYNC_WINDOW samples, fits host time against the
+ * timebase through the midpoints of the faster half of the round trips
+ * (slow ones waited behind telemetry in the transmit queue) and so tracks
+ * offset and skew. The tick edges sit at a fixed timebase phase (one
+ * crystal feeds both), found as the smallest (us - ms * 1000) seen; a tick
+ * timestamp is then placed in the middle of its ms.
+ *
+ *   tlm::ClockSync sync;
+ *   sync.add(sent_us, recv_us, rsp.tick_ms, rsp.micros);   // per response
+ *   if (sync.locked()) t = sync.host_us(frame.ts);
+ *
+ * A device restart (tick or timebase going back, or the two disagreeing)
+ * drops the samples and starts over. Asymmetric link delays shift every
+ * board of a kind alike, so boards line up with each other better than with
+ * the host clock.
+ */
+
+#ifndef __TLM_SYNC_HPP__
+#define __TLM_SYNC_HPP__
+
+#include <cstdint>
+#include <deque>
+
+namespace tlm {
+
+constexpr unsigned SYNC_WINDOW = 256;               // samples kept for the fit, about 4 min
+constexpr unsigned SYNC_DEFAULT_PERIOD_MS = 1000;
+constexpr unsigned SYNC_FAST_SAMPLES = 32;          // sent SYNC_FAST_PERIOD_MS apart after a (re)start
+constexpr unsigned SYNC_FAST_PERIOD_MS = 50;
+constexpr unsigned SYNC_LOCK_SAMPLES = SYNC_FAST_SAMPLES;   // tick edge to about 1000 / 32 us
+constexpr double SYNC_MIN_SPAN_S = 2.0;             // shorter baseline: offset only, skew kept
+constexpr int64_t SYNC_MAX_GAP_US = 30LL * 60 * 1000000;   // the timebase wraps in 71 min
+constexpr int64_t SYNC_JUMP_US = 5000;              // tick and timebase disagree by more: restart
+
+struct SyncStats {
+    uint64_t samples;           // responses taken since the last (re)start
+    uint64_t restarts;          // device clock went back or jumped between samples
+    bool locked;
+    double offset_us;           // host - device timebase at the newest sample
+    double skew_ppm;            // device crystal fast (+) against the host
+    double rtt_min_us;          // best round trip in the window
+    double residual_us;         // rms of the fitted samples around the line
+};
+
+class ClockSync {
+public:
+    /* Drop the samples (port reopened, board restarted); restarts is kept */
+    void reset();
+    /* One round trip on the host clock and the response's tick and timebase */
+    void add(uint64_t sent_us, uint64_t recv_us, uint32_t tick_ms, uint32_t micros);
+
+    bool locked() const { return stats_.locked; }
+    /* Host time of a tick timestamp near the samples (within +-24 days) */
+    uint64_t host_us(uint32_t tick_ms) const;
+    const SyncStats &stats() const { return stats_; }
+
+    /* When the next request is due after request n (counted from 0 at a
+     * start) went out at sent_us; the fast ones step through the ms so the
+     * tick edge is found quickly */
+    static uint64_t next_request(uint64_t sent_us, uint64_t n, unsigned period_ms = SYNC_DEFAULT_PERIOD_MS);
+
+private:
+    struct Sample {
+        int64_t dev;            // unwrapped timebase us
+        int64_t y;              // host midpoint - dev - base_
+        int64_t rtt;
+    };
+
+    void fit();
+    uint64_t map(int64_t dev) const;
+
+    std::deque<Sample> win_;
+    bool have_ = false;
+    uint32_t last_tick_ = 0, last_micros_ = 0;
+    int64_t tick_ext_ = 0, micros_ext_ = 0;
+    uint64_t last_recv_ = 0;
+    int64_t phase_ = 0;         // timebase us at tick 0 (unwrapped)
+    int64_t base_ = 0;          // host - device at the first sample
+    int64_t ref_ = 0;           // timebase us the fit is centred on
+    double off_ = 0;            // host - device - base_ at ref_
+    double skew_ = 0;
+    SyncStats stats_{};
+};
+
+} // namespace tlm
+
+#endif /* __TLM_SYNC_HPP__ */
@@ -0,0 +1,79 @@
+/**
+ * @file tlm_wav.cpp
+ * @brief Microphone stream of a capture to WAV or FLAC (tlm_audio.hpp)
+ *
+ * Reads a raw capture (file, tty or stdin) and writes the audio channel at
+ * the device's configured rate, resampled by the I2S rate the device
+ * measured against USB SOF, so the file is as long as the capture took.
+ * Lost packets and pauses become silence with a marker. The format follows
+ * the extension (.flac, otherwise WAV). Markers and counters go to stderr.
+ *
+ * Usage: tlm_wav [-r out Hz] [-s source Hz] [-g max gap s] [-q] OUT.wav|OUT.flac [capture]
+ *   tlm_wav mic.flac capture.bin
+ *   cat /dev/ttyACM0 | tlm_wav -g 5 mic.wav
+ */
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tlm_audio.hpp"
+
+int main(int argc, char **argv)
+{
+    int quiet = 0, opt;
+    tlm::AudioExport ex;
+
+    while ((opt = getopt(argc, argv, "r:s:g:q")) != -1) {
+        switch (opt) {
+        case 'r': ex.set_rate((unsigned)atoi(optarg)); break;
+        case 's': ex.set_source_rate(atof(optarg)); break;
+        case 'g': ex.set_max_gap(atof(optarg)); break;
+        case 'q': quiet = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-r out Hz] [-s source Hz] [-g max gap s] [-q] OUT.wav|OUT.flac [capture]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-r out Hz] [-s source Hz] [-g max gap s] [-q] OUT.wav|OUT.flac [capture]\n",
+                argv[0]);
+        return 2;
+    }
+    const char *out = argv[optind], *in = optind + 1 < argc ? argv[optind + 1] : nullptr;
+    int fd = in ? open(in, O_RDONLY) : 0;
+    if (fd < 0) {
+        perror(in);
+        return 1;
+    }
+    if (!ex.open(out)) {
+        perror(out);
+        return 1;
+    }
+
+    tlm::Reader rd;
+    while (rd.fill(fd) > 0) {
+        for (const tlm::Frame &f : rd.frames())
+            ex.add(f);
+        rd.consume();
+    }
+    if (!ex.close()) {
+        perror(out);
+        return 1;
+    }
+
+    const tlm::AudioExportStats &s = ex.stats();
+    if (!quiet)
+        for (const tlm::AudioMarker &m : ex.markers())
+            fprintf(stderr, "%12.3f s  %-28s %" PRIu64 " samples\n", (double)m.sample / ex.rate(), m.label.c_str(),
+                    m.samples);
+    fprintf(stderr, "%" PRIu64 " packets, %" PRIu64 " samples in, %" PRIu64 " out at %u Hz (%.3f s), source %.3f Hz "
+            "from %" PRIu64 " clock records\n", s.packets, s.samples_in, s.samples_out, ex.rate(),
+            (double)s.samples_out / ex.rate(), s.source_hz, s.clock_records);
+    fprintf(stderr, "%" PRIu64 " lost packets, %" PRIu64 " gaps (%" PRIu64 " samples of silence, %.1f s cut), %" PRIu64
+            " restarts\n", s.lost_packets, s.gaps, s.gap_samples, s.cut_s, s.restarts);
+    return 0;
+}
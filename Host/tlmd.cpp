@@ -0,0 +1,169 @@
+/**
+ * @file tlmd.cpp
+ * @brief Capture daemon: owns the device tty, publishes frames to shared memory
+ *
+ * Only one process can have /dev/ttyACM* open. tlmd opens it (raw, DTR
+ * raised so the device starts sending), decodes the stream with
+ * tlm::Reader and publishes every valid frame into the ring /dev/shm/<name>
+ * (tlm_shm.hpp), where any number of readers pick it up. Delta coded
+ * frames are published expanded, so readers only see plain records. It never waits for
+ * a reader. The decoder counters are kept in the ring header.
+ *
+ * When the device goes away (unplug, reset, pty closed) the port is reopened
+ * every 500 ms; readers see the ring state change and stay attached. SIGINT
+ * or SIGTERM stops the daemon and removes the ring.
+ *
+ * Usage: tlmd [-n name] [-s ring KiB] [-q] DEVICE
+ *   tlmd -n tlm /dev/ttyACM0
+ */
+
+#include <cerrno>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tlm_stream.hpp"
+#include "tlm_shm.hpp"
+
+static volatile sig_atomic_t stop;
+static int quiet;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static int open_tty(const char *path)
+{
+    struct termios tio;
+    int bits = TIOCM_DTR | TIOCM_RTS;
+
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) return -1;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    ioctl(fd, TIOCMBIS, &bits);     // opens the device side (DTR); not on a pty
+    return fd;
+}
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, nullptr);
+}
+
+/* Read and publish until the port fails or a signal arrives */
+static void pump(int fd, tlm::ShmWriter &ring)
+{
+    tlm::Reader rd(256U << 10);
+    tlm::DeltaDecoder delta;
+    tlm::ShmHeader *h = ring.header();
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    time_t last_reap = time(nullptr);
+    /* counters run on across reconnects */
+    const tlm::ScanStats base = { h->frames.load(), h->crc_errors.load(), h->bad_headers.load(),
+                                  h->skipped_bytes.load() };
+
+    while (!stop) {
+        int r = poll(&pfd, 1, 200);
+        if (r < 0 && errno != EINTR) break;
+        if (r > 0) {
+            long n = rd.fill(fd);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) break;
+            if (n > 0) {
+                h->bytes_in.fetch_add((uint64_t)n, std::memory_order_relaxed);
+                for (const tlm::Frame &f : rd.frames())
+                    if (std::optional<tlm::Frame> x = delta.expand(f)) ring.publish(x->raw, x->size());
+                rd.consume();
+
+                /* counters first: wake() publishes them with the batch (release on head) */
+                const tlm::ScanStats &st = rd.stats();
+                h->frames.store(base.frames + st.frames, std::memory_order_relaxed);
+                h->crc_errors.store(base.crc_errors + st.crc_errors, std::memory_order_relaxed);
+                h->bad_headers.store(base.bad_headers + st.bad_headers, std::memory_order_relaxed);
+                h->skipped_bytes.store(base.skipped_bytes + st.skipped_bytes, std::memory_order_relaxed);
+                ring.wake();
+            }
+        }
+        if (time(nullptr) != last_reap) {
+            last_reap = time(nullptr);
+            unsigned n = ring.reap_readers();
+            if (n && !quiet) fprintf(stderr, "tlmd: freed %u slot(s) of exited readers\n", n);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = "tlm";
+    size_t ring_kib = tlm::SHM_DEFAULT_CAPACITY >> 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:q")) != -1) {
+        switch (opt) {
+        case 'n': name = optarg; break;
+        case 's': ring_kib = (size_t)atol(optarg); break;
+        case 'q': quiet = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-n name] [-s ring KiB] [-q] DEVICE\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind + 1 != argc) {
+        fprintf(stderr, "usage: %s [-n name] [-s ring KiB] [-q] DEVICE\n", argv[0]);
+        return 2;
+    }
+    const char *path = argv[optind];
+
+    struct sigaction sa = {};
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    tlm::ShmWriter ring;
+    if (!ring.create(name, ring_kib << 10)) {
+        fprintf(stderr, "tlmd: /dev/shm/%s: %s\n", name, strerror(errno));
+        return 1;
+    }
+    tlm::ShmHeader *h = ring.header();
+    if (!quiet) fprintf(stderr, "tlmd: %s -> /dev/shm/%s (%" PRIu64 " KiB)\n", path, name, h->capacity >> 10);
+
+    int warned = 0;
+    while (!stop) {
+        int fd = open_tty(path);
+        if (fd < 0) {
+            if (!warned++ && !quiet) fprintf(stderr, "tlmd: %s: %s, retrying\n", path, strerror(errno));
+            ring.set_state(tlm::SHM_STATE_DISCONNECTED);
+            sleep_ms(500);
+            continue;
+        }
+        warned = 0;
+        ring.set_state(tlm::SHM_STATE_CONNECTED);
+        pump(fd, ring);
+        close(fd);
+        if (!stop) {
+            h->reconnects.fetch_add(1, std::memory_order_relaxed);
+            ring.set_state(tlm::SHM_STATE_DISCONNECTED);
+            if (!quiet) fprintf(stderr, "tlmd: %s closed, reopening\n", path);
+            sleep_ms(500);
+        }
+    }
+
+    if (!quiet)
+        fprintf(stderr, "tlmd: %" PRIu64 " bytes, %" PRIu64 " frames, %" PRIu64 " crc errors, %" PRIu64
+                " reconnects\n", h->bytes_in.load(), h->frames.load(), h->crc_errors.load(), h->reconnects.load());
+    ring.close();
+    return 0;
+}
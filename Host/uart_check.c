@@ -0,0 +1,219 @@
+/**
+ * @file uart_check.c
+ * @brief Host-native check of the DMA-driven USART1 transmit ring (uart_tx.c)
+ *
+ * Runs the unmodified uart_tx.c against the HAL shim's USART1 DMA latch with
+ * a 1 ms line model at 460800 baud (46.08 bytes per ms), the transfer
+ * complete interrupt raised once the line has clocked out the whole span:
+ *   - below the line rate every record arrives intact and in order, across
+ *     many ring wraps, each span chained from the previous completion;
+ *   - above the line rate writes never wait: whole records are rejected and
+ *     counted, every record that is sent arrives intact, and the missing
+ *     sequence numbers are exactly the counted drops;
+ *   - a DMA start the HAL refuses is counted and retried by the next write.
+ *
+ * Usage: uart_check
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "hal_shim.h"
+#include "microphone_sensor.h"
+#include "audio_packetizer.h"
+#include "audio_sync.h"
+#include "scheduler.h"
+#include "uart_tx.h"
+
+MIC_HandleTypeDef mic;
+AUDIO_PKT_HandleTypeDef audio_pkt;
+AUDIO_SYNC_HandleTypeDef audio_sync;
+SCHED_HandleTypeDef sched;
+
+/* ==== HELPERS ==== */
+#define LINE_TENTHS         461U        // bytes per 0.1 ms at 460800 baud, 8N1
+#define REC_SYNC            0xA5U
+#define REC_MAX             64U
+
+/* Receiver: records of sync, seq u16, len, payload, xor */
+typedef struct {
+    uint8_t  buf[REC_MAX + 8U];
+    uint16_t pos;
+    uint16_t next_seq;
+    uint32_t records;
+    uint32_t missing;           // seq gaps
+    uint32_t bad;               // broken record or out of order
+    uint32_t bytes;
+} RX_TypeDef;
+
+static RX_TypeDef rx;
+static uint32_t carry;
+static uint32_t line_left;      // bytes of the latched span still on the wire
+static const uint8_t *line_span;
+static uint32_t line_len;
+static uint32_t offered_bytes;
+
+static void rx_byte(uint8_t b)
+{
+    rx.bytes++;
+    if (rx.pos == 0 && b != REC_SYNC) {
+        rx.bad++;
+        return;
+    }
+    rx.buf[rx.pos++] = b;
+    if (rx.pos < 4U || rx.pos < 5U + rx.buf[3]) return;
+
+    uint8_t x = 0;
+    for (uint16_t i = 0; i < rx.pos - 1U; i++)
+        x ^= rx.buf[i];
+    uint16_t seq = (uint16_t)(rx.buf[1] | (rx.buf[2] << 8));
+    if (x != rx.buf[rx.pos - 1U] || (uint16_t)(seq - rx.next_seq) > 0x7FFFU)
+        rx.bad++;
+    else
+        rx.missing += (uint16_t)(seq - rx.next_seq);
+    rx.next_seq = (uint16_t)(seq + 1U);
+    rx.records++;
+    rx.pos = 0;
+}
+
+static void uart_reset(void)
+{
+    HalShim_Reset();
+    UartTx_Init(&huart1);
+    memset(&rx, 0, sizeof(rx));
+    carry = 0;
+    line_left = 0;
+    line_span = NULL;
+    offered_bytes = 0;
+    lcg_state = 11;
+}
+
+/* One ms of line time; the completion interrupt chains the next span */
+static void run_line_ms(void)
+{
+    carry += LINE_TENTHS;
+    uint32_t budget = carry / 10U;
+    carry %= 10U;
+    while (budget > 0) {
+        if (line_span == NULL) {
+            line_span = HalShim_TakeUartTx(&line_len);
+            if (line_span == NULL) return;
+            line_left = line_len;
+        }
+        uint32_t n = line_left < budget ? line_left : budget;
+        budget -= n;
+        if ((line_left -= n) != 0) return;
+        for (uint32_t i = 0; i < line_len; i++)
+            rx_byte(line_span[i]);
+        line_span = NULL;
+        HAL_UART_TxCpltCallback(&huart1);
+    }
+}
+
+static uint16_t send_record(uint16_t seq, uint8_t len)
+{
+    uint8_t r[REC_MAX + 5U];
+    uint8_t x = 0;
+    r[0] = REC_SYNC;
+    r[1] = (uint8_t)seq;
+    r[2] = (uint8_t)(seq >> 8);
+    r[3] = len;
+    for (uint8_t i = 0; i < len; i++)
+        r[4 + i] = (uint8_t)lcg_next();
+    for (uint16_t i = 0; i < 4U + len; i++)
+        x ^= r[i];
+    r[4 + len] = x;
+    offered_bytes += 5U + len;
+    return UartTx_Write(r, (uint16_t)(5U + len));
+}
+
+/* Records of random length, rate_tenths bytes per 0.1 ms on average */
+static uint32_t produce(uint32_t ms, uint32_t rate_tenths, uint16_t *seq)
+{
+    uint32_t owed = 0, rejected = 0;
+    for (; ms > 0; ms--) {
+        owed += rate_tenths;
+        while (owed >= 10U * (5U + REC_MAX / 2U)) {
+            uint8_t len = (uint8_t)(lcg_next() % (REC_MAX + 1U));
+            if (send_record((*seq)++, len) == 0) rejected++;
+            owed -= 10U * (5U + REC_MAX / 2U);
+        }
+        run_line_ms();
+    }
+    return rejected;
+}
+
+static void drain(void)
+{
+    for (uint32_t ms = 0; ms < 2U * UART_TX_RING_SIZE / 46U + 10U; ms++)
+        run_line_ms();
+}
+
+/* ==== BELOW THE LINE RATE ==== */
+static void check_below_rate(void)
+{
+    uint16_t seq = 0;
+    uart_reset();
+    uint32_t rejected = produce(3000, 300, &seq);
+    drain();
+
+    printf("  below rate: %u records, %u bytes in %u spans, high watermark %u\n", rx.records,
+           uart_tx_stats.bytes_sent, uart_tx_stats.transfers, uart_tx_stats.high_watermark);
+    CHECK(rejected == 0 && uart_tx_stats.drops == 0, "below rate: %u writes rejected", rejected);
+    CHECK(rx.records == seq && rx.missing == 0 && rx.bad == 0, "below rate: %u of %u records, %u missing, %u bad",
+          rx.records, seq, rx.missing, rx.bad);
+    CHECK(uart_tx_stats.bytes_sent == offered_bytes && rx.bytes == offered_bytes &&
+          uart_tx_stats.bytes_sent > 10U * UART_TX_RING_SIZE, "below rate: %u of %u bytes sent",
+          uart_tx_stats.bytes_sent, offered_bytes);
+    CHECK(UartTx_Free() == UART_TX_RING_SIZE, "below rate: %u bytes left queued", UART_TX_RING_SIZE - UartTx_Free());
+}
+
+/* ==== ABOVE THE LINE RATE ==== */
+static void check_above_rate(void)
+{
+    uint16_t seq = 0;
+    uart_reset();
+    uint32_t rejected = produce(3000, 1000, &seq);
+    drain();
+
+    printf("  above rate: %u of %u records sent, %u writes dropped (%u bytes), high watermark %u\n", rx.records, seq,
+           uart_tx_stats.drops, uart_tx_stats.dropped_bytes, uart_tx_stats.high_watermark);
+    CHECK(rejected > 0 && rejected == uart_tx_stats.drops, "above rate: %u rejected, %u counted", rejected,
+          uart_tx_stats.drops);
+    CHECK(rx.bad == 0 && rx.missing + (uint16_t)(seq - rx.next_seq) == uart_tx_stats.drops,
+          "above rate: %u bad, %u missing for %u dropped", rx.bad, rx.missing, uart_tx_stats.drops);
+    CHECK(uart_tx_stats.bytes_sent + uart_tx_stats.dropped_bytes == offered_bytes,
+          "above rate: %u sent + %u dropped of %u", uart_tx_stats.bytes_sent, uart_tx_stats.dropped_bytes,
+          offered_bytes);
+    CHECK(uart_tx_stats.high_watermark <= UART_TX_RING_SIZE && uart_tx_stats.high_watermark > UART_TX_RING_SIZE - 70U,
+          "above rate: high watermark %u", uart_tx_stats.high_watermark);
+    /* the line never idled while data was queued */
+    CHECK(uart_tx_stats.bytes_sent >= 3000U * 46U - 100U, "above rate: only %u bytes on the line in 3 s",
+          uart_tx_stats.bytes_sent);
+}
+
+/* ==== DMA START REFUSED ==== */
+static void check_refused(void)
+{
+    uint16_t seq = 0;
+    uart_reset();
+    huart1.gState = 1U;             // UART busy with a transfer of its own
+    send_record(seq++, 10);
+    CHECK(uart_tx_stats.errors == 1U && UartTx_Free() == UART_TX_RING_SIZE - 15U,
+          "refused: %u errors, %u bytes queued", uart_tx_stats.errors, UART_TX_RING_SIZE - UartTx_Free());
+    huart1.gState = 0U;
+    send_record(seq++, 20);
+    drain();
+    CHECK(rx.records == 2U && rx.bad == 0 && rx.missing == 0, "refused: %u records after the retry, %u bad",
+          rx.records, rx.bad);
+}
+
+int main(void)
+{
+    check_below_rate();
+    check_above_rate();
+    check_refused();
+
+    return check_result();
+}
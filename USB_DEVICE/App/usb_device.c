@@ -27,6 +27,8 @@
 #include "usbd_cdc_if.h"
 
 /* USER CODE BEGIN Includes */
+#include "usbd_cdc_dual.h"
+#include "usbd_cdc_log_if.h"
 
 /* USER CODE END Includes */
 
@@ -86,7 +88,12 @@ void MX_USB_DEVICE_Init(void)
   }
 
   /* USER CODE BEGIN USB_DEVICE_Init_PostTreatment */
-
+  /* The generated single CDC function becomes the data function of the
+     dual CDC composite; the log console is the second (usbd_cdc_dual.h) */
+  if (USBD_CDC_DUAL_Install(&hUsbDeviceFS, &USBD_LogInterface_fops_FS) != USBD_OK)
+  {
+    Error_Handler();
+  }
   /* USER CODE END USB_DEVICE_Init_PostTreatment */
 }
 
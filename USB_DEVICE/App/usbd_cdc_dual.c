@@ -0,0 +1,326 @@
+/**
+ * @file usbd_cdc_dual.c
+ * @brief Two-function CDC ACM composite class implementation
+ *
+ * The core sees a single class: requests and endpoint events are routed by
+ * interface number (wIndex) or endpoint address. Function 0 goes to the
+ * stock USBD_CDC callbacks unchanged, so usbd_cdc_if.c keeps using
+ * pClassData and the USBD_CDC_xxx calls. Function 1 mirrors the stock class
+ * with its own handle and interface callbacks. The device is full speed
+ * only, so one configuration descriptor serves every speed request.
+ */
+
+#include "usbd_cdc_dual.h"
+#include "usbd_cdc_if.h"
+#include "usbd_cdc_log_if.h"
+#include "usbd_ctlreq.h"
+#include "audio_sync.h"
+#include <string.h>
+
+extern AUDIO_SYNC_HandleTypeDef audio_sync;
+
+/* ==== DESCRIPTOR ==== */
+/* IAD + communication interface + data interface of one ACM function */
+#define CDC_DUAL_FUNCTION(itf, in_ep, out_ep, cmd_ep)                                       \
+    /* Interface Association Descriptor */                                                  \
+    0x08, 0x0B, (itf), 0x02,            /* bFirstInterface, bInterfaceCount */             \
+    0x02, 0x02, 0x01, 0x00,             /* CDC, ACM, AT commands, iFunction */             \
+    /* Communication interface */                                                           \
+    0x09, USB_DESC_TYPE_INTERFACE, (itf), 0x00, 0x01, 0x02, 0x02, 0x01, 0x00,              \
+    0x05, 0x24, 0x00, 0x10, 0x01,       /* Header: CDC 1.10 */                             \
+    0x05, 0x24, 0x01, 0x00, (itf) + 1U, /* Call Management: data interface */              \
+    0x04, 0x24, 0x02, 0x02,             /* ACM: line coding and state */                   \
+    0x05, 0x24, 0x06, (itf), (itf) + 1U, /* Union: master, slave */                        \
+    0x07, USB_DESC_TYPE_ENDPOINT, (cmd_ep), 0x03,                                           \
+    LOBYTE(CDC_CMD_PACKET_SIZE), HIBYTE(CDC_CMD_PACKET_SIZE), CDC_FS_BINTERVAL,             \
+    /* Data interface */                                                                    \
+    0x09, USB_DESC_TYPE_INTERFACE, (itf) + 1U, 0x00, 0x02, 0x0A, 0x00, 0x00, 0x00,         \
+    0x07, USB_DESC_TYPE_ENDPOINT, (out_ep), 0x02,                                           \
+    LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE), HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE), 0x00,         \
+    0x07, USB_DESC_TYPE_ENDPOINT, (in_ep), 0x02,                                            \
+    LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE), HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE), 0x00
+
+__ALIGN_BEGIN static uint8_t CDC_DUAL_CfgDesc[USB_CDC_DUAL_CONFIG_DESC_SIZ] __ALIGN_END =
+{
+    0x09, USB_DESC_TYPE_CONFIGURATION,
+    LOBYTE(USB_CDC_DUAL_CONFIG_DESC_SIZ), HIBYTE(USB_CDC_DUAL_CONFIG_DESC_SIZ),
+    0x04,                               // bNumInterfaces
+    0x01,                               // bConfigurationValue
+    0x00,                               // iConfiguration
+#if (USBD_SELF_POWERED == 1U)
+    0xC0,
+#else
+    0x80,
+#endif
+    USBD_MAX_POWER,
+
+    CDC_DUAL_FUNCTION(CDC_DUAL_DATA_ITF, CDC_IN_EP, CDC_OUT_EP, CDC_CMD_EP),
+    CDC_DUAL_FUNCTION(CDC_DUAL_LOG_ITF, CDC_LOG_IN_EP, CDC_LOG_OUT_EP, CDC_LOG_CMD_EP),
+};
+
+/* Device descriptor of the generated single function, with the IAD class */
+static USBD_DescriptorsTypeDef cdc_dual_desc;
+static USBD_DescriptorsTypeDef *cdc_dual_base_desc;
+__ALIGN_BEGIN static uint8_t CDC_DUAL_DeviceDesc[USB_LEN_DEV_DESC] __ALIGN_END;
+
+/* ==== LOG FUNCTION STATE ==== */
+static USBD_CDC_HandleTypeDef log_cdc;
+static USBD_CDC_ItfTypeDef *log_fops;
+static uint8_t log_active;              // endpoints open, handle valid
+
+/* ==== CLASS CALLBACKS ==== */
+static uint8_t CDC_DUAL_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    uint8_t ret = USBD_CDC.Init(pdev, cfgidx);
+    if (ret != (uint8_t)USBD_OK) return ret;
+
+    memset(&log_cdc, 0, sizeof(log_cdc));
+    log_cdc.CmdOpCode = 0xFFU;
+
+    (void)USBD_LL_OpenEP(pdev, CDC_LOG_IN_EP, USBD_EP_TYPE_BULK, CDC_DATA_FS_IN_PACKET_SIZE);
+    pdev->ep_in[CDC_LOG_IN_EP & 0xFU].is_used = 1U;
+    (void)USBD_LL_OpenEP(pdev, CDC_LOG_OUT_EP, USBD_EP_TYPE_BULK, CDC_DATA_FS_OUT_PACKET_SIZE);
+    pdev->ep_out[CDC_LOG_OUT_EP & 0xFU].is_used = 1U;
+    pdev->ep_in[CDC_LOG_CMD_EP & 0xFU].bInterval = CDC_FS_BINTERVAL;
+    (void)USBD_LL_OpenEP(pdev, CDC_LOG_CMD_EP, USBD_EP_TYPE_INTR, CDC_CMD_PACKET_SIZE);
+    pdev->ep_in[CDC_LOG_CMD_EP & 0xFU].is_used = 1U;
+
+    log_active = 1U;
+    if (log_fops != NULL) log_fops->Init();
+
+    if (log_cdc.RxBuffer == NULL) return (uint8_t)USBD_EMEM;
+    (void)USBD_LL_PrepareReceive(pdev, CDC_LOG_OUT_EP, log_cdc.RxBuffer, CDC_DATA_FS_OUT_PACKET_SIZE);
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t CDC_DUAL_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    (void)USBD_LL_CloseEP(pdev, CDC_LOG_IN_EP);
+    pdev->ep_in[CDC_LOG_IN_EP & 0xFU].is_used = 0U;
+    (void)USBD_LL_CloseEP(pdev, CDC_LOG_OUT_EP);
+    pdev->ep_out[CDC_LOG_OUT_EP & 0xFU].is_used = 0U;
+    (void)USBD_LL_CloseEP(pdev, CDC_LOG_CMD_EP);
+    pdev->ep_in[CDC_LOG_CMD_EP & 0xFU].is_used = 0U;
+    pdev->ep_in[CDC_LOG_CMD_EP & 0xFU].bInterval = 0U;
+
+    if (log_active && log_fops != NULL) log_fops->DeInit();
+    log_active = 0U;
+
+    return USBD_CDC.DeInit(pdev, cfgidx);
+}
+
+/**
+ * @brief Class requests addressed to interface 2 or 3 are the log function's;
+ *        everything else (and standard requests) follows the stock class
+ */
+static uint8_t CDC_DUAL_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    if ((req->bmRequest & USB_REQ_TYPE_MASK) != USB_REQ_TYPE_CLASS ||
+        (req->bmRequest & USB_REQ_RECIPIENT_MASK) != USB_REQ_RECIPIENT_INTERFACE ||
+        LOBYTE(req->wIndex) < CDC_DUAL_LOG_ITF)
+        return USBD_CDC.Setup(pdev, req);
+
+    if (!log_active || log_fops == NULL) {
+        USBD_CtlError(pdev, req);
+        return (uint8_t)USBD_FAIL;
+    }
+
+    if (req->wLength == 0U) {
+        log_fops->Control(req->bRequest, (uint8_t *)req, 0U);
+    } else if ((req->bmRequest & 0x80U) != 0U) {
+        log_fops->Control(req->bRequest, (uint8_t *)log_cdc.data, req->wLength);
+        (void)USBD_CtlSendData(pdev, (uint8_t *)log_cdc.data, MIN(CDC_REQ_MAX_DATA_SIZE, req->wLength));
+    } else {
+        log_cdc.CmdOpCode = req->bRequest;
+        log_cdc.CmdLength = (uint8_t)MIN(req->wLength, USB_MAX_EP0_SIZE);
+        (void)USBD_CtlPrepareRx(pdev, (uint8_t *)log_cdc.data, log_cdc.CmdLength);
+    }
+    return (uint8_t)USBD_OK;
+}
+
+/**
+ * @brief Data stage of a host-to-device request; the setup packet that
+ *        started it is still in pdev->request
+ */
+static uint8_t CDC_DUAL_EP0_RxReady(USBD_HandleTypeDef *pdev)
+{
+    if (LOBYTE(pdev->request.wIndex) < CDC_DUAL_LOG_ITF)
+        return USBD_CDC.EP0_RxReady(pdev);
+
+    if (log_active && log_fops != NULL && log_cdc.CmdOpCode != 0xFFU) {
+        log_fops->Control(log_cdc.CmdOpCode, (uint8_t *)log_cdc.data, log_cdc.CmdLength);
+        log_cdc.CmdOpCode = 0xFFU;
+    }
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t CDC_DUAL_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    if (epnum != (CDC_LOG_IN_EP & 0x7FU))
+        return USBD_CDC.DataIn(pdev, epnum);
+    if (!log_active) return (uint8_t)USBD_FAIL;
+
+    /* A transfer ending on a packet boundary is terminated with a ZLP, as
+     * in the stock class */
+    PCD_HandleTypeDef *hpcd = (PCD_HandleTypeDef *)pdev->pData;
+    USBD_EndpointTypeDef *ep = &pdev->ep_in[epnum & 0xFU];
+    if (ep->total_length > 0U && (ep->total_length % hpcd->IN_ep[epnum & 0xFU].maxpacket) == 0U) {
+        ep->total_length = 0U;
+        (void)USBD_LL_Transmit(pdev, epnum, NULL, 0U);
+        return (uint8_t)USBD_OK;
+    }
+
+    log_cdc.TxState = 0U;
+    if (log_fops != NULL && log_fops->TransmitCplt != NULL)
+        log_fops->TransmitCplt(log_cdc.TxBuffer, &log_cdc.TxLength, epnum);
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t CDC_DUAL_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    if (epnum != CDC_LOG_OUT_EP)
+        return USBD_CDC.DataOut(pdev, epnum);
+    if (!log_active || log_fops == NULL) return (uint8_t)USBD_FAIL;
+
+    log_cdc.RxLength = USBD_LL_GetRxDataSize(pdev, epnum);
+    log_fops->Receive(log_cdc.RxBuffer, &log_cdc.RxLength);
+    return (uint8_t)USBD_OK;
+}
+
+/**
+ * @brief Start of frame (1 ms), configured device only: the audio clock
+ *        sync sample, the data queue's flush deadline and the log ring
+ */
+static uint8_t CDC_DUAL_SOF(USBD_HandleTypeDef *pdev)
+{
+    PCD_HandleTypeDef *hpcd = (PCD_HandleTypeDef *)pdev->pData;
+    USB_OTG_DeviceTypeDef *dev = (USB_OTG_DeviceTypeDef *)((uint32_t)hpcd->Instance + USB_OTG_DEVICE_BASE);
+
+    AudioSync_OnSOF(&audio_sync, (uint16_t)((dev->DSTS & USB_OTG_DSTS_FNSOF) >> USB_OTG_DSTS_FNSOF_Pos));
+    CDC_TxQueue_OnSOF();
+    CDC_Log_OnSOF();
+    return (uint8_t)USBD_OK;
+}
+
+static uint8_t *CDC_DUAL_GetCfgDesc(uint16_t *length)
+{
+    *length = (uint16_t)sizeof(CDC_DUAL_CfgDesc);
+    return CDC_DUAL_CfgDesc;
+}
+
+static uint8_t *CDC_DUAL_GetDeviceQualifierDesc(uint16_t *length)
+{
+    return USBD_CDC.GetDeviceQualifierDescriptor(length);
+}
+
+/* bDeviceClass/SubClass/Protocol: Miscellaneous, Common Class, IAD */
+static uint8_t *CDC_DUAL_GetDeviceDesc(USBD_SpeedTypeDef speed, uint16_t *length)
+{
+    uint8_t *desc = cdc_dual_base_desc->GetDeviceDescriptor(speed, length);
+    *length = MIN(*length, (uint16_t)sizeof(CDC_DUAL_DeviceDesc));
+    memcpy(CDC_DUAL_DeviceDesc, desc, *length);
+    CDC_DUAL_DeviceDesc[4] = 0xEFU;
+    CDC_DUAL_DeviceDesc[5] = 0x02U;
+    CDC_DUAL_DeviceDesc[6] = 0x01U;
+    return CDC_DUAL_DeviceDesc;
+}
+
+USBD_ClassTypeDef USBD_CDC_DUAL =
+{
+    CDC_DUAL_Init,
+    CDC_DUAL_DeInit,
+    CDC_DUAL_Setup,
+    NULL,                               // EP0_TxSent
+    CDC_DUAL_EP0_RxReady,
+    CDC_DUAL_DataIn,
+    CDC_DUAL_DataOut,
+    CDC_DUAL_SOF,
+    NULL,
+    NULL,
+    CDC_DUAL_GetCfgDesc,
+    CDC_DUAL_GetCfgDesc,
+    CDC_DUAL_GetCfgDesc,
+    CDC_DUAL_GetDeviceQualifierDesc,
+};
+
+/* ==== SETUP ==== */
+
+/**
+ * @brief Turn the generated single CDC device into the dual composite
+ * @param pdev     started by MX_USB_DEVICE_Init with USBD_CDC and the data
+ *                 function's interface registered
+ * @param log_fops interface callbacks of the log function
+ * @note  Stops the device (host detach is debounced for 100 ms, nothing has
+ *        enumerated yet), resizes the FIFOs, registers the class and starts
+ *        it again
+ */
+uint8_t USBD_CDC_DUAL_Install(USBD_HandleTypeDef *pdev, USBD_CDC_ItfTypeDef *log_fops)
+{
+    PCD_HandleTypeDef *hpcd = (PCD_HandleTypeDef *)pdev->pData;
+
+    if (USBD_Stop(pdev) != USBD_OK) return (uint8_t)USBD_FAIL;
+
+    /* 320 words in total: the data IN endpoint (EP1) keeps its 512 bytes, the
+     * log console (EP3), EP0 and both notification endpoints one packet each */
+    HAL_PCDEx_SetRxFiFo(hpcd, 0x80);
+    HAL_PCDEx_SetTxFiFo(hpcd, 0, 0x10);
+    HAL_PCDEx_SetTxFiFo(hpcd, 1, 0x80);
+    HAL_PCDEx_SetTxFiFo(hpcd, 2, 0x10);
+    HAL_PCDEx_SetTxFiFo(hpcd, 3, 0x10);
+    HAL_PCDEx_SetTxFiFo(hpcd, 4, 0x10);
+
+    cdc_dual_base_desc = pdev->pDesc;
+    cdc_dual_desc = *pdev->pDesc;
+    cdc_dual_desc.GetDeviceDescriptor = CDC_DUAL_GetDeviceDesc;
+    pdev->pDesc = &cdc_dual_desc;
+
+    if (USBD_RegisterClass(pdev, &USBD_CDC_DUAL) != USBD_OK ||
+        USBD_CDC_LOG_RegisterInterface(pdev, log_fops) != (uint8_t)USBD_OK)
+        return (uint8_t)USBD_FAIL;
+    return (uint8_t)USBD_Start(pdev);
+}
+
+/* ==== LOG FUNCTION API ==== */
+
+uint8_t USBD_CDC_LOG_RegisterInterface(USBD_HandleTypeDef *pdev, USBD_CDC_ItfTypeDef *fops)
+{
+    UNUSED(pdev);
+    if (fops == NULL) return (uint8_t)USBD_FAIL;
+    log_fops = fops;
+    return (uint8_t)USBD_OK;
+}
+
+uint8_t USBD_CDC_LOG_SetTxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff, uint32_t length)
+{
+    UNUSED(pdev);
+    if (!log_active) return (uint8_t)USBD_FAIL;
+    log_cdc.TxBuffer = pbuff;
+    log_cdc.TxLength = length;
+    return (uint8_t)USBD_OK;
+}
+
+uint8_t USBD_CDC_LOG_TransmitPacket(USBD_HandleTypeDef *pdev)
+{
+    if (!log_active) return (uint8_t)USBD_FAIL;
+    if (log_cdc.TxState != 0U) return (uint8_t)USBD_BUSY;
+
+    log_cdc.TxState = 1U;
+    pdev->ep_in[CDC_LOG_IN_EP & 0xFU].total_length = log_cdc.TxLength;
+    (void)USBD_LL_Transmit(pdev, CDC_LOG_IN_EP, log_cdc.TxBuffer, log_cdc.TxLength);
+    return (uint8_t)USBD_OK;
+}
+
+uint8_t USBD_CDC_LOG_SetRxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff)
+{
+    UNUSED(pdev);
+    if (!log_active) return (uint8_t)USBD_FAIL;
+    log_cdc.RxBuffer = pbuff;
+    return (uint8_t)USBD_OK;
+}
+
+uint8_t USBD_CDC_LOG_ReceivePacket(USBD_HandleTypeDef *pdev)
+{
+    if (!log_active) return (uint8_t)USBD_FAIL;
+    (void)USBD_LL_PrepareReceive(pdev, CDC_LOG_OUT_EP, log_cdc.RxBuffer, CDC_DATA_FS_OUT_PACKET_SIZE);
+    return (uint8_t)USBD_OK;
+}
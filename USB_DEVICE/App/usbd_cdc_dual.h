@@ -0,0 +1,62 @@
+/**
+ * @file usbd_cdc_dual.h
+ * @brief Composite device with two CDC ACM functions: data stream and log console
+ * @version 1.0
+ * @date 2025-10
+ *
+ * Function 0 (interfaces 0/1, EP 0x81/0x01/0x82) is the stock USBD_CDC class
+ * behind usbd_cdc_if.c: telemetry, audio and commands.
+ * Function 1 (interfaces 2/3, EP 0x83/0x03/0x84) is the log console behind
+ * usbd_cdc_log_if.c. Each function is announced by an IAD, so the host binds
+ * one ACM driver per function (/dev/ttyACM0 data, /dev/ttyACM1 log on Linux).
+ *
+ * The library's composite builder is not part of this tree: this class is
+ * registered as the only device class, forwards function 0 to USBD_CDC and
+ * runs function 1 itself. Each function has its own endpoints and Tx FIFO,
+ * so a backed-up console never delays the data stream.
+ *
+ * usb_device.c, usbd_desc.c and usbd_conf.c stay as CubeMX generates them
+ * for one CDC function: USBD_CDC_DUAL_Install(), called from
+ * MX_USB_DEVICE_Init's PostTreatment section, swaps in this class, the IAD
+ * device class and the FIFO split. Only USBD_MAX_NUM_INTERFACES (4) comes
+ * from the CubeMX project (finger.ioc).
+ */
+
+#ifndef __USBD_CDC_DUAL_H__
+#define __USBD_CDC_DUAL_H__
+
+#include "usbd_cdc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== CONFIGURATION ==== */
+#define CDC_LOG_IN_EP           0x83U   // EP3 for log data IN
+#define CDC_LOG_OUT_EP          0x03U   // EP3 for log data OUT
+#define CDC_LOG_CMD_EP          0x84U   // EP4 for log notifications (never sent)
+
+#define CDC_DUAL_DATA_ITF       0x00U   // first interface of the data function
+#define CDC_DUAL_LOG_ITF        0x02U   // first interface of the log function
+
+#define CDC_DUAL_FUNC_DESC_SIZ  66U     // IAD + one CDC ACM function
+#define USB_CDC_DUAL_CONFIG_DESC_SIZ (9U + 2U * CDC_DUAL_FUNC_DESC_SIZ)
+
+/* ==== EXPORTED VARIABLES ==== */
+extern USBD_ClassTypeDef USBD_CDC_DUAL;
+
+/* ==== FUNCTION PROTOTYPES ==== */
+uint8_t USBD_CDC_DUAL_Install(USBD_HandleTypeDef *pdev, USBD_CDC_ItfTypeDef *log_fops);
+
+/* Function 0 uses USBD_CDC_RegisterInterface() and the USBD_CDC_xxx calls */
+uint8_t USBD_CDC_LOG_RegisterInterface(USBD_HandleTypeDef *pdev, USBD_CDC_ItfTypeDef *fops);
+uint8_t USBD_CDC_LOG_SetTxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff, uint32_t length);
+uint8_t USBD_CDC_LOG_TransmitPacket(USBD_HandleTypeDef *pdev);
+uint8_t USBD_CDC_LOG_SetRxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff);
+uint8_t USBD_CDC_LOG_ReceivePacket(USBD_HandleTypeDef *pdev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_CDC_DUAL_H__ */
@@ -22,7 +22,8 @@
 #include "usbd_cdc_if.h"
 
 /* USER CODE BEGIN INCLUDE */
-
+#include "audio_packetizer.h"
+#include <string.h>
 /* USER CODE END INCLUDE */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -62,6 +63,17 @@
   */
 
 /* USER CODE BEGIN PRIVATE_DEFINES */
+#define CDC_TX_RING_MASK  (CDC_TX_RING_SIZE - 1U)
+
+#if (CDC_TX_RING_SIZE & CDC_TX_RING_MASK) != 0U
+#error "CDC_TX_RING_SIZE must be a power of two"
+#endif
+
+#define CDC_RX_RING_MASK  (CDC_RX_RING_SIZE - 1U)
+
+#if (CDC_RX_RING_SIZE & CDC_RX_RING_MASK) != 0U
+#error "CDC_RX_RING_SIZE must be a power of two"
+#endif
 /* USER CODE END PRIVATE_DEFINES */
 
 /**
@@ -94,7 +106,28 @@ uint8_t UserRxBufferFS[APP_RX_DATA_SIZE];
 uint8_t UserTxBufferFS[APP_TX_DATA_SIZE];
 
 /* USER CODE BEGIN PRIVATE_VARIABLES */
-
+/* Transmit queue: single producer (main loop), drained from the USB interrupt.
+ * head/tail are free running byte counters, UserTxBufferFS is the storage. */
+CDC_TxStatsTypeDef cdc_tx_stats;
+static volatile uint32_t tx_head;
+static volatile uint32_t tx_tail;
+static volatile uint32_t tx_inflight;   /* ring bytes owned by the IN endpoint */
+static volatile uint8_t  tx_at_bound = 1U; /* tail is at the end of a write */
+static volatile uint8_t  tx_end_bound;  /* the transfer in flight ends at a write end */
+static volatile uint32_t tx_stamp;      /* tick when the oldest unsent byte was queued */
+
+/* Receive queue: filled from the USB interrupt, drained by the main loop.
+ * OUT packets land in rx_packet and are copied into UserRxBufferFS; the
+ * endpoint is only re-armed while a whole packet still fits, otherwise the
+ * host is NAKed until CDC_RxQueue_Read() makes room. */
+CDC_RxStatsTypeDef cdc_rx_stats;
+static uint8_t rx_packet[CDC_DATA_FS_MAX_PACKET_SIZE];
+static volatile uint32_t rx_head;
+static volatile uint32_t rx_tail;
+static volatile uint8_t  rx_paused;
+
+/* DTR/RTS as last set by the host; cleared whenever the class is (re)initialized */
+static volatile uint8_t  line_state;
 /* USER CODE END PRIVATE_VARIABLES */
 
 /**
@@ -109,7 +142,7 @@ uint8_t UserTxBufferFS[APP_TX_DATA_SIZE];
 extern USBD_HandleTypeDef hUsbDeviceFS;
 
 /* USER CODE BEGIN EXPORTED_VARIABLES */
-
+extern AUDIO_PKT_HandleTypeDef audio_pkt;
 /* USER CODE END EXPORTED_VARIABLES */
 
 /**
@@ -128,7 +161,7 @@ static int8_t CDC_Receive_FS(uint8_t* pbuf, uint32_t *Len);
 static int8_t CDC_TransmitCplt_FS(uint8_t *pbuf, uint32_t *Len, uint8_t epnum);
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_DECLARATION */
-
+static void CDC_TxStart(void);
 /* USER CODE END PRIVATE_FUNCTIONS_DECLARATION */
 
 /**
@@ -154,7 +187,14 @@ static int8_t CDC_Init_FS(void)
   /* USER CODE BEGIN 3 */
   /* Set Application Buffers */
   USBD_CDC_SetTxBuffer(&hUsbDeviceFS, UserTxBufferFS, 0);
-  USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
+  USBD_CDC_SetRxBuffer(&hUsbDeviceFS, rx_packet);
+  /* The class arms the OUT endpoint after this returns */
+  rx_paused = 0;
+  /* A new enumeration starts with the port closed */
+  line_state = 0;
+  /* A transfer cut by a bus reset never completes: send it again */
+  tx_inflight = 0;
+  AudioPkt_Unclaim(&audio_pkt);
   return (USBD_OK);
   /* USER CODE END 3 */
 }
@@ -166,6 +206,7 @@ static int8_t CDC_Init_FS(void)
 static int8_t CDC_DeInit_FS(void)
 {
   /* USER CODE BEGIN 4 */
+  line_state = 0;
   return (USBD_OK);
   /* USER CODE END 4 */
 }
@@ -228,7 +269,8 @@ static int8_t CDC_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length)
     break;
 
     case CDC_SET_CONTROL_LINE_STATE:
-
+      /* No data stage: pbuf is the setup request, wValue holds DTR (bit 0) and RTS (bit 1) */
+      line_state = (uint8_t)(((USBD_SetupReqTypedef *)pbuf)->wValue & (CDC_LINE_DTR | CDC_LINE_RTS));
     break;
 
     case CDC_SEND_BREAK:
@@ -261,8 +303,39 @@ static int8_t CDC_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length)
 static int8_t CDC_Receive_FS(uint8_t* Buf, uint32_t *Len)
 {
   /* USER CODE BEGIN 6 */
+  uint32_t len = *Len;
+  uint32_t head = rx_head;
+  uint32_t used = head - rx_tail;
+
+  if (len > CDC_RX_RING_SIZE - used){
+    cdc_rx_stats.overflows++;
+    cdc_rx_stats.dropped_bytes += len;
+  }
+  else{
+    uint32_t off = head & CDC_RX_RING_MASK;
+    uint32_t first = CDC_RX_RING_SIZE - off;
+    if (first > len){
+      first = len;
+    }
+    memcpy(&UserRxBufferFS[off], Buf, first);
+    memcpy(UserRxBufferFS, Buf + first, len - first);
+    rx_head = head + len;
+    used += len;
+    cdc_rx_stats.bytes_received += len;
+    cdc_rx_stats.packets++;
+    if (used > cdc_rx_stats.high_watermark){
+      cdc_rx_stats.high_watermark = used;
+    }
+  }
+
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
-  USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+  if (CDC_RX_RING_SIZE - used >= CDC_DATA_FS_MAX_PACKET_SIZE){
+    USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+  }
+  else{
+    rx_paused = 1;
+    cdc_rx_stats.pauses++;
+  }
   return (USBD_OK);
   /* USER CODE END 6 */
 }
@@ -282,12 +355,10 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
 {
   uint8_t result = USBD_OK;
   /* USER CODE BEGIN 7 */
-  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
-  if (hcdc->TxState != 0){
+  /* Buf is copied into the transmit queue and may be reused on return */
+  if (CDC_TxQueue_Write(Buf, Len) != Len){
     return USBD_BUSY;
   }
-  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, Buf, Len);
-  result = USBD_CDC_TransmitPacket(&hUsbDeviceFS);
   /* USER CODE END 7 */
   return result;
 }
@@ -308,15 +379,285 @@ static int8_t CDC_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
 {
   uint8_t result = USBD_OK;
   /* USER CODE BEGIN 13 */
-  UNUSED(Buf);
   UNUSED(Len);
   UNUSED(epnum);
+  cdc_tx_stats.transfers++;
+  AudioPkt_OnTxComplete(&audio_pkt, Buf);
+  if (tx_inflight != 0U && Buf == &UserTxBufferFS[tx_tail & CDC_TX_RING_MASK]){
+    cdc_tx_stats.bytes_sent += tx_inflight;
+    tx_tail += tx_inflight;
+    tx_inflight = 0;
+    tx_at_bound = tx_end_bound;
+  }
+  /* Chain the next transfer without waiting for the main loop */
+  CDC_TxStart();
   /* USER CODE END 13 */
   return result;
 }
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
+/**
+  * @brief  Queue data for the IN endpoint, all or nothing.
+  * @note   Main loop context only (single producer).
+  * @param  Buf: Data to send
+  * @param  Len: Number of bytes
+  * @retval Len when queued, 0 if no host is listening or the ring lacks space
+  */
+uint16_t CDC_TxQueue_Write(const uint8_t* Buf, uint16_t Len)
+{
+  if (!CDC_HostListening()){
+    return 0;
+  }
+
+  uint32_t head = tx_head;
+  uint32_t used = head - tx_tail;
+  if (Len > CDC_TX_RING_SIZE - used){
+    cdc_tx_stats.drops++;
+    cdc_tx_stats.dropped_bytes += Len;
+    return 0;
+  }
+
+  if (head == tx_tail + tx_inflight){
+    tx_stamp = HAL_GetTick();
+  }
+
+  uint32_t off = head & CDC_TX_RING_MASK;
+  uint32_t first = CDC_TX_RING_SIZE - off;
+  if (first > Len){
+    first = Len;
+  }
+  memcpy(&UserTxBufferFS[off], Buf, first);
+  memcpy(UserTxBufferFS, Buf + first, Len - first);
+  tx_head = head + Len;
+
+  used += Len;
+  if (used > cdc_tx_stats.high_watermark){
+    cdc_tx_stats.high_watermark = used;
+  }
+  cdc_tx_stats.bytes_queued += Len;
+
+  CDC_TxQueue_Kick();
+  return Len;
+}
+
+/**
+  * @brief  Free space in the transmit queue.
+  * @retval Bytes that CDC_TxQueue_Write() accepts right now
+  */
+uint16_t CDC_TxQueue_Free(void)
+{
+  return (uint16_t)(CDC_TX_RING_SIZE - (tx_head - tx_tail));
+}
+
+/**
+  * @brief  Start a transfer if the endpoint is idle and anything is pending.
+  * @note   Call from the main loop so ready audio slots go out even when no
+  *         completion interrupt is outstanding.
+  */
+void CDC_TxQueue_Kick(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  CDC_TxStart();
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Send everything queued so far without waiting for a full batch.
+  * @note   Main loop context. For replies a host is waiting on (command
+  *         responses, echo); streaming producers should not call it.
+  */
+void CDC_TxQueue_Flush(void)
+{
+  /* Age the unsent bytes past the deadline; a later write that finds the
+   * queue drained stamps itself afresh */
+  tx_stamp = HAL_GetTick() - CDC_TX_FLUSH_MS;
+  CDC_TxQueue_Kick();
+}
+
+/**
+  * @brief  Drop everything queued that the IN endpoint does not own yet.
+  * @note   Main loop context. For when the host goes away, so the next one
+  *         to open the port does not get the previous session's bytes. The
+  *         transfer in flight completes as usual; the next write starts a
+  *         fresh batch on a write boundary.
+  * @retval Number of bytes discarded
+  */
+uint16_t CDC_TxQueue_Discard(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t keep = tx_tail + tx_inflight;
+  uint32_t n = tx_head - keep;
+  tx_head = keep;
+  if (tx_inflight != 0U){
+    tx_end_bound = 1U;
+  }
+  else{
+    tx_at_bound = 1U;
+  }
+  cdc_tx_stats.discarded_bytes += n;
+  __set_PRIMASK(primask);
+  return (uint16_t)n;
+}
+
+/**
+  * @brief  Flush deadline tick, called from the USBD_CDC_DUAL SOF callback (1 ms).
+  * @note   USB interrupt context.
+  */
+void CDC_TxQueue_OnSOF(void)
+{
+  CDC_TxStart();
+}
+
+/**
+  * @brief  Take received bytes out of the receive queue.
+  * @note   Main loop context only (single consumer).
+  * @param  Buf: Destination
+  * @param  Len: Maximum number of bytes
+  * @retval Number of bytes copied
+  */
+uint16_t CDC_RxQueue_Read(uint8_t* Buf, uint16_t Len)
+{
+  uint32_t tail = rx_tail;
+  uint32_t avail = rx_head - tail;
+  if (Len > avail){
+    Len = (uint16_t)avail;
+  }
+
+  uint32_t off = tail & CDC_RX_RING_MASK;
+  uint32_t first = CDC_RX_RING_SIZE - off;
+  if (first > Len){
+    first = Len;
+  }
+  memcpy(Buf, &UserRxBufferFS[off], first);
+  memcpy(Buf + first, UserRxBufferFS, Len - first);
+  rx_tail = tail + Len;
+
+  /* Resume the OUT endpoint once a whole packet fits again */
+  if (rx_paused && CDC_RX_RING_SIZE - (rx_head - rx_tail) >= CDC_DATA_FS_MAX_PACKET_SIZE){
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    rx_paused = 0;
+    if (hUsbDeviceFS.dev_state == USBD_STATE_CONFIGURED){
+      USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+    }
+    __set_PRIMASK(primask);
+  }
+  return Len;
+}
+
+/**
+  * @brief  Bytes waiting in the receive queue.
+  */
+uint16_t CDC_RxQueue_Count(void)
+{
+  return (uint16_t)(rx_head - rx_tail);
+}
+
+/**
+  * @brief  Control line state (CDC_LINE_DTR | CDC_LINE_RTS) set by the host.
+  */
+uint8_t CDC_GetLineState(void)
+{
+  return line_state;
+}
+
+/**
+  * @brief  Whether a host application has the port open.
+  * @retval 1 when configured and, with CDC_TX_REQUIRE_DTR, DTR is asserted.
+  *         Goes to 0 on suspend, bus reset, unplug or when the port is closed.
+  */
+uint8_t CDC_HostListening(void)
+{
+  if (hUsbDeviceFS.dev_state != USBD_STATE_CONFIGURED){
+    return 0;
+  }
+#if CDC_TX_REQUIRE_DTR
+  return (line_state & CDC_LINE_DTR) != 0U;
+#else
+  return 1;
+#endif
+}
+
+/**
+  * @brief  Hand the next block to the IN endpoint: a ready audio slot first,
+  *         then queued bytes coalesced into whole max-size packets.
+  * @note   USB interrupt context or with interrupts masked.
+  *
+  * Queued bytes wait until CDC_TX_BATCH_SIZE are pending and then go out in
+  * multiples of CDC_DATA_FS_MAX_PACKET_SIZE, so every packet of a batch is
+  * full; USBD_CDC_DataIn terminates such a transfer with a ZLP. Once the
+  * oldest byte is CDC_TX_FLUSH_MS old everything pending is sent as one
+  * short-ended transfer. The run before the ring wrap is sent as is.
+  *
+  * Batches may end inside a write, so an audio slot is only inserted when
+  * the ring tail sits on a write boundary; until then pending bytes are
+  * flushed up to the head to reach one.
+  */
+static void CDC_TxStart(void)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
+  if (hUsbDeviceFS.dev_state != USBD_STATE_CONFIGURED || hcdc == NULL || hcdc->TxState != 0){
+    return;
+  }
+
+  uint8_t flush = 0;
+  uint8_t *slot = NULL;
+  if (tx_at_bound || tx_head == tx_tail){
+    slot = AudioPkt_Claim(&audio_pkt);
+  }
+  else if (AudioPkt_Pending(&audio_pkt)){
+    flush = 1;
+  }
+  if (slot != NULL){
+    USBD_CDC_SetTxBuffer(&hUsbDeviceFS, slot, AUDIO_PKT_SLOT_SIZE);
+    if (USBD_CDC_TransmitPacket(&hUsbDeviceFS) != USBD_OK){
+      AudioPkt_Unclaim(&audio_pkt);
+    }
+    return;
+  }
+
+  uint32_t used = tx_head - tx_tail;
+  if (used == 0U){
+    return;
+  }
+  uint32_t off = tx_tail & CDC_TX_RING_MASK;
+  uint32_t len = CDC_TX_RING_SIZE - off;
+  uint32_t age = HAL_GetTick() - tx_stamp;
+  if (len >= used){
+    len = used;
+    if (age >= CDC_TX_FLUSH_MS){
+      if ((len % CDC_DATA_FS_MAX_PACKET_SIZE) != 0U){
+        cdc_tx_stats.deadline_flushes++;
+      }
+    }
+    else if (flush){
+      /* send up to the head so the waiting audio slot can follow */
+    }
+    else if (len >= CDC_TX_BATCH_SIZE){
+      len -= len % CDC_DATA_FS_MAX_PACKET_SIZE;
+    }
+    else{
+      return;
+    }
+  }
+
+  if (age > cdc_tx_stats.age_max){
+    cdc_tx_stats.age_max = age;
+  }
+  if ((len % CDC_DATA_FS_MAX_PACKET_SIZE) == 0U){
+    cdc_tx_stats.zlps++;
+  }
+  tx_inflight = len;
+  tx_end_bound = (len == used);
+  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, &UserTxBufferFS[off], len);
+  if (USBD_CDC_TransmitPacket(&hUsbDeviceFS) != USBD_OK){
+    tx_inflight = 0;
+  }
+}
+
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
 /**
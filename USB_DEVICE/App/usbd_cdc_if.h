@@ -52,7 +52,19 @@
 #define APP_RX_DATA_SIZE  2048
 #define APP_TX_DATA_SIZE  2048
 /* USER CODE BEGIN EXPORTED_DEFINES */
-
+/* The transmit queue is a byte ring over UserTxBufferFS */
+#define CDC_TX_RING_SIZE  APP_TX_DATA_SIZE
+/* Coalescing: queued bytes are sent once CDC_TX_BATCH_SIZE are pending
+ * (whole packets only) or the oldest is CDC_TX_FLUSH_MS old (everything) */
+#define CDC_TX_BATCH_SIZE (8U * CDC_DATA_FS_MAX_PACKET_SIZE)
+#define CDC_TX_FLUSH_MS   2U
+/* The receive queue is a byte ring over UserRxBufferFS */
+#define CDC_RX_RING_SIZE  APP_RX_DATA_SIZE
+/* SET_CONTROL_LINE_STATE wValue bits */
+#define CDC_LINE_DTR      0x01U
+#define CDC_LINE_RTS      0x02U
+/* Refuse writes until a host application has the port open (DTR set) */
+#define CDC_TX_REQUIRE_DTR 1U
 /* USER CODE END EXPORTED_DEFINES */
 
 /**
@@ -65,7 +77,29 @@
   */
 
 /* USER CODE BEGIN EXPORTED_TYPES */
-
+typedef struct
+{
+  uint32_t bytes_queued;
+  uint32_t bytes_sent;
+  uint32_t transfers;         /* completed IN transfers, audio slots included */
+  uint32_t drops;             /* writes rejected because the ring was full */
+  uint32_t dropped_bytes;
+  uint32_t high_watermark;    /* highest ring fill level in bytes */
+  uint32_t deadline_flushes;  /* short transfers sent because CDC_TX_FLUSH_MS expired */
+  uint32_t zlps;              /* transfers ending on a packet boundary (class adds a ZLP) */
+  uint32_t age_max;           /* oldest queued byte age when its transfer started (ms) */
+  uint32_t discarded_bytes;   /* unsent bytes dropped by CDC_TxQueue_Discard() */
+} CDC_TxStatsTypeDef;
+
+typedef struct
+{
+  uint32_t bytes_received;
+  uint32_t packets;
+  uint32_t overflows;         /* OUT packets that did not fit (should stay 0) */
+  uint32_t dropped_bytes;
+  uint32_t pauses;            /* times the OUT endpoint was left NAKing for lack of space */
+  uint32_t high_watermark;    /* highest ring fill level in bytes */
+} CDC_RxStatsTypeDef;
 /* USER CODE END EXPORTED_TYPES */
 
 /**
@@ -94,7 +128,8 @@
 extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 
 /* USER CODE BEGIN EXPORTED_VARIABLES */
-
+extern CDC_TxStatsTypeDef cdc_tx_stats;
+extern CDC_RxStatsTypeDef cdc_rx_stats;
 /* USER CODE END EXPORTED_VARIABLES */
 
 /**
@@ -109,7 +144,16 @@ extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
-
+uint16_t CDC_TxQueue_Write(const uint8_t* Buf, uint16_t Len);
+uint16_t CDC_TxQueue_Free(void);
+void CDC_TxQueue_Kick(void);
+void CDC_TxQueue_Flush(void);
+uint16_t CDC_TxQueue_Discard(void);
+void CDC_TxQueue_OnSOF(void);
+uint16_t CDC_RxQueue_Read(uint8_t* Buf, uint16_t Len);
+uint16_t CDC_RxQueue_Count(void);
+uint8_t CDC_GetLineState(void);
+uint8_t CDC_HostListening(void);
 /* USER CODE END EXPORTED_FUNCTIONS */
 
 /**
@@ -0,0 +1,199 @@
+/**
+ * @file usbd_cdc_log_if.c
+ * @brief Log console interface callbacks and transmit ring
+ *
+ * Single producer (main loop) writes at head; the USB interrupt sends from
+ * tail. head/tail are free running byte counters. A transfer covers the
+ * pending run up to the ring wrap and is only started from SOF or from the
+ * previous completion, so the console costs at most one transfer per frame.
+ * Received bytes go the other way through a second, smaller ring: the USB
+ * interrupt writes at rx_head, the main loop reads from rx_tail.
+ */
+
+#include "usbd_cdc_log_if.h"
+#include "usbd_cdc_if.h"
+#include <string.h>
+
+#define CDC_LOG_RING_MASK   (CDC_LOG_RING_SIZE - 1U)
+
+#if (CDC_LOG_RING_SIZE & CDC_LOG_RING_MASK) != 0U
+#error "CDC_LOG_RING_SIZE must be a power of two"
+#endif
+
+#define CDC_LOG_RX_MASK     (CDC_LOG_RX_SIZE - 1U)
+
+#if (CDC_LOG_RX_SIZE & CDC_LOG_RX_MASK) != 0U
+#error "CDC_LOG_RX_SIZE must be a power of two"
+#endif
+
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+CDC_LogStatsTypeDef cdc_log_stats;
+
+static uint8_t log_ring[CDC_LOG_RING_SIZE];
+static uint8_t log_rx_packet[CDC_DATA_FS_MAX_PACKET_SIZE];
+static uint8_t log_rx_ring[CDC_LOG_RX_SIZE];
+static volatile uint32_t log_rx_head;
+static volatile uint32_t log_rx_tail;
+static volatile uint32_t log_head;
+static volatile uint32_t log_tail;
+static volatile uint32_t log_inflight;  // ring bytes owned by the IN endpoint
+static volatile uint8_t  log_line_state;
+
+/* ==== INTERNAL HELPERS ==== */
+
+/* USB interrupt context */
+static void CDC_Log_TxStart(void)
+{
+    if (log_inflight != 0U || !CDC_Log_HostListening()) return;
+
+    uint32_t used = log_head - log_tail;
+    if (used == 0U) return;
+    uint32_t off = log_tail & CDC_LOG_RING_MASK;
+    uint32_t len = CDC_LOG_RING_SIZE - off;
+    if (len > used) len = used;
+
+    log_inflight = len;
+    USBD_CDC_LOG_SetTxBuffer(&hUsbDeviceFS, &log_ring[off], len);
+    if (USBD_CDC_LOG_TransmitPacket(&hUsbDeviceFS) != USBD_OK)
+        log_inflight = 0;
+}
+
+/* ==== INTERFACE CALLBACKS ==== */
+static int8_t CDC_Log_Init(void)
+{
+    USBD_CDC_LOG_SetTxBuffer(&hUsbDeviceFS, log_ring, 0);
+    USBD_CDC_LOG_SetRxBuffer(&hUsbDeviceFS, log_rx_packet);
+    log_line_state = 0;
+    /* A transfer cut by a bus reset never completes: send it again */
+    log_inflight = 0;
+    return USBD_OK;
+}
+
+static int8_t CDC_Log_DeInit(void)
+{
+    log_line_state = 0;
+    return USBD_OK;
+}
+
+static int8_t CDC_Log_Control(uint8_t cmd, uint8_t *pbuf, uint16_t length)
+{
+    UNUSED(length);
+    /* Line coding is meaningless here; only DTR decides whether to send */
+    if (cmd == CDC_SET_CONTROL_LINE_STATE)
+        log_line_state = (uint8_t)(((USBD_SetupReqTypedef *)pbuf)->wValue & (CDC_LINE_DTR | CDC_LINE_RTS));
+    return USBD_OK;
+}
+
+static int8_t CDC_Log_Receive(uint8_t *buf, uint32_t *len)
+{
+    /* Never NAK the console: keyboard input beyond the ring is discarded */
+    uint32_t head = log_rx_head;
+    uint32_t room = CDC_LOG_RX_SIZE - (head - log_rx_tail);
+    uint32_t n = *len < room ? *len : room;
+    for (uint32_t i = 0; i < n; i++)
+        log_rx_ring[(head + i) & CDC_LOG_RX_MASK] = buf[i];
+    log_rx_head = head + n;
+    cdc_log_stats.rx_bytes += *len;
+    cdc_log_stats.rx_dropped += *len - n;
+    USBD_CDC_LOG_SetRxBuffer(&hUsbDeviceFS, buf);
+    USBD_CDC_LOG_ReceivePacket(&hUsbDeviceFS);
+    return USBD_OK;
+}
+
+static int8_t CDC_Log_TransmitCplt(uint8_t *buf, uint32_t *len, uint8_t epnum)
+{
+    UNUSED(len);
+    UNUSED(epnum);
+    if (log_inflight != 0U && buf == &log_ring[log_tail & CDC_LOG_RING_MASK]) {
+        cdc_log_stats.bytes_sent += log_inflight;
+        cdc_log_stats.transfers++;
+        log_tail += log_inflight;
+        log_inflight = 0;
+    }
+    /* the part after the ring wrap, if any */
+    CDC_Log_TxStart();
+    return USBD_OK;
+}
+
+USBD_CDC_ItfTypeDef USBD_LogInterface_fops_FS =
+{
+    CDC_Log_Init,
+    CDC_Log_DeInit,
+    CDC_Log_Control,
+    CDC_Log_Receive,
+    CDC_Log_TransmitCplt
+};
+
+/* ==== PUBLIC API ==== */
+
+/**
+ * @brief Queue console output, all or nothing
+ * @note  Main loop context only (single producer); accepted while no
+ *        terminal is open, sent once one is
+ * @retval len when queued, 0 if the ring lacks space
+ */
+uint16_t CDC_Log_Write(const uint8_t *buf, uint16_t len)
+{
+    uint32_t head = log_head;
+    uint32_t used = head - log_tail;
+    if (len > CDC_LOG_RING_SIZE - used) {
+        cdc_log_stats.drops++;
+        cdc_log_stats.dropped_bytes += len;
+        return 0;
+    }
+
+    uint32_t off = head & CDC_LOG_RING_MASK;
+    uint32_t first = CDC_LOG_RING_SIZE - off;
+    if (first > len) first = len;
+    memcpy(&log_ring[off], buf, first);
+    memcpy(log_ring, buf + first, len - first);
+    log_head = head + len;
+
+    used += len;
+    if (used > cdc_log_stats.high_watermark)
+        cdc_log_stats.high_watermark = used;
+    cdc_log_stats.bytes_queued += len;
+    return len;
+}
+
+/**
+ * @brief Bytes that CDC_Log_Write() accepts right now
+ */
+uint16_t CDC_Log_Free(void)
+{
+    return (uint16_t)(CDC_LOG_RING_SIZE - (log_head - log_tail));
+}
+
+/**
+ * @brief Take bytes typed into the console, without waiting
+ * @note  Main loop context only (single consumer)
+ * @retval bytes copied, 0 if nothing is pending
+ */
+uint16_t CDC_Log_Read(uint8_t *buf, uint16_t len)
+{
+    uint32_t tail = log_rx_tail;
+    uint32_t avail = log_rx_head - tail;
+    if (len > avail) len = (uint16_t)avail;
+    for (uint16_t i = 0; i < len; i++)
+        buf[i] = log_rx_ring[(tail + i) & CDC_LOG_RX_MASK];
+    log_rx_tail = tail + len;
+    return len;
+}
+
+/**
+ * @brief Send pending output, called from the USBD_CDC_DUAL SOF callback (1 ms)
+ * @note  USB interrupt context
+ */
+void CDC_Log_OnSOF(void)
+{
+    CDC_Log_TxStart();
+}
+
+/**
+ * @brief Whether a terminal has the console open (configured and DTR set)
+ */
+uint8_t CDC_Log_HostListening(void)
+{
+    return hUsbDeviceFS.dev_state == USBD_STATE_CONFIGURED && (log_line_state & CDC_LINE_DTR) != 0U;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file usbd_cdc_log_if.h
+ * @brief Log console on the second CDC ACM function (see usbd_cdc_dual.h)
+ * @version 1.0
+ * @date 2025-10
+ *
+ * Human-readable debug output (USB_Print, I2C_Scan) goes here instead of the
+ * binary telemetry stream. Writes are copied into a small ring and sent from
+ * the SOF interrupt at most once per frame while a terminal has the port
+ * open; until then output is kept, up to the ring size, so boot messages are
+ * seen by the first terminal. A full ring drops whole writes and counts them,
+ * it never blocks and never touches the data function's queue or endpoint.
+ * Bytes typed into the console are kept in a small ring for CDC_Log_Read()
+ * (stdin, see console.h); what does not fit is counted and discarded.
+ */
+
+#ifndef __USBD_CDC_LOG_IF_H__
+#define __USBD_CDC_LOG_IF_H__
+
+#include "usbd_cdc_dual.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ==== CONFIGURATION ==== */
+#define CDC_LOG_RING_SIZE   1024U       // power of two
+#define CDC_LOG_RX_SIZE     256U        // power of two
+
+/* ==== STRUCTURE ==== */
+typedef struct {
+    uint32_t bytes_queued;
+    uint32_t bytes_sent;
+    uint32_t transfers;
+    uint32_t drops;             // writes rejected because the ring was full
+    uint32_t dropped_bytes;
+    uint32_t high_watermark;    // highest ring fill level in bytes
+    uint32_t rx_bytes;          // typed into the console
+    uint32_t rx_dropped;        // typed while the receive ring was full
+} CDC_LogStatsTypeDef;
+
+/* ==== EXPORTED VARIABLES ==== */
+extern USBD_CDC_ItfTypeDef USBD_LogInterface_fops_FS;
+extern CDC_LogStatsTypeDef cdc_log_stats;
+
+/* ==== FUNCTION PROTOTYPES ==== */
+uint16_t CDC_Log_Write(const uint8_t *buf, uint16_t len);
+uint16_t CDC_Log_Free(void);
+uint16_t CDC_Log_Read(uint8_t *buf, uint16_t len);
+void CDC_Log_OnSOF(void);
+uint8_t CDC_Log_HostListening(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_CDC_LOG_IF_H__ */